@@ -126,12 +126,97 @@
 #define MPU_RASR_ATTR_B			(1 << 16) /**< Bufferable */
 #define MPU_RASR_ATTR_SCB		(7 << 16) /**< SCB mask */
 /**@}*/
+
+/** @defgroup mpu_rasr_memory_types MPU RASR Memory Types
+ * @ingroup CM3_mpu_rasr
+ * TEX, C and B combinations of the usual memory types. Normal memory is
+ * also made shareable with MPU_RASR_ATTR_S.
+ *
+ *@{*/
+#define MPU_RASR_ATTR_STRONGLY_ORDERED	0 /**< Strongly ordered, shareable */
+#define MPU_RASR_ATTR_DEVICE		MPU_RASR_ATTR_B /**< Device, shareable */
+/** Normal, write-through, no write allocate */
+#define MPU_RASR_ATTR_NORMAL_WT		MPU_RASR_ATTR_C
+/** Normal, write-back, no write allocate */
+#define MPU_RASR_ATTR_NORMAL_WB		(MPU_RASR_ATTR_C | MPU_RASR_ATTR_B)
+/** Normal, not cacheable */
+#define MPU_RASR_ATTR_NORMAL_NC		(1 << 19)
+/** Normal, write-back, write and read allocate */
+#define MPU_RASR_ATTR_NORMAL_WBWA	((1 << 19) | MPU_RASR_ATTR_C | \
+					 MPU_RASR_ATTR_B)
+/**@}*/
+/**@}*/
+
+/* ARMv8-M: memory types are held by the MAIR registers and regions given by
+ * a base and a limit. */
+#if defined(__ARM_ARCH_8M_MAIN__) || defined(__ARM_ARCH_8M_BASE__)
+/** @defgroup CM3_mpu_v8_registers MPU ARMv8-M Registers
+ * @ingroup CM3_mpu_defines
+ * MPU_RBAR keeps its address, MPU_RLAR takes the place of MPU_RASR.
+ *@{*/
+#define MPU_RLAR			MMIO32(MPU_BASE + 0x10) /**< See also \ref CM3_mpu_rlar */
+#define MPU_MAIR0			MMIO32(MPU_BASE + 0x30) /**< Attributes 0 to 3 */
+#define MPU_MAIR1			MMIO32(MPU_BASE + 0x34) /**< Attributes 4 to 7 */
+/**@}*/
+
+/** @defgroup CM3_mpu_v8_rbar MPU ARMv8-M RBAR register fields
+ * @ingroup CM3_mpu_defines
+ *@{*/
+#define MPU_RBAR_BASE			0xFFFFFFE0 /**< Base address, 32 byte aligned */
+#define MPU_RBAR_SH_NON			(0 << 3) /**< Non-shareable */
+#define MPU_RBAR_SH_OUTER		(2 << 3) /**< Outer shareable */
+#define MPU_RBAR_SH_INNER		(3 << 3) /**< Inner shareable */
+#define MPU_RBAR_AP_PRW_UNO		(0 << 1) /**< Priv.: RW, Unpriv.: no */
+#define MPU_RBAR_AP_PRW_URW		(1 << 1) /**< Priv.: RW, Unpriv.: RW */
+#define MPU_RBAR_AP_PRO_UNO		(2 << 1) /**< Priv.: RO, Unpriv.: no */
+#define MPU_RBAR_AP_PRO_URO		(3 << 1) /**< Priv.: RO, Unpriv.: RO */
+#define MPU_RBAR_XN			(1 << 0) /**< Execute never */
+/**@}*/
+
+/** @defgroup CM3_mpu_rlar MPU ARMv8-M RLAR register fields
+ * @ingroup CM3_mpu_defines
+ *@{*/
+#define MPU_RLAR_LIMIT			0xFFFFFFE0 /**< Last 32 byte block of the region */
+#define MPU_RLAR_ATTRINDX_LSB		1
+#define MPU_RLAR_ATTRINDX		(7 << MPU_RLAR_ATTRINDX_LSB) /**< MAIR attribute index */
+#define MPU_RLAR_EN			(1 << 0) /**< Region enable bit */
+/**@}*/
+
+/** @defgroup CM3_mpu_mair MPU ARMv8-M MAIR attributes
+ * @ingroup CM3_mpu_defines
+ *@{*/
+#define MPU_MAIR_DEVICE_NGNRNE		0x00 /**< Device, no gathering, reordering nor early ack */
+#define MPU_MAIR_DEVICE_NGNRE		0x04 /**< Device, early write ack */
+#define MPU_MAIR_NORMAL_NC		0x44 /**< Normal, not cacheable */
+#define MPU_MAIR_NORMAL_WT		0xAA /**< Normal, write-through, read allocate */
+#define MPU_MAIR_NORMAL_WB		0xFF /**< Normal, write-back, read and write allocate */
 /**@}*/
 
+/** MAIR attribute indices programmed by the region presets */
+#define MPU_MAIR_INDEX_NC		6
+#define MPU_MAIR_INDEX_WT		7
+#endif
+
 /* --- MPU functions ------------------------------------------------------- */
 
 BEGIN_DECLS
 
+void mpu_enable(uint32_t flags);
+void mpu_disable(void);
+uint8_t mpu_region_count(void);
+void mpu_disable_region(uint8_t region);
+#if defined(__ARM_ARCH_8M_MAIN__) || defined(__ARM_ARCH_8M_BASE__)
+void mpu_set_mair(uint8_t index, uint8_t attributes);
+bool mpu_set_region(uint8_t region, uint32_t base, uint32_t size,
+		    uint32_t access, uint8_t attr_index);
+#else
+bool mpu_set_region(uint8_t region, uint32_t base, uint32_t size,
+		    uint32_t attributes);
+#endif
+bool mpu_set_region_dma_buffer(uint8_t region, uint32_t base, uint32_t size);
+bool mpu_set_region_stack_guard(uint8_t region, uint32_t base, uint32_t size);
+bool mpu_set_region_write_through(uint8_t region, uint32_t base,
+				  uint32_t size);
 
 END_DECLS
 
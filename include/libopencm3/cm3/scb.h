@@ -31,6 +31,7 @@
  * Manual" for either ARMv7-M or ARMV6-m.
  * @{
  */
+#include <stddef.h>
 #include <libopencm3/cm3/memorymap.h>
 #include <libopencm3/cm3/common.h>
 
@@ -517,6 +518,27 @@
 #define SCB_CTR_IMINLINE_SHIFT	0
 #define SCB_CTR_IMINLINE_MASK	0xf
 
+/* --- SCB_CCSIDR values --------------------------------------------------- */
+/* NUMSETS: number of sets - 1 */
+#define SCB_CCSIDR_NUMSETS_SHIFT	13
+#define SCB_CCSIDR_NUMSETS_MASK		0x7fff
+/* ASSOCIATIVITY: number of ways - 1 */
+#define SCB_CCSIDR_ASSOCIATIVITY_SHIFT	3
+#define SCB_CCSIDR_ASSOCIATIVITY_MASK	0x3ff
+/* LINESIZE: log2 of number of words in a cache line - 2 */
+#define SCB_CCSIDR_LINESIZE_SHIFT	0
+#define SCB_CCSIDR_LINESIZE_MASK	0x7
+
+/* --- SCB_CCSELR values --------------------------------------------------- */
+/* LEVEL: cache level - 1 */
+#define SCB_CCSELR_LEVEL_SHIFT		1
+#define SCB_CCSELR_LEVEL_MASK		0x7
+/* IND: select the instruction cache, rather than the data cache */
+#define SCB_CCSELR_IND			(1 << 0)
+
+/** Data cache line size of the Cortex-M7, for aligning DMA buffers */
+#define SCB_DCACHE_LINE_SIZE	32
+
 #endif
 
 /* --- SCB_CPACR values ---------------------------------------------------- */
@@ -569,6 +591,24 @@ void scb_reset_core(void) __attribute__((noreturn));
 void scb_set_priority_grouping(uint32_t prigroup);
 #endif
 
+/* Those defined only on ARMv7EM and above */
+#if defined(__ARM_ARCH_7EM__) || defined(__ARM_ARCH_8M_MAIN__)
+void scb_enable_icache(void);
+void scb_disable_icache(void);
+void scb_invalidate_icache(void);
+void scb_enable_dcache(void);
+void scb_disable_dcache(void);
+void scb_invalidate_dcache(void);
+void scb_clean_dcache(void);
+void scb_clean_invalidate_dcache(void);
+void scb_invalidate_dcache_range(void *addr, size_t len);
+void scb_clean_dcache_range(const void *addr, size_t len);
+void scb_clean_invalidate_dcache_range(void *addr, size_t len);
+void scb_dma_prepare_tx(const void *buf, size_t len);
+void scb_dma_prepare_rx(void *buf, size_t len);
+void scb_dma_complete_rx(void *buf, size_t len);
+#endif
+
 END_DECLS
 
 /**@}*/
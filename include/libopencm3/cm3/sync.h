@@ -33,8 +33,9 @@ void __dmb(void);
 
 /* --- Exclusive load and store instructions ------------------------------- */
 
-/* Those are defined only on CM3 or CM4 */
-#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+/* Those are defined only on CM3, CM4, CM7 and CM33 */
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__) || \
+	defined(__ARM_ARCH_8M_MAIN__)
 
 uint32_t __ldrex(volatile uint32_t *addr);
 uint32_t __strex(uint32_t val, volatile uint32_t *addr);
@@ -54,6 +55,51 @@ void mutex_unlock(mutex_t *m);
 
 #endif
 
+/* --- Lock-free queues ---------------------------------------------------- */
+
+/* Ring buffers of fixed size records (bytes with a record size of 1) which
+ * can be shared between interrupt handlers and thread code without locks.
+ * The number of records must be a power of two. Indices run freely and are
+ * only masked when accessing the buffer.
+ */
+
+/* Single producer, single consumer. Works on every core, the producer only
+ * writes head and the consumer only writes tail. */
+typedef struct {
+	uint8_t *buf;
+	uint32_t count;
+	uint32_t rec_size;
+	volatile uint32_t head;
+	volatile uint32_t tail;
+} spsc_queue_t;
+
+void spsc_init(spsc_queue_t *q, void *buf, uint32_t count, uint32_t rec_size);
+bool spsc_push(spsc_queue_t *q, const void *rec);
+bool spsc_pop(spsc_queue_t *q, void *rec);
+uint32_t spsc_write(spsc_queue_t *q, const void *data, uint32_t n);
+uint32_t spsc_read(spsc_queue_t *q, void *data, uint32_t n);
+uint32_t spsc_used(const spsc_queue_t *q);
+
+/* Multiple producers, single consumer. Producers claim a slot by compare and
+ * swap on head (LDREX/STREX, or a short PRIMASK section on ARMv6-M) and
+ * publish it through a per-slot sequence number, so a producer preempted
+ * halfway never blocks another one: the consumer just sees the queue end
+ * there until it is done. */
+typedef struct {
+	uint8_t *buf;
+	uint32_t count;
+	uint32_t rec_size;
+	volatile uint32_t head;
+	volatile uint32_t tail;
+} mpsc_queue_t;
+
+/* Bytes of buffer needed per record, for the sequence number and padding */
+#define MPSC_QUEUE_SLOT_SIZE(rec_size)	(4 + (((rec_size) + 3) & ~3))
+
+void mpsc_init(mpsc_queue_t *q, void *buf, uint32_t count, uint32_t rec_size);
+bool mpsc_push(mpsc_queue_t *q, const void *rec);
+bool mpsc_pop(mpsc_queue_t *q, void *rec);
+
 END_DECLS
 
 #endif
@@ -576,6 +576,7 @@
 #define ETH_DMAMFBOCR_MFC_SHIFT		0
 #define ETH_DMAMFBOCR_MFC		(0xFFFF << ETH_DMAMFBOCR_MFC_SHIFT)
 #define ETH_DMAMFBOCR_OMFC		(1<<16)
+#define ETH_DMAMFBOCR_MFA_SHIFT		17
 #define ETH_DMAMFBOCR_MFA		(0x7FF << ETH_DMAMFBOCR_MFA_SHIFT)
 #define ETH_DMAMFBOCR_OFOC		(1<<28)
 
@@ -729,6 +730,34 @@ enum eth_clk {
 	ETH_CLK_150_168MHZ = ETH_MACMIIAR_CR_HCLK_DIV_102,
 };
 
+/** Received frame leased from the descriptor ring, see eth_rx_lease() */
+struct eth_rx_frame {
+	uint32_t desc;		/**< First descriptor of the frame */
+	uint32_t ndesc;		/**< Number of descriptors the frame spans */
+	uint32_t len;		/**< Frame length in bytes, including the CRC */
+	uint32_t status;	/**< RDES0 of the last descriptor */
+};
+
+/** Handler for each frame received by eth_rx_batch(). The frame is returned
+ * to the descriptor ring as soon as the handler returns. */
+typedef void (*eth_rx_handler_t)(const struct eth_rx_frame *frame, void *arg);
+
+/** Driver counters, see eth_get_stats() */
+struct eth_stats {
+	uint32_t rx_frames;	/**< Frames delivered to the application */
+	uint32_t rx_bytes;	/**< Bytes delivered, including the CRC */
+	uint32_t rx_errors;	/**< Frames dropped with the error summary set */
+	uint32_t rx_dropped;	/**< Frames too long for the caller's buffer */
+	uint32_t rx_missed;	/**< Frames missed by the controller for lack
+				     of a free descriptor */
+	uint32_t rx_overruns;	/**< Frames missed due to receive FIFO
+				     overflow */
+	uint32_t rx_stalls;	/**< Receive buffer unavailable events */
+	uint32_t rx_batches;	/**< Calls to eth_rx_batch() */
+	uint32_t tx_frames;	/**< Frames handed to the DMA */
+	uint32_t tx_bytes;	/**< Bytes handed to the DMA */
+};
+
 /*****************************************************************************/
 /* API Functions                                                             */
 /*****************************************************************************/
@@ -747,6 +776,17 @@ void eth_desc_init(uint8_t *buf, uint32_t nTx, uint32_t nRx, uint32_t cTx,
 bool eth_tx(uint8_t *ppkt, uint32_t n);
 bool eth_rx(uint8_t *ppkt, uint32_t *len, uint32_t maxlen);
 
+uint8_t *eth_tx_borrow(uint32_t *size);
+bool eth_tx_submit(uint32_t n);
+bool eth_rx_lease(struct eth_rx_frame *frame);
+uint8_t *eth_rx_frame_data(const struct eth_rx_frame *frame, uint32_t idx,
+			   uint32_t *len);
+void eth_rx_release(const struct eth_rx_frame *frame);
+bool eth_rx_irq_defer(void);
+uint32_t eth_rx_batch(eth_rx_handler_t handler, void *arg, uint32_t budget);
+void eth_get_stats(struct eth_stats *stats);
+void eth_clear_stats(void);
+
 void eth_init(uint8_t phy, enum eth_clk clock);
 void eth_start(void);
 
@@ -773,6 +813,11 @@ END_DECLS
  *  eth_start();
  *  for (;;)
  *    eth_tx(frame,sizeof(frame));
+ *
+ * Batched receive, one interrupt per burst of frames:
+ *  eth_irq_enable(ETH_DMAIER_NISE | ETH_DMAIER_RIE);
+ *  isr: if (eth_rx_irq_defer()) [ schedule rx task ]
+ *  rx task: while (eth_rx_batch(handler, arg, 16) == 16) [ yield ]
  */
 
 /**@}*/
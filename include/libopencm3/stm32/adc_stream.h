@@ -0,0 +1,78 @@
+/** @defgroup adc_stream_defines ADC Streaming Defines
+ *
+ * @ingroup adc_defines
+ *
+ * @brief <b>Continuous, DMA driven ADC acquisition</b>
+ *
+ * LGPL License Terms @ref lgpl_license
+ */
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_ADC_STREAM_H
+#define LIBOPENCM3_ADC_STREAM_H
+
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/stm32/adc.h>
+#include <libopencm3/stm32/dma_async.h>
+
+/**@{*/
+
+struct adc_stream;
+
+/** Called from the DMA interrupt each time one half of the buffer is full.
+ * @p block stays valid until the DMA comes back to it, one half buffer later. */
+typedef void (*adc_stream_callback_t)(struct adc_stream *s, const void *block,
+				      uint16_t count, void *arg);
+
+/** Event counters, only ever incremented by the driver */
+struct adc_stream_stats {
+	uint32_t blocks;	/**< Half buffers delivered */
+	uint32_t overruns;	/**< ADC overruns, each restarts the stream */
+	uint32_t dma_errors;	/**< DMA transfer errors, the stream stops */
+};
+
+/** State of one streaming ADC, owned by the driver once started */
+struct adc_stream {
+	uint32_t adc;
+	struct dma_async_chan *dma;
+	void *buf;
+	/** Data units in the whole buffer, an even number */
+	uint16_t count;
+	/** Reading the packed data of a multi ADC mode, 32 bit units */
+	bool multi;
+	adc_stream_callback_t callback;
+	void *callback_arg;
+	struct adc_stream_stats stats;
+};
+
+/**@}*/
+
+BEGIN_DECLS
+
+bool adc_stream_init(struct adc_stream *s, uint32_t adc,
+		     struct dma_async_chan *dma, void *buf, uint16_t count,
+		     bool multi);
+void adc_stream_set_callback(struct adc_stream *s,
+			     adc_stream_callback_t callback, void *arg);
+bool adc_stream_start(struct adc_stream *s);
+void adc_stream_stop(struct adc_stream *s);
+void adc_stream_isr(struct adc_stream *s);
+
+END_DECLS
+
+#endif
@@ -36,6 +36,7 @@ LGPL License Terms @ref lgpl_license
 
 #include <libopencm3/stm32/memorymap.h>
 #include <libopencm3/cm3/common.h>
+#include <libopencm3/stm32/can_filter.h>
 
 /**@{*/
 
@@ -662,6 +663,12 @@ void can_filter_id_list_16bit_init(uint32_t nr, uint16_t id1,
 				   uint32_t fifo, bool enable);
 void can_filter_id_list_32bit_init(uint32_t nr, uint32_t id1,
 				   uint32_t id2, uint32_t fifo, bool enable);
+int can_filter_plan(const struct can_filter_id *ids, uint32_t count,
+		    struct can_filter_mask *blocks, uint32_t max_blocks,
+		    uint32_t banks, struct can_filter_report *report);
+uint32_t can_filter_apply(uint32_t first_bank,
+			  const struct can_filter_mask *blocks, uint32_t n,
+			  uint32_t fifo);
 
 void can_enable_irq(uint32_t canport, uint32_t irq);
 void can_disable_irq(uint32_t canport, uint32_t irq);
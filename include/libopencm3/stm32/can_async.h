@@ -0,0 +1,103 @@
+/** @defgroup can_async_defines CAN Asynchronous Driver Defines
+ *
+ * @ingroup can_defines
+ *
+ * @brief <b>Interrupt driven, queued bxCAN layer</b>
+ *
+ * LGPL License Terms @ref lgpl_license
+ */
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_CAN_ASYNC_H
+#define LIBOPENCM3_CAN_ASYNC_H
+
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/cm3/sync.h>
+#include <libopencm3/stm32/can.h>
+
+/**@{*/
+
+/** Received message */
+struct can_msg {
+	uint32_t id;
+	bool ext;
+	bool rtr;
+	uint8_t length;
+	uint8_t fmi;		/**< Index of the matching filter */
+	uint8_t fifo;		/**< FIFO the message was received in */
+	uint16_t timestamp;	/**< Only valid in time triggered mode */
+	uint8_t data[8];
+};
+
+/** Queued message, as it is loaded into a transmit mailbox */
+struct can_async_tx_entry {
+	uint32_t tir;
+	uint32_t tdtr;
+	uint32_t tdlr;
+	uint32_t tdhr;
+};
+
+/** Event counters, only ever incremented by the driver */
+struct can_async_stats {
+	uint32_t tx_frames;	/**< Frames sent successfully */
+	uint32_t tx_errors;	/**< Transmissions failed, only with NART */
+	uint32_t tx_preempted;	/**< Frames taken back from a mailbox for a
+				     higher priority one */
+	uint32_t rx_frames;	/**< Frames put into the RX ring */
+	uint32_t rx_overruns;	/**< Hardware FIFO overrun events */
+	uint32_t rx_dropped;	/**< Frames lost because the RX ring was full */
+};
+
+/** State of one queued CAN port, owned by the driver once started */
+struct can_async {
+	uint32_t canport;
+	/** Pending frames sorted by descending identifier, so the highest
+	 * priority frame is at the end. */
+	struct can_async_tx_entry *tx_queue;
+	uint32_t tx_size;
+	uint32_t tx_count;
+	/** Queue slots held back for frames being aborted */
+	uint32_t tx_reserved;
+	/** Copy of the frame in each transmit mailbox */
+	struct can_async_tx_entry mbox[3];
+	uint8_t mbox_busy;
+	uint8_t mbox_abort;
+	spsc_queue_t rx;
+	struct can_async_stats stats;
+};
+
+/**@}*/
+
+BEGIN_DECLS
+
+void can_async_init(struct can_async *ca, uint32_t canport,
+		    struct can_async_tx_entry *tx_buf, uint32_t tx_count,
+		    struct can_msg *rx_buf, uint32_t rx_count);
+void can_async_start(struct can_async *ca);
+void can_async_stop(struct can_async *ca);
+void can_async_tx_isr(struct can_async *ca);
+void can_async_rx_isr(struct can_async *ca);
+bool can_async_transmit(struct can_async *ca, uint32_t id, bool ext, bool rtr,
+			uint8_t length, const uint8_t *data);
+bool can_async_receive(struct can_async *ca, struct can_msg *msg);
+uint32_t can_async_rx_available(struct can_async *ca);
+uint32_t can_async_tx_pending(struct can_async *ca);
+
+END_DECLS
+
+#endif
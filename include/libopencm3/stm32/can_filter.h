@@ -0,0 +1,61 @@
+/** @defgroup can_filter_defines CAN Filter Planner Defines
+ *
+ * @ingroup can_defines
+ *
+ * @brief <b>Types shared by the bxCAN and FDCAN acceptance filter planners</b>
+ *
+ * LGPL License Terms @ref lgpl_license
+ */
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_CAN_FILTER_H
+#define LIBOPENCM3_CAN_FILTER_H
+
+#include <libopencm3/cm3/common.h>
+
+/**@{*/
+
+#define CAN_FILTER_STD_ID_MAX	0x7FF
+#define CAN_FILTER_EXT_ID_MAX	0x1FFFFFFF
+
+/** Identifier, or inclusive range of identifiers, to accept */
+struct can_filter_id {
+	uint32_t first;
+	uint32_t last;
+	bool ext;
+};
+
+/** Identifier and mask of bits that have to match, as used by mask filters */
+struct can_filter_mask {
+	uint32_t id;
+	uint32_t mask;
+	bool ext;
+};
+
+/** Outcome of planning a filter set */
+struct can_filter_report {
+	uint32_t rules;		/**< Filter banks or elements needed */
+	uint32_t widened;	/**< Merges that accept identifiers not asked
+				     for, 0 if the filter is exact */
+	uint32_t extra_ids;	/**< Upper bound of identifiers accepted in
+				     excess of the list */
+};
+
+/**@}*/
+
+#endif
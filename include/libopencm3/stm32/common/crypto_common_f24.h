@@ -15,6 +15,9 @@
  * - STM32F417 <i>(tested)</i>
  * - STM32F427
  * - STM32F437
+ * - STM32F756
+ * - STM32F777
+ * - STM32F779
  *
  * @section crypto_api_theory Theory of operation
  *
@@ -56,19 +59,20 @@
  *
  * @section crypto_api_dma DMA handling API
  *
- * @warning This operation mode is currently not supported.
+ * DMA transfers, and messages processed in pieces, are provided by the
+ * stream API of @ref crypto_stream_defines.
  *
  * @b Example @b 3: DMA mode
  *
  * @code
- * //[enable-clocks]
- * crypto_set_key(CRYPTO_KEY_128BIT,key);
- * crypto_set_iv(iv);                          // only in CBC or CTR mode
- * crypto_set_datatype(CRYPTO_DATA_16BIT);
- * crypto_set_algorithm(ENCRYPT_AES_ECB);
- * crypto_start();
- *	[... API to be described later ...]
- * crypto_stop();
+ * //[enable-clocks, allocate the CRYP IN and OUT DMA channels]
+ * crypto_stream_init(&s, ENCRYPT_AES_CBC, CRYPTO_KEY_128BIT,
+ *		      CRYPTO_DATA_8BIT, key, iv);
+ * crypto_stream_set_dma(&s, &in_dma, &out_dma);
+ * crypto_stream_set_callback(&s, chunk_done, NULL);
+ * foreach(chunk in message)
+ *	crypto_stream_update_dma(&s, chunk, out, words);  // next from chunk_done
+ * crypto_stream_final(&s);
  * @endcode
  */
 
@@ -143,6 +147,13 @@ specific memorymap.h header before including this header file.*/
 /* CRYP Initialization Vector Registers (CRYP_IVxLR) x=0..1 */
 #define CRYP_IVR(i)		MMIO32(CRYP_BASE + 0x40 + (i) * 8)
 
+/* CRYP Key registers as 32 bit words, K0LR to K3RR, i=0..7 */
+#define CRYP_KW(i)		MMIO32(CRYP_BASE + 0x20 + (i) * 4)
+
+/* CRYP Initialization Vector registers as 32 bit words, IV0LR to IV1RR,
+ * i=0..3 */
+#define CRYP_IVW(i)		MMIO32(CRYP_BASE + 0x40 + (i) * 4)
+
 /* --- CRYP_CR values ------------------------------------------------------ */
 
 /* ALGODIR: Algorithm direction */
@@ -141,6 +141,38 @@
 #define FLASH_OPTKEYR_KEY1		(0x08192a3bU)
 #define FLASH_OPTKEYR_KEY2		(0x4c5d6e7fU)
 
+/* --- Interrupt driven programming ---------------------------------------- */
+
+struct flash_async;
+
+/** Called from the flash interrupt when an interrupt driven programming has
+ * ended */
+typedef void (*flash_async_callback_t)(struct flash_async *f, bool ok,
+				       void *arg);
+
+/** Event counters, only ever incremented by the driver */
+struct flash_async_stats {
+	uint32_t bytes;		/**< Bytes programmed */
+	uint32_t errors;	/**< Programmings stopped by an error flag */
+};
+
+/** State of an interrupt driven programming, see @ref flash_program_async */
+struct flash_async {
+	/** Next address to program and bytes left */
+	uint32_t address;
+	const uint8_t *data;
+	uint32_t left;
+	/** Widest programming width allowed, @ref flash_cr_program_width */
+	uint32_t program_size;
+	flash_async_callback_t callback;
+	void *callback_arg;
+	/** Set while a programming is running */
+	volatile bool busy;
+	/** FLASH_SR error flags which stopped the last programming */
+	uint32_t error;
+	struct flash_async_stats stats;
+};
+
 /* --- Function prototypes ------------------------------------------------- */
 
 BEGIN_DECLS
@@ -156,6 +188,14 @@ void flash_program_word(uint32_t address, uint32_t data);
 void flash_program_half_word(uint32_t address, uint16_t data);
 void flash_program_byte(uint32_t address, uint8_t data);
 void flash_program(uint32_t address, const uint8_t *data, uint32_t len);
+void flash_program_block(uint32_t address, const uint8_t *data, uint32_t len,
+			 uint32_t program_size);
+void flash_async_set_callback(struct flash_async *f,
+			      flash_async_callback_t callback, void *arg);
+bool flash_program_async(struct flash_async *f, uint32_t address,
+			 const uint8_t *data, uint32_t len,
+			 uint32_t program_size);
+void flash_async_isr(struct flash_async *f);
 void flash_program_option_bytes(uint32_t data);
 
 END_DECLS
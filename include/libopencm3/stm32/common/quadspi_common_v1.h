@@ -172,6 +172,28 @@
 #define QUADSPI_CCR_FMODE_APOLL   2
 #define QUADSPI_CCR_FMODE_MEMMAP  3
 
+/** A command for the flash: the phases to run and their contents. Phases
+ * whose mode is QUADSPI_CCR_MODE_NONE are skipped. */
+struct quadspi_command {
+	uint8_t instruction;
+	uint8_t instruction_mode;	/**< QUADSPI_CCR_MODE_* */
+	uint32_t address;
+	uint8_t address_mode;		/**< QUADSPI_CCR_MODE_* */
+	uint8_t address_size;		/**< 1 to 4 bytes */
+	uint32_t alternate;
+	uint8_t alternate_mode;		/**< QUADSPI_CCR_MODE_* */
+	uint8_t alternate_size;		/**< 1 to 4 bytes */
+	uint8_t dummy_cycles;		/**< 0 to 31 */
+	uint8_t data_mode;		/**< QUADSPI_CCR_MODE_* */
+	bool ddr;			/**< Double data rate for the address,
+					     alternate and data phases */
+	bool sioo;			/**< In memory mapped mode, send the
+					     instruction only for the first
+					     access */
+};
+
+struct dma_async_chan;
+
 /**@}*/
 
 
@@ -198,6 +220,135 @@ void quadspi_enable(uint32_t quadspi);
  */
 void quadspi_disable(uint32_t quadspi);
 
+/**
+ * Set the clock prescaler: the flash clock is the kernel clock divided by
+ * prescaler + 1.
+ */
+void quadspi_set_prescaler(uint32_t quadspi, uint8_t prescaler);
+
+/**
+ * Set the flash size, 2^(fsize + 1) bytes. Addresses beyond it raise a
+ * transfer error, and it bounds the memory mapped window.
+ */
+void quadspi_set_flash_size(uint32_t quadspi, uint8_t fsize);
+
+/**
+ * Set the minimum number of clock cycles, 1 to 8, nCS stays high between
+ * commands.
+ */
+void quadspi_set_cs_high_time(uint32_t quadspi, uint8_t cycles);
+
+/**
+ * Set the clock level between commands: mode 0 (low) or mode 3 (high).
+ */
+void quadspi_set_clock_mode(uint32_t quadspi, uint8_t mode);
+
+/**
+ * Set the FIFO threshold, 1 to the FIFO size in bytes, at which the FIFO
+ * flag and the DMA requests are raised in indirect mode.
+ */
+void quadspi_set_fifo_threshold(uint32_t quadspi, uint8_t bytes);
+
+/**
+ * Sample the data half a clock cycle later, for fast clocks.
+ */
+void quadspi_enable_sample_shift(uint32_t quadspi);
+
+/**
+ * Sample the data on the clock edge.
+ */
+void quadspi_disable_sample_shift(uint32_t quadspi);
+
+/**
+ * Build the communication configuration register value of a command.
+ * @param cmd The command
+ * @param fmode Functional mode, QUADSPI_CCR_FMODE_*
+ */
+uint32_t quadspi_command_ccr(const struct quadspi_command *cmd,
+			     uint8_t fmode);
+
+/**
+ * Stop the command in progress, including memory mapped mode, and wait
+ * for the peripheral to be idle.
+ */
+void quadspi_abort(uint32_t quadspi);
+
+/**
+ * Send a command without a data phase and wait for its end.
+ * @returns false on a transfer error
+ */
+bool quadspi_command(uint32_t quadspi, const struct quadspi_command *cmd);
+
+/**
+ * Send a command and read its data phase in indirect mode, by the CPU.
+ * @returns false on a transfer error
+ */
+bool quadspi_read(uint32_t quadspi, const struct quadspi_command *cmd,
+		  uint8_t *data, uint32_t len);
+
+/**
+ * Send a command and write its data phase in indirect mode, by the CPU.
+ * @returns false on a transfer error
+ */
+bool quadspi_write(uint32_t quadspi, const struct quadspi_command *cmd,
+		   const uint8_t *data, uint32_t len);
+
+/**
+ * Start a command whose data phase is read by DMA, and return.
+ *
+ * The channel, allocated with dma_async_alloc() for the QUADSPI request,
+ * reports the end through its callback, which must then call
+ * quadspi_dma_finish().
+ * @param len 1 to 65535 bytes
+ * @returns false if the length is out of range, the channel is busy, or
+ * the peripheral has no DMA request (H7, where QUADSPI is served by MDMA)
+ */
+bool quadspi_read_dma(uint32_t quadspi, const struct quadspi_command *cmd,
+		      struct dma_async_chan *dma, uint8_t *data, uint32_t len);
+
+/**
+ * Start a command whose data phase is written by DMA, and return. See
+ * quadspi_read_dma().
+ */
+bool quadspi_write_dma(uint32_t quadspi, const struct quadspi_command *cmd,
+		       struct dma_async_chan *dma, const uint8_t *data,
+		       uint32_t len);
+
+/**
+ * End a DMA transfer: wait for the last bytes to go out, then turn the
+ * DMA requests off.
+ * @returns false on a transfer error
+ */
+bool quadspi_dma_finish(uint32_t quadspi);
+
+/**
+ * Send a status read command repeatedly until the status matches, without
+ * the CPU, and wait for the match. For instance, wait for the end of a
+ * program or erase with the read status register command (0x05), mask 0x01
+ * (WIP) and match 0.
+ * @param cmd Status read command, with a data phase
+ * @param mask Status bits to compare
+ * @param match Expected value of those bits
+ * @param size Status length, 1 to 4 bytes
+ * @param interval Clock cycles between two reads
+ * @returns false on a transfer error
+ */
+bool quadspi_poll_status(uint32_t quadspi, const struct quadspi_command *cmd,
+			 uint32_t mask, uint32_t match, uint8_t size,
+			 uint16_t interval);
+
+/**
+ * Map the flash in the memory space, for reading and executing in place.
+ * Each access sends cmd at the accessed address, and the peripheral reads
+ * ahead of it while the bus is idle.
+ * @param cmd Read command; its address field is unused
+ * @param timeout Clock cycles without an access before nCS is released and
+ * reading ahead stops, to let the flash sleep, or 0 to read ahead until the
+ * next access
+ */
+void quadspi_memory_mapped(uint32_t quadspi, const struct quadspi_command *cmd,
+			   uint16_t timeout);
+
 END_DECLS
 
 /**@}*/
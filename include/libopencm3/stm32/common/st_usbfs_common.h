@@ -171,6 +171,13 @@ LGPL License Terms @ref lgpl_license
 
 #define USB_EP_ADDR		0x000F /* Endpoint Address */
 
+/*
+ * Double-buffered endpoints only use one direction, the data toggle bit of
+ * the unused direction becomes the application's buffer pointer (SW_BUF).
+ */
+#define USB_EP_TX_SW_BUF	USB_EP_RX_DTOG /* SW_BUF of an IN endpoint */
+#define USB_EP_RX_SW_BUF	USB_EP_TX_DTOG /* SW_BUF of an OUT endpoint */
+
 /* Masking all toggle bits */
 #define USB_EP_NTOGGLE_MSK	(USB_EP_RX_CTR | \
 				 USB_EP_SETUP | \
@@ -273,6 +280,17 @@ LGPL License Terms @ref lgpl_license
 		GET_REG(USB_EP_REG(EP)) & \
 		(USB_EP_NTOGGLE_MSK | USB_EP_RX_DTOG))
 
+/* Macros for toggling DTOG bits, which moves SW_BUF on double-buffered EPs */
+#define USB_TOG_EP_TX_DTOG(EP) \
+	SET_REG(USB_EP_REG(EP), \
+		(GET_REG(USB_EP_REG(EP)) & USB_EP_NTOGGLE_MSK) | \
+		USB_EP_TX_DTOG | USB_EP_RX_CTR | USB_EP_TX_CTR)
+
+#define USB_TOG_EP_RX_DTOG(EP) \
+	SET_REG(USB_EP_REG(EP), \
+		(GET_REG(USB_EP_REG(EP)) & USB_EP_NTOGGLE_MSK) | \
+		USB_EP_RX_DTOG | USB_EP_RX_CTR | USB_EP_TX_CTR)
+
 
 /* --- USB BTABLE registers ------------------------------------------------ */
 
@@ -289,6 +307,24 @@ LGPL License Terms @ref lgpl_license
 #define USB_SET_EP_RX_ADDR(EP, ADDR)	SET_REG(USB_EP_RX_ADDR(EP), ADDR)
 #define USB_SET_EP_RX_COUNT(EP, COUNT)	SET_REG(USB_EP_RX_COUNT(EP), COUNT)
 
+/*
+ * Double-buffered and isochronous endpoints use both halves of the buffer
+ * descriptor for the one direction: buffer 0 is the TX entry and buffer 1
+ * the RX entry.
+ */
+#define USB_GET_EP_DBUF_BUFF(EP, BUF) \
+	((BUF) ? USB_GET_EP_RX_BUFF(EP) : USB_GET_EP_TX_BUFF(EP))
+#define USB_GET_EP_DBUF_COUNT(EP, BUF) \
+	((BUF) ? USB_GET_EP_RX_COUNT(EP) : USB_GET_EP_TX_COUNT(EP))
+#define USB_SET_EP_DBUF_COUNT(EP, BUF, COUNT) \
+	do { \
+		if (BUF) { \
+			USB_SET_EP_RX_COUNT(EP, COUNT); \
+		} else { \
+			USB_SET_EP_TX_COUNT(EP, COUNT); \
+		} \
+	} while (0)
+
 
 
 /**@}*/
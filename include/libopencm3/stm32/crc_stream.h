@@ -0,0 +1,101 @@
+/** @defgroup crc_stream_defines CRC Streaming Defines
+ *
+ * @ingroup crc_defines
+ *
+ * @brief <b>Incremental CRC over byte streams, with a DMA feed</b>
+ *
+ * LGPL License Terms @ref lgpl_license
+ */
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_CRC_STREAM_H
+#define LIBOPENCM3_CRC_STREAM_H
+
+#include <stddef.h>
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/stm32/crc.h>
+#include <libopencm3/stm32/dma_async.h>
+
+/**@{*/
+
+/** A CRC algorithm, in the usual parametrised form */
+struct crc_config {
+	uint32_t poly;		/**< Polynomial, without its top bit */
+	uint8_t width;		/**< 32, 16, 8 or 7 bits */
+	bool reflect_in;	/**< Least significant bit of each byte first */
+	bool reflect_out;
+	uint32_t init;
+	uint32_t xor_out;
+};
+
+/** @defgroup crc_stream_configs Predefined algorithms
+@{*/
+/** CRC-32 as used by Ethernet, zlib and PNG, check 0xCBF43926 */
+extern const struct crc_config crc_config_crc32;
+/** CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF), check 0x29B1 */
+extern const struct crc_config crc_config_crc16_ccitt;
+/** CRC-8 (poly 0x07, init 0), check 0xF4 */
+extern const struct crc_config crc_config_crc8;
+/**@}*/
+
+struct crc_stream;
+
+/** Called from the DMA interrupt when a DMA update has ended */
+typedef void (*crc_stream_callback_t)(struct crc_stream *s, bool ok,
+				      void *arg);
+
+/** Event counters, only ever incremented by the driver */
+struct crc_stream_stats {
+	uint32_t bytes;		/**< Bytes fed to the CRC unit */
+	uint32_t dma_errors;	/**< DMA transfer errors, the CRC is lost */
+};
+
+/** State of the CRC computation in progress */
+struct crc_stream {
+	const struct crc_config *cfg;
+	/** Bytes waiting for a whole word, for the v1 unit which only
+	 * takes words */
+	uint8_t tail[4];
+	uint8_t ntail;
+	struct dma_async_chan *dma;
+	/** Part of a DMA update not handed to the DMA yet */
+	const uint8_t *dma_next;
+	size_t dma_left;
+	crc_stream_callback_t callback;
+	void *callback_arg;
+	/** Set while a DMA update is running */
+	volatile bool busy;
+	struct crc_stream_stats stats;
+};
+
+/**@}*/
+
+BEGIN_DECLS
+
+bool crc_stream_init(struct crc_stream *s, const struct crc_config *cfg);
+void crc_stream_set_dma(struct crc_stream *s, struct dma_async_chan *dma);
+void crc_stream_set_callback(struct crc_stream *s,
+			     crc_stream_callback_t callback, void *arg);
+bool crc_stream_update(struct crc_stream *s, const void *data, size_t len);
+bool crc_stream_update_dma(struct crc_stream *s, const void *data,
+			   size_t len);
+uint32_t crc_stream_final(struct crc_stream *s);
+
+END_DECLS
+
+#endif
@@ -24,7 +24,9 @@
 #       include <libopencm3/stm32/f2/crypto.h>
 #elif defined(STM32F4)
 #       include <libopencm3/stm32/f4/crypto.h>
+#elif defined(STM32F7)
+#       include <libopencm3/stm32/f7/crypto.h>
 #else
 #       error "CRYPTO processor is supported only" \
-	"in stm32f2xx, stm32f41xx, stm32f42xx and stm32f43xx family."
+	"in stm32f2xx, stm32f41xx, stm32f42xx, stm32f43xx and stm32f7xx family."
 #endif
@@ -0,0 +1,106 @@
+/** @defgroup crypto_stream_defines CRYPTO Streaming Defines
+ *
+ * @ingroup crypto_defines
+ *
+ * @brief <b>Incremental, DMA capable ciphering on the CRYP processor</b>
+ *
+ * LGPL License Terms @ref lgpl_license
+ */
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_CRYPTO_STREAM_H
+#define LIBOPENCM3_CRYPTO_STREAM_H
+
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/stm32/crypto.h>
+#include <libopencm3/stm32/dma_async.h>
+
+/**@{*/
+
+struct crypto_stream;
+
+/** Called from the DMA interrupt when a DMA update has ended */
+typedef void (*crypto_stream_callback_t)(struct crypto_stream *s, void *arg);
+
+/** Event counters, only ever incremented by the driver */
+struct crypto_stream_stats {
+	uint32_t blocks;	/**< Cipher blocks processed */
+	uint32_t swaps;		/**< Times the stream was loaded into the
+				     processor after another one */
+	uint32_t dma_errors;	/**< DMA transfer errors, the update is lost */
+};
+
+/** State of one cipher stream. While another stream uses the processor the
+ * whole context lives here; several streams can be interleaved. */
+struct crypto_stream {
+	/** CR without CRYPEN, including the GCM/CCM phase once saved */
+	uint32_t cr;
+	/** K0LR to K3RR */
+	uint32_t key[8];
+	/** IV0LR to IV1RR, the chaining value or counter once saved */
+	uint32_t iv[4];
+#if defined(CRYP_CR_ALGOMODE3)
+	/** CSGCMCCM0R to CSGCM7R */
+	uint32_t gcm[16];
+	/** CCM counter block 0, encrypted into the tag */
+	uint32_t ctr0[4];
+#endif
+	struct dma_async_chan *in_dma;
+	struct dma_async_chan *out_dma;
+	crypto_stream_callback_t callback;
+	void *callback_arg;
+	/** Set while a DMA update is running */
+	volatile bool busy;
+	struct crypto_stream_stats stats;
+};
+
+/**@}*/
+
+BEGIN_DECLS
+
+void crypto_stream_init(struct crypto_stream *s, enum crypto_mode mode,
+			enum crypto_keysize keysize,
+			enum crypto_datatype datatype, const uint32_t *key,
+			const uint32_t *iv);
+#if defined(CRYP_CR_ALGOMODE3)
+bool crypto_stream_init_gcm(struct crypto_stream *s, bool decrypt,
+			    enum crypto_keysize keysize,
+			    enum crypto_datatype datatype, const uint32_t *key,
+			    const uint32_t iv[3]);
+bool crypto_stream_init_ccm(struct crypto_stream *s, bool decrypt,
+			    enum crypto_keysize keysize,
+			    enum crypto_datatype datatype, const uint32_t *key,
+			    const uint32_t b0[4]);
+bool crypto_stream_header(struct crypto_stream *s, const uint32_t *in,
+			  uint32_t words);
+bool crypto_stream_tag(struct crypto_stream *s, uint64_t header_bytes,
+		       uint64_t payload_bytes, uint32_t tag[4]);
+#endif
+void crypto_stream_set_dma(struct crypto_stream *s, struct dma_async_chan *in,
+			   struct dma_async_chan *out);
+void crypto_stream_set_callback(struct crypto_stream *s,
+				crypto_stream_callback_t callback, void *arg);
+bool crypto_stream_update(struct crypto_stream *s, const uint32_t *in,
+			  uint32_t *out, uint32_t words);
+bool crypto_stream_update_dma(struct crypto_stream *s, const uint32_t *in,
+			      uint32_t *out, uint32_t words);
+void crypto_stream_final(struct crypto_stream *s);
+
+END_DECLS
+
+#endif
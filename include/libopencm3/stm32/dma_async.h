@@ -0,0 +1,150 @@
+/** @defgroup dma_async_defines DMA Asynchronous Transfer Defines
+ *
+ * @ingroup dma_defines
+ *
+ * @brief <b>Channel allocator and transfer API shared by all DMA flavours</b>
+ *
+ * LGPL License Terms @ref lgpl_license
+ */
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_DMA_ASYNC_H
+#define LIBOPENCM3_DMA_ASYNC_H
+
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/stm32/dma.h>
+
+/**@{*/
+
+/** Any channel (or stream) of the controller, where the request can be
+ * routed to any of them: DMAMUX, GPDMA and memory to memory transfers */
+#define DMA_ASYNC_ANY		0xFF
+/** The channel needs no request routing, or it is fixed in hardware */
+#define DMA_ASYNC_REQUEST_NONE	0xFF
+
+/** @defgroup dma_async_width Transfer unit width
+@{*/
+#define DMA_ASYNC_WIDTH_8	0
+#define DMA_ASYNC_WIDTH_16	1
+#define DMA_ASYNC_WIDTH_32	2
+/**@}*/
+
+/** @defgroup dma_async_event Events passed to the callback
+@{*/
+#define DMA_ASYNC_HALF		(1 << 0)
+#define DMA_ASYNC_COMPLETE	(1 << 1)
+#define DMA_ASYNC_ERROR		(1 << 2)
+/**@}*/
+
+/** Transfer direction */
+enum dma_async_dir {
+	DMA_ASYNC_PERIPH_TO_MEM,
+	DMA_ASYNC_MEM_TO_PERIPH,
+	DMA_ASYNC_MEM_TO_MEM,
+	/** Memory to a register that takes data without a request, such as
+	 * the CRC data register: @p periph is the register, not
+	 * incremented. Memory to memory capable controllers only. */
+	DMA_ASYNC_MEM_TO_REG,
+};
+
+/** One place a peripheral request can be served from.
+ *
+ * @p request is the request line to route to the channel: the CSELR value on
+ * parts with a channel selection register, the stream CHSEL value on F2/F4/F7,
+ * the DMAMUX request ID on G0/G4/H7 and REQSEL on U5.
+ */
+struct dma_async_route {
+	uint32_t dma;		/**< Controller base, DMA1 or DMA2 (GPDMA1 or
+				     LPDMA1 on U5) */
+	uint8_t channel;	/**< Channel or stream, or DMA_ASYNC_ANY */
+	uint8_t request;	/**< Request line, or DMA_ASYNC_REQUEST_NONE */
+};
+
+/** Transfer description */
+struct dma_async_xfer {
+	enum dma_async_dir dir;
+	uint32_t periph;	/**< Peripheral address, source of a memory to
+				     memory transfer */
+	uint32_t mem;		/**< Memory address, destination of a memory
+				     to memory transfer */
+	uint16_t count;		/**< Number of data units */
+	uint8_t width;		/**< @ref dma_async_width, on both sides */
+	uint8_t priority;	/**< 0 (low) to 3 (very high) */
+	bool circular;		/**< Restart from the beginning when done, only
+				     for transfers with a request */
+	bool half;		/**< Also report the half way point */
+};
+
+struct dma_async_chan;
+
+/** Called from @ref dma_async_irq with the @ref dma_async_event flags seen */
+typedef void (*dma_async_callback_t)(struct dma_async_chan *ch,
+				     uint32_t events, void *arg);
+
+/** Event counters, only ever incremented by the driver */
+struct dma_async_stats {
+	uint32_t completed;	/**< Transfers (or circular laps) completed */
+	uint32_t half;		/**< Half transfer events */
+	uint32_t errors;	/**< Transfer errors, the channel is stopped */
+};
+
+/** An allocated channel or stream */
+struct dma_async_chan {
+	uint32_t dma;
+	uint8_t channel;
+	uint8_t request;
+	uint8_t width;
+	bool circular;
+	/** Set while a transfer is running, cleared when it completes,
+	 * fails or is stopped */
+	volatile bool busy;
+	dma_async_callback_t callback;
+	void *callback_arg;
+	struct dma_async_stats stats;
+#if defined(STM32U5)
+	/** Linked-list item reloading BR1, SAR and DAR, used by circular
+	 * transfers since the GPDMA has no circular mode of its own */
+	uint32_t reload[4];
+#endif
+#if defined(STM32F7) || defined(STM32H7)
+	/** Memory written by the transfer, invalidated from the data cache
+	 * before the callback runs */
+	uint32_t dcache_dst;
+	uint32_t dcache_len;
+#endif
+};
+
+/**@}*/
+
+BEGIN_DECLS
+
+void dma_async_set_channel_count(uint32_t dma, uint8_t count);
+bool dma_async_alloc(struct dma_async_chan *ch,
+		     const struct dma_async_route *routes, uint32_t count);
+void dma_async_free(struct dma_async_chan *ch);
+void dma_async_set_callback(struct dma_async_chan *ch,
+			    dma_async_callback_t callback, void *arg);
+bool dma_async_start(struct dma_async_chan *ch,
+		     const struct dma_async_xfer *xfer);
+void dma_async_stop(struct dma_async_chan *ch);
+uint16_t dma_async_remaining(struct dma_async_chan *ch);
+void dma_async_irq(uint32_t dma, uint8_t channel);
+
+END_DECLS
+
+#endif
@@ -33,4 +33,24 @@ LGPL License Terms @ref lgpl_license
 
 #include <libopencm3/stm32/common/hash_common_f24.h>
 
+/* --- HASH registers (F42xx and F43xx only) ------------------------------- */
+
+/* HASH digest registers for SHA-224 and SHA-256 (HASH_HR[8]), the first five
+ * mirror HASH_HR */
+#define HASH_HR_EXT	(&MMIO32(HASH + 0x310)) /* x8 */
+
+/* --- HASH_CR values (F42xx and F43xx only) ------------------------------- */
+
+/* ALGO[1]: Algorithm selection, high bit */
+#define HASH_CR_ALGO1		(1 << 18)
+
+/* MDMAT: Multiple DMA transfers, no digest at the end of a DMA transfer */
+#define HASH_CR_MDMAT		(1 << 13)
+
+/** @addtogroup hash_algorithm
+@{*/
+#define HASH_ALGO_SHA224	HASH_CR_ALGO1
+#define HASH_ALGO_SHA256	(HASH_CR_ALGO1 | HASH_CR_ALGO)
+/**@}*/
+
 #endif
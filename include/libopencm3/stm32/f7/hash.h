@@ -0,0 +1,52 @@
+/** @defgroup hash_defines HASH Defines
+
+@ingroup STM32F7xx_defines
+
+@brief Defined Constants and Types for the STM32F7xx HASH Controller
+
+LGPL License Terms @ref lgpl_license
+ */
+
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_HASH_H
+#define LIBOPENCM3_HASH_H
+
+#include <libopencm3/stm32/common/hash_common_f24.h>
+
+/* --- HASH registers ------------------------------------------------------ */
+
+/* HASH digest registers for SHA-224 and SHA-256 (HASH_HR[8]), the first five
+ * mirror HASH_HR */
+#define HASH_HR_EXT	(&MMIO32(HASH + 0x310)) /* x8 */
+
+/* --- HASH_CR values ------------------------------------------------------ */
+
+/* ALGO[1]: Algorithm selection, high bit */
+#define HASH_CR_ALGO1		(1 << 18)
+
+/* MDMAT: Multiple DMA transfers, no digest at the end of a DMA transfer */
+#define HASH_CR_MDMAT		(1 << 13)
+
+/** @addtogroup hash_algorithm
+@{*/
+#define HASH_ALGO_SHA224	HASH_CR_ALGO1
+#define HASH_ALGO_SHA256	(HASH_CR_ALGO1 | HASH_CR_ALGO)
+/**@}*/
+
+#endif
@@ -21,6 +21,7 @@
 
 #include <libopencm3/stm32/memorymap.h>
 #include <libopencm3/cm3/common.h>
+#include <libopencm3/stm32/can_filter.h>
 
 #if defined(STM32G4)
 #	include <libopencm3/stm32/g4/fdcan.h>
@@ -780,6 +781,12 @@ void fdcan_set_ext_filter(uint32_t canport, uint32_t nr,
 		uint8_t id_list_mode, uint32_t id1, uint32_t id2,
 		uint8_t action);
 
+int fdcan_filter_plan(struct can_filter_id *ids, uint32_t count,
+		uint32_t std_max, uint32_t ext_max, struct can_filter_report *report);
+
+int fdcan_filter_apply(uint32_t canport, const struct can_filter_id *ids, uint32_t count,
+		uint8_t action);
+
 void fdcan_enable_irq(uint32_t canport, uint32_t irq);
 void fdcan_disable_irq(uint32_t canport, uint32_t irq);
 
@@ -795,6 +802,15 @@ void fdcan_release_fifo(uint32_t canport, uint8_t fifo);
 bool fdcan_available_tx(uint32_t canport);
 bool fdcan_available_rx(uint32_t canport, uint8_t fifo);
 
+unsigned fdcan_rx_fifo_peek(uint32_t canport, uint8_t fifo_id,
+		const struct fdcan_rx_fifo_element **elements, unsigned max);
+void fdcan_rx_fifo_ack(uint32_t canport, uint8_t fifo_id, unsigned count);
+
+uint32_t fdcan_tx_free_mask(uint32_t canport);
+int fdcan_tx_fill(struct fdcan_tx_buffer_element *tx_buffer, uint32_t id, bool ext,
+		bool rtr, bool fdcan_fmt, bool btr_switch, uint8_t length, const uint8_t *data);
+void fdcan_tx_request(uint32_t canport, uint32_t mask);
+
 int fdcan_cccr_init_cfg(uint32_t canport, bool set, uint32_t timeout);
 struct fdcan_standard_filter *fdcan_get_flssa_addr(uint32_t canport);
 struct fdcan_extended_filter *fdcan_get_flesa_addr(uint32_t canport);
@@ -802,10 +818,12 @@ struct fdcan_extended_filter *fdcan_get_flesa_addr(uint32_t canport);
 struct fdcan_rx_fifo_element *fdcan_get_rxfifo_addr(uint32_t canport,
 		unsigned fifo_id, unsigned element_id);
 unsigned fdcan_get_fifo_element_size(uint32_t canport, unsigned fifo_id);
+unsigned fdcan_get_fifo_size(uint32_t canport, unsigned fifo_id);
 
 struct fdcan_tx_event_element *fdcan_get_txevt_addr(uint32_t canport);
 struct fdcan_tx_buffer_element *fdcan_get_txbuf_addr(uint32_t canport, unsigned element_id);
 unsigned fdcan_get_txbuf_element_size(uint32_t canport);
+unsigned fdcan_get_txbuf_count(uint32_t canport);
 void fdcan_set_fifo_locked_mode(uint32_t canport, bool locked);
 uint32_t fdcan_length_to_dlc(uint8_t length);
 uint8_t fdcan_dlc_to_length(uint32_t dlc);
@@ -0,0 +1,100 @@
+/** @defgroup hash_stream_defines HASH Streaming Defines
+ *
+ * @ingroup hash_defines
+ *
+ * @brief <b>Incremental, DMA capable hashing and HMAC</b>
+ *
+ * LGPL License Terms @ref lgpl_license
+ */
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_HASH_STREAM_H
+#define LIBOPENCM3_HASH_STREAM_H
+
+#include <stddef.h>
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/stm32/hash.h>
+#include <libopencm3/stm32/dma_async.h>
+
+/**@{*/
+
+/** Number of context swap registers: 38 for a hash and 54 for a HMAC on
+ * processors with SHA-2, always 51 on the others */
+#if defined(HASH_ALGO_SHA256)
+#define HASH_STREAM_CSR_COUNT	54
+#else
+#define HASH_STREAM_CSR_COUNT	51
+#endif
+
+struct hash_stream;
+
+/** Called from the DMA interrupt when a DMA update has ended */
+typedef void (*hash_stream_callback_t)(struct hash_stream *s, bool ok,
+				       void *arg);
+
+/** Event counters, only ever incremented by the driver */
+struct hash_stream_stats {
+	uint32_t bytes;		/**< Message bytes fed */
+	uint32_t swaps;		/**< Times the stream was restored into the
+				     processor after another one */
+	uint32_t dma_errors;	/**< DMA transfer errors, the hash is lost */
+};
+
+/** State of one hash. While another hash uses the processor its whole
+ * context lives here; several hashes can be in progress. */
+struct hash_stream {
+	uint32_t cr;
+	uint32_t str;
+	uint32_t imr;
+	uint32_t csr[HASH_STREAM_CSR_COUNT];
+	/** The processor has been initialised for this hash */
+	bool started;
+	/** Message bytes waiting for a whole word */
+	uint8_t tail[4];
+	uint8_t ntail;
+	/** HMAC key, fed again for the outer hash */
+	const uint8_t *key;
+	size_t key_len;
+	struct dma_async_chan *dma;
+	/** Part of a DMA update not handed to the DMA yet */
+	const uint8_t *dma_next;
+	size_t dma_left;
+	hash_stream_callback_t callback;
+	void *callback_arg;
+	/** Set while a DMA update is running */
+	volatile bool busy;
+	struct hash_stream_stats stats;
+};
+
+/**@}*/
+
+BEGIN_DECLS
+
+bool hash_stream_init(struct hash_stream *s, uint32_t algorithm,
+		      const uint8_t *key, size_t key_len);
+void hash_stream_set_dma(struct hash_stream *s, struct dma_async_chan *dma);
+void hash_stream_set_callback(struct hash_stream *s,
+			      hash_stream_callback_t callback, void *arg);
+bool hash_stream_update(struct hash_stream *s, const void *data, size_t len);
+bool hash_stream_update_dma(struct hash_stream *s, const void *data,
+			    size_t len);
+uint8_t hash_stream_final(struct hash_stream *s, uint32_t *digest);
+
+END_DECLS
+
+#endif
@@ -0,0 +1,111 @@
+/** @defgroup i2c_async_defines I2C Asynchronous Driver Defines
+ *
+ * @ingroup i2c_defines
+ *
+ * @brief <b>Queued, interrupt and DMA driven I2C master</b>
+ *
+ * LGPL License Terms @ref lgpl_license
+ */
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_I2C_ASYNC_H
+#define LIBOPENCM3_I2C_ASYNC_H
+
+#include <stddef.h>
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/stm32/i2c.h>
+#include <libopencm3/stm32/dma_async.h>
+
+/**@{*/
+
+/** Transaction state */
+enum i2c_async_status {
+	I2C_ASYNC_QUEUED,
+	I2C_ASYNC_RUNNING,
+	I2C_ASYNC_DONE,
+	I2C_ASYNC_NACK,		/**< Address or data not acknowledged */
+	I2C_ASYNC_ERROR,	/**< Bus error, arbitration lost or overrun */
+	I2C_ASYNC_TIMEOUT,
+};
+
+struct i2c_async_xfer;
+
+/** Called from interrupt context when a transaction has ended */
+typedef void (*i2c_async_callback_t)(struct i2c_async_xfer *xfer, void *arg);
+
+/** A write, a read, or a write followed by a repeated start and a read.
+ * Owned by the driver from @ref i2c_async_submit until it has ended. */
+struct i2c_async_xfer {
+	uint8_t addr;		/**< 7 bit device address */
+	const uint8_t *w;
+	size_t wn;
+	uint8_t *r;
+	size_t rn;
+	i2c_async_callback_t callback;	/**< May be NULL */
+	void *arg;
+	volatile enum i2c_async_status status;
+	struct i2c_async_xfer *next;
+};
+
+/** Event counters, only ever incremented by the driver */
+struct i2c_async_stats {
+	uint32_t completed;	/**< Transactions ended without error */
+	uint32_t nacks;
+	uint32_t errors;
+	uint32_t timeouts;
+};
+
+/** State of one I2C bus, owned by the driver once initialised */
+struct i2c_async {
+	uint32_t i2c;
+	/** Queued transactions, the head is the one on the bus */
+	struct i2c_async_xfer *head;
+	struct i2c_async_xfer *tail;
+	/** Progress of the head transaction */
+	bool reading;
+	bool nack;
+	size_t pos;
+	/** Bytes of the phase not yet loaded into NBYTES (v2 only) */
+	size_t left;
+	/** Ticks of @ref i2c_async_tick a transaction may take, 0 for none */
+	uint32_t timeout;
+	uint32_t ticks;
+	/** Channels for the data of the v2 peripheral, NULL to use the
+	 * TX and RX interrupts */
+	struct dma_async_chan *tx_dma;
+	struct dma_async_chan *rx_dma;
+	struct i2c_async_stats stats;
+};
+
+/**@}*/
+
+BEGIN_DECLS
+
+void i2c_async_init(struct i2c_async *bus, uint32_t i2c, uint32_t timeout);
+#if defined(I2C_ICR)
+void i2c_async_set_dma(struct i2c_async *bus, struct dma_async_chan *tx,
+		       struct dma_async_chan *rx);
+#endif
+bool i2c_async_submit(struct i2c_async *bus, struct i2c_async_xfer *xfer);
+void i2c_async_isr(struct i2c_async *bus);
+void i2c_async_tick(struct i2c_async *bus);
+bool i2c_async_idle(struct i2c_async *bus);
+
+END_DECLS
+
+#endif
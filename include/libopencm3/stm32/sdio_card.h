@@ -0,0 +1,108 @@
+/** @defgroup sdio_card_defines SDIO Card Defines
+ *
+ * @brief <b>SD and MMC memory cards over the SDIO peripheral</b>
+ *
+ * LGPL License Terms @ref lgpl_license
+ */
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_SDIO_CARD_H
+#define LIBOPENCM3_SDIO_CARD_H
+
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/stm32/sdio.h>
+#include <libopencm3/stm32/dma_async.h>
+
+/**@{*/
+
+/** Block size of all transfers */
+#define SDIO_CARD_BLOCK_SIZE		512
+/** Most blocks in one transfer, bounded by the 16 bit DMA word count */
+#define SDIO_CARD_MAX_BLOCKS		511
+/** Clock divider value selecting the SDIO clock itself (CLKCR BYPASS) */
+#define SDIO_CARD_CLKDIV_BYPASS		0x100
+/** Error flag of a transfer ended by the DMA, outside the SDIO_STA bits */
+#define SDIO_CARD_ERROR_DMA		(1U << 31)
+
+/** Kind of card found by @ref sdio_card_init */
+enum sdio_card_type {
+	SDIO_CARD_NONE,
+	SDIO_CARD_SDSC,		/**< SD standard capacity, byte addressed */
+	SDIO_CARD_SDHC,		/**< SD high or extended capacity */
+	SDIO_CARD_MMC,		/**< MMC or eMMC */
+};
+
+struct sdio_card;
+
+/** Called from interrupt context when a transfer has ended */
+typedef void (*sdio_card_callback_t)(struct sdio_card *c, bool ok, void *arg);
+
+/** Event counters, only ever incremented by the driver */
+struct sdio_card_stats {
+	uint32_t blocks_read;
+	uint32_t blocks_written;
+	uint32_t errors;	/**< Transfers ended by a data or DMA error */
+};
+
+/** State of the card on the SDIO bus */
+struct sdio_card {
+	enum sdio_card_type type;
+	uint16_t rca;		/**< Relative card address */
+	/** Blocks addressed by block number rather than by byte */
+	bool block_addressing;
+	bool wide;		/**< 4 bit data bus */
+	bool high_speed;
+	uint32_t cid[4];
+	uint32_t csd[4];
+	uint32_t blocks;	/**< Capacity, in blocks */
+	struct dma_async_chan *dma;
+	sdio_card_callback_t callback;
+	void *callback_arg;
+	/** Progress of the transfer in progress */
+	uint16_t count;
+	bool writing;
+	bool data_done;
+	bool dma_done;
+	bool ending;
+	/** Set while a transfer is running */
+	volatile bool busy;
+	/** SDIO_STA error flags which ended the last transfer, or
+	 * SDIO_CARD_ERROR_DMA, 0 if none */
+	uint32_t error;
+	struct sdio_card_stats stats;
+};
+
+/**@}*/
+
+BEGIN_DECLS
+
+bool sdio_card_init(struct sdio_card *c, uint16_t init_div, uint16_t div,
+		    uint16_t hs_div);
+void sdio_card_set_dma(struct sdio_card *c, struct dma_async_chan *dma);
+void sdio_card_set_callback(struct sdio_card *c,
+			    sdio_card_callback_t callback, void *arg);
+bool sdio_card_read(struct sdio_card *c, uint32_t block, void *buf,
+		    uint16_t count);
+bool sdio_card_write(struct sdio_card *c, uint32_t block, const void *buf,
+		     uint16_t count);
+bool sdio_card_wait(struct sdio_card *c);
+void sdio_card_isr(struct sdio_card *c);
+
+END_DECLS
+
+#endif
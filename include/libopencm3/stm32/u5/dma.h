@@ -120,6 +120,10 @@
 #define GPDMA1_CTR3(n)      DMA_CTR3(GPDMA1, (n))
 #define LPDMA1_CTR3(n)      DMA_CTR3(LPDMA1, (n))
 
+/* DMA Channel x Block Register 2 (DMA_CxBR2), 2D channels only */
+#define DMA_CBR2(periph, n) MMIO32(DMA_CHANNEL((periph), (n)) + 0x58U)
+#define GPDMA1_CBR2(n)      DMA_CBR2(GPDMA1, (n))
+
 /* DMA Channel x Linked-List address Register (DMA_CxLLR) */
 #define DMA_CLLR(periph, n) MMIO32(DMA_CHANNEL((periph), (n)) + 0x7cU)
 #define GPDMA1_CLLR(n)      DMA_CLLR(GPDMA1, (n))
@@ -510,6 +514,23 @@ typedef enum dma_transfer_complete_mode {
 	DMA_TRANSFER_COMPLETE_MODE_CHANNEL = 3U,
 } dma_transfer_complete_mode_e;
 
+/* --- DMA_CxBR1 values ---------------------------------------------------- */
+
+/* BNDT[15:0]: Block number of data bytes to transfer */
+#define DMA_CxBR1_BNDT_MASK  0x0000ffffU
+#define DMA_CxBR1_BNDT_SHIFT 0U
+/* BRC[26:16]: Block repeat counter minus 1, 2D channels only */
+#define DMA_CxBR1_BRC_MASK  (0x7ffU << 16U)
+#define DMA_CxBR1_BRC_SHIFT 16U
+/* SDEC: Source address decrement */
+#define DMA_CxBR1_SDEC (1U << 28U)
+/* DDEC: Destination address decrement */
+#define DMA_CxBR1_DDEC (1U << 29U)
+/* BRSDEC: Block repeat source address decrement */
+#define DMA_CxBR1_BRSDEC (1U << 30U)
+/* BRDDEC: Block repeat destination address decrement */
+#define DMA_CxBR1_BRDDEC (1U << 31U)
+
 /* --- DMA_CxTR3 values ---------------------------------------------------- */
 
 /* DAO[28:16]: Destination address offset (stride) */
@@ -530,10 +551,25 @@ typedef enum dma_transfer_complete_mode {
 #define DMA_CxTR3_SAO_SHIFT 0U
 /**@}*/
 
+/* --- DMA_CxBR2 values ---------------------------------------------------- */
+
+/* BRSAO[15:0]: Block repeated source address offset */
+#define DMA_CxBR2_BRSAO_MASK  0x0000ffffU
+#define DMA_CxBR2_BRSAO_SHIFT 0U
+/* BRDAO[31:16]: Block repeated destination address offset */
+#define DMA_CxBR2_BRDAO_MASK  0xffff0000U
+#define DMA_CxBR2_BRDAO_SHIFT 16U
+
 /* --- DMA_CxLLR values ---------------------------------------------------- */
 
+/** LA[15:2]: Low 16 bits of the next linked-list item address */
+#define DMA_CxLLR_LA_MASK 0x0000fffcU
 /** ULL: Update LLR from memory */
 #define DMA_CxLLR_ULL (1U << 16U)
+/** UB2: Update BR2 from memory, 2D channels only */
+#define DMA_CxLLR_UB2 (1U << 25U)
+/** UT3: Update TR3 from memory, 2D channels only */
+#define DMA_CxLLR_UT3 (1U << 26U)
 /** UDA: Update DAR from memory */
 #define DMA_CxLLR_UDA (1U << 27U)
 /** USA: Update SAR from memory */
@@ -545,6 +581,68 @@ typedef enum dma_transfer_complete_mode {
 /** UT1: Update TR1 from memory */
 #define DMA_CxLLR_UT1 (1U << 31U)
 
+/** Update flags of a full linked-list item on a linear addressing channel */
+#define DMA_CxLLR_UPDATE_LINEAR \
+	(DMA_CxLLR_UT1 | DMA_CxLLR_UT2 | DMA_CxLLR_UB1 | DMA_CxLLR_USA | DMA_CxLLR_UDA | DMA_CxLLR_ULL)
+/** Update flags of a full linked-list item on a 2D addressing channel */
+#define DMA_CxLLR_UPDATE_2D (DMA_CxLLR_UPDATE_LINEAR | DMA_CxLLR_UT3 | DMA_CxLLR_UB2)
+
+/* --- Linked-list transfer engine ------------------------------------------ */
+
+/**
+ * Linked-list item, the memory image of the registers the channel reloads between blocks.
+ * The controller reads only the registers flagged in the previous item's link word, in register
+ * order, so on linear addressing channels the link word follows cdar and takes the place of ctr3.
+ * Items must be 4-byte aligned and live in the same 64KiB region as the rest of their list.
+ */
+typedef struct dma_ll_node {
+	uint32_t ctr1;
+	uint32_t ctr2;
+	uint32_t cbr1;
+	uint32_t csar;
+	uint32_t cdar;
+	uint32_t ctr3;
+	uint32_t cbr2;
+	uint32_t cllr;
+} dma_ll_node_s;
+
+/** Fixed pool of linked-list items, handed out by dma_ll_node_alloc() */
+typedef struct dma_ll_pool {
+	dma_ll_node_s *nodes;
+	uint16_t count;
+	/* Index + 1 of the first free item, 0 when the pool is exhausted */
+	uint16_t free_head;
+	uint16_t free_count;
+} dma_ll_pool_s;
+
+struct dma_ll_list;
+
+/**
+ * Completion callback, run from dma_ll_isr().
+ * node is the item that just completed, or NULL if the event was an error. flags holds the
+ * DMA_CxSR flags that caused the call.
+ */
+typedef void (*dma_ll_callback_t)(struct dma_ll_list *list, dma_ll_node_s *node, uint32_t flags);
+
+/** A linked-list transfer bound to one channel */
+typedef struct dma_ll_list {
+	uintptr_t dma;
+	uint8_t channel;
+	/* true on channels with 2D addressing (GPDMA1 channels 12 to 15) */
+	bool two_d;
+	bool circular;
+	bool per_node;
+	dma_ll_pool_s *pool;
+	dma_ll_node_s *head;
+	dma_ll_node_s *tail;
+	/* Item the channel is working on, tracked from the per-item completion events */
+	dma_ll_node_s *current;
+	uint16_t count;
+	uint32_t completed;
+	dma_ll_callback_t callback;
+	void *callback_arg;
+} dma_ll_list_s;
+
 BEGIN_DECLS
 
 void dma_channel_reset(uintptr_t dma, uint8_t channel);
@@ -590,6 +688,21 @@ void dma_set_destination_address(uintptr_t dma, uint8_t channel, uintptr_t addre
 uint16_t dma_get_number_of_data(uintptr_t dma, uint8_t channel);
 void dma_set_number_of_data(uintptr_t dma, uint8_t channel, uint16_t number);
 
+bool dma_ll_pool_init(dma_ll_pool_s *pool, dma_ll_node_s *nodes, uint16_t count);
+dma_ll_node_s *dma_ll_node_alloc(dma_ll_pool_s *pool);
+void dma_ll_node_free(dma_ll_pool_s *pool, dma_ll_node_s *node);
+
+void dma_ll_init(dma_ll_list_s *list, uintptr_t dma, uint8_t channel, dma_ll_pool_s *pool);
+dma_ll_node_s *dma_ll_append(dma_ll_list_s *list, uintptr_t source, uintptr_t destination, uint16_t bytes);
+dma_ll_node_s *dma_ll_append_2d(dma_ll_list_s *list, uintptr_t source, uintptr_t destination, uint16_t bytes,
+	uint16_t repeat, uint16_t source_block_offset, uint16_t destination_block_offset);
+bool dma_ll_set_circular(dma_ll_list_s *list, dma_ll_node_s *loop_start);
+void dma_ll_clear(dma_ll_list_s *list);
+void dma_ll_set_callback(dma_ll_list_s *list, dma_ll_callback_t callback, void *arg);
+bool dma_ll_start(dma_ll_list_s *list, bool per_node);
+void dma_ll_stop(dma_ll_list_s *list);
+void dma_ll_isr(dma_ll_list_s *list);
+
 END_DECLS
 /**@}*/
 #endif
@@ -0,0 +1,87 @@
+/** @defgroup usart_async_defines USART Asynchronous Driver Defines
+ *
+ * @ingroup usart_defines
+ *
+ * @brief <b>Buffered, interrupt and DMA driven USART layer</b>
+ *
+ * LGPL License Terms @ref lgpl_license
+ */
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_USART_ASYNC_H
+#define LIBOPENCM3_USART_ASYNC_H
+
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/cm3/sync.h>
+#include <libopencm3/stm32/usart.h>
+
+/**@{*/
+
+/** Event counters, only ever incremented by the driver */
+struct usart_async_stats {
+	uint32_t rx_bytes;	/**< Bytes made available to the reader */
+	uint32_t tx_bytes;	/**< Bytes handed to the hardware */
+	uint32_t overruns;	/**< Hardware overrun (ORE) events */
+	uint32_t rx_dropped;	/**< Bytes lost because the RX ring was full */
+	uint32_t errors;	/**< Framing, noise and parity errors */
+	uint32_t idle;		/**< Idle line / receiver timeout events */
+};
+
+/** State of one buffered USART, owned by the driver once started */
+struct usart_async {
+	uint32_t usart;
+	spsc_queue_t rx;
+	spsc_queue_t tx;
+	/** Transfer count register of a circular DMA channel writing into
+	 * the RX ring, NULL to receive from the RX interrupt. */
+	volatile uint32_t *rx_dma_count;
+	/** Starts a DMA transfer of len bytes from buf to the data register,
+	 * NULL to transmit from the TX interrupt. */
+	void (*tx_dma_start)(const uint8_t *buf, uint16_t len);
+	uint16_t tx_dma_len;
+	/** Called from the interrupt handler on idle line or receiver
+	 * timeout, may be NULL. */
+	void (*rx_callback)(struct usart_async *ua);
+	struct usart_async_stats stats;
+};
+
+/**@}*/
+
+BEGIN_DECLS
+
+void usart_async_init(struct usart_async *ua, uint32_t usart,
+		      uint8_t *rx_buf, uint32_t rx_size,
+		      uint8_t *tx_buf, uint32_t tx_size);
+void usart_async_set_rx_dma(struct usart_async *ua,
+			    volatile uint32_t *dma_count);
+void usart_async_set_tx_dma(struct usart_async *ua,
+			    void (*start)(const uint8_t *buf, uint16_t len));
+void usart_async_start(struct usart_async *ua);
+void usart_async_stop(struct usart_async *ua);
+void usart_async_isr(struct usart_async *ua);
+void usart_async_rx_dma_sync(struct usart_async *ua);
+void usart_async_tx_dma_done(struct usart_async *ua);
+uint32_t usart_async_write(struct usart_async *ua, const void *data,
+			   uint32_t len);
+uint32_t usart_async_read(struct usart_async *ua, void *data, uint32_t len);
+uint32_t usart_async_rx_available(struct usart_async *ua);
+uint32_t usart_async_tx_pending(struct usart_async *ua);
+
+END_DECLS
+
+#endif
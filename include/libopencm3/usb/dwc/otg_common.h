@@ -80,6 +80,8 @@
 #define OTG_DIEPTSIZ(x)			(0x910U + 0x20*(x))
 #define OTG_DOEPTSIZ0			0xB10U
 #define OTG_DOEPTSIZ(x)			(0xB10U + 0x20*(x))
+#define OTG_DIEPDMA(x)			(0x914U + 0x20*(x))
+#define OTG_DOEPDMA(x)			(0xB14U + 0x20*(x))
 #define OTG_DTXFSTS(x)			(0x918U + 0x20*(x))
 
 /* Power and clock gating control and status register */
@@ -115,6 +117,13 @@
 
 /* OTG AHB configuration register (OTG_GAHBCFG) */
 #define OTG_GAHBCFG_GINT		(1U << 0U)
+#define OTG_GAHBCFG_HBSTLEN_SINGLE	(0x0U << 1U)
+#define OTG_GAHBCFG_HBSTLEN_INCR	(0x1U << 1U)
+#define OTG_GAHBCFG_HBSTLEN_INCR4	(0x3U << 1U)
+#define OTG_GAHBCFG_HBSTLEN_INCR8	(0x5U << 1U)
+#define OTG_GAHBCFG_HBSTLEN_INCR16	(0x7U << 1U)
+#define OTG_GAHBCFG_HBSTLEN_MASK	(0xfU << 1U)
+#define OTG_GAHBCFG_DMAEN		(1U << 5U)
 #define OTG_GAHBCFG_TXFELVL		(1U << 7U)
 #define OTG_GAHBCFG_PTXFELVL		(1U << 8U)
 
@@ -91,6 +91,22 @@ usbd_mass_storage *usb_msc_init(usbd_device *usbd_dev,
 				 int (*read_block)(uint32_t lba, uint8_t *copy_to),
 				 int (*write_block)(uint32_t lba, const uint8_t *copy_from));
 
+/** Returned by a multi-block backend which will complete the request later
+ * through usb_msc_io_complete() */
+#define USB_MSC_IO_PENDING			1
+
+usbd_mass_storage *usb_msc_init_async(usbd_device *usbd_dev,
+				       uint8_t ep_in, uint8_t ep_in_size,
+				       uint8_t ep_out, uint8_t ep_out_size,
+				       const char *vendor_id,
+				       const char *product_id,
+				       const char *product_revision_level,
+				       const uint32_t block_count,
+				       int (*read_blocks)(uint32_t lba, uint8_t *copy_to, uint32_t count),
+				       int (*write_blocks)(uint32_t lba, const uint8_t *copy_from, uint32_t count));
+
+void usb_msc_io_complete(usbd_mass_storage *ms, int result);
+
 #endif
 
 /**@}*/
@@ -61,12 +61,16 @@ extern const usbd_driver stm32f207_usb_driver;
 extern const usbd_driver stm32u5_usb_driver;
 extern const usbd_driver stm32h7_usb_driver;
 extern const usbd_driver st_usbfs_v2_usb_driver;
+extern const usbd_driver stm32f207_usb_dma_driver;
+extern const usbd_driver stm32h7_usb_dma_driver;
 #if !defined(STM32H7) && !defined(STM32U5)
 #define otgfs_usb_driver stm32f107_usb_driver
 #define otghs_usb_driver stm32f207_usb_driver
+#define otghs_usb_dma_driver stm32f207_usb_dma_driver
 #else
 #define otgfs_usb_driver stm32u5_usb_driver
 #define otghs_usb_driver stm32h7_usb_driver
+#define otghs_usb_dma_driver stm32h7_usb_dma_driver
 #endif
 extern const usbd_driver efm32lg_usb_driver;
 extern const usbd_driver efm32hg_usb_driver;
@@ -117,6 +121,49 @@ extern void usbd_register_resume_callback(usbd_device *usbd_dev, void (*callback
 /** Registers a SOF callback */
 extern void usbd_register_sof_callback(usbd_device *usbd_dev, void (*callback)(void));
 
+/** Events counted in @ref usbd_stats, the first three match the endpoint callback types */
+enum usbd_event {
+	USBD_EVENT_IN,
+	USBD_EVENT_OUT,
+	USBD_EVENT_SETUP,
+	USBD_EVENT_RESET,
+	USBD_EVENT_SUSPEND,
+	USBD_EVENT_RESUME,
+	USBD_EVENT_SOF,
+	USBD_EVENT_COUNT,
+};
+
+/** Dispatch statistics for one kind of event, times are in timestamp ticks */
+struct usbd_event_stats {
+	uint32_t count;
+	uint32_t latency_max; /**< From entering @ref usbd_poll to calling the handler */
+	uint32_t ticks_total; /**< Spent in the handlers */
+	uint32_t ticks_max;
+};
+
+/** Event statistics kept by the stack, see @ref usbd_get_stats */
+struct usbd_stats {
+	struct usbd_event_stats event[USBD_EVENT_COUNT];
+	uint32_t events;
+	uint32_t polls;
+	uint32_t idle_polls; /**< Calls to @ref usbd_poll that found nothing to do */
+};
+
+/** Registers a free running timestamp source for the event statistics
+ *
+ * Without one only the event counts are kept. On ARMv7-M the DWT cycle
+ * counter is a good choice.
+ * @param usbd_dev the usb device handle returned from @ref usbd_init
+ * @param timestamp returns the current time in any unit, wrapping at 2^32
+ */
+extern void usbd_register_timestamp(usbd_device *usbd_dev, uint32_t (*timestamp)(void));
+
+/** Get the event statistics gathered since init or @ref usbd_clear_stats */
+extern const struct usbd_stats *usbd_get_stats(usbd_device *usbd_dev);
+
+/** Reset the event statistics */
+extern void usbd_clear_stats(usbd_device *usbd_dev);
+
 typedef void (*usbd_control_complete_callback)(usbd_device *usbd_dev, struct usb_setup_data *req);
 
 typedef enum usbd_request_return_codes (*usbd_control_callback)(usbd_device *usbd_dev, struct usb_setup_data *req,
@@ -131,6 +178,12 @@ typedef void (*usbd_set_altsetting_callback)(usbd_device *usbd_dev, uint16_t wIn
 
 typedef void (*usbd_endpoint_callback)(usbd_device *usbd_dev, uint8_t ep);
 
+/** Completion of a @ref usbd_ep_transfer, ep is the full EP address */
+typedef void (*usbd_transfer_callback)(usbd_device *usbd_dev, uint8_t ep, uint32_t len);
+
+/** @ref usbd_ep_transfer flag: end an IN transfer that fills its last packet with a zero length packet */
+#define USBD_TRANSFER_ZLP	(1U << 0U)
+
 /* <usb_control.c> */
 /** Registers a control callback.
  *
@@ -167,6 +220,12 @@ extern void usbd_register_set_altsetting_callback(usbd_device *usbd_dev, usbd_se
 extern void usbd_register_extra_string(usbd_device *usbd_dev, int index, const char *string);
 
 /* Functions to be provided by the hardware abstraction layer */
+/** Service all pending events of the device
+ *
+ * Safe to call from the USB interrupt handler, each call drains every
+ * endpoint event that is pending so one interrupt is enough for a burst.
+ * @param usbd_dev the usb device handle returned from @ref usbd_init
+ */
 extern void usbd_poll(usbd_device *usbd_dev);
 
 /** Disconnect, if supported by the driver
@@ -192,6 +251,52 @@ extern void usbd_disconnect(usbd_device *usbd_dev, bool disconnected);
 extern void usbd_ep_setup(
 	usbd_device *usbd_dev, uint8_t addr, uint8_t type, uint16_t max_size, usbd_endpoint_callback callback);
 
+/** Setup an endpoint with two packet buffers
+ *
+ * Like @ref usbd_ep_setup, but asks for a bulk endpoint to be double-buffered
+ * where the hardware needs this to stream back-to-back packets (st_usbfs).
+ * The host can then move one packet while the other buffer is being read
+ * or refilled, so @ref usbd_ep_write_packet accepts a second packet while
+ * the first is still being sent. Other endpoint types, and drivers without
+ * double buffering, get a normal endpoint.
+ * @param usbd_dev the usb device handle returned from @ref usbd_init
+ * @param addr Full EP address including direction (e.g. 0x01 or 0x81)
+ * @param type Value for bmAttributes (USB_ENDPOINT_ATTR_*)
+ * @param max_size Endpoint max size, twice this is taken from packet memory
+ * @param callback your desired callback function
+ */
+extern void usbd_ep_setup_double_buffered(
+	usbd_device *usbd_dev, uint8_t addr, uint8_t type, uint16_t max_size, usbd_endpoint_callback callback);
+
+/** Queue a multi-packet transfer on an endpoint
+ *
+ * Moves the whole buffer, calling callback once at the end instead of the
+ * endpoint's callback once per packet. Drivers that can (otghs_usb_dma_driver
+ * with a word aligned buffer) hand the transfer to the hardware in one go,
+ * everywhere else it is split into packets from the endpoint's completion
+ * events. The endpoint callback given to @ref usbd_ep_setup is not called
+ * while the transfer is in progress.
+ *
+ * The buffer must stay untouched until the callback. An OUT transfer ends
+ * when len bytes or a short packet have arrived, and len should be a
+ * multiple of the max packet size. Only one transfer per endpoint and
+ * direction can be queued at a time, and EP0 belongs to the control logic.
+ *
+ * With the data cache on (STM32F7, STM32H7) the driver cleans and
+ * invalidates the buffer around the DMA. An OUT buffer must then start and
+ * end on a cache line boundary (SCB_DCACHE_LINE_SIZE), as the CPU writes to
+ * data sharing its lines are lost.
+ * @param usbd_dev the usb device handle returned from @ref usbd_init
+ * @param addr Full EP address including direction (e.g. 0x01 or 0x81)
+ * @param buf data to send or space to receive into
+ * @param len # of bytes
+ * @param flags USBD_TRANSFER_* flags, or 0
+ * @param callback called with the # of bytes actually transferred
+ * @return true if the transfer was queued
+ */
+extern bool usbd_ep_transfer(usbd_device *usbd_dev, uint8_t addr, void *buf, uint32_t len, uint8_t flags,
+	usbd_transfer_callback callback);
+
 /** Write a packet
  * @param usbd_dev the usb device handle returned from @ref usbd_init
  * @param addr EP address (direction is ignored)
@@ -0,0 +1,274 @@
+/** @defgroup CM3_mpu_file MPU
+ *
+ * @ingroup CM3_files
+ *
+ * @brief <b>libopencm3 Cortex-M Memory Protection Unit</b>
+ *
+ * The MPU gives regions of the memory map their access permissions and
+ * memory type. Besides catching stray accesses, it is how memory is made
+ * cacheable or not on parts with a cache: on the Cortex-M7, DMA buffers are
+ * best put in a non-cacheable region, and external memories in a
+ * write-through one.
+ *
+ * On ARMv6-M and ARMv7-M a region is a naturally aligned power of two of at
+ * least 32 bytes, with its attributes in MPU_RASR. On ARMv8-M a region is
+ * any range of 32 byte blocks, and its memory type one of the eight held by
+ * the MAIR registers.
+ *
+ * The presets cover common cases on every architecture. On ARMv8-M they
+ * program the MAIR attributes @ref MPU_MAIR_INDEX_NC and
+ * @ref MPU_MAIR_INDEX_WT.
+ *
+ * @see ARMv7m Architecture Reference Manual (Chapter B3.5 Protected Memory
+ * System Architecture)
+ *
+ * LGPL License Terms @ref lgpl_license
+ * @{
+ */
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libopencm3/cm3/mpu.h>
+
+#if defined(__ARM_ARCH_8M_MAIN__) || defined(__ARM_ARCH_8M_BASE__)
+#define MPU_V8
+#endif
+
+static inline void mpu_barrier(void)
+{
+	__asm__ volatile("dsb\n\tisb" : : : "memory");
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Enable the MPU
+ *
+ * Regions should be set up first.
+ *
+ * @param[in] flags MPU_CTRL_PRIVDEFENA to keep the default memory map for
+ * privileged accesses outside the regions, MPU_CTRL_HFNMIENA to keep the
+ * MPU on in fault handlers, or 0
+ */
+void mpu_enable(uint32_t flags)
+{
+	MPU_CTRL = flags | MPU_CTRL_ENABLE;
+	mpu_barrier();
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Disable the MPU */
+void mpu_disable(void)
+{
+	__asm__ volatile("dmb" : : : "memory");
+	MPU_CTRL = 0;
+	mpu_barrier();
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Number of regions
+ *
+ * @returns 0 if the MPU is not implemented
+ */
+uint8_t mpu_region_count(void)
+{
+	return (MPU_TYPE & MPU_TYPE_DREGION) >> MPU_TYPE_DREGION_LSB;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Disable a region
+ *
+ * @param[in] region Region number
+ */
+void mpu_disable_region(uint8_t region)
+{
+	MPU_RNR = region;
+#if defined(MPU_V8)
+	MPU_RLAR = 0;
+#else
+	MPU_RASR = 0;
+#endif
+	mpu_barrier();
+}
+
+#if defined(MPU_V8)
+/*---------------------------------------------------------------------------*/
+/** @brief Set a memory attribute
+ *
+ * @param[in] index Attribute index, 0 to 7
+ * @param[in] attributes Attribute, @ref CM3_mpu_mair
+ */
+void mpu_set_mair(uint8_t index, uint8_t attributes)
+{
+	uint32_t shift = (index & 3) * 8;
+
+	if (index < 4) {
+		MPU_MAIR0 = (MPU_MAIR0 & ~(0xFFU << shift)) |
+			    ((uint32_t)attributes << shift);
+	} else {
+		MPU_MAIR1 = (MPU_MAIR1 & ~(0xFFU << shift)) |
+			    ((uint32_t)attributes << shift);
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set up and enable a region
+ *
+ * @param[in] region Region number
+ * @param[in] base Base address, 32 byte aligned
+ * @param[in] size Size in bytes, a multiple of 32, ending within the address
+ * space
+ * @param[in] access Shareability, access permissions and execute never,
+ * @ref CM3_mpu_v8_rbar
+ * @param[in] attr_index Memory attribute index, see @ref mpu_set_mair
+ * @returns false if the region is not valid
+ */
+bool mpu_set_region(uint8_t region, uint32_t base, uint32_t size,
+		    uint32_t access, uint8_t attr_index)
+{
+	if ((region >= mpu_region_count()) || (base & 31) || !size ||
+	    (size & 31) || (size - 1 > 0xFFFFFFFFU - base) ||
+	    (attr_index > 7)) {
+		return false;
+	}
+
+	MPU_RNR = region;
+	MPU_RLAR = 0;
+	MPU_RBAR = base | (access & ~MPU_RBAR_BASE);
+	MPU_RLAR = ((base + size - 1) & MPU_RLAR_LIMIT) |
+		   ((uint32_t)attr_index << MPU_RLAR_ATTRINDX_LSB) |
+		   MPU_RLAR_EN;
+	mpu_barrier();
+	return true;
+}
+#else
+/* Smallest region SIZE can encode */
+#if defined(__ARM_ARCH_6M__)
+#define MPU_REGION_SIZE_MIN 256
+#else
+#define MPU_REGION_SIZE_MIN 32
+#endif
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set up and enable a region
+ *
+ * @param[in] region Region number
+ * @param[in] base Base address, aligned on the size
+ * @param[in] size Size in bytes, a power of two of at least 32 (256 on
+ * ARMv6-M)
+ * @param[in] attributes Access permissions, execute never, memory type and
+ * subregion disable bits, @ref mpu_rasr_attributes and
+ * @ref mpu_rasr_memory_types
+ * @returns false if the region is not valid
+ */
+bool mpu_set_region(uint8_t region, uint32_t base, uint32_t size,
+		    uint32_t attributes)
+{
+	if ((region >= mpu_region_count()) || (size < MPU_REGION_SIZE_MIN) ||
+	    (size & (size - 1)) || (base & (size - 1))) {
+		return false;
+	}
+
+	MPU_RNR = region;
+	MPU_RASR = 0;
+	MPU_RBAR = base;
+	/* SIZE encodes a region of 2^(SIZE + 1) bytes */
+	MPU_RASR = (attributes & (MPU_RASR_ATTRS | MPU_RASR_SRD)) |
+		   ((uint32_t)(30 - __builtin_clz(size)) << MPU_RASR_SIZE_LSB) |
+		   MPU_RASR_ENABLE;
+	mpu_barrier();
+	return true;
+}
+#endif
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set up a region for DMA buffers
+ *
+ * Normal memory, not cacheable, read-write and never executed: buffers in it
+ * need no cache maintenance around DMA transfers.
+ *
+ * @param[in] region Region number
+ * @param[in] base Base address, see @ref mpu_set_region
+ * @param[in] size Size in bytes, see @ref mpu_set_region
+ * @returns false if the region is not valid
+ */
+bool mpu_set_region_dma_buffer(uint8_t region, uint32_t base, uint32_t size)
+{
+#if defined(MPU_V8)
+	mpu_set_mair(MPU_MAIR_INDEX_NC, MPU_MAIR_NORMAL_NC);
+	return mpu_set_region(region, base, size, MPU_RBAR_SH_OUTER |
+			      MPU_RBAR_AP_PRW_URW | MPU_RBAR_XN,
+			      MPU_MAIR_INDEX_NC);
+#else
+	return mpu_set_region(region, base, size, MPU_RASR_ATTR_NORMAL_NC |
+			      MPU_RASR_ATTR_S | MPU_RASR_ATTR_AP_PRW_URW |
+			      MPU_RASR_ATTR_XN);
+#endif
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set up a stack guard region
+ *
+ * Placed just below a stack, it turns an overflow into a MemManage fault
+ * instead of a silent corruption. Writes fault everywhere; on ARMv6-M and
+ * ARMv7-M reads and execution too.
+ *
+ * @note ARMv8-M Mainline cores also have stack limit registers (MSPLIM,
+ * PSPLIM), which do not use a region.
+ *
+ * @param[in] region Region number
+ * @param[in] base Base address, see @ref mpu_set_region
+ * @param[in] size Size in bytes, see @ref mpu_set_region
+ * @returns false if the region is not valid
+ */
+bool mpu_set_region_stack_guard(uint8_t region, uint32_t base, uint32_t size)
+{
+#if defined(MPU_V8)
+	mpu_set_mair(MPU_MAIR_INDEX_NC, MPU_MAIR_NORMAL_NC);
+	return mpu_set_region(region, base, size, MPU_RBAR_SH_NON |
+			      MPU_RBAR_AP_PRO_UNO | MPU_RBAR_XN,
+			      MPU_MAIR_INDEX_NC);
+#else
+	return mpu_set_region(region, base, size, MPU_RASR_ATTR_NORMAL_WB |
+			      MPU_RASR_ATTR_AP_PNO_UNO | MPU_RASR_ATTR_XN);
+#endif
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set up a write-through region for external memory
+ *
+ * Normal memory, write-through cacheable, read-write and executable: reads,
+ * including execution in place, are cached while writes go straight to the
+ * memory, so it is never stale for a DMA or another master.
+ *
+ * @param[in] region Region number
+ * @param[in] base Base address, see @ref mpu_set_region
+ * @param[in] size Size in bytes, see @ref mpu_set_region
+ * @returns false if the region is not valid
+ */
+bool mpu_set_region_write_through(uint8_t region, uint32_t base,
+				  uint32_t size)
+{
+#if defined(MPU_V8)
+	mpu_set_mair(MPU_MAIR_INDEX_WT, MPU_MAIR_NORMAL_WT);
+	return mpu_set_region(region, base, size, MPU_RBAR_SH_NON |
+			      MPU_RBAR_AP_PRW_URW, MPU_MAIR_INDEX_WT);
+#else
+	return mpu_set_region(region, base, size, MPU_RASR_ATTR_NORMAL_WT |
+			      MPU_RASR_ATTR_AP_PRW_URW);
+#endif
+}
+
+/**@}*/
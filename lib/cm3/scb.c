@@ -12,6 +12,7 @@
  * * fault information
  * * power management
  * * debug status information
+ * * level 1 cache maintenance, on the Cortex-M7
  *
  * @see ARMv7m Architecture Reference Manual (Chapter B3.2.1 About the SCB)
  *
@@ -88,4 +89,164 @@ void scb_set_priority_grouping(uint32_t prigroup)
 }
 #endif
 
+/* Those are defined only on ARMv7EM and above */
+#if defined(__ARM_ARCH_7EM__) || defined(__ARM_ARCH_8M_MAIN__)
+static inline void scb_barrier(void)
+{
+	__asm__ volatile("dsb\n\tisb" : : : "memory");
+}
+
+/* Apply a set/way operation to every line of the level 1 data cache.
+ * Inlined so that it runs without touching the stack, as required once the
+ * cache is disabled, see scb_disable_dcache(). */
+static inline __attribute__((always_inline))
+void scb_dcache_set_way(volatile uint32_t *op)
+{
+	uint32_t ccsidr, sets, ways, line_shift, way_shift, set, way;
+
+	SCB_CCSELR = 0;
+	__asm__ volatile("dsb" : : : "memory");
+	ccsidr = SCB_CCSIDR;
+
+	sets = ((ccsidr >> SCB_CCSIDR_NUMSETS_SHIFT) &
+		SCB_CCSIDR_NUMSETS_MASK) + 1;
+	ways = ((ccsidr >> SCB_CCSIDR_ASSOCIATIVITY_SHIFT) &
+		SCB_CCSIDR_ASSOCIATIVITY_MASK) + 1;
+	line_shift = ((ccsidr >> SCB_CCSIDR_LINESIZE_SHIFT) &
+		      SCB_CCSIDR_LINESIZE_MASK) + 4;
+	way_shift = ways > 1 ? __builtin_clz(ways - 1) : 0;
+
+	for (set = 0; set < sets; set++) {
+		for (way = 0; way < ways; way++) {
+			*op = (way << way_shift) | (set << line_shift);
+		}
+	}
+	scb_barrier();
+}
+
+/* Apply an address operation to every data cache line holding part of
+ * [addr, addr + len) */
+static void scb_dcache_range(volatile uint32_t *op, uint32_t addr, size_t len)
+{
+	uint32_t line = 4U << ((SCB_CTR >> SCB_CTR_DMINLINE_SHIFT) &
+			       SCB_CTR_DMINLINE_MASK);
+	uint32_t end = addr + len;
+
+	if (!len) {
+		return;
+	}
+	__asm__ volatile("dsb" : : : "memory");
+	for (addr &= ~(line - 1); addr < end; addr += line) {
+		*op = addr;
+	}
+	scb_barrier();
+}
+
+void scb_enable_icache(void)
+{
+	if (SCB_CCR & SCB_CCR_IC) {
+		return;
+	}
+	scb_barrier();
+	SCB_ICIALLU = 0;
+	scb_barrier();
+	SCB_CCR |= SCB_CCR_IC;
+	scb_barrier();
+}
+
+void scb_disable_icache(void)
+{
+	scb_barrier();
+	SCB_CCR &= ~SCB_CCR_IC;
+	SCB_ICIALLU = 0;
+	scb_barrier();
+}
+
+void scb_invalidate_icache(void)
+{
+	scb_barrier();
+	SCB_ICIALLU = 0;
+	scb_barrier();
+}
+
+/* The cache holds garbage out of reset: it is invalidated before use. */
+void scb_enable_dcache(void)
+{
+	if (SCB_CCR & SCB_CCR_DC) {
+		return;
+	}
+	scb_dcache_set_way(&SCB_DCISW);
+	SCB_CCR |= SCB_CCR_DC;
+	scb_barrier();
+}
+
+/* Dirty lines are written back once the cache no longer allocates. Nothing
+ * may be written to memory in between, a later write back of a stale line
+ * would overwrite it: the loop is inlined and keeps to registers. */
+void scb_disable_dcache(void)
+{
+	SCB_CCR &= ~SCB_CCR_DC;
+	scb_barrier();
+	scb_dcache_set_way(&SCB_DCCISW);
+}
+
+void scb_invalidate_dcache(void)
+{
+	scb_dcache_set_way(&SCB_DCISW);
+}
+
+void scb_clean_dcache(void)
+{
+	scb_dcache_set_way(&SCB_DCCSW);
+}
+
+void scb_clean_invalidate_dcache(void)
+{
+	scb_dcache_set_way(&SCB_DCCISW);
+}
+
+void scb_invalidate_dcache_range(void *addr, size_t len)
+{
+	scb_dcache_range(&SCB_DCIMVAC, (uint32_t)addr, len);
+}
+
+void scb_clean_dcache_range(const void *addr, size_t len)
+{
+	scb_dcache_range(&SCB_DCCMVAC, (uint32_t)addr, len);
+}
+
+void scb_clean_invalidate_dcache_range(void *addr, size_t len)
+{
+	scb_dcache_range(&SCB_DCCIMVAC, (uint32_t)addr, len);
+}
+
+/* Before a DMA reads buf: write back what the CPU wrote. */
+void scb_dma_prepare_tx(const void *buf, size_t len)
+{
+	if (SCB_CCR & SCB_CCR_DC) {
+		scb_clean_dcache_range(buf, len);
+	}
+}
+
+/* Before a DMA writes buf: write back and drop the lines, so no eviction
+ * lands on the DMA data. Lines shared with other data are written back
+ * rather than lost. */
+void scb_dma_prepare_rx(void *buf, size_t len)
+{
+	if (SCB_CCR & SCB_CCR_DC) {
+		scb_clean_invalidate_dcache_range(buf, len);
+	}
+}
+
+/* After a DMA wrote buf: drop the lines fetched meanwhile, by speculative
+ * reads. buf should cover whole cache lines, see SCB_DCACHE_LINE_SIZE, as
+ * CPU writes to the rest of a shared line are lost. */
+void scb_dma_complete_rx(void *buf, size_t len)
+{
+	if (SCB_CCR & SCB_CCR_DC) {
+		scb_invalidate_dcache_range(buf, len);
+	}
+}
+#endif
+
 /**@}*/
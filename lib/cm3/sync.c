@@ -17,16 +17,19 @@
  * along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <string.h>
+#include <libopencm3/cm3/cortex.h>
 #include <libopencm3/cm3/sync.h>
 
 /* DMB is supported on CM0 */
 void __dmb()
 {
-	__asm__ volatile ("dmb");
+	__asm__ volatile ("dmb" : : : "memory");
 }
 
-/* Those are defined only on CM3 or CM4 */
-#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+/* Those are defined only on CM3, CM4, CM7 and CM33 */
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__) || \
+	defined(__ARM_ARCH_8M_MAIN__)
 
 uint32_t __ldrex(volatile uint32_t *addr)
 {
@@ -76,4 +79,204 @@ void mutex_unlock(mutex_t *m)
 	*m = MUTEX_UNLOCKED;
 }
 
+/* returns true if *addr held expected and has been replaced by desired */
+static bool sync_cas(volatile uint32_t *addr, uint32_t expected,
+		     uint32_t desired)
+{
+	do {
+		/* An open exclusive monitor is harmless, it is cleared on
+		 * every exception entry and exit. */
+		if (__ldrex(addr) != expected) {
+			return false;
+		}
+	} while (__strex(desired, addr) != 0);
+
+	return true;
+}
+
+#else
+
+/* No exclusive access on ARMv6-M, make the compare and swap atomic by
+ * masking interrupts for its duration instead. */
+static bool sync_cas(volatile uint32_t *addr, uint32_t expected,
+		     uint32_t desired)
+{
+	uint32_t primask = cm_mask_interrupts(1);
+	bool ret = false;
+
+	if (*addr == expected) {
+		*addr = desired;
+		ret = true;
+	}
+
+	cm_mask_interrupts(primask);
+	return ret;
+}
+
 #endif
+
+/* --- Single producer, single consumer queue ------------------------------ */
+
+void spsc_init(spsc_queue_t *q, void *buf, uint32_t count, uint32_t rec_size)
+{
+	q->buf = buf;
+	q->count = count;
+	q->rec_size = rec_size;
+	q->head = 0;
+	q->tail = 0;
+}
+
+/* returns the number of records in the queue */
+uint32_t spsc_used(const spsc_queue_t *q)
+{
+	return q->head - q->tail;
+}
+
+/* returns the number of records written, at most n */
+uint32_t spsc_write(spsc_queue_t *q, const void *data, uint32_t n)
+{
+	uint32_t head = q->head;
+	uint32_t idx = head & (q->count - 1);
+	uint32_t free = q->count - (head - q->tail);
+	uint32_t first;
+
+	if (n > free) {
+		n = free;
+	}
+
+	/* Copy in at most two runs, up to the end of the buffer and from
+	 * its start. */
+	first = q->count - idx;
+	if (first > n) {
+		first = n;
+	}
+	memcpy(&q->buf[idx * q->rec_size], data, first * q->rec_size);
+	memcpy(q->buf, (const uint8_t *)data + first * q->rec_size,
+	       (n - first) * q->rec_size);
+
+	/* Records must be in memory before the consumer can see them */
+	__dmb();
+	q->head = head + n;
+
+	return n;
+}
+
+/* returns the number of records read, at most n */
+uint32_t spsc_read(spsc_queue_t *q, void *data, uint32_t n)
+{
+	uint32_t tail = q->tail;
+	uint32_t idx = tail & (q->count - 1);
+	uint32_t used = q->head - tail;
+	uint32_t first;
+
+	if (n > used) {
+		n = used;
+	}
+
+	/* Don't read records ahead of the head update */
+	__dmb();
+
+	first = q->count - idx;
+	if (first > n) {
+		first = n;
+	}
+	memcpy(data, &q->buf[idx * q->rec_size], first * q->rec_size);
+	memcpy((uint8_t *)data + first * q->rec_size, q->buf,
+	       (n - first) * q->rec_size);
+
+	/* Finish reading before the producer may overwrite the records */
+	__dmb();
+	q->tail = tail + n;
+
+	return n;
+}
+
+/* returns true if the record has been queued */
+bool spsc_push(spsc_queue_t *q, const void *rec)
+{
+	return spsc_write(q, rec, 1) == 1;
+}
+
+/* returns true if a record has been dequeued */
+bool spsc_pop(spsc_queue_t *q, void *rec)
+{
+	return spsc_read(q, rec, 1) == 1;
+}
+
+/* --- Multiple producer, single consumer queue ---------------------------- */
+
+static volatile uint32_t *mpsc_slot(mpsc_queue_t *q, uint32_t pos)
+{
+	uint32_t idx = pos & (q->count - 1);
+
+	return (volatile uint32_t *)
+		&q->buf[idx * MPSC_QUEUE_SLOT_SIZE(q->rec_size)];
+}
+
+/* buf must hold count * MPSC_QUEUE_SLOT_SIZE(rec_size) bytes, 4 aligned */
+void mpsc_init(mpsc_queue_t *q, void *buf, uint32_t count, uint32_t rec_size)
+{
+	uint32_t i;
+
+	q->buf = buf;
+	q->count = count;
+	q->rec_size = rec_size;
+	q->head = 0;
+	q->tail = 0;
+
+	/* A slot is free for position pos when its sequence equals pos, and
+	 * holds a record for the consumer when it equals pos + 1. */
+	for (i = 0; i < count; i++) {
+		*mpsc_slot(q, i) = i;
+	}
+}
+
+/* returns true if the record has been queued */
+bool mpsc_push(mpsc_queue_t *q, const void *rec)
+{
+	volatile uint32_t *seq;
+	uint32_t pos;
+	int32_t diff;
+
+	for (;;) {
+		pos = q->head;
+		seq = mpsc_slot(q, pos);
+		diff = (int32_t)(*seq - pos);
+
+		if (diff < 0) {
+			/* The consumer hasn't freed this slot yet: full */
+			return false;
+		}
+		if ((diff == 0) && sync_cas(&q->head, pos, pos + 1)) {
+			break;
+		}
+		/* Another producer got there first, retry. */
+	}
+
+	memcpy((void *)(seq + 1), rec, q->rec_size);
+	__dmb();
+	*seq = pos + 1;
+
+	return true;
+}
+
+/* returns true if a record has been dequeued */
+bool mpsc_pop(mpsc_queue_t *q, void *rec)
+{
+	uint32_t pos = q->tail;
+	volatile uint32_t *seq = mpsc_slot(q, pos);
+
+	if (*seq != pos + 1) {
+		return false;
+	}
+
+	__dmb();
+	memcpy(rec, (const void *)(seq + 1), q->rec_size);
+	__dmb();
+
+	/* Free the slot for the producer one lap ahead */
+	*seq = pos + q->count;
+	q->tail = pos + 1;
+
+	return true;
+}
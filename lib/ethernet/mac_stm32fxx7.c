@@ -37,11 +37,90 @@
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/cm3/nvic.h>
 
+#if defined(STM32F7)
+#define ETH_DCACHE
+#include <libopencm3/cm3/scb.h>
+#endif
+
 /**@{*/
 
 uint32_t TxBD;
 uint32_t RxBD;
 
+/* Ring geometry, and the state of buffers handed out by the zero-copy API */
+static uint32_t TxDescCount, TxBufSize, TxBorrowed, TxBorrowBD;
+static uint32_t RxDescCount, RxBufSize, RxLeased, RxLeaseBD;
+
+/* Receive interrupt masked by eth_rx_irq_defer() until the ring is drained */
+static volatile bool RxDeferred;
+
+static struct eth_stats EthStats;
+
+/* Only the first four words of a descriptor are used by the driver */
+#define ETH_DES_USED_SIZE	ETH_DES_STD_SIZE
+
+/*---------------------------------------------------------------------------*/
+/** @brief Write what the CPU wrote to descriptors or buffers back to memory
+ *
+ * With the data cache on, this has to be done before the DMA may read them.
+ */
+static void eth_dcache_clean(uint32_t addr, uint32_t len)
+{
+#if defined(ETH_DCACHE)
+	scb_dma_prepare_tx((const void *)addr, len);
+#else
+	(void)addr;
+	(void)len;
+#endif
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Drop cached copies of descriptors or buffers the DMA may write
+ *
+ * Anything the CPU wrote is written back first, so this is safe on lines
+ * shared between a descriptor and its buffer. Used before a buffer is handed
+ * to the DMA, not after it has been filled: a dirty line would be written
+ * over the received data.
+ */
+static void eth_dcache_refresh(uint32_t addr, uint32_t len)
+{
+#if defined(ETH_DCACHE)
+	scb_dma_prepare_rx((void *)addr, len);
+#else
+	(void)addr;
+	(void)len;
+#endif
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Drop cached copies of a buffer the DMA has filled
+ *
+ * The CPU must not have written to it since it was handed to the DMA, see
+ * @ref eth_rx_give.
+ */
+static void eth_dcache_invalidate(uint32_t addr, uint32_t len)
+{
+#if defined(ETH_DCACHE)
+	scb_dma_complete_rx((void *)addr, len);
+#else
+	(void)addr;
+	(void)len;
+#endif
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Hand a receive descriptor and its buffer back to the DMA
+ *
+ * Whatever the CPU wrote to the buffer, eg. when working on a leased frame in
+ * place, is written back first so that no eviction lands on the next frame.
+ */
+static void eth_rx_give(uint32_t bd)
+{
+	eth_dcache_refresh(ETH_DES2(bd), RxBufSize);
+	ETH_DES0(bd) = ETH_RDES0_OWN;
+	eth_dcache_clean(bd, ETH_DES_USED_SIZE);
+}
+
 /*---------------------------------------------------------------------------*/
 /** @brief Set MAC to the PHY
  *
@@ -69,6 +148,11 @@ void eth_set_mac(const uint8_t *mac)
  *
  * Note, the space passed via buf pointer must be large enough to
  * hold all the buffers and one descriptor per buffer.
+ *
+ * With the data cache on (STM32F7), the driver keeps the descriptors and
+ * buffers coherent. buf must then be aligned to a cache line
+ * (SCB_DCACHE_LINE_SIZE), and the size of a descriptor plus its buffer a
+ * multiple of it, so that no line is shared with other data.
  */
 void eth_desc_init(uint8_t *buf, uint32_t nTx, uint32_t nRx, uint32_t cTx,
 		    uint32_t cRx, bool isext)
@@ -78,6 +162,14 @@ void eth_desc_init(uint8_t *buf, uint32_t nTx, uint32_t nRx, uint32_t cTx,
 
 	memset(buf, 0, nTx * (cTx + sz) + nRx * (cRx + sz));
 
+	TxDescCount = nTx;
+	TxBufSize = cTx;
+	TxBorrowed = 0;
+	RxDescCount = nRx;
+	RxBufSize = cRx;
+	RxLeased = 0;
+	RxDeferred = false;
+
 	/* enable / disable extended frames */
 	if (isext) {
 		ETH_DMABMR |= ETH_DMABMR_EDFE;
@@ -112,6 +204,8 @@ void eth_desc_init(uint8_t *buf, uint32_t nTx, uint32_t nRx, uint32_t cTx,
 	ETH_DES2(bd) = bd + sz;
 	ETH_DES3(bd) = RxBD;
 
+	eth_dcache_refresh((uint32_t)buf, bd + sz + cRx - (uint32_t)buf);
+
 	ETH_DMARDLAR = (uint32_t) RxBD;
 	ETH_DMATDLAR = (uint32_t) TxBD;
 }
@@ -125,16 +219,22 @@ void eth_desc_init(uint8_t *buf, uint32_t nTx, uint32_t nRx, uint32_t cTx,
  */
 bool eth_tx(uint8_t *ppkt, uint32_t n)
 {
+	eth_dcache_refresh(TxBD, ETH_DES_USED_SIZE);
 	if (ETH_DES0(TxBD) & ETH_TDES0_OWN) {
 		return false;
 	}
 
 	memcpy((void *)ETH_DES2(TxBD), ppkt, n);
+	eth_dcache_clean(ETH_DES2(TxBD), n);
 
 	ETH_DES1(TxBD) = n & ETH_TDES1_TBS1;
 	ETH_DES0(TxBD) |= ETH_TDES0_LS | ETH_TDES0_FS | ETH_TDES0_OWN;
+	eth_dcache_clean(TxBD, ETH_DES_USED_SIZE);
 	TxBD = ETH_DES3(TxBD);
 
+	EthStats.tx_frames++;
+	EthStats.tx_bytes += n;
+
 	if (ETH_DMASR & ETH_DMASR_TBUS) {
 		ETH_DMASR = ETH_DMASR_TBUS;
 		ETH_DMATPDR = 0;
@@ -143,6 +243,40 @@ bool eth_tx(uint8_t *ppkt, uint32_t n)
 	return true;
 }
 
+/*---------------------------------------------------------------------------*/
+/** @brief Restart a receive DMA suspended for lack of descriptors
+ */
+static void eth_rx_resume(void)
+{
+	if (ETH_DMASR & ETH_DMASR_RBUS) {
+		ETH_DMASR = ETH_DMASR_RBUS;
+		ETH_DMARPDR = 0;
+		EthStats.rx_stalls++;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Fold the clear-on-read missed frame counters into the statistics
+ */
+static void eth_rx_count_missed(void)
+{
+	uint32_t reg32 = ETH_DMAMFBOCR;
+
+	EthStats.rx_missed += (reg32 & ETH_DMAMFBOCR_MFC) >>
+			      ETH_DMAMFBOCR_MFC_SHIFT;
+	if (reg32 & ETH_DMAMFBOCR_OMFC) {
+		EthStats.rx_missed += (ETH_DMAMFBOCR_MFC >>
+				       ETH_DMAMFBOCR_MFC_SHIFT) + 1;
+	}
+
+	EthStats.rx_overruns += (reg32 & ETH_DMAMFBOCR_MFA) >>
+				ETH_DMAMFBOCR_MFA_SHIFT;
+	if (reg32 & ETH_DMAMFBOCR_OFOC) {
+		EthStats.rx_overruns += (ETH_DMAMFBOCR_MFA >>
+					 ETH_DMAMFBOCR_MFA_SHIFT) + 1;
+	}
+}
+
 /*---------------------------------------------------------------------------*/
 /** @brief Receive packet
  *
@@ -158,6 +292,7 @@ bool eth_rx(uint8_t *ppkt, uint32_t *len, uint32_t maxlen)
 	bool overrun = false;
 	uint32_t l = 0;
 
+	eth_dcache_refresh(RxBD, ETH_DES_USED_SIZE);
 	while (!(ETH_DES0(RxBD) & ETH_RDES0_OWN) && !ls) {
 		l = (ETH_DES0(RxBD) & ETH_RDES0_FL) >> ETH_RDES0_FL_SHIFT;
 
@@ -167,24 +302,371 @@ bool eth_rx(uint8_t *ppkt, uint32_t *len, uint32_t maxlen)
 		overrun |= fs && (maxlen < l);
 
 		if (fs && !overrun) {
+			eth_dcache_invalidate(ETH_DES2(RxBD), RxBufSize);
 			memcpy(ppkt, (void *)ETH_DES2(RxBD), l);
 			ppkt += l;
 			*len += l;
 			maxlen -= l;
 		}
 
-		ETH_DES0(RxBD) = ETH_RDES0_OWN;
+		eth_rx_give(RxBD);
 		RxBD = ETH_DES3(RxBD);
+		eth_dcache_refresh(RxBD, ETH_DES_USED_SIZE);
 	}
 
-	if (ETH_DMASR & ETH_DMASR_RBUS) {
-		ETH_DMASR = ETH_DMASR_RBUS;
-		ETH_DMARPDR = 0;
+	eth_rx_resume();
+
+	if (fs && ls) {
+		if (overrun) {
+			EthStats.rx_dropped++;
+		} else {
+			EthStats.rx_frames++;
+			EthStats.rx_bytes += l;
+		}
 	}
 
 	return fs && ls && !overrun;
 }
 
+/*---------------------------------------------------------------------------*/
+/** @brief Borrow the next transmit buffer from the descriptor ring
+ *
+ * The frame is written in place into one or more borrowed buffers and handed
+ * to the DMA with @ref eth_tx_submit. A frame larger than one buffer
+ * continues at the start of the next borrowed buffer.
+ *
+ * @param[out] size uint32_t* Size of the returned buffer, may be NULL
+ * @returns uint8_t* Pointer to the buffer, NULL if the ring is full
+ */
+uint8_t *eth_tx_borrow(uint32_t *size)
+{
+	uint32_t bd;
+
+	if (TxBorrowed == 0) {
+		TxBorrowBD = TxBD;
+	}
+
+	bd = TxBorrowBD;
+	eth_dcache_refresh(bd, ETH_DES_USED_SIZE);
+	if ((TxBorrowed == TxDescCount) || (ETH_DES0(bd) & ETH_TDES0_OWN)) {
+		return NULL;
+	}
+
+	TxBorrowed++;
+	TxBorrowBD = ETH_DES3(bd);
+
+	if (size) {
+		*size = TxBufSize;
+	}
+	return (uint8_t *)ETH_DES2(bd);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Transmit a frame from borrowed buffers
+ *
+ * The frame occupies as many of the oldest borrowed buffers as its size
+ * needs, any remaining borrowed buffers stay borrowed for the next frame.
+ *
+ * @param[in] n uint32_t Size of the frame
+ * @returns bool true, if success; false if not enough buffers are borrowed
+ */
+bool eth_tx_submit(uint32_t n)
+{
+	uint32_t first = TxBD;
+	uint32_t bd = TxBD;
+	uint32_t cnt = (n + TxBufSize - 1) / TxBufSize;
+	uint32_t i, len, reg32;
+
+	if ((n == 0) || (cnt > TxBorrowed)) {
+		return false;
+	}
+
+	EthStats.tx_frames++;
+	EthStats.tx_bytes += n;
+
+	for (i = 0; i < cnt; i++) {
+		len = (n < TxBufSize) ? n : TxBufSize;
+		/* The data has to be in memory before the DMA owns it */
+		eth_dcache_clean(ETH_DES2(bd), len);
+		ETH_DES1(bd) = len & ETH_TDES1_TBS1;
+		n -= len;
+
+		reg32 = ETH_DES0(bd) & (ETH_TDES0_TCH | ETH_TDES0_CIC);
+		if (i == 0) {
+			reg32 |= ETH_TDES0_FS;
+		} else {
+			reg32 |= ETH_TDES0_OWN;
+		}
+		if (i == cnt - 1) {
+			reg32 |= ETH_TDES0_LS;
+		}
+		ETH_DES0(bd) = reg32;
+		eth_dcache_clean(bd, ETH_DES_USED_SIZE);
+		bd = ETH_DES3(bd);
+	}
+
+	/* Hand over the first descriptor last, so the DMA never sees a
+	 * partial frame. */
+	ETH_DES0(first) |= ETH_TDES0_OWN;
+	eth_dcache_clean(first, ETH_DES_USED_SIZE);
+	TxBD = bd;
+	TxBorrowed -= cnt;
+
+	if (ETH_DMASR & ETH_DMASR_TBUS) {
+		ETH_DMASR = ETH_DMASR_TBUS;
+		ETH_DMATPDR = 0;
+	}
+
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Give unleased descriptors at the head of the ring back to the DMA
+ *
+ * Only done with nothing leased, as leases are returned in ring order.
+ */
+static void eth_rx_discard(uint32_t n)
+{
+	while (n--) {
+		eth_rx_give(RxBD);
+		RxBD = ETH_DES3(RxBD);
+	}
+	RxLeaseBD = RxBD;
+	EthStats.rx_dropped++;
+	eth_rx_resume();
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Lease the next received frame from the descriptor ring
+ *
+ * The frame stays in the DMA buffers, which are not reused until the lease is
+ * returned with @ref eth_rx_release. Several frames may be leased at once;
+ * leases must be returned in the order they were taken. Do not mix with
+ * @ref eth_rx while frames are leased.
+ *
+ * Descriptors which do not start a frame, and frames too long for the ring,
+ * are given back to the DMA and counted as dropped once nothing is leased.
+ *
+ * @param[out] frame struct eth_rx_frame* Leased frame
+ * @returns bool true, if a complete frame has been leased
+ */
+bool eth_rx_lease(struct eth_rx_frame *frame)
+{
+	uint32_t bd;
+	uint32_t n;
+
+	if (RxLeased == 0) {
+		RxLeaseBD = RxBD;
+	}
+
+	for (;;) {
+		bd = RxLeaseBD;
+		if (RxLeased == RxDescCount) {
+			return false;
+		}
+		eth_dcache_refresh(bd, ETH_DES_USED_SIZE);
+		if (ETH_DES0(bd) & ETH_RDES0_OWN) {
+			return false;
+		}
+
+		/* The rest of a frame whose start was lost */
+		if (!(ETH_DES0(bd) & ETH_RDES0_FS)) {
+			if (RxLeased != 0) {
+				return false;
+			}
+			eth_rx_discard(1);
+			continue;
+		}
+
+		for (n = 1; !(ETH_DES0(bd) & ETH_RDES0_LS); n++) {
+			if (RxLeased + n == RxDescCount) {
+				break;
+			}
+			bd = ETH_DES3(bd);
+			eth_dcache_refresh(bd, ETH_DES_USED_SIZE);
+			if (ETH_DES0(bd) & ETH_RDES0_OWN) {
+				return false;
+			}
+		}
+		if (ETH_DES0(bd) & ETH_RDES0_LS) {
+			break;
+		}
+
+		/* No room left for the end of the frame, with nothing leased
+		 * it fills the ring and can never complete */
+		if (RxLeased != 0) {
+			return false;
+		}
+		eth_rx_discard(n);
+	}
+
+	frame->desc = RxLeaseBD;
+	frame->ndesc = n;
+	frame->len = (ETH_DES0(bd) & ETH_RDES0_FL) >> ETH_RDES0_FL_SHIFT;
+	frame->status = ETH_DES0(bd);
+
+	RxLeased += n;
+	RxLeaseBD = ETH_DES3(bd);
+
+	/* Drop lines of the buffers fetched before the DMA filled them */
+	for (bd = frame->desc; n--; bd = ETH_DES3(bd)) {
+		eth_dcache_invalidate(ETH_DES2(bd), RxBufSize);
+	}
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Get one segment of a leased frame
+ *
+ * @param[in] frame struct eth_rx_frame* Leased frame
+ * @param[in] idx uint32_t Segment index, below frame->ndesc
+ * @param[out] len uint32_t* Bytes of the frame in this segment
+ * @returns uint8_t* Pointer to the segment data in the DMA buffer
+ */
+uint8_t *eth_rx_frame_data(const struct eth_rx_frame *frame, uint32_t idx,
+			   uint32_t *len)
+{
+	uint32_t bd = frame->desc;
+	uint32_t i;
+
+	for (i = 0; i < idx; i++) {
+		bd = ETH_DES3(bd);
+	}
+
+	if (idx == frame->ndesc - 1) {
+		*len = frame->len - idx * RxBufSize;
+	} else {
+		*len = RxBufSize;
+	}
+	return (uint8_t *)ETH_DES2(bd);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Give the descriptors of a leased frame back to the DMA
+ */
+static void eth_rx_return(const struct eth_rx_frame *frame)
+{
+	uint32_t bd = frame->desc;
+	uint32_t i;
+
+	for (i = 0; i < frame->ndesc; i++) {
+		eth_rx_give(bd);
+		bd = ETH_DES3(bd);
+	}
+
+	RxBD = bd;
+	RxLeased -= frame->ndesc;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Return a leased frame to the descriptor ring
+ *
+ * @param[in] frame struct eth_rx_frame* The oldest leased frame
+ */
+void eth_rx_release(const struct eth_rx_frame *frame)
+{
+	eth_rx_return(frame);
+	eth_rx_resume();
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Defer receive processing from the Ethernet interrupt
+ *
+ * Called from the interrupt handler. If a frame has been received, the
+ * receive interrupt is masked until @ref eth_rx_batch drains the ring, so a
+ * burst of frames costs one interrupt rather than one per frame.
+ *
+ * @returns bool true, if eth_rx_batch has to be scheduled
+ */
+bool eth_rx_irq_defer(void)
+{
+	if (!(ETH_DMAIER & ETH_DMAIER_RIE) || !(ETH_DMASR & ETH_DMASR_RS)) {
+		return false;
+	}
+
+	ETH_DMAIER &= ~ETH_DMAIER_RIE;
+	ETH_DMASR = ETH_DMASR_NIS;
+	RxDeferred = true;
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Receive a batch of frames
+ *
+ * Hands up to budget completed frames to the handler, in place in the DMA
+ * buffers, then returns their descriptors to the ring and restarts a
+ * suspended receive DMA once for the whole batch. Frames with the error
+ * summary bit set are counted and dropped without calling the handler. The
+ * handler may use @ref eth_rx_frame_data but must not lease or release
+ * frames itself. Returns 0 while frames are leased with @ref eth_rx_lease.
+ *
+ * If the receive interrupt was masked by @ref eth_rx_irq_defer and the ring
+ * has been drained within the budget, the interrupt is enabled again.
+ * Otherwise frames are still pending and the call has to be repeated.
+ *
+ * @param[in] handler eth_rx_handler_t Called once for each good frame
+ * @param[in] arg void* Passed to the handler
+ * @param[in] budget uint32_t Maximum number of frames to process
+ * @returns uint32_t Number of frames processed, including dropped ones
+ */
+uint32_t eth_rx_batch(eth_rx_handler_t handler, void *arg, uint32_t budget)
+{
+	struct eth_rx_frame frame;
+	uint32_t done = 0;
+
+	if (RxLeased != 0) {
+		return 0;
+	}
+
+	EthStats.rx_batches++;
+
+	/* Acknowledge first, so a frame completing after the ring has been
+	 * scanned raises the receive interrupt again. */
+	ETH_DMASR = ETH_DMASR_RS;
+
+	while ((done < budget) && eth_rx_lease(&frame)) {
+		if (frame.status & ETH_RDES0_ES) {
+			EthStats.rx_errors++;
+		} else {
+			EthStats.rx_frames++;
+			EthStats.rx_bytes += frame.len;
+			handler(&frame, arg);
+		}
+		eth_rx_return(&frame);
+		done++;
+	}
+
+	eth_rx_resume();
+	eth_rx_count_missed();
+
+	if (RxDeferred && (done < budget)) {
+		RxDeferred = false;
+		ETH_DMAIER |= ETH_DMAIER_RIE;
+	}
+
+	return done;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Read the driver statistics
+ *
+ * @param[out] stats struct eth_stats* Copy of the counters
+ */
+void eth_get_stats(struct eth_stats *stats)
+{
+	eth_rx_count_missed();
+	*stats = EthStats;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Reset the driver statistics
+ */
+void eth_clear_stats(void)
+{
+	(void)ETH_DMAMFBOCR;
+	memset(&EthStats, 0, sizeof(EthStats));
+}
+
 /*---------------------------------------------------------------------------*/
 /** @brief Start the Ethernet DMA processing
  */
@@ -280,7 +762,9 @@ void eth_enable_checksum_offload(void)
 {
 	uint32_t tab = TxBD;
 	do {
+		eth_dcache_refresh(tab, ETH_DES_USED_SIZE);
 		ETH_DES0(tab) |= ETH_TDES0_CIC_IPPLPH;
+		eth_dcache_clean(tab, ETH_DES_USED_SIZE);
 		tab = ETH_DES3(tab);
 	}
 	while (tab != TxBD);
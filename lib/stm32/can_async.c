@@ -0,0 +1,339 @@
+/** @addtogroup can_file
+
+@brief Queued CAN driver
+
+Decouples the application from the bxCAN mailboxes and FIFOs. Frames to send
+are kept in a software queue ordered by identifier, and moved into the
+transmit mailboxes from the transmit mailbox empty interrupt. When all three
+mailboxes hold frames of lower priority than the head of the queue, the lowest
+priority one is aborted and requeued, so a burst of low priority traffic
+cannot delay a high priority frame by more than the frame on the wire. Frames
+with the same identifier are sent in the order they were queued.
+
+Received frames are drained from both FIFOs by the FIFO message pending
+interrupts into a lock-free ring.
+
+The peripheral must be initialised with transmit FIFO priority (TXFP) off, so
+the mailboxes are sent by identifier. Do not mix with @ref can_transmit and
+@ref can_receive.
+
+LGPL License Terms @ref lgpl_license
+*/
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#include <string.h>
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/stm32/can_async.h>
+
+static const uint32_t can_async_mbox[3] = {CAN_MBOX0, CAN_MBOX1, CAN_MBOX2};
+
+/* Flags of mailbox n in CAN_TSR are those of mailbox 0 shifted by 8 * n */
+#define CAN_ASYNC_TSR(flag, n)	((flag) << (8 * (n)))
+
+#define CAN_ASYNC_RX_IRQS	(CAN_IER_FMPIE0 | CAN_IER_FOVIE0 | \
+				 CAN_IER_FMPIE1 | CAN_IER_FOVIE1)
+
+/*---------------------------------------------------------------------------*/
+/** @brief Insert a frame into the transmit queue.
+
+The identifier register doubles as the sort key: without TXRQ, a lower value
+wins arbitration on the bus. A new frame goes behind, an aborted frame in front
+of the queued frames with the same identifier.
+*/
+static void can_async_queue_insert(struct can_async *ca,
+				   const struct can_async_tx_entry *entry,
+				   bool oldest)
+{
+	uint32_t pos = 0;
+
+	while ((pos < ca->tx_count) &&
+	       ((ca->tx_queue[pos].tir > entry->tir) ||
+		(oldest && (ca->tx_queue[pos].tir == entry->tir)))) {
+		pos++;
+	}
+
+	memmove(&ca->tx_queue[pos + 1], &ca->tx_queue[pos],
+		(ca->tx_count - pos) * sizeof(*entry));
+	ca->tx_queue[pos] = *entry;
+	ca->tx_count++;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Move queued frames into the transmit mailboxes.
+
+Called with the transmit interrupt masked or from it.
+*/
+static void can_async_refill(struct can_async *ca)
+{
+	const struct can_async_tx_entry *head;
+	uint32_t mailbox;
+	int i, empty, lowest;
+
+	while (ca->tx_count) {
+		head = &ca->tx_queue[ca->tx_count - 1];
+		empty = -1;
+		lowest = -1;
+
+		for (i = 0; i < 3; i++) {
+			if (!(ca->mbox_busy & (1 << i))) {
+				if (empty < 0) {
+					empty = i;
+				}
+				continue;
+			}
+			/* Keep frames of one identifier in order, the
+			 * hardware sends equal identifiers by mailbox number. */
+			if (ca->mbox[i].tir == head->tir) {
+				return;
+			}
+			if ((lowest < 0) || (ca->mbox[i].tir > ca->mbox[lowest].tir)) {
+				lowest = i;
+			}
+		}
+
+		if (empty < 0) {
+			/* The aborted frame comes back through the queue, make
+			 * sure there is room for it. */
+			if ((head->tir < ca->mbox[lowest].tir) &&
+			    !(ca->mbox_abort & (1 << lowest)) &&
+			    (ca->tx_count + ca->tx_reserved < ca->tx_size)) {
+				ca->mbox_abort |= 1 << lowest;
+				ca->tx_reserved++;
+				CAN_TSR(ca->canport) =
+					CAN_ASYNC_TSR(CAN_TSR_ABRQ0, lowest);
+			}
+			return;
+		}
+
+		mailbox = can_async_mbox[empty];
+		ca->mbox[empty] = *head;
+		ca->mbox_busy |= 1 << empty;
+		ca->tx_count--;
+
+		CAN_TDTxR(ca->canport, mailbox) = head->tdtr;
+		CAN_TDLxR(ca->canport, mailbox) = head->tdlr;
+		CAN_TDHxR(ca->canport, mailbox) = head->tdhr;
+		CAN_TIxR(ca->canport, mailbox) = head->tir | CAN_TIxR_TXRQ;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Initialise a queued CAN port.
+
+The peripheral must have been set up with @ref can_init (with txfp false) and
+its filters configured.
+
+@param[in] ca Driver state
+@param[in] canport CAN block register base @ref can_reg_base
+@param[in] tx_buf Transmit queue
+@param[in] tx_count Number of entries in the transmit queue
+@param[in] rx_buf Receive ring
+@param[in] rx_count Number of messages in the receive ring, a power of two
+*/
+void can_async_init(struct can_async *ca, uint32_t canport,
+		    struct can_async_tx_entry *tx_buf, uint32_t tx_count,
+		    struct can_msg *rx_buf, uint32_t rx_count)
+{
+	ca->canport = canport;
+	ca->tx_queue = tx_buf;
+	ca->tx_size = tx_count;
+	ca->tx_count = 0;
+	ca->tx_reserved = 0;
+	ca->mbox_busy = 0;
+	ca->mbox_abort = 0;
+	spsc_init(&ca->rx, rx_buf, rx_count, sizeof(struct can_msg));
+	memset(&ca->stats, 0, sizeof(ca->stats));
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Enable the interrupts the driver needs.
+
+The transmit interrupt must be enabled in the NVIC and call
+@ref can_async_tx_isr, the FIFO 0 and FIFO 1 receive interrupts must call
+@ref can_async_rx_isr. On parts with a single CAN interrupt, call both.
+*/
+void can_async_start(struct can_async *ca)
+{
+	can_enable_irq(ca->canport, CAN_IER_TMEIE | CAN_ASYNC_RX_IRQS);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Disable all interrupts used by the driver. */
+void can_async_stop(struct can_async *ca)
+{
+	can_disable_irq(ca->canport, CAN_IER_TMEIE | CAN_ASYNC_RX_IRQS);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Transmit interrupt handler.
+
+Retires completed mailboxes, requeues aborted frames and refills the
+mailboxes from the queue.
+*/
+void can_async_tx_isr(struct can_async *ca)
+{
+	uint32_t tsr = CAN_TSR(ca->canport);
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		if (!(tsr & CAN_ASYNC_TSR(CAN_TSR_RQCP0, i))) {
+			continue;
+		}
+
+		/* Clears RQCP, TXOK, ALST and TERR of the mailbox. */
+		CAN_TSR(ca->canport) = CAN_ASYNC_TSR(CAN_TSR_RQCP0, i);
+
+		if (!(ca->mbox_busy & (1 << i))) {
+			continue;
+		}
+		ca->mbox_busy &= ~(1 << i);
+
+		if (tsr & CAN_ASYNC_TSR(CAN_TSR_TXOK0, i)) {
+			ca->stats.tx_frames++;
+		} else if (ca->mbox_abort & (1 << i)) {
+			can_async_queue_insert(ca, &ca->mbox[i], true);
+			ca->stats.tx_preempted++;
+		} else {
+			ca->stats.tx_errors++;
+		}
+
+		if (ca->mbox_abort & (1 << i)) {
+			ca->mbox_abort &= ~(1 << i);
+			ca->tx_reserved--;
+		}
+	}
+
+	can_async_refill(ca);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Receive interrupt handler.
+
+Drains both receive FIFOs into the RX ring and counts FIFO overruns.
+*/
+void can_async_rx_isr(struct can_async *ca)
+{
+	struct can_msg msg;
+	uint8_t fifo;
+
+	for (fifo = 0; fifo < 2; fifo++) {
+		volatile uint32_t *rfr = fifo ? &CAN_RF1R(ca->canport) :
+					       &CAN_RF0R(ca->canport);
+
+		if (*rfr & CAN_RF0R_FOVR0) {
+			*rfr = CAN_RF0R_FOVR0;
+			ca->stats.rx_overruns++;
+		}
+
+		while (can_fifo_pending(ca->canport, fifo)) {
+			can_receive(ca->canport, fifo, true, &msg.id, &msg.ext,
+				    &msg.rtr, &msg.fmi, &msg.length, msg.data,
+				    &msg.timestamp);
+			msg.fifo = fifo;
+
+			if (spsc_push(&ca->rx, &msg)) {
+				ca->stats.rx_frames++;
+			} else {
+				ca->stats.rx_dropped++;
+			}
+		}
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Queue a frame for transmission.
+
+@param[in] ca Driver state
+@param[in] id Message ID
+@param[in] ext Extended message ID?
+@param[in] rtr Request transmit?
+@param[in] length Message payload length
+@param[in] data Message payload data
+@returns true if the frame was queued, false if the queue is full
+*/
+bool can_async_transmit(struct can_async *ca, uint32_t id, bool ext, bool rtr,
+			uint8_t length, const uint8_t *data)
+{
+	struct can_async_tx_entry entry;
+	uint8_t payload[8] = {0};
+	uint32_t primask;
+	bool queued = false;
+
+	if (length > 8) {
+		length = 8;
+	}
+	memcpy(payload, data, length);
+
+	if (ext) {
+		entry.tir = (id << CAN_TIxR_EXID_SHIFT) | CAN_TIxR_IDE;
+	} else {
+		entry.tir = id << CAN_TIxR_STID_SHIFT;
+	}
+	if (rtr) {
+		entry.tir |= CAN_TIxR_RTR;
+	}
+	entry.tdtr = length & CAN_TDTxR_DLC_MASK;
+	entry.tdlr = (uint32_t)payload[0] | ((uint32_t)payload[1] << 8) |
+		     ((uint32_t)payload[2] << 16) | ((uint32_t)payload[3] << 24);
+	entry.tdhr = (uint32_t)payload[4] | ((uint32_t)payload[5] << 8) |
+		     ((uint32_t)payload[6] << 16) | ((uint32_t)payload[7] << 24);
+
+	primask = cm_mask_interrupts(1);
+	if (ca->tx_count + ca->tx_reserved < ca->tx_size) {
+		can_async_queue_insert(ca, &entry, false);
+		can_async_refill(ca);
+		queued = true;
+	}
+	cm_mask_interrupts(primask);
+
+	return queued;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Take a received frame from the RX ring.
+
+@returns true if a frame was returned in @p msg
+*/
+bool can_async_receive(struct can_async *ca, struct can_msg *msg)
+{
+	return spsc_pop(&ca->rx, msg);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Number of received frames waiting to be read. */
+uint32_t can_async_rx_available(struct can_async *ca)
+{
+	return spsc_used(&ca->rx);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Number of frames queued or in a mailbox, not yet sent. */
+uint32_t can_async_tx_pending(struct can_async *ca)
+{
+	uint32_t primask = cm_mask_interrupts(1);
+	uint32_t pending = ca->tx_count;
+	uint8_t busy = ca->mbox_busy;
+
+	cm_mask_interrupts(primask);
+
+	return pending + (busy & 1) + ((busy >> 1) & 1) + ((busy >> 2) & 1);
+}
+
+/**@}*/
@@ -0,0 +1,385 @@
+/** @addtogroup can_file
+
+@brief bxCAN acceptance filter planner
+
+Turns a list of identifiers and identifier ranges into filter banks. Ranges
+are split into aligned identifier/mask blocks. Single standard identifiers are
+packed four to a bank in 16 bit list mode, standard blocks two to a bank in 16
+bit mask mode, single extended identifiers two to a bank in 32 bit list mode
+and extended blocks one to a bank in 32 bit mask mode.
+
+If that needs more banks than are available, blocks of the same identifier
+type are merged, each time picking the pair whose common mask lets through the
+fewest identifiers that were not asked for, until the set fits. The report
+tells whether, and by how much, the filter had to be widened.
+
+Filters match data frames only.
+
+LGPL License Terms @ref lgpl_license
+*/
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#include <libopencm3/stm32/can.h>
+
+/* Filter register layout, 16 bit scale: STID[10:0] RTR IDE EXID[17:15] */
+#define CAN_FILTER16_STID_SHIFT	5
+#define CAN_FILTER16_RTR	(1 << 4)
+#define CAN_FILTER16_IDE	(1 << 3)
+
+/* Filter register layout, 32 bit scale: EXID[28:0] IDE RTR 0 */
+#define CAN_FILTER32_EXID_SHIFT	3
+#define CAN_FILTER32_IDE	(1 << 2)
+#define CAN_FILTER32_RTR	(1 << 1)
+
+static uint32_t can_filter_full_mask(bool ext)
+{
+	return ext ? CAN_FILTER_EXT_ID_MAX : CAN_FILTER_STD_ID_MAX;
+}
+
+static bool can_filter_is_single(const struct can_filter_mask *b)
+{
+	return b->mask == can_filter_full_mask(b->ext);
+}
+
+/* Number of identifiers a block accepts */
+static uint32_t can_filter_size(const struct can_filter_mask *b)
+{
+	uint32_t free_bits = can_filter_full_mask(b->ext) & ~b->mask;
+
+	return 1U << __builtin_popcount(free_bits);
+}
+
+/* true if every identifier accepted by inner is accepted by outer */
+static bool can_filter_contains(const struct can_filter_mask *outer,
+				const struct can_filter_mask *inner)
+{
+	return (outer->ext == inner->ext) &&
+	       ((inner->mask & outer->mask) == outer->mask) &&
+	       ((inner->id & outer->mask) == outer->id);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Banks needed for a block list.
+
+Single standard identifiers may also take spare 16 bit mask slots, @p k
+returns how many of them should.
+*/
+static uint32_t can_filter_banks(const struct can_filter_mask *blocks,
+				 uint32_t n, uint32_t *k)
+{
+	uint32_t s = 0, m = 0, e = 0, em = 0;
+	uint32_t i, best = 0xFFFFFFFF;
+
+	for (i = 0; i < n; i++) {
+		bool single = can_filter_is_single(&blocks[i]);
+
+		if (blocks[i].ext && single) {
+			e++;
+		} else if (blocks[i].ext) {
+			em++;
+		} else if (single) {
+			s++;
+		} else {
+			m++;
+		}
+	}
+
+	for (i = 0; i <= s; i++) {
+		uint32_t banks = (s - i + 3) / 4 + (m + i + 1) / 2;
+
+		if (banks < best) {
+			best = banks;
+			*k = i;
+		}
+	}
+
+	return best + (e + 1) / 2 + em;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Merge the pair of blocks that widens the filter the least. */
+static uint32_t can_filter_merge(struct can_filter_mask *blocks, uint32_t n,
+				 struct can_filter_report *report)
+{
+	struct can_filter_mask merged = {0, 0, false};
+	uint32_t best_cost = 0xFFFFFFFF;
+	uint32_t i, j, out;
+
+	for (i = 0; i < n; i++) {
+		for (j = i + 1; j < n; j++) {
+			struct can_filter_mask c;
+			uint32_t size, cost;
+
+			if (blocks[i].ext != blocks[j].ext) {
+				continue;
+			}
+			c.ext = blocks[i].ext;
+			c.mask = blocks[i].mask & blocks[j].mask &
+				 ~(blocks[i].id ^ blocks[j].id);
+			c.id = blocks[i].id & c.mask;
+
+			size = can_filter_size(&blocks[i]) +
+			       can_filter_size(&blocks[j]);
+			cost = can_filter_size(&c);
+			cost = (cost > size) ? cost - size : 0;
+
+			if (cost < best_cost) {
+				best_cost = cost;
+				merged = c;
+			}
+		}
+	}
+
+	if (best_cost == 0xFFFFFFFF) {
+		return n;
+	}
+
+	/* Drop everything the merged block now covers, then add it. */
+	for (i = 0, out = 0; i < n; i++) {
+		if (!can_filter_contains(&merged, &blocks[i])) {
+			blocks[out++] = blocks[i];
+		}
+	}
+	blocks[out++] = merged;
+
+	if (best_cost) {
+		report->widened++;
+		report->extra_ids += best_cost;
+	}
+	return out;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Add a block to the list, unless it is already covered. */
+static uint32_t can_filter_add(struct can_filter_mask *blocks, uint32_t n,
+			       const struct can_filter_mask *b)
+{
+	uint32_t i, out;
+
+	for (i = 0; i < n; i++) {
+		if (can_filter_contains(&blocks[i], b)) {
+			return n;
+		}
+	}
+
+	for (i = 0, out = 0; i < n; i++) {
+		if (!can_filter_contains(b, &blocks[i])) {
+			blocks[out++] = blocks[i];
+		}
+	}
+	blocks[out++] = *b;
+	return out;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Plan filter banks for a list of identifiers.
+
+@param[in] ids Identifiers and ranges to accept
+@param[in] count Number of entries in @p ids
+@param[out] blocks Work area receiving the planned identifier/mask blocks
+@param[in] max_blocks Size of @p blocks, at least 2. A work area smaller than
+the number of blocks the ranges split into forces the filter to be widened.
+@param[in] banks Number of filter banks available
+@param[out] report Banks needed and how much the filter had to be widened
+@returns Number of blocks to pass to @ref can_filter_apply, -1 if an entry is
+invalid or standard and extended identifiers need more than @p banks even
+fully merged.
+*/
+int can_filter_plan(const struct can_filter_id *ids, uint32_t count,
+		    struct can_filter_mask *blocks, uint32_t max_blocks,
+		    uint32_t banks, struct can_filter_report *report)
+{
+	uint32_t i, n = 0, k;
+
+	report->rules = 0;
+	report->widened = 0;
+	report->extra_ids = 0;
+
+	if (max_blocks < 2) {
+		return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		uint32_t full = can_filter_full_mask(ids[i].ext);
+		uint32_t first = ids[i].first;
+
+		if ((first > ids[i].last) || (ids[i].last > full)) {
+			return -1;
+		}
+
+		/* Split the range into the largest aligned blocks. */
+		for (;;) {
+			struct can_filter_mask b;
+			uint32_t size = 1;
+
+			while (!(first & size) && (size <= full) &&
+			       (first + (size << 1) - 1 <= ids[i].last)) {
+				size <<= 1;
+			}
+
+			b.id = first;
+			b.mask = full & ~(size - 1);
+			b.ext = ids[i].ext;
+
+			while (n == max_blocks) {
+				uint32_t merged = can_filter_merge(blocks, n,
+								   report);
+				if (merged == n) {
+					return -1;
+				}
+				n = merged;
+			}
+			n = can_filter_add(blocks, n, &b);
+
+			if (first + size - 1 >= ids[i].last) {
+				break;
+			}
+			first += size;
+		}
+	}
+
+	while (can_filter_banks(blocks, n, &k) > banks) {
+		uint32_t merged = can_filter_merge(blocks, n, report);
+
+		if (merged == n) {
+			return -1;
+		}
+		n = merged;
+	}
+
+	report->rules = can_filter_banks(blocks, n, &k);
+	return n;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Program planned filter banks.
+
+Blocks are written to consecutive banks starting at @p first_bank, all
+assigned to the same FIFO. The number of banks used is reported by
+@ref can_filter_plan.
+
+@param[in] first_bank Number of the first filter bank to use
+@param[in] blocks Blocks returned by @ref can_filter_plan
+@param[in] n Number of blocks
+@param[in] fifo FIFO the banks are assigned to
+@returns Number of banks written
+*/
+uint32_t can_filter_apply(uint32_t first_bank,
+			  const struct can_filter_mask *blocks, uint32_t n,
+			  uint32_t fifo)
+{
+	uint32_t fr[4];
+	uint32_t i, k, seen, slots = 0, nr = first_bank;
+	int pass;
+
+	can_filter_banks(blocks, n, &k);
+
+	/* Standard blocks, with k single identifiers in spare mask slots,
+	 * then standard lists, extended lists and extended blocks. */
+	for (pass = 0; pass < 4; pass++) {
+		seen = 0;
+		for (i = 0; i < n; i++) {
+			const struct can_filter_mask *b = &blocks[i];
+			bool single = can_filter_is_single(b);
+			uint32_t per_bank;
+
+			switch (pass) {
+			case 0:
+				if (b->ext || (single && (seen++ >= k))) {
+					continue;
+				}
+				fr[slots] = (b->id << CAN_FILTER16_STID_SHIFT) |
+					    (((b->mask << CAN_FILTER16_STID_SHIFT) |
+					      CAN_FILTER16_RTR |
+					      CAN_FILTER16_IDE) << 16);
+				per_bank = 2;
+				break;
+			case 1:
+				if (b->ext || !single || (seen++ < k)) {
+					continue;
+				}
+				fr[slots] = b->id << CAN_FILTER16_STID_SHIFT;
+				per_bank = 4;
+				break;
+			case 2:
+				if (!b->ext || !single) {
+					continue;
+				}
+				fr[slots] = (b->id << CAN_FILTER32_EXID_SHIFT) |
+					    CAN_FILTER32_IDE;
+				per_bank = 2;
+				break;
+			default:
+				if (!b->ext || single) {
+					continue;
+				}
+				fr[0] = (b->id << CAN_FILTER32_EXID_SHIFT) |
+					CAN_FILTER32_IDE;
+				fr[1] = (b->mask << CAN_FILTER32_EXID_SHIFT) |
+					CAN_FILTER32_IDE | CAN_FILTER32_RTR;
+				can_filter_init(nr++, true, false, fr[0], fr[1],
+						fifo, true);
+				continue;
+			}
+
+			if (++slots < per_bank) {
+				continue;
+			}
+			slots = 0;
+
+			if (pass == 0) {
+				can_filter_init(nr++, false, false, fr[0], fr[1],
+						fifo, true);
+			} else if (pass == 1) {
+				can_filter_id_list_16bit_init(nr++, fr[0], fr[1],
+							      fr[2], fr[3],
+							      fifo, true);
+			} else {
+				can_filter_init(nr++, true, true, fr[0], fr[1],
+						fifo, true);
+			}
+		}
+
+		/* Fill up a partly used bank by repeating its last entry. */
+		if (slots) {
+			while (slots < ((pass == 1) ? 4 : 2)) {
+				fr[slots] = fr[slots - 1];
+				slots++;
+			}
+			slots = 0;
+
+			if (pass == 0) {
+				can_filter_init(nr++, false, false, fr[0], fr[1],
+						fifo, true);
+			} else if (pass == 1) {
+				can_filter_id_list_16bit_init(nr++, fr[0], fr[1],
+							      fr[2], fr[3],
+							      fifo, true);
+			} else {
+				can_filter_init(nr++, true, true, fr[0], fr[1],
+						fifo, true);
+			}
+		}
+	}
+
+	return nr - first_bank;
+}
+
+/**@}*/
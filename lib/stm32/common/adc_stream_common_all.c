@@ -0,0 +1,297 @@
+/** @addtogroup adc_file ADC peripheral API
+@ingroup peripheral_apis
+
+@brief Continuous, DMA driven ADC acquisition
+
+Streams the results of the regular sequence into a caller buffer through a
+circular DMA transfer, without an interrupt per conversion. The buffer is used
+as two halves: while the DMA fills one, the callback gets the other.
+
+The ADC, its sequence and its trigger (typically a timer) are set up by the
+application with the usual register level functions, and the DMA channel is
+allocated with @ref dma_async_alloc. For multi ADC modes, select the mode with
+adc_set_multi_mode() and stream from the master ADC: the data of the ADCs is
+then read packed, two results per 32 bit unit, from the common data register.
+
+ADC overruns are counted and recovered from by restarting the stream at the
+start of the buffer and of the sequence, which keeps the channel order of the
+samples intact.
+
+LGPL License Terms @ref lgpl_license
+*/
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#include <stddef.h>
+#include <libopencm3/stm32/adc_stream.h>
+
+/* ADC flavours: the v2 IP with ADSTART, the v1 IP with and without an
+ * overrun flag. Multi ADC data comes from the common data register of the
+ * ADC pair (F3, G4) or of the whole block (F2/F4/F7), or in the case of the
+ * F1 from the master's own data register. */
+#if defined(ADC_CR_ADSTART)
+#define ADC_STREAM_V2
+#elif defined(ADC_SR_OVR)
+#define ADC_STREAM_V1_OVR
+#endif
+
+#if defined(ADC_CCR_MDMA_12_10_BIT)
+#define ADC_STREAM_MDMA_MASK	ADC_CCR_MDMA_8_6_BIT
+#define ADC_STREAM_MULTI
+#elif defined(ADC_CCR_DMA_MODE_2)
+#define ADC_STREAM_MULTI
+#elif defined(ADC_CR1_DUALMOD_MASK)
+#define ADC_STREAM_MULTI
+#endif
+
+static uint32_t adc_stream_source(const struct adc_stream *s)
+{
+	if (s->multi) {
+#if defined(ADC_CCR_MDMA_12_10_BIT)
+		return (uint32_t)&ADC_CDR(s->adc);
+#elif defined(ADC_CCR_DMA_MODE_2)
+		return (uint32_t)&ADC_CDR;
+#endif
+	}
+	return (uint32_t)&ADC_DR(s->adc);
+}
+
+static void adc_stream_enable_dma(const struct adc_stream *s)
+{
+	if (s->multi) {
+#if defined(ADC_CCR_MDMA_12_10_BIT)
+		ADC_CCR(s->adc) = (ADC_CCR(s->adc) & ~ADC_STREAM_MDMA_MASK) |
+				  ADC_CCR_MDMA_12_10_BIT | ADC_CCR_DMACFG;
+		return;
+#elif defined(ADC_CCR_DMA_MODE_2)
+		ADC_CCR = (ADC_CCR & ~ADC_CCR_DMA_MASK) | ADC_CCR_DMA_MODE_2 |
+			  ADC_CCR_DDS;
+		return;
+#endif
+	}
+
+	adc_enable_dma(s->adc);
+#if defined(ADC_STREAM_V2)
+	adc_enable_dma_circular_mode(s->adc);
+#elif defined(ADC_STREAM_V1_OVR)
+	adc_set_dma_continue(s->adc);
+#endif
+}
+
+static void adc_stream_disable_dma(const struct adc_stream *s)
+{
+	if (s->multi) {
+#if defined(ADC_CCR_MDMA_12_10_BIT)
+		ADC_CCR(s->adc) &= ~ADC_STREAM_MDMA_MASK;
+		return;
+#elif defined(ADC_CCR_DMA_MODE_2)
+		ADC_CCR &= ~ADC_CCR_DMA_MASK;
+		return;
+#endif
+	}
+	adc_disable_dma(s->adc);
+}
+
+static bool adc_stream_dma_start(struct adc_stream *s)
+{
+	const struct dma_async_xfer xfer = {
+		.dir = DMA_ASYNC_PERIPH_TO_MEM,
+		.periph = adc_stream_source(s),
+		.mem = (uint32_t)s->buf,
+		.count = s->count,
+		.width = s->multi ? DMA_ASYNC_WIDTH_32 : DMA_ASYNC_WIDTH_16,
+		.priority = 3,
+		.circular = true,
+		.half = true,
+	};
+
+	return dma_async_start(s->dma, &xfer);
+}
+
+#if defined(ADC_STREAM_V2)
+static void adc_stream_stop_conversions(uint32_t adc)
+{
+	if (ADC_CR(adc) & ADC_CR_ADSTART) {
+		ADC_CR(adc) |= ADC_CR_ADSTP;
+		while (ADC_CR(adc) & ADC_CR_ADSTP);
+	}
+}
+#endif
+
+static void adc_stream_deliver(struct adc_stream *s, uint16_t first)
+{
+	uint16_t half = s->count / 2;
+	const uint8_t *block = (const uint8_t *)s->buf +
+			       first * (s->multi ? 4 : 2);
+
+	s->stats.blocks++;
+	if (s->callback) {
+		s->callback(s, block, half, s->callback_arg);
+	}
+}
+
+static void adc_stream_dma_event(struct dma_async_chan *ch, uint32_t events,
+				 void *arg)
+{
+	struct adc_stream *s = arg;
+
+	(void)ch;
+	if (events & DMA_ASYNC_ERROR) {
+		s->stats.dma_errors++;
+		adc_stream_stop(s);
+		return;
+	}
+	/* A late interrupt may see both halves done, hand them out in order */
+	if (events & DMA_ASYNC_HALF) {
+		adc_stream_deliver(s, 0);
+	}
+	if (events & DMA_ASYNC_COMPLETE) {
+		adc_stream_deliver(s, s->count / 2);
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Initialise a streaming ADC.
+
+@param[in] s Stream state
+@param[in] adc ADC block register address base @ref adc_reg_base, the master
+ADC in multi ADC modes
+@param[in] dma DMA channel allocated for the ADC request, the stream takes
+over its callback
+@param[in] buf Sample buffer, 16 bit units or 32 bit units in multi ADC modes
+@param[in] count Number of units in @p buf, even and a multiple of the
+sequence length so every half starts with the first channel
+@param[in] multi Read the packed data of a multi ADC mode
+@returns false if @p count is not valid, or multi ADC modes are not supported
+*/
+bool adc_stream_init(struct adc_stream *s, uint32_t adc,
+		     struct dma_async_chan *dma, void *buf, uint16_t count,
+		     bool multi)
+{
+#if !defined(ADC_STREAM_MULTI)
+	if (multi) {
+		return false;
+	}
+#endif
+	if ((count < 2) || (count & 1)) {
+		return false;
+	}
+
+	s->adc = adc;
+	s->dma = dma;
+	s->buf = buf;
+	s->count = count;
+	s->multi = multi;
+	s->callback = NULL;
+	s->callback_arg = NULL;
+	s->stats.blocks = 0;
+	s->stats.overruns = 0;
+	s->stats.dma_errors = 0;
+	dma_async_set_callback(dma, adc_stream_dma_event, s);
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set the function called with every filled half buffer. */
+void adc_stream_set_callback(struct adc_stream *s,
+			     adc_stream_callback_t callback, void *arg)
+{
+	s->callback = callback;
+	s->callback_arg = arg;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Start streaming.
+
+The ADC must be powered on and its regular sequence set up. On the v2 ADC
+this also arms the conversions, which then run on the selected trigger. On
+the v1 ADC conversions start with the trigger, or with
+adc_start_conversion_regular() for a software triggered sequence.
+
+The DMA interrupt must call @ref dma_async_irq, the ADC interrupt
+@ref adc_stream_isr.
+
+@returns false if the DMA channel is busy
+*/
+bool adc_stream_start(struct adc_stream *s)
+{
+	if (!adc_stream_dma_start(s)) {
+		return false;
+	}
+	adc_stream_enable_dma(s);
+
+#if defined(ADC_STREAM_V2) || defined(ADC_STREAM_V1_OVR)
+	adc_clear_overrun_flag(s->adc);
+	adc_enable_overrun_interrupt(s->adc);
+#endif
+#if defined(ADC_STREAM_V2)
+	adc_start_conversion_regular(s->adc);
+#endif
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Stop streaming. */
+void adc_stream_stop(struct adc_stream *s)
+{
+#if defined(ADC_STREAM_V2)
+	adc_stream_stop_conversions(s->adc);
+#endif
+#if defined(ADC_STREAM_V2) || defined(ADC_STREAM_V1_OVR)
+	adc_disable_overrun_interrupt(s->adc);
+#endif
+	adc_stream_disable_dma(s);
+	dma_async_stop(s->dma);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief ADC interrupt handler.
+
+Counts overruns and restarts the stream. After an overrun the ADC no longer
+issues DMA requests, so both the DMA and the ADC are set up again.
+*/
+void adc_stream_isr(struct adc_stream *s)
+{
+#if defined(ADC_STREAM_V2) || defined(ADC_STREAM_V1_OVR)
+	if (!adc_get_overrun_flag(s->adc)) {
+		return;
+	}
+	s->stats.overruns++;
+
+#if defined(ADC_STREAM_V2)
+	adc_stream_stop_conversions(s->adc);
+#endif
+	adc_stream_disable_dma(s);
+	dma_async_stop(s->dma);
+	adc_clear_overrun_flag(s->adc);
+	adc_stream_dma_start(s);
+	adc_stream_enable_dma(s);
+#if defined(ADC_STREAM_V2)
+	adc_start_conversion_regular(s->adc);
+#else
+	if (!(ADC_CR2(s->adc) & ADC_CR2_EXTEN_MASK)) {
+		ADC_CR2(s->adc) |= ADC_CR2_SWSTART;
+	}
+#endif
+#else
+	(void)s;
+#endif
+}
+
+/**@}*/
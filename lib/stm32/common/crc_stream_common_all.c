@@ -0,0 +1,385 @@
+/** @addtogroup crc_file CRC peripheral API
+@ingroup peripheral_apis
+
+@brief Incremental CRC over byte streams
+
+Computes a CRC over data given in pieces of any length and alignment, with
+the usual parametrised algorithms (polynomial, width, reflection, initial
+value and final XOR) rather than the raw 32 bit word interface of
+crc_calculate_block().
+
+On the v2 unit (programmable polynomial) every algorithm of 7 to 32 bits
+runs in hardware, words are written whole and the ends of a piece with 8
+and 16 bit accesses. Large pieces can be fed by a memory to register DMA
+transfer, allocated by the application with @ref dma_async_alloc on a
+controller capable of memory to memory transfers.
+
+The v1 unit only knows CRC-32 over whole words: algorithms on its polynomial
+and initial value are supported, with the reflections and the bytes of an
+incomplete last word done in software. It has no DMA feed.
+
+The CRC unit holds one computation at a time.
+
+LGPL License Terms @ref lgpl_license
+*/
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#include <string.h>
+#include <libopencm3/stm32/crc_stream.h>
+
+/* CRC flavours: the v2 IP with a programmable polynomial and 8/16 bit data
+ * accesses, and the fixed CRC-32 v1 IP. */
+#if defined(CRC_POL)
+#define CRC_STREAM_V2
+#endif
+
+/* Largest piece handed to the DMA at once, in bytes: the GPDMA counts
+ * bytes on 16 bits. */
+#define CRC_STREAM_DMA_CHUNK	0xFFFCU
+
+const struct crc_config crc_config_crc32 = {
+	.poly = 0x04C11DB7,
+	.width = 32,
+	.reflect_in = true,
+	.reflect_out = true,
+	.init = 0xFFFFFFFF,
+	.xor_out = 0xFFFFFFFF,
+};
+
+const struct crc_config crc_config_crc16_ccitt = {
+	.poly = 0x1021,
+	.width = 16,
+	.init = 0xFFFF,
+};
+
+const struct crc_config crc_config_crc8 = {
+	.poly = 0x07,
+	.width = 8,
+};
+
+#if defined(CRC_STREAM_V2)
+
+static void crc_stream_feed(struct crc_stream *s, const uint8_t *p,
+			    size_t len)
+{
+	s->stats.bytes += len;
+	while (((uint32_t)p & 3) && len) {
+		CRC_DR8 = *p++;
+		len--;
+	}
+	/* The unit takes the most significant byte of a word first */
+	for (; len >= 4; p += 4, len -= 4) {
+		CRC_DR = __builtin_bswap32(*(const uint32_t *)p);
+	}
+	if (len >= 2) {
+		CRC_DR16 = (p[0] << 8) | p[1];
+		p += 2;
+		len -= 2;
+	}
+	if (len) {
+		CRC_DR8 = *p;
+	}
+}
+
+static void crc_stream_set_rev_in(const struct crc_stream *s, bool words)
+{
+	uint32_t rev = CRC_CR_REV_IN_NONE;
+
+	if (s->cfg->reflect_in) {
+		rev = words ? CRC_CR_REV_IN_WORD : CRC_CR_REV_IN_BYTE;
+	}
+	CRC_CR = (CRC_CR & ~CRC_CR_REV_IN) | rev;
+}
+
+static void crc_stream_dma_next(struct crc_stream *s);
+
+static void crc_stream_dma_event(struct dma_async_chan *ch, uint32_t events,
+				 void *arg)
+{
+	struct crc_stream *s = arg;
+
+	(void)ch;
+	if (events & DMA_ASYNC_ERROR) {
+		s->stats.dma_errors++;
+		crc_stream_set_rev_in(s, false);
+		s->busy = false;
+		if (s->callback) {
+			s->callback(s, false, s->callback_arg);
+		}
+		return;
+	}
+	if (events & DMA_ASYNC_COMPLETE) {
+		crc_stream_dma_next(s);
+	}
+}
+
+/* Hand the next chunk to the DMA, or finish the update from the CPU.
+ * Reflected algorithms take whole words, with the unit reversing each word
+ * the way the CPU path reverses each byte of a swapped word; the others
+ * must keep the byte order of memory and take bytes. */
+static void crc_stream_dma_next(struct crc_stream *s)
+{
+	uint8_t width = s->cfg->reflect_in ? DMA_ASYNC_WIDTH_32 :
+					     DMA_ASYNC_WIDTH_8;
+	size_t n = s->dma_left >> width;
+	struct dma_async_xfer xfer = {
+		.dir = DMA_ASYNC_MEM_TO_REG,
+		.periph = (uint32_t)&CRC_DR,
+		.mem = (uint32_t)s->dma_next,
+		.width = width,
+		.priority = 1,
+	};
+
+	if (n > (CRC_STREAM_DMA_CHUNK >> width)) {
+		n = CRC_STREAM_DMA_CHUNK >> width;
+	}
+	if (!n) {
+		crc_stream_set_rev_in(s, false);
+		crc_stream_feed(s, s->dma_next, s->dma_left);
+		s->dma_left = 0;
+		s->busy = false;
+		if (s->callback) {
+			s->callback(s, true, s->callback_arg);
+		}
+		return;
+	}
+
+	xfer.count = n;
+	s->dma_next += n << width;
+	s->dma_left -= n << width;
+	s->stats.bytes += n << width;
+	crc_stream_set_rev_in(s, width == DMA_ASYNC_WIDTH_32);
+	dma_async_start(s->dma, &xfer);
+}
+
+#else
+
+static uint32_t crc_stream_rbit(uint32_t w)
+{
+	uint32_t r;
+
+	__asm__("rbit %0, %1" : "=r" (r) : "r" (w));
+	return r;
+}
+
+static void crc_stream_word(const struct crc_stream *s, const uint8_t *p)
+{
+	uint32_t w;
+
+	memcpy(&w, p, 4);
+	CRC_DR = s->cfg->reflect_in ? crc_stream_rbit(w) :
+				      __builtin_bswap32(w);
+}
+
+static void crc_stream_feed(struct crc_stream *s, const uint8_t *p,
+			    size_t len)
+{
+	s->stats.bytes += len;
+	while (s->ntail && len) {
+		s->tail[s->ntail++] = *p++;
+		len--;
+		if (s->ntail == 4) {
+			crc_stream_word(s, s->tail);
+			s->ntail = 0;
+		}
+	}
+	for (; len >= 4; p += 4, len -= 4) {
+		crc_stream_word(s, p);
+	}
+	while (len--) {
+		s->tail[s->ntail++] = *p++;
+	}
+}
+
+#endif
+
+/*---------------------------------------------------------------------------*/
+/** @brief Start a CRC computation.
+
+Sets up and resets the CRC unit, whose clock must be enabled.
+
+@param[in] s Stream state
+@param[in] cfg Algorithm, for instance @ref crc_config_crc32
+@returns false if the CRC unit cannot compute the algorithm
+*/
+bool crc_stream_init(struct crc_stream *s, const struct crc_config *cfg)
+{
+#if defined(CRC_STREAM_V2)
+	uint32_t polysize;
+
+	switch (cfg->width) {
+	case 32:
+		polysize = CRC_CR_POLYSIZE_32;
+		break;
+	case 16:
+		polysize = CRC_CR_POLYSIZE_16;
+		break;
+	case 8:
+		polysize = CRC_CR_POLYSIZE_8;
+		break;
+	case 7:
+		polysize = CRC_CR_POLYSIZE_7;
+		break;
+	default:
+		return false;
+	}
+#else
+	if ((cfg->width != 32) || (cfg->poly != 0x04C11DB7) ||
+	    (cfg->init != 0xFFFFFFFF)) {
+		return false;
+	}
+#endif
+
+	s->cfg = cfg;
+	s->ntail = 0;
+	s->dma = NULL;
+	s->dma_next = NULL;
+	s->dma_left = 0;
+	s->callback = NULL;
+	s->callback_arg = NULL;
+	s->busy = false;
+	s->stats.bytes = 0;
+	s->stats.dma_errors = 0;
+
+#if defined(CRC_STREAM_V2)
+	CRC_POL = cfg->poly;
+	CRC_INIT = cfg->init;
+	CRC_CR = polysize | (cfg->reflect_out ? CRC_CR_REV_OUT : 0);
+	crc_stream_set_rev_in(s, false);
+#endif
+	crc_reset();
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set the DMA channel of @ref crc_stream_update_dma. */
+void crc_stream_set_dma(struct crc_stream *s, struct dma_async_chan *dma)
+{
+	s->dma = dma;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set the function called when a DMA update has ended. */
+void crc_stream_set_callback(struct crc_stream *s,
+			     crc_stream_callback_t callback, void *arg)
+{
+	s->callback = callback;
+	s->callback_arg = arg;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Feed the next piece of data from the CPU.
+
+@param[in] s Stream state
+@param[in] data Data, any alignment
+@param[in] len Number of bytes
+@returns false if a DMA update is running
+*/
+bool crc_stream_update(struct crc_stream *s, const void *data, size_t len)
+{
+	if (s->busy) {
+		return false;
+	}
+	crc_stream_feed(s, data, len);
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Start feeding the next piece of data by DMA.
+
+Returns at once, the callback runs when the whole piece has been fed. Pieces
+longer than a DMA transfer are fed in several transfers. Leading and
+trailing bytes that do not make up a DMA unit are fed by the CPU.
+
+@param[in] s Stream state
+@param[in] data Data, any alignment
+@param[in] len Number of bytes
+@returns false if no DMA channel is set, a DMA update is running, or the
+CRC unit has no DMA feed
+*/
+bool crc_stream_update_dma(struct crc_stream *s, const void *data,
+			   size_t len)
+{
+#if defined(CRC_STREAM_V2)
+	const uint8_t *p = data;
+	size_t head = (4 - ((uint32_t)p & 3)) & 3;
+
+	if (!s->dma || s->busy) {
+		return false;
+	}
+
+	if (head > len) {
+		head = len;
+	}
+	crc_stream_feed(s, p, head);
+
+	s->dma_next = p + head;
+	s->dma_left = len - head;
+	s->busy = true;
+	dma_async_set_callback(s->dma, crc_stream_dma_event, s);
+	crc_stream_dma_next(s);
+	return true;
+#else
+	(void)s;
+	(void)data;
+	(void)len;
+	return false;
+#endif
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Finish the computation.
+
+@param[in] s Stream state
+@returns The CRC of all the data fed since @ref crc_stream_init
+*/
+uint32_t crc_stream_final(struct crc_stream *s)
+{
+	uint32_t crc = CRC_DR;
+
+#if defined(CRC_STREAM_V2)
+	if (s->cfg->width < 32) {
+		return (crc ^ s->cfg->xor_out) & ((1u << s->cfg->width) - 1);
+	}
+#else
+	uint8_t i, b;
+	int bit;
+
+	/* Bytes of an incomplete word, on in software from the unit */
+	for (i = 0; i < s->ntail; i++) {
+		b = s->tail[i];
+		if (s->cfg->reflect_in) {
+			b = crc_stream_rbit(b) >> 24;
+		}
+		crc ^= (uint32_t)b << 24;
+		for (bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 :
+						   crc << 1;
+		}
+	}
+	s->ntail = 0;
+	if (s->cfg->reflect_out) {
+		crc = crc_stream_rbit(crc);
+	}
+#endif
+	return crc ^ s->cfg->xor_out;
+}
+
+/**@}*/
@@ -99,7 +99,7 @@ void crypto_set_datatype(enum crypto_datatype datatype)
  */
 void crypto_set_algorithm(enum crypto_mode mode)
 {
-	mode &= ~CRYP_CR_ALGOMODE_MASK;
+	mode &= CRYP_CR_ALGOMODE_MASK | CRYP_CR_ALGODIR;
 
 	if ((mode == DECRYPT_AES_ECB) || (mode == DECRYPT_AES_CBC)) {
 		/* Unroll keys for the AES encoder for the user automatically */
@@ -172,4 +172,39 @@ uint32_t crypto_process_block(uint32_t *inp, uint32_t *outp, uint32_t length)
 	return wr;
 }
 
+#if defined(CRYP_CR_ALGOMODE3)
+/* GCM and CCM, on STM32F4 and STM32F7 only */
+
+/** @brief Set the MAC algorithm
+ */
+void crypto_set_mac_algorithm(enum crypto_mode_mac mode)
+{
+	crypto_set_algorithm((enum crypto_mode) mode);
+}
+
+/**
+ * @brief Swap context
+ *
+ * Exchanges the GCM/CCM context registers, then the GCM ones, with buf.
+ *
+ *@param[in] buf uint32_t Memory space for swap (16 items length)
+ */
+void crypto_context_swap(uint32_t *buf)
+{
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		uint32_t save = *buf;
+		*buf++ = CRYP_CSGCMCCMR(i);
+		CRYP_CSGCMCCMR(i) = save;
+	}
+
+	for (i = 0; i < 8; i++) {
+		uint32_t save = *buf;
+		*buf++ = CRYP_CSGCMR(i);
+		CRYP_CSGCMR(i) = save;
+	}
+}
+#endif
+
 /**@}*/
@@ -0,0 +1,613 @@
+/** @addtogroup crypto_file
+ *
+ * @brief Incremental, DMA capable ciphering on the CRYP processor
+ *
+ * A stream holds the key, mode and chaining state of one message, so a long
+ * message can be fed in pieces as it arrives instead of in one blocking
+ * call. Each piece is a whole number of cipher blocks: 2 words for DES and
+ * TDES, 4 words for AES.
+ *
+ * Several streams may be open at the same time. The processor holds one of
+ * them; using another saves the state of the one loaded (the IV registers,
+ * and the GCM/CCM context registers where present) into its structure and
+ * restores the other, as described for context swapping in the reference
+ * manual.
+ *
+ * Pieces are processed either by the CPU feeding the FIFOs, or by two DMA
+ * channels allocated by the application with @ref dma_async_alloc for the
+ * CRYP IN and OUT requests, whose interrupts must call @ref dma_async_irq.
+ *
+ * On parts with GCM and CCM (F42x/F43x, F7), @ref crypto_stream_header
+ * authenticates the additional data, @ref crypto_stream_update ciphers the
+ * payload and @ref crypto_stream_tag returns the tag.
+ *
+ * LGPL License Terms @ref lgpl_license
+ */
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#include <stddef.h>
+#include <libopencm3/stm32/crypto_stream.h>
+
+#if defined(CRYP_CR_ALGOMODE3)
+#define CRYPTO_STREAM_ALGO	(CRYP_CR_ALGOMODE3 | CRYP_CR_ALGOMODE)
+#else
+#define CRYPTO_STREAM_ALGO	CRYP_CR_ALGOMODE
+#endif
+
+/* The stream whose state is in the processor */
+static struct crypto_stream *crypto_stream_loaded;
+
+static bool crypto_stream_is_aes(uint32_t cr)
+{
+#if defined(CRYP_CR_ALGOMODE3)
+	if (cr & CRYP_CR_ALGOMODE3) {
+		return true;
+	}
+#endif
+	return (cr & CRYP_CR_ALGOMODE) >= CRYP_CR_ALGOMODE_AES_ECB;
+}
+
+#if defined(CRYP_CR_ALGOMODE3)
+static bool crypto_stream_is_aead(uint32_t cr)
+{
+	return cr & CRYP_CR_ALGOMODE3;
+}
+#endif
+
+/* AES ECB and CBC decryption run on a key schedule prepared from the key */
+static bool crypto_stream_needs_prep(uint32_t cr)
+{
+	uint32_t mode = cr & (CRYPTO_STREAM_ALGO | CRYP_CR_ALGODIR);
+
+	return (mode == DECRYPT_AES_ECB) || (mode == DECRYPT_AES_CBC);
+}
+
+static uint32_t crypto_stream_block_words(const struct crypto_stream *s)
+{
+	return crypto_stream_is_aes(s->cr) ? 4 : 2;
+}
+
+#if defined(CRYP_CR_ALGOMODE3)
+/* Data written to DIN is swapped according to DATATYPE, words the processor
+ * takes as numbers (GCM lengths, CCM blocks) are swapped ahead to match. */
+static uint32_t crypto_stream_swap(const struct crypto_stream *s, uint32_t w)
+{
+	uint32_t r = 0;
+	int i;
+
+	switch (s->cr & CRYP_CR_DATATYPE) {
+	case CRYP_CR_DATATYPE_16:
+		return (w << 16) | (w >> 16);
+	case CRYP_CR_DATATYPE_8:
+		return __builtin_bswap32(w);
+	case CRYP_CR_DATATYPE_BIT:
+		for (i = 0; i < 32; i++) {
+			r = (r << 1) | (w & 1);
+			w >>= 1;
+		}
+		return r;
+	default:
+		return w;
+	}
+}
+#endif
+
+static bool crypto_stream_idle(void)
+{
+	return !crypto_stream_loaded || !crypto_stream_loaded->busy;
+}
+
+static void crypto_stream_save(struct crypto_stream *s)
+{
+	int i;
+
+	crypto_wait_busy();
+	CRYP_CR &= ~CRYP_CR_CRYPEN;
+	s->cr = CRYP_CR;
+	for (i = 0; i < 4; i++) {
+		s->iv[i] = CRYP_IVW(i);
+	}
+#if defined(CRYP_CR_ALGOMODE3)
+	if (crypto_stream_is_aead(s->cr)) {
+		for (i = 0; i < 8; i++) {
+			s->gcm[i] = CRYP_CSGCMCCMR(i);
+			s->gcm[8 + i] = CRYP_CSGCMR(i);
+		}
+	}
+#endif
+}
+
+static void crypto_stream_load(struct crypto_stream *s)
+{
+	int i;
+
+	if (crypto_stream_loaded == s) {
+		return;
+	}
+	if (crypto_stream_loaded) {
+		crypto_stream_save(crypto_stream_loaded);
+		s->stats.swaps++;
+	}
+
+	CRYP_CR = s->cr;
+	for (i = 0; i < 8; i++) {
+		CRYP_KW(i) = s->key[i];
+	}
+	if (crypto_stream_needs_prep(s->cr)) {
+		CRYP_CR = (s->cr & ~CRYPTO_STREAM_ALGO) |
+			  CRYP_CR_ALGOMODE_AES_PREP | CRYP_CR_CRYPEN;
+		/* The processor disables itself when the key is ready */
+		crypto_wait_busy();
+		CRYP_CR = s->cr;
+	}
+	for (i = 0; i < 4; i++) {
+		CRYP_IVW(i) = s->iv[i];
+	}
+#if defined(CRYP_CR_ALGOMODE3)
+	if (crypto_stream_is_aead(s->cr)) {
+		for (i = 0; i < 8; i++) {
+			CRYP_CSGCMCCMR(i) = s->gcm[i];
+			CRYP_CSGCMR(i) = s->gcm[8 + i];
+		}
+	}
+#endif
+	CRYP_CR = s->cr | CRYP_CR_FFLUSH;
+	crypto_stream_loaded = s;
+}
+
+static void crypto_stream_unload(struct crypto_stream *s)
+{
+	if (crypto_stream_loaded != s) {
+		return;
+	}
+	if (s->busy) {
+		CRYP_DMACR = 0;
+		dma_async_stop(s->in_dma);
+		dma_async_stop(s->out_dma);
+		s->busy = false;
+	}
+	crypto_wait_busy();
+	CRYP_CR &= ~CRYP_CR_CRYPEN;
+	crypto_stream_loaded = NULL;
+}
+
+/* Load the stream, move a GCM/CCM stream to the given phase, and enable the
+ * processor. */
+static void crypto_stream_enter(struct crypto_stream *s, uint32_t phase)
+{
+	crypto_stream_load(s);
+#if defined(CRYP_CR_ALGOMODE3)
+	if (crypto_stream_is_aead(s->cr) &&
+	    ((CRYP_CR & CRYP_CR_GCM_CMPH) != phase)) {
+		crypto_wait_busy();
+		CRYP_CR &= ~CRYP_CR_CRYPEN;
+		CRYP_CR = (CRYP_CR & ~CRYP_CR_GCM_CMPH) | phase;
+	}
+#else
+	(void)phase;
+#endif
+	CRYP_CR |= CRYP_CR_CRYPEN;
+}
+
+static void crypto_stream_setup(struct crypto_stream *s, uint32_t mode,
+				enum crypto_keysize keysize,
+				enum crypto_datatype datatype,
+				const uint32_t *key)
+{
+	uint32_t first, words, i;
+
+	crypto_stream_unload(s);
+
+	s->cr = mode | (keysize << CRYP_CR_KEYSIZE_SHIFT) |
+		(datatype << CRYP_CR_DATATYPE_SHIFT);
+
+	/* AES keys end at K3RR, DES and TDES keys start at K1LR */
+	if (crypto_stream_is_aes(s->cr)) {
+		words = 4 + 2 * keysize;
+		first = 8 - words;
+	} else {
+		words = ((mode & CRYP_CR_ALGOMODE) <= CRYP_CR_ALGOMODE_TDES_CBC) ?
+			6 : 2;
+		first = 2;
+	}
+	for (i = 0; i < 8; i++) {
+		s->key[i] = 0;
+	}
+	for (i = 0; i < words; i++) {
+		s->key[first + i] = key[i];
+	}
+	for (i = 0; i < 4; i++) {
+		s->iv[i] = 0;
+	}
+
+	s->in_dma = NULL;
+	s->out_dma = NULL;
+	s->callback = NULL;
+	s->callback_arg = NULL;
+	s->busy = false;
+	s->stats.blocks = 0;
+	s->stats.swaps = 0;
+	s->stats.dma_errors = 0;
+}
+
+static void crypto_stream_dma_event(struct dma_async_chan *ch,
+				    uint32_t events, void *arg)
+{
+	struct crypto_stream *s = arg;
+
+	if (events & DMA_ASYNC_ERROR) {
+		s->stats.dma_errors++;
+		dma_async_stop(s->in_dma);
+		dma_async_stop(s->out_dma);
+	} else if ((ch != s->out_dma) || !(events & DMA_ASYNC_COMPLETE)) {
+		return;
+	}
+
+	CRYP_DMACR = 0;
+	s->busy = false;
+	if (s->callback) {
+		s->callback(s, s->callback_arg);
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Open a DES, TDES or AES ECB, CBC or CTR stream.
+
+The key and IV words are in the order of the key and IV registers, most
+significant word first. The stream is loaded into the processor on its first
+update.
+
+@param[in] s Stream state
+@param[in] mode Algorithm, chaining mode and direction
+@param[in] keysize AES key size, ignored for DES and TDES
+@param[in] datatype Swapping of the data words
+@param[in] key 2 (DES), 6 (TDES) or 4, 6 or 8 (AES) words
+@param[in] iv 2 (DES, TDES) or 4 (AES) words, NULL in ECB mode
+*/
+void crypto_stream_init(struct crypto_stream *s, enum crypto_mode mode,
+			enum crypto_keysize keysize,
+			enum crypto_datatype datatype, const uint32_t *key,
+			const uint32_t *iv)
+{
+	uint32_t i;
+
+	crypto_stream_setup(s, mode, keysize, datatype, key);
+	if (iv) {
+		for (i = 0; i < crypto_stream_block_words(s); i++) {
+			s->iv[i] = iv[i];
+		}
+	}
+}
+
+#if defined(CRYP_CR_ALGOMODE3)
+/* Run the init phase, in which the processor derives the hash subkey */
+static void crypto_stream_init_phase(struct crypto_stream *s,
+				     const uint32_t *b0)
+{
+	int i;
+
+	crypto_stream_enter(s, CRYP_CR_GCM_CMPH_INIT);
+	if (b0) {
+		for (i = 0; i < 4; i++) {
+			CRYP_DIN = crypto_stream_swap(s, b0[i]);
+		}
+	}
+	while (CRYP_CR & CRYP_CR_CRYPEN);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Open an AES GCM stream.
+
+The processor is taken over at once to run the GCM init phase, so this fails
+while a DMA update of any stream is running.
+
+@param[in] s Stream state
+@param[in] decrypt Decrypt rather than encrypt the payload
+@param[in] keysize AES key size
+@param[in] datatype Swapping of the data words
+@param[in] key 4, 6 or 8 words, most significant first
+@param[in] iv The 96 bit IV, most significant word first
+@returns false if a DMA update is running
+*/
+bool crypto_stream_init_gcm(struct crypto_stream *s, bool decrypt,
+			    enum crypto_keysize keysize,
+			    enum crypto_datatype datatype, const uint32_t *key,
+			    const uint32_t iv[3])
+{
+	if (!crypto_stream_idle()) {
+		return false;
+	}
+
+	crypto_stream_setup(s, decrypt ? DECRYPT_GCM : ENCRYPT_GCM, keysize,
+			    datatype, key);
+	s->iv[0] = iv[0];
+	s->iv[1] = iv[1];
+	s->iv[2] = iv[2];
+	/* Counter 1 is used for the tag, the payload starts at 2 */
+	s->iv[3] = 2;
+	crypto_stream_init_phase(s, NULL);
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Open an AES CCM stream.
+
+The counter blocks are derived from @p b0. The additional data given to
+@ref crypto_stream_header must be formatted as in NIST SP 800-38C, starting
+with its encoded length, and zero padded to a whole block. The processor is
+taken over at once, as by @ref crypto_stream_init_gcm.
+
+@param[in] s Stream state
+@param[in] decrypt Decrypt rather than encrypt the payload
+@param[in] keysize AES key size
+@param[in] datatype Swapping of the data words
+@param[in] key 4, 6 or 8 words, most significant first
+@param[in] b0 The first CCM block (flags, nonce and payload length), most
+significant word first
+@returns false if a DMA update is running
+*/
+bool crypto_stream_init_ccm(struct crypto_stream *s, bool decrypt,
+			    enum crypto_keysize keysize,
+			    enum crypto_datatype datatype, const uint32_t *key,
+			    const uint32_t b0[4])
+{
+	uint32_t q = ((b0[0] >> 24) & 0x7) + 1;
+	uint32_t i;
+
+	if (!crypto_stream_idle()) {
+		return false;
+	}
+
+	crypto_stream_setup(s, decrypt ? DECRYPT_CCM : ENCRYPT_CCM, keysize,
+			    datatype, key);
+
+	/* Counter block 0 keeps the q-1 flags bits and the nonce of B0, with
+	 * the q bytes of the payload length replaced by the counter */
+	for (i = 0; i < 4; i++) {
+		s->ctr0[i] = b0[i];
+	}
+	s->ctr0[0] &= 0x07FFFFFF;
+	for (i = 0; i < q; i++) {
+		s->ctr0[3 - i / 4] &= ~(0xFFu << ((i % 4) * 8));
+	}
+	for (i = 0; i < 4; i++) {
+		s->iv[i] = s->ctr0[i];
+	}
+	s->iv[3] |= 1;
+	crypto_stream_init_phase(s, b0);
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Authenticate additional data of a GCM or CCM stream.
+
+Must come before any payload. May be called several times.
+
+@param[in] s Stream state
+@param[in] in Additional data, the last block zero padded
+@param[in] words Number of words, a multiple of 4
+@returns false if @p words is not a whole number of blocks, or a DMA update
+is running
+*/
+bool crypto_stream_header(struct crypto_stream *s, const uint32_t *in,
+			  uint32_t words)
+{
+	uint32_t i;
+
+	if ((words % 4) || !crypto_stream_idle()) {
+		return false;
+	}
+
+	crypto_stream_enter(s, CRYP_CR_GCM_CMPH_HEADER);
+	for (i = 0; i < words; i++) {
+		while (!(CRYP_SR & CRYP_SR_IFNF));
+		CRYP_DIN = in[i];
+	}
+	while (!(CRYP_SR & CRYP_SR_IFEM));
+	crypto_wait_busy();
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Finish a GCM or CCM stream and read its tag.
+
+The payload given to the updates must have been a whole number of blocks for
+a GCM encryption: the processor would authenticate the padding of a partial
+last block as ciphertext. The stream is closed as by
+@ref crypto_stream_final.
+
+@param[in] s Stream state
+@param[in] header_bytes Length of the additional data, used by GCM
+@param[in] payload_bytes Length of the payload, used by GCM
+@param[out] tag The 128 bit tag, in the data format of the stream
+@returns false if a DMA update is running, the stream is then left open
+*/
+bool crypto_stream_tag(struct crypto_stream *s, uint64_t header_bytes,
+		       uint64_t payload_bytes, uint32_t tag[4])
+{
+	uint64_t header_bits = header_bytes * 8;
+	uint64_t payload_bits = payload_bytes * 8;
+	int i;
+
+	if (!crypto_stream_idle()) {
+		return false;
+	}
+
+	crypto_stream_enter(s, CRYP_CR_GCM_CMPH_FINAL);
+	if ((s->cr & CRYPTO_STREAM_ALGO) == (uint32_t)ENCRYPT_GCM) {
+		CRYP_DIN = crypto_stream_swap(s, header_bits >> 32);
+		CRYP_DIN = crypto_stream_swap(s, header_bits);
+		CRYP_DIN = crypto_stream_swap(s, payload_bits >> 32);
+		CRYP_DIN = crypto_stream_swap(s, payload_bits);
+	} else {
+		for (i = 0; i < 4; i++) {
+			CRYP_DIN = crypto_stream_swap(s, s->ctr0[i]);
+		}
+	}
+	for (i = 0; i < 4; i++) {
+		while (!(CRYP_SR & CRYP_SR_OFNE));
+		tag[i] = CRYP_DOUT;
+	}
+	crypto_stream_final(s);
+	return true;
+}
+#endif
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set the DMA channels of @ref crypto_stream_update_dma.
+
+The same pair of channels may be given to several streams.
+
+@param[in] s Stream state
+@param[in] in Channel for the CRYP IN request
+@param[in] out Channel for the CRYP OUT request
+*/
+void crypto_stream_set_dma(struct crypto_stream *s, struct dma_async_chan *in,
+			   struct dma_async_chan *out)
+{
+	s->in_dma = in;
+	s->out_dma = out;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set the function called when a DMA update has ended. */
+void crypto_stream_set_callback(struct crypto_stream *s,
+				crypto_stream_callback_t callback, void *arg)
+{
+	s->callback = callback;
+	s->callback_arg = arg;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Cipher the next piece of a stream, feeding the FIFOs from the CPU.
+
+@param[in] s Stream state
+@param[in] in Input data
+@param[out] out Output data, may be the same buffer as @p in
+@param[in] words Number of words, a whole number of blocks
+@returns false if @p words is not a whole number of blocks, or a DMA update
+is running
+*/
+bool crypto_stream_update(struct crypto_stream *s, const uint32_t *in,
+			  uint32_t *out, uint32_t words)
+{
+	uint32_t rd = 0, wr = 0;
+
+	if ((words % crypto_stream_block_words(s)) || !crypto_stream_idle()) {
+		return false;
+	}
+
+#if defined(CRYP_CR_ALGOMODE3)
+	crypto_stream_enter(s, CRYP_CR_GCM_CMPH_PAYLOAD);
+#else
+	crypto_stream_enter(s, 0);
+#endif
+	while (rd != words) {
+		if ((wr < words) && (CRYP_SR & CRYP_SR_IFNF)) {
+			CRYP_DIN = in[wr++];
+		}
+		if (CRYP_SR & CRYP_SR_OFNE) {
+			out[rd++] = CRYP_DOUT;
+		}
+	}
+	s->stats.blocks += words / crypto_stream_block_words(s);
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Start ciphering the next piece of a stream by DMA.
+
+Returns at once; the callback runs when the output is in @p out. Until then
+no stream can use the processor, and the buffers must stay untouched.
+
+@param[in] s Stream state
+@param[in] in Input data
+@param[out] out Output data, may be the same buffer as @p in
+@param[in] words Number of words, a whole number of blocks, at most 65535
+@returns false if @p words is not valid, no DMA channels are set or a DMA
+update is already running
+*/
+bool crypto_stream_update_dma(struct crypto_stream *s, const uint32_t *in,
+			      uint32_t *out, uint32_t words)
+{
+	const struct dma_async_xfer xin = {
+		.dir = DMA_ASYNC_MEM_TO_PERIPH,
+		.periph = (uint32_t)&CRYP_DIN,
+		.mem = (uint32_t)in,
+		.count = words,
+		.width = DMA_ASYNC_WIDTH_32,
+		.priority = 2,
+	};
+	const struct dma_async_xfer xout = {
+		.dir = DMA_ASYNC_PERIPH_TO_MEM,
+		.periph = (uint32_t)&CRYP_DOUT,
+		.mem = (uint32_t)out,
+		.count = words,
+		.width = DMA_ASYNC_WIDTH_32,
+		.priority = 2,
+	};
+
+	if (!s->in_dma || !s->out_dma || !words || (words > 0xFFFF) ||
+	    (words % crypto_stream_block_words(s)) || !crypto_stream_idle()) {
+		return false;
+	}
+
+#if defined(CRYP_CR_ALGOMODE3)
+	crypto_stream_enter(s, CRYP_CR_GCM_CMPH_PAYLOAD);
+#else
+	crypto_stream_enter(s, 0);
+#endif
+	dma_async_set_callback(s->in_dma, crypto_stream_dma_event, s);
+	dma_async_set_callback(s->out_dma, crypto_stream_dma_event, s);
+	if (!dma_async_start(s->out_dma, &xout)) {
+		return false;
+	}
+	if (!dma_async_start(s->in_dma, &xin)) {
+		dma_async_stop(s->out_dma);
+		return false;
+	}
+	s->busy = true;
+	s->stats.blocks += words / crypto_stream_block_words(s);
+	CRYP_DMACR = CRYP_DMACR_DIEN | CRYP_DMACR_DOEN;
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Close a stream.
+
+Stops a running DMA update, releases the processor and wipes the key from
+the stream and, if it was loaded, from the key registers.
+*/
+void crypto_stream_final(struct crypto_stream *s)
+{
+	int i;
+
+	if (crypto_stream_loaded == s) {
+		crypto_stream_unload(s);
+		for (i = 0; i < 8; i++) {
+			CRYP_KW(i) = 0;
+		}
+	}
+	for (i = 0; i < 8; i++) {
+		s->key[i] = 0;
+	}
+}
+
+/**@}*/
@@ -0,0 +1,677 @@
+/** @addtogroup dma_file DMA peripheral API
+@ingroup peripheral_apis
+
+@brief Asynchronous DMA transfers
+
+One API over the three DMA flavours: the channel based controller of
+F0/F1/F3/G0/G4/L0/L1/L4, the stream based controller of F2/F4/F7/H7 and the
+U5 GPDMA.
+
+A driver allocates a channel by passing the places its request can be served
+from, in order of preference. Where the request can go to any channel (DMAMUX
+on G0/G4/H7, GPDMA, memory to memory transfers) a route may leave the channel
+open. The request is routed through CSELR, CHSEL, DMAMUX or REQSEL as the part
+requires.
+
+Completion, half transfer and error events are delivered to a callback from
+@ref dma_async_irq, which the interrupt vector of every channel in use has to
+call. Enabling the interrupts in the NVIC is left to the application.
+
+On the Cortex-M7 parts (F7, H7) the data cache is kept coherent with the
+transfers: memory read by the DMA is cleaned when a transfer starts, and
+memory written is cleaned and invalidated then, and invalidated again before
+each callback. Buffers written by the DMA should be aligned on and sized in
+whole cache lines, see SCB_DCACHE_LINE_SIZE.
+
+LGPL License Terms @ref lgpl_license
+*/
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#include <stddef.h>
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/stm32/dma_async.h>
+
+#if defined(STM32F2) || defined(STM32F4) || defined(STM32F7) || \
+    defined(STM32H7)
+#define DMA_ASYNC_STREAMS
+#elif defined(STM32U5)
+#define DMA_ASYNC_GPDMA
+#endif
+
+#if defined(STM32F7) || defined(STM32H7)
+#define DMA_ASYNC_DCACHE
+#include <libopencm3/cm3/scb.h>
+#endif
+
+#if defined(STM32G0) || defined(STM32G4) || defined(STM32H7)
+#define DMA_ASYNC_DMAMUX
+#include <libopencm3/stm32/dmamux.h>
+#endif
+
+/* Controllers, channel numbering and the default number of channels, that of
+ * the smallest part of the family. */
+#if defined(DMA_ASYNC_GPDMA)
+#define DMA_ASYNC_CTRL0		GPDMA1
+#define DMA_ASYNC_CTRL1		LPDMA1
+#define DMA_ASYNC_FIRST		0
+#define DMA_ASYNC_MAX_CHANNELS	16
+#define DMA_ASYNC_DEFAULT	{16, 4}
+#elif defined(DMA_ASYNC_STREAMS)
+#define DMA_ASYNC_CTRL0		DMA1
+#define DMA_ASYNC_CTRL1		DMA2
+#define DMA_ASYNC_FIRST		0
+#define DMA_ASYNC_MAX_CHANNELS	8
+#define DMA_ASYNC_DEFAULT	{8, 8}
+#else
+#define DMA_ASYNC_CTRL0		DMA1
+#if defined(STM32L0)
+#define DMA_ASYNC_CTRL1		0
+#else
+#define DMA_ASYNC_CTRL1		DMA2
+#endif
+#define DMA_ASYNC_FIRST		1
+#define DMA_ASYNC_MAX_CHANNELS	8
+#if defined(STM32G4)
+#define DMA_ASYNC_DEFAULT	{6, 6}
+#elif defined(STM32F0) || defined(STM32G0)
+#define DMA_ASYNC_DEFAULT	{5, 0}
+#elif defined(STM32L0)
+#define DMA_ASYNC_DEFAULT	{7, 0}
+#elif defined(STM32L4)
+#define DMA_ASYNC_DEFAULT	{7, 7}
+#else
+#define DMA_ASYNC_DEFAULT	{7, 5}
+#endif
+#endif
+
+static uint8_t dma_async_channels[2] = DMA_ASYNC_DEFAULT;
+static struct dma_async_chan *dma_async_owner[2][DMA_ASYNC_MAX_CHANNELS];
+
+static int dma_async_ctrl(uint32_t dma)
+{
+	if (dma == DMA_ASYNC_CTRL0) {
+		return 0;
+	}
+	return (DMA_ASYNC_CTRL1 && (dma == DMA_ASYNC_CTRL1)) ? 1 : -1;
+}
+
+static struct dma_async_chan **dma_async_slot(uint32_t dma, uint8_t channel)
+{
+	int ctrl = dma_async_ctrl(dma);
+	int idx = channel - DMA_ASYNC_FIRST;
+
+	if ((ctrl < 0) || (idx < 0) || (idx >= dma_async_channels[ctrl])) {
+		return NULL;
+	}
+	return &dma_async_owner[ctrl][idx];
+}
+
+#if defined(DMA_ASYNC_DMAMUX)
+/* DMAMUX outputs are wired to the channels of DMA1, then those of DMA2.
+ * The DMAMUX API numbers them from 1. */
+static uint8_t dma_async_mux_channel(uint32_t dma, uint8_t channel)
+{
+	uint8_t base = (dma == DMA_ASYNC_CTRL0) ? 0 : dma_async_channels[0];
+
+	return base + channel - DMA_ASYNC_FIRST + 1;
+}
+#endif
+
+/*---------------------------------------------------------------------------*/
+/* Register level access, one set of helpers per DMA flavour */
+
+#if defined(DMA_ASYNC_GPDMA)
+
+#define DMA_ASYNC_IRQS	(DMA_TCIF | DMA_HTIF | DMA_DTEIF | DMA_ULEIF | \
+			 DMA_USEIF)
+
+static void dma_async_hw_stop(struct dma_async_chan *ch)
+{
+	dma_disable_interrupts(ch->dma, ch->channel, DMA_ASYNC_IRQS);
+	dma_disable_channel(ch->dma, ch->channel);
+	dma_clear_interrupt_flags(ch->dma, ch->channel, DMA_ISR_FLAGS);
+}
+
+static void dma_async_hw_start(struct dma_async_chan *ch,
+			       const struct dma_async_xfer *xfer)
+{
+	uint32_t dma = ch->dma;
+	uint8_t channel = ch->channel;
+	uint32_t tr1 = (xfer->width << DMA_CxTR1_SDW_SHIFT) |
+		       (xfer->width << DMA_CxTR1_DDW_SHIFT);
+	uint32_t tr2 = 0;
+	uint32_t src = xfer->periph, dst = xfer->mem;
+	uint32_t irqs = DMA_TCIF | DMA_DTEIF | DMA_ULEIF | DMA_USEIF;
+
+	switch (xfer->dir) {
+	case DMA_ASYNC_PERIPH_TO_MEM:
+		tr1 |= DMA_CxTR1_DINC;
+		break;
+	case DMA_ASYNC_MEM_TO_PERIPH:
+		tr1 |= DMA_CxTR1_SINC;
+		tr2 |= DMA_CxTR2_DREQ;
+		src = xfer->mem;
+		dst = xfer->periph;
+		break;
+	case DMA_ASYNC_MEM_TO_REG:
+		tr1 |= DMA_CxTR1_SINC;
+		tr2 |= DMA_CxTR2_SWREQ;
+		src = xfer->mem;
+		dst = xfer->periph;
+		break;
+	default:
+		tr1 |= DMA_CxTR1_SINC | DMA_CxTR1_DINC;
+		tr2 |= DMA_CxTR2_SWREQ;
+		break;
+	}
+	if ((xfer->dir < DMA_ASYNC_MEM_TO_MEM) &&
+	    (ch->request != DMA_ASYNC_REQUEST_NONE)) {
+		tr2 |= ch->request << DMA_CxTR2_REQSEL_SHIFT;
+	}
+	if (xfer->half) {
+		irqs |= DMA_HTIF;
+	}
+
+	DMA_CCR(dma, channel) = DMA_CxCR_RESET;
+	dma_clear_interrupt_flags(dma, channel, DMA_ISR_FLAGS);
+	DMA_CTR1(dma, channel) = tr1;
+	DMA_CTR2(dma, channel) = tr2;
+	DMA_CBR1(dma, channel) = (uint32_t)xfer->count << xfer->width;
+	DMA_CSAR(dma, channel) = src;
+	DMA_CDAR(dma, channel) = dst;
+	if ((dma == GPDMA1) && (channel >= DMA_CHANNEL12)) {
+		DMA_CTR3(dma, channel) = 0;
+		DMA_CBR2(dma, channel) = 0;
+	}
+
+	if (xfer->circular) {
+		/* A one item list linking to itself restores the block
+		 * size and both addresses after every block. */
+		uint32_t item = (uint32_t)ch->reload;
+
+		ch->reload[0] = DMA_CBR1(dma, channel);
+		ch->reload[1] = src;
+		ch->reload[2] = dst;
+		ch->reload[3] = DMA_CxLLR_UB1 | DMA_CxLLR_USA | DMA_CxLLR_UDA |
+				DMA_CxLLR_ULL | (item & DMA_CxLLR_LA_MASK);
+		DMA_CLBAR(dma, channel) = item & 0xffff0000U;
+		DMA_CLLR(dma, channel) = ch->reload[3];
+	} else {
+		DMA_CLLR(dma, channel) = 0;
+	}
+
+	DMA_CCR(dma, channel) = (xfer->priority << DMA_CxCR_PRIO_SHIFT) | irqs;
+	DMA_CCR(dma, channel) |= DMA_CxCR_EN;
+}
+
+static uint32_t dma_async_hw_events(struct dma_async_chan *ch)
+{
+	uint32_t flags = DMA_CSR(ch->dma, ch->channel) & DMA_ASYNC_IRQS;
+	uint32_t events = 0;
+
+	dma_clear_interrupt_flags(ch->dma, ch->channel, flags);
+	if (flags & DMA_HTIF) {
+		events |= DMA_ASYNC_HALF;
+	}
+	if (flags & DMA_TCIF) {
+		events |= DMA_ASYNC_COMPLETE;
+	}
+	if (flags & (DMA_DTEIF | DMA_ULEIF | DMA_USEIF)) {
+		events |= DMA_ASYNC_ERROR;
+	}
+	return events;
+}
+
+static uint16_t dma_async_hw_remaining(struct dma_async_chan *ch)
+{
+	return (DMA_CBR1(ch->dma, ch->channel) & DMA_CxBR1_BNDT_MASK) >>
+	       ch->width;
+}
+
+#elif defined(DMA_ASYNC_STREAMS)
+
+static void dma_async_hw_stop(struct dma_async_chan *ch)
+{
+	DMA_SCR(ch->dma, ch->channel) &= ~(DMA_SxCR_EN | DMA_SxCR_TCIE |
+					   DMA_SxCR_HTIE | DMA_SxCR_TEIE);
+	while (DMA_SCR(ch->dma, ch->channel) & DMA_SxCR_EN);
+	dma_clear_interrupt_flags(ch->dma, ch->channel, DMA_ISR_FLAGS);
+}
+
+static void dma_async_hw_start(struct dma_async_chan *ch,
+			       const struct dma_async_xfer *xfer)
+{
+	uint32_t dma = ch->dma;
+	uint8_t stream = ch->channel;
+	uint32_t cr = (xfer->width << DMA_SxCR_PSIZE_SHIFT) |
+		      (xfer->width << DMA_SxCR_MSIZE_SHIFT) |
+		      (xfer->priority << DMA_SxCR_PL_SHIFT) |
+		      DMA_SxCR_MINC | DMA_SxCR_TCIE | DMA_SxCR_TEIE;
+	uint32_t fcr = 0;
+	uint32_t par = xfer->periph, m0ar = xfer->mem;
+
+	switch (xfer->dir) {
+	case DMA_ASYNC_PERIPH_TO_MEM:
+		cr |= DMA_SxCR_DIR_PERIPHERAL_TO_MEM;
+		break;
+	case DMA_ASYNC_MEM_TO_PERIPH:
+		cr |= DMA_SxCR_DIR_MEM_TO_PERIPHERAL;
+		break;
+	case DMA_ASYNC_MEM_TO_REG:
+		/* Memory to memory reads from the peripheral port, so the
+		 * buffer goes there and the register on the memory port. */
+		cr = (cr & ~DMA_SxCR_MINC) | DMA_SxCR_DIR_MEM_TO_MEM |
+		     DMA_SxCR_PINC;
+		fcr = DMA_SxFCR_DMDIS | DMA_SxFCR_FTH_4_4_FULL;
+		par = xfer->mem;
+		m0ar = xfer->periph;
+		break;
+	default:
+		/* Direct mode is not allowed for memory to memory. */
+		cr |= DMA_SxCR_DIR_MEM_TO_MEM | DMA_SxCR_PINC;
+		fcr = DMA_SxFCR_DMDIS | DMA_SxFCR_FTH_4_4_FULL;
+		break;
+	}
+#if !defined(DMA_ASYNC_DMAMUX)
+	if (ch->request != DMA_ASYNC_REQUEST_NONE) {
+		cr |= DMA_SxCR_CHSEL(ch->request);
+	}
+#endif
+	if (xfer->circular) {
+		cr |= DMA_SxCR_CIRC;
+	}
+	if (xfer->half) {
+		cr |= DMA_SxCR_HTIE;
+	}
+
+	DMA_SCR(dma, stream) = 0;
+	while (DMA_SCR(dma, stream) & DMA_SxCR_EN);
+	dma_clear_interrupt_flags(dma, stream, DMA_ISR_FLAGS);
+	DMA_SPAR(dma, stream) = (void *)par;
+	DMA_SM0AR(dma, stream) = (void *)m0ar;
+	DMA_SNDTR(dma, stream) = xfer->count;
+	DMA_SFCR(dma, stream) = fcr;
+	DMA_SCR(dma, stream) = cr;
+	DMA_SCR(dma, stream) = cr | DMA_SxCR_EN;
+}
+
+static uint32_t dma_async_hw_events(struct dma_async_chan *ch)
+{
+	uint32_t events = 0;
+
+	/* Only clear what was seen, a flag raised since is kept for the
+	 * next interrupt. FIFO and direct mode errors are not fatal. */
+	if (dma_get_interrupt_flag(ch->dma, ch->channel, DMA_HTIF)) {
+		dma_clear_interrupt_flags(ch->dma, ch->channel, DMA_HTIF);
+		events |= DMA_ASYNC_HALF;
+	}
+	if (dma_get_interrupt_flag(ch->dma, ch->channel, DMA_TCIF)) {
+		dma_clear_interrupt_flags(ch->dma, ch->channel, DMA_TCIF);
+		events |= DMA_ASYNC_COMPLETE;
+	}
+	if (dma_get_interrupt_flag(ch->dma, ch->channel, DMA_TEIF)) {
+		dma_clear_interrupt_flags(ch->dma, ch->channel, DMA_TEIF);
+		events |= DMA_ASYNC_ERROR;
+	}
+	dma_clear_interrupt_flags(ch->dma, ch->channel, DMA_DMEIF | DMA_FEIF);
+	return events;
+}
+
+static uint16_t dma_async_hw_remaining(struct dma_async_chan *ch)
+{
+	return DMA_SNDTR(ch->dma, ch->channel);
+}
+
+#else
+
+static void dma_async_hw_stop(struct dma_async_chan *ch)
+{
+	DMA_CCR(ch->dma, ch->channel) &= ~(DMA_CCR_EN | DMA_CCR_TCIE |
+					   DMA_CCR_HTIE | DMA_CCR_TEIE);
+	dma_clear_interrupt_flags(ch->dma, ch->channel, DMA_FLAGS);
+}
+
+static void dma_async_hw_start(struct dma_async_chan *ch,
+			       const struct dma_async_xfer *xfer)
+{
+	uint32_t dma = ch->dma;
+	uint8_t channel = ch->channel;
+	uint32_t ccr = (xfer->width << DMA_CCR_PSIZE_SHIFT) |
+		       (xfer->width << DMA_CCR_MSIZE_SHIFT) |
+		       (xfer->priority << DMA_CCR_PL_SHIFT) |
+		       DMA_CCR_MINC | DMA_CCR_TCIE | DMA_CCR_TEIE;
+
+	switch (xfer->dir) {
+	case DMA_ASYNC_PERIPH_TO_MEM:
+		break;
+	case DMA_ASYNC_MEM_TO_PERIPH:
+		ccr |= DMA_CCR_DIR;
+		break;
+	case DMA_ASYNC_MEM_TO_REG:
+		ccr |= DMA_CCR_MEM2MEM | DMA_CCR_DIR;
+		break;
+	default:
+		/* Reads from the peripheral address, writes to memory. */
+		ccr |= DMA_CCR_MEM2MEM | DMA_CCR_PINC;
+		break;
+	}
+	if (xfer->circular) {
+		ccr |= DMA_CCR_CIRC;
+	}
+	if (xfer->half) {
+		ccr |= DMA_CCR_HTIE;
+	}
+
+	DMA_CCR(dma, channel) = 0;
+	dma_clear_interrupt_flags(dma, channel, DMA_FLAGS);
+	DMA_CPAR(dma, channel) = xfer->periph;
+	DMA_CMAR(dma, channel) = xfer->mem;
+	DMA_CNDTR(dma, channel) = xfer->count;
+	DMA_CCR(dma, channel) = ccr;
+	DMA_CCR(dma, channel) = ccr | DMA_CCR_EN;
+}
+
+static uint32_t dma_async_hw_events(struct dma_async_chan *ch)
+{
+	uint32_t events = 0;
+
+	/* Only clear what was seen, a flag raised since is kept for the
+	 * next interrupt. */
+	if (dma_get_interrupt_flag(ch->dma, ch->channel, DMA_HTIF)) {
+		dma_clear_interrupt_flags(ch->dma, ch->channel, DMA_HTIF);
+		events |= DMA_ASYNC_HALF;
+	}
+	if (dma_get_interrupt_flag(ch->dma, ch->channel, DMA_TCIF)) {
+		dma_clear_interrupt_flags(ch->dma, ch->channel, DMA_TCIF);
+		events |= DMA_ASYNC_COMPLETE;
+	}
+	if (dma_get_interrupt_flag(ch->dma, ch->channel, DMA_TEIF)) {
+		dma_clear_interrupt_flags(ch->dma, ch->channel, DMA_TEIF);
+		events |= DMA_ASYNC_ERROR;
+	}
+	return events;
+}
+
+static uint16_t dma_async_hw_remaining(struct dma_async_chan *ch)
+{
+	return DMA_CNDTR(ch->dma, ch->channel);
+}
+
+#endif
+
+#if defined(DMA_ASYNC_DCACHE)
+/* Make the memory of a starting transfer coherent with the data cache */
+static void dma_async_dcache_start(struct dma_async_chan *ch,
+				   const struct dma_async_xfer *xfer)
+{
+	size_t len = (size_t)xfer->count << xfer->width;
+
+	ch->dcache_dst = 0;
+	ch->dcache_len = 0;
+	switch (xfer->dir) {
+	case DMA_ASYNC_MEM_TO_MEM:
+		scb_dma_prepare_tx((const void *)xfer->periph, len);
+		/* Fall through */
+	case DMA_ASYNC_PERIPH_TO_MEM:
+		scb_dma_prepare_rx((void *)xfer->mem, len);
+		ch->dcache_dst = xfer->mem;
+		ch->dcache_len = len;
+		break;
+	default:
+		scb_dma_prepare_tx((const void *)xfer->mem, len);
+		break;
+	}
+}
+#endif
+
+/* Connect the request line to the channel, where that is not fixed. */
+static void dma_async_route_request(struct dma_async_chan *ch)
+{
+	if (ch->request == DMA_ASYNC_REQUEST_NONE) {
+		return;
+	}
+#if defined(DMA_ASYNC_DMAMUX)
+	dmamux_set_dma_channel_request(DMAMUX1,
+				       dma_async_mux_channel(ch->dma,
+							     ch->channel),
+				       ch->request);
+#elif defined(DMA_CSELR)
+	dma_set_channel_request(ch->dma, ch->channel, ch->request);
+#endif
+	/* CHSEL and REQSEL are part of the transfer setup. */
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set the number of channels of a controller.
+
+The driver assumes the channel count of the smallest part of the family. Set
+the actual count on larger parts before allocating, to make the extra
+channels available. On DMAMUX parts the count of DMA1 also places the DMAMUX
+outputs of DMA2, so it has to match the part.
+
+@param[in] dma Controller base
+@param[in] count Number of channels or streams
+*/
+void dma_async_set_channel_count(uint32_t dma, uint8_t count)
+{
+	int ctrl = dma_async_ctrl(dma);
+
+	if (ctrl >= 0) {
+		dma_async_channels[ctrl] = (count > DMA_ASYNC_MAX_CHANNELS) ?
+					   DMA_ASYNC_MAX_CHANNELS : count;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Allocate a channel.
+
+The routes are tried in order, a route with channel DMA_ASYNC_ANY takes the
+first free channel of its controller. The request of the route taken is
+connected to the channel.
+
+@param[in] ch Channel state, owned by the driver until @ref dma_async_free
+@param[in] routes Places the request can be served from, in order of preference
+@param[in] count Number of entries in @p routes
+@returns true if a channel was allocated
+*/
+bool dma_async_alloc(struct dma_async_chan *ch,
+		     const struct dma_async_route *routes, uint32_t count)
+{
+	struct dma_async_chan **slot = NULL;
+	uint32_t primask, i;
+	uint8_t channel;
+
+	primask = cm_mask_interrupts(1);
+	for (i = 0; (i < count) && !slot; i++) {
+		int ctrl = dma_async_ctrl(routes[i].dma);
+		uint8_t first = routes[i].channel, last = routes[i].channel;
+
+		if ((ctrl < 0) || !dma_async_channels[ctrl]) {
+			continue;
+		}
+		if (routes[i].channel == DMA_ASYNC_ANY) {
+			first = DMA_ASYNC_FIRST;
+			last = DMA_ASYNC_FIRST + dma_async_channels[ctrl] - 1;
+		}
+		for (channel = first; channel <= last; channel++) {
+			struct dma_async_chan **s = dma_async_slot(routes[i].dma,
+								  channel);
+			if (s && !*s) {
+				slot = s;
+				ch->dma = routes[i].dma;
+				ch->channel = channel;
+				ch->request = routes[i].request;
+				break;
+			}
+		}
+	}
+	if (slot) {
+		*slot = ch;
+	}
+	cm_mask_interrupts(primask);
+
+	if (!slot) {
+		return false;
+	}
+
+	ch->width = DMA_ASYNC_WIDTH_8;
+	ch->circular = false;
+	ch->busy = false;
+	ch->callback = NULL;
+	ch->callback_arg = NULL;
+	ch->stats.completed = 0;
+	ch->stats.half = 0;
+	ch->stats.errors = 0;
+	dma_async_route_request(ch);
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Stop any transfer and release the channel. */
+void dma_async_free(struct dma_async_chan *ch)
+{
+	struct dma_async_chan **slot = dma_async_slot(ch->dma, ch->channel);
+
+	dma_async_stop(ch);
+	if (slot && (*slot == ch)) {
+		*slot = NULL;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set the function called on transfer events.
+
+@param[in] ch Channel
+@param[in] callback Called from @ref dma_async_irq, may be NULL
+@param[in] arg Passed to @p callback
+*/
+void dma_async_set_callback(struct dma_async_chan *ch,
+			    dma_async_callback_t callback, void *arg)
+{
+	ch->callback = callback;
+	ch->callback_arg = arg;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Start a transfer.
+
+Completion is reported with @ref DMA_ASYNC_COMPLETE, after every lap for
+circular transfers, which run until stopped.
+
+@param[in] ch Channel
+@param[in] xfer Transfer description
+@returns false if a transfer is still running or @p xfer is not valid. On
+GPDMA, whose block size is counted in bytes, that includes transfers of more
+than 0xFFFF bytes.
+*/
+bool dma_async_start(struct dma_async_chan *ch,
+		     const struct dma_async_xfer *xfer)
+{
+	if (ch->busy || (xfer->count == 0) ||
+	    (xfer->width > DMA_ASYNC_WIDTH_32) || (xfer->priority > 3) ||
+	    ((xfer->dir >= DMA_ASYNC_MEM_TO_MEM) && xfer->circular)) {
+		return false;
+	}
+#if defined(DMA_ASYNC_GPDMA)
+	/* BNDT is 16 bits wide */
+	if (((uint32_t)xfer->count << xfer->width) > 0xFFFF) {
+		return false;
+	}
+#endif
+
+	ch->width = xfer->width;
+	ch->circular = xfer->circular;
+	ch->busy = true;
+#if defined(DMA_ASYNC_DCACHE)
+	dma_async_dcache_start(ch, xfer);
+#endif
+	dma_async_hw_start(ch, xfer);
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Abort a running transfer, without calling the callback. */
+void dma_async_stop(struct dma_async_chan *ch)
+{
+	dma_async_hw_stop(ch);
+	ch->busy = false;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Number of data units still to be transferred. */
+uint16_t dma_async_remaining(struct dma_async_chan *ch)
+{
+	return dma_async_hw_remaining(ch);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Shared interrupt dispatcher.
+
+Call from the interrupt vector of every channel or stream handed out by
+@ref dma_async_alloc. On parts where channels share a vector, call it once
+for each of them.
+
+@param[in] dma Controller base
+@param[in] channel Channel or stream number
+*/
+void dma_async_irq(uint32_t dma, uint8_t channel)
+{
+	struct dma_async_chan **slot = dma_async_slot(dma, channel);
+	struct dma_async_chan *ch;
+	uint32_t events;
+
+	if (!slot || !*slot) {
+		return;
+	}
+	ch = *slot;
+
+	events = dma_async_hw_events(ch);
+	if (!events) {
+		return;
+	}
+
+	if (events & DMA_ASYNC_HALF) {
+		ch->stats.half++;
+	}
+	if (events & DMA_ASYNC_COMPLETE) {
+		ch->stats.completed++;
+		if (!ch->circular) {
+			ch->busy = false;
+		}
+	}
+	if (events & DMA_ASYNC_ERROR) {
+		/* The hardware has disabled the channel already. */
+		dma_async_hw_stop(ch);
+		ch->stats.errors++;
+		ch->busy = false;
+	}
+
+#if defined(DMA_ASYNC_DCACHE)
+	if (events & (DMA_ASYNC_HALF | DMA_ASYNC_COMPLETE)) {
+		scb_dma_complete_rx((void *)ch->dcache_dst, ch->dcache_len);
+	}
+#endif
+
+	if (ch->callback) {
+		ch->callback(ch, events, ch->callback_arg);
+	}
+}
+
+/**@}*/
@@ -470,6 +470,241 @@ void fdcan_set_ext_filter(uint32_t canport, uint32_t nr,
 		| ((id2 & FDCAN_EFID2_MASK) << FDCAN_EFID2_SHIFT);
 }
 
+/** Count filter elements needed for one type of identifiers.
+ *
+ * Ranges take one element each, single identifiers are paired into dual
+ * ID filters.
+ */
+static uint32_t fdcan_filter_elements(const struct can_filter_id *ids, uint32_t count,
+		bool ext)
+{
+	uint32_t ranges = 0, singles = 0;
+
+	for (uint32_t q = 0; q < count; q++) {
+		if (ids[q].ext != ext) {
+			continue;
+		}
+		if (ids[q].first == ids[q].last) {
+			singles++;
+		} else {
+			ranges++;
+		}
+	}
+
+	return ranges + (singles + 1) / 2;
+}
+
+/** Merge two neighbouring entries of one type into a range.
+ *
+ * Prefers merges that save a filter element, and among those the one
+ * accepting the fewest identifiers which were not asked for.
+ */
+static uint32_t fdcan_filter_merge(struct can_filter_id *ids, uint32_t count,
+		bool ext, struct can_filter_report *report)
+{
+	uint32_t ranges = 0, singles = 0;
+	uint32_t best = count, best_gap = 0;
+	bool best_saves = false;
+
+	for (uint32_t q = 0; q < count; q++) {
+		if (ids[q].ext == ext) {
+			if (ids[q].first == ids[q].last) {
+				singles++;
+			} else {
+				ranges++;
+			}
+		}
+	}
+
+	for (uint32_t q = 0; q + 1 < count; q++) {
+		bool a_single = ids[q].first == ids[q].last;
+		bool b_single = ids[q + 1].first == ids[q + 1].last;
+		uint32_t s_after, r_after, gap;
+		bool saves;
+
+		if ((ids[q].ext != ext) || (ids[q + 1].ext != ext)) {
+			continue;
+		}
+
+		gap = ids[q + 1].first - ids[q].last - 1;
+		s_after = singles - a_single - b_single;
+		r_after = ranges - !a_single - !b_single + 1;
+		saves = r_after + (s_after + 1) / 2 < ranges + (singles + 1) / 2;
+
+		if ((best == count) || (saves && !best_saves)
+				|| ((saves == best_saves) && (gap < best_gap))) {
+			best = q;
+			best_gap = gap;
+			best_saves = saves;
+		}
+	}
+
+	if (best == count) {
+		return count;
+	}
+
+	ids[best].last = ids[best + 1].last;
+	for (uint32_t q = best + 1; q + 1 < count; q++) {
+		ids[q] = ids[q + 1];
+	}
+
+	if (best_gap) {
+		report->widened++;
+		report->extra_ids += best_gap;
+	}
+
+	return count - 1;
+}
+
+/** Plan filter elements for a list of identifiers.
+ *
+ * Sorts the list in place, joins overlapping and adjacent ranges and, if
+ * standard or extended identifiers still need more filter elements than are
+ * available, merges neighbouring entries into ranges, closing the smallest
+ * gaps first. The report tells how many elements are needed and whether the
+ * filter had to be widened to fit.
+ *
+ * @param [inout] ids Identifiers and ranges to accept, replaced by the plan
+ * @param [in] count Amount of entries in ids
+ * @param [in] std_max Amount of standard ID filter elements available
+ * @param [in] ext_max Amount of extended ID filter elements available
+ * @param [out] report Elements needed and how much the filter was widened
+ * @returns Amount of entries to pass to @ref fdcan_filter_apply, or
+ * FDCAN_E_INVALID if an entry is invalid or no element is available for
+ * identifiers of one type.
+ */
+int fdcan_filter_plan(struct can_filter_id *ids, uint32_t count,
+		uint32_t std_max, uint32_t ext_max, struct can_filter_report *report)
+{
+	uint32_t n = 0;
+
+	report->rules = 0;
+	report->widened = 0;
+	report->extra_ids = 0;
+
+	for (uint32_t q = 0; q < count; q++) {
+		uint32_t max = ids[q].ext ? CAN_FILTER_EXT_ID_MAX : CAN_FILTER_STD_ID_MAX;
+
+		if ((ids[q].first > ids[q].last) || (ids[q].last > max)) {
+			return FDCAN_E_INVALID;
+		}
+	}
+
+	/* Insertion sort, standard identifiers first */
+	for (uint32_t q = 1; q < count; q++) {
+		struct can_filter_id entry = ids[q];
+		uint32_t r = q;
+
+		while ((r > 0) && ((ids[r - 1].ext > entry.ext)
+				|| ((ids[r - 1].ext == entry.ext) && (ids[r - 1].first > entry.first)))) {
+			ids[r] = ids[r - 1];
+			r--;
+		}
+		ids[r] = entry;
+	}
+
+	/* Join overlapping and adjacent entries, this never widens the filter */
+	for (uint32_t q = 0; q < count; q++) {
+		if ((n > 0) && (ids[n - 1].ext == ids[q].ext)
+				&& (ids[q].first <= ids[n - 1].last + 1)) {
+			if (ids[q].last > ids[n - 1].last) {
+				ids[n - 1].last = ids[q].last;
+			}
+		} else {
+			ids[n++] = ids[q];
+		}
+	}
+
+	while (fdcan_filter_elements(ids, n, false) > std_max) {
+		uint32_t merged = fdcan_filter_merge(ids, n, false, report);
+
+		if (merged == n) {
+			return FDCAN_E_INVALID;
+		}
+		n = merged;
+	}
+
+	while (fdcan_filter_elements(ids, n, true) > ext_max) {
+		uint32_t merged = fdcan_filter_merge(ids, n, true, report);
+
+		if (merged == n) {
+			return FDCAN_E_INVALID;
+		}
+		n = merged;
+	}
+
+	report->rules = fdcan_filter_elements(ids, n, false)
+		+ fdcan_filter_elements(ids, n, true);
+
+	return n;
+}
+
+/** Program planned filter elements.
+ *
+ * Configures amount of filter rules using @ref fdcan_init_filter and writes
+ * ranges as range filters and pairs of single identifiers as dual ID filters.
+ * Must be called in INIT mode, before @ref fdcan_start. Frames not matching
+ * any filter are still handled as set by the global filter configuration.
+ *
+ * @param [in] canport FDCAN block base address. See @ref fdcan_block.
+ * @param [in] ids Entries planned by @ref fdcan_filter_plan
+ * @param [in] count Amount of entries
+ * @param [in] action Action of all elements, FDCAN_SFEC_FIFO0 or FDCAN_SFEC_FIFO1.
+ *				Extended filters use the same encoding, see @ref fdcan_efec.
+ * @returns FDCAN_E_OK, or FDCAN_E_BUSY if FDCAN block is not in INIT mode.
+ */
+int fdcan_filter_apply(uint32_t canport, const struct can_filter_id *ids, uint32_t count,
+		uint8_t action)
+{
+	uint32_t nr[2] = {0, 0};
+	const struct can_filter_id *single[2] = {NULL, NULL};
+
+	if ((FDCAN_CCCR(canport) & FDCAN_CCCR_INIT) == 0) {
+		return FDCAN_E_BUSY;
+	}
+
+	fdcan_init_filter(canport, fdcan_filter_elements(ids, count, false),
+			fdcan_filter_elements(ids, count, true));
+
+	/* FDCAN_EFT_RANGE and FDCAN_EFT_DUAL share the encoding of their
+	 * standard ID counterparts.
+	 */
+	for (uint32_t q = 0; q < count; q++) {
+		bool ext = ids[q].ext;
+		uint32_t id1 = ids[q].first;
+		uint8_t mode = FDCAN_SFT_RANGE;
+
+		if (ids[q].first == ids[q].last) {
+			/* Hold single identifiers back until there is a pair */
+			if (single[ext] == NULL) {
+				single[ext] = &ids[q];
+				continue;
+			}
+			id1 = single[ext]->first;
+			single[ext] = NULL;
+			mode = FDCAN_SFT_DUAL;
+		}
+
+		if (ext) {
+			fdcan_set_ext_filter(canport, nr[1]++, mode, id1, ids[q].last, action);
+		} else {
+			fdcan_set_std_filter(canport, nr[0]++, mode, id1, ids[q].last, action);
+		}
+	}
+
+	/* Left over single identifiers get a dual ID filter of their own */
+	if (single[0]) {
+		fdcan_set_std_filter(canport, nr[0], FDCAN_SFT_DUAL, single[0]->first,
+				single[0]->first, action);
+	}
+	if (single[1]) {
+		fdcan_set_ext_filter(canport, nr[1], FDCAN_EFT_DUAL, single[1]->first,
+				single[1]->first, action);
+	}
+
+	return FDCAN_E_OK;
+}
+
 /** Transmit Message using FDCAN
  *
  * @param [in] canport CAN block register base. See @ref fdcan_block.
@@ -486,8 +721,7 @@ void fdcan_set_ext_filter(uint32_t canport, uint32_t nr,
 int fdcan_transmit(uint32_t canport, uint32_t id, bool ext, bool rtr,
 			bool fdcan_fmt, bool btr_switch, uint8_t length, const uint8_t *data)
 {
-	int mailbox;
-	uint32_t dlc, flags = 0;
+	int mailbox, ret;
 
 	mailbox = fdcan_get_free_txbuf(canport);
 
@@ -495,7 +729,39 @@ int fdcan_transmit(uint32_t canport, uint32_t id, bool ext, bool rtr,
 		return mailbox;
 	}
 
-	struct fdcan_tx_buffer_element *tx_buffer = fdcan_get_txbuf_addr(canport, mailbox);
+	ret = fdcan_tx_fill(fdcan_get_txbuf_addr(canport, mailbox), id, ext, rtr,
+			fdcan_fmt, btr_switch, length, data);
+
+	if (ret != FDCAN_E_OK) {
+		return ret;
+	}
+
+	FDCAN_TXBAR(canport) = 1 << mailbox;
+
+	return mailbox;
+}
+
+/** Fill transmit buffer element in message RAM.
+ *
+ * Writes message header and payload into transmit buffer element without
+ * requesting its transmission. Together with @ref fdcan_tx_free_mask and
+ * @ref fdcan_tx_request, this allows to queue several frames with single
+ * write to FDCAN_TXBAR.
+ *
+ * @param [in] tx_buffer Transmit buffer element, see @ref fdcan_get_txbuf_addr
+ * @param [in] id Message ID
+ * @param [in] ext Extended message ID?
+ * @param [in] rtr Request transmit?
+ * @param [in] fdcan_fmt Use FDCAN format
+ * @param [in] btr_switch Switch bitrate for data portion of frame
+ * @param [in] length Message payload length. Must be valid CAN or FDCAN frame length
+ * @param [in] data Message payload data
+ * @returns FDCAN_E_OK on success, FDCAN_E_INVALID if length cannot be encoded.
+ */
+int fdcan_tx_fill(struct fdcan_tx_buffer_element *tx_buffer, uint32_t id, bool ext,
+		bool rtr, bool fdcan_fmt, bool btr_switch, uint8_t length, const uint8_t *data)
+{
+	uint32_t dlc, identifier_flags, flags = 0;
 
 	/* Early check: if FDCAN message lentgh is > 8, it must be
 	 * a multiple of 4 *and* fdcan format must be enabled.
@@ -507,15 +773,15 @@ int fdcan_transmit(uint32_t canport, uint32_t id, bool ext, bool rtr,
 	}
 
 	if (ext) {
-		tx_buffer->identifier_flags = FDCAN_FIFO_XTD
+		identifier_flags = FDCAN_FIFO_XTD
 			| ((id & FDCAN_FIFO_EID_MASK) << FDCAN_FIFO_EID_SHIFT);
 	} else {
-		tx_buffer->identifier_flags =
+		identifier_flags =
 			(id & FDCAN_FIFO_SID_MASK) << FDCAN_FIFO_SID_SHIFT;
 	}
 
 	if (rtr) {
-		tx_buffer->identifier_flags |= FDCAN_FIFO_RTR;
+		identifier_flags |= FDCAN_FIFO_RTR;
 	}
 
 	if (fdcan_fmt) {
@@ -526,6 +792,9 @@ int fdcan_transmit(uint32_t canport, uint32_t id, bool ext, bool rtr,
 		flags |= FDCAN_FIFO_BRS;
 	}
 
+	/* Message RAM is only accessible in 32bit quantities, write each
+	 * word once. */
+	tx_buffer->identifier_flags = identifier_flags;
 	tx_buffer->evt_fmt_dlc_res =
 		(dlc << FDCAN_FIFO_DLC_SHIFT) | flags;
 
@@ -533,9 +802,34 @@ int fdcan_transmit(uint32_t canport, uint32_t id, bool ext, bool rtr,
 		tx_buffer->data[q / 4] = *((uint32_t *) &data[q]);
 	}
 
-	FDCAN_TXBAR(canport) |= 1 << mailbox;
+	return FDCAN_E_OK;
+}
 
-	return mailbox;
+/** Return mask of free transmit buffers.
+ *
+ * @param [in] canport FDCAN block base address. See @ref fdcan_block.
+ * @returns Bit n is set if transmit buffer n has no pending transmission request
+ * and can be filled using @ref fdcan_tx_fill.
+ */
+uint32_t fdcan_tx_free_mask(uint32_t canport)
+{
+	unsigned count = fdcan_get_txbuf_count(canport);
+	uint32_t all = (count >= 32) ? 0xFFFFFFFF : ((1U << count) - 1);
+
+	return ~FDCAN_TXBRP(canport) & all;
+}
+
+/** Request transmission of filled transmit buffers.
+ *
+ * Adds transmission requests for all buffers in mask with a single write,
+ * frames are then sent in order of their priority.
+ *
+ * @param [in] canport FDCAN block base address. See @ref fdcan_block.
+ * @param [in] mask Bit n requests transmission of transmit buffer n
+ */
+void fdcan_tx_request(uint32_t canport, uint32_t mask)
+{
+	FDCAN_TXBAR(canport) = mask;
 }
 
 /** Receive Message from FDCAN FIFO
@@ -640,6 +934,71 @@ void fdcan_release_fifo(uint32_t canport, uint8_t fifo_id)
 	}
 }
 
+/** Get pointers to all pending elements of receive FIFO.
+ *
+ * Reads fill level and get index of FIFO once and returns pointers to
+ * up to max oldest pending elements directly in message RAM, in order of
+ * reception. Elements stay valid until they are acknowledged using
+ * @ref fdcan_rx_fifo_ack. Frame fields are decoded using FDCAN_FIFO_*
+ * flags and @ref fdcan_dlc_to_length.
+ *
+ * @param [in] canport FDCAN block base address. See @ref fdcan_block.
+ * @param [in] fifo_id ID of FIFO to be read (0 or 1)
+ * @param [out] elements Array receiving element pointers
+ * @param [in] max Size of elements array
+ * @returns Amount of element pointers stored.
+ */
+unsigned fdcan_rx_fifo_peek(uint32_t canport, uint8_t fifo_id,
+		const struct fdcan_rx_fifo_element **elements, unsigned max)
+{
+	unsigned pending_frames, get_index, size, element_size;
+	uintptr_t base;
+
+	fdcan_get_fill_rxfifo(canport, fifo_id, &get_index, &pending_frames);
+
+	if (pending_frames > max) {
+		pending_frames = max;
+	}
+
+	size = fdcan_get_fifo_size(canport, fifo_id);
+	element_size = fdcan_get_fifo_element_size(canport, fifo_id);
+	base = (uintptr_t) fdcan_get_rxfifo_addr(canport, fifo_id, 0);
+
+	for (unsigned q = 0; q < pending_frames; q++) {
+		elements[q] = (const struct fdcan_rx_fifo_element *)
+			(base + get_index * element_size);
+		if (++get_index == size) {
+			get_index = 0;
+		}
+	}
+
+	return pending_frames;
+}
+
+/** Acknowledge oldest elements of receive FIFO.
+ *
+ * Releases count oldest elements, typically obtained using
+ * @ref fdcan_rx_fifo_peek, by single write of acknowledge index of the last of
+ * them.
+ *
+ * @param [in] canport FDCAN block base address. See @ref fdcan_block.
+ * @param [in] fifo_id ID of FIFO (0 or 1)
+ * @param [in] count Amount of elements to release, at most the fill level
+ */
+void fdcan_rx_fifo_ack(uint32_t canport, uint8_t fifo_id, unsigned count)
+{
+	unsigned pending_frames, get_index;
+
+	fdcan_get_fill_rxfifo(canport, fifo_id, &get_index, &pending_frames);
+
+	if ((count == 0) || (count > pending_frames)) {
+		return;
+	}
+
+	get_index = (get_index + count - 1) % fdcan_get_fifo_size(canport, fifo_id);
+	FDCAN_RXFIA(canport, fifo_id) = get_index << FDCAN_RXFIFO_AI_SHIFT;
+}
+
 /** Enable IRQ from FDCAN block.
  *
  * This routine configures FDCAN to enable certain IRQ.
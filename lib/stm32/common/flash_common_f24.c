@@ -24,8 +24,20 @@
 
 /**@{*/
 
+#include <string.h>
 #include <libopencm3/stm32/flash.h>
 
+/* Error flags of a programming operation */
+#if defined(FLASH_SR_PGSERR)
+#define FLASH_SR_PROGRAM_ERRORS	(FLASH_SR_PGSERR | FLASH_SR_PGPERR | \
+				 FLASH_SR_PGAERR | FLASH_SR_WRPERR | \
+				 FLASH_SR_OPERR)
+#else
+#define FLASH_SR_PROGRAM_ERRORS	(FLASH_SR_ERSERR | FLASH_SR_PGPERR | \
+				 FLASH_SR_PGAERR | FLASH_SR_WRPERR | \
+				 FLASH_SR_OPERR)
+#endif
+
 /*---------------------------------------------------------------------------*/
 /** @brief Set the Program Parallelism Size
 
@@ -197,6 +209,9 @@ This programs an arbitrary length data block to FLASH memory.
 The program error flag should be checked separately for the event that memory
 was not properly erased.
 
+Bytes are programmed one at a time, which works at any supply voltage.
+@ref flash_program_block programs with wider accesses.
+
 @param[in] address Starting address in Flash.
 @param[in] data Pointer to start of data block.
 @param[in] len Length of data block.
@@ -204,12 +219,210 @@ was not properly erased.
 
 void flash_program(uint32_t address, const uint8_t *data, uint32_t len)
 {
-	/* TODO: Use dword and word size program operations where possible for
-	 * turbo speed.
-	 */
-	uint32_t i;
-	for (i = 0; i < len; i++) {
-		flash_program_byte(address+i, data[i]);
+	flash_program_block(address, data, len, FLASH_CR_PROGRAM_X8);
+}
+
+/* Widest programming width, up to program_size, for the next access */
+static uint32_t flash_program_width(uint32_t address, uint32_t len,
+				    uint32_t program_size)
+{
+	uint32_t psize = program_size;
+
+	while (psize && ((address & ((1U << psize) - 1)) ||
+			 (len < (1U << psize)))) {
+		psize--;
+	}
+	return psize;
+}
+
+/* Start programming one access of 1 << psize bytes, with PG set and the
+ * flash idle. Returns the number of bytes. */
+static uint32_t flash_program_access(uint32_t address, const uint8_t *data,
+				     uint32_t psize)
+{
+	uint64_t d = 0;
+	uint32_t n = 1U << psize;
+
+	memcpy(&d, data, n);
+	if (((FLASH_CR >> FLASH_CR_PROGRAM_SHIFT) & FLASH_CR_PROGRAM_MASK) !=
+	    psize) {
+		flash_set_program_size(psize);
+	}
+
+	switch (psize) {
+	case FLASH_CR_PROGRAM_X64:
+		MMIO64(address) = d;
+		break;
+	case FLASH_CR_PROGRAM_X32:
+		MMIO32(address) = (uint32_t)d;
+		break;
+	case FLASH_CR_PROGRAM_X16:
+		MMIO16(address) = (uint16_t)d;
+		break;
+	default:
+		MMIO8(address) = (uint8_t)d;
+		break;
+	}
+	return n;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Program a Data Block to FLASH with wide accesses
+
+This programs an arbitrary length data block to FLASH memory, with the widest
+accesses the alignment of the address allows, up to program_size. Bytes at
+either end that do not make up a wide access are programmed with narrower
+ones. Programming stops at the first error, whose flag is left set.
+
+The programming width is limited by the supply voltage: x8 from 1.7 V, x16
+from 1.8 V, x32 from 2.1 V (2.7 V on F2), and x64 only with an external Vpp.
+See the programming manual for more information.
+
+@param[in] address Starting address in Flash.
+@param[in] data Pointer to start of data block, any alignment.
+@param[in] len Length of data block.
+@param[in] program_size Widest programming width, one of
+@ref flash_cr_program_width
+*/
+
+void flash_program_block(uint32_t address, const uint8_t *data, uint32_t len,
+			 uint32_t program_size)
+{
+	uint32_t n;
+
+	flash_wait_for_last_operation();
+	FLASH_CR |= FLASH_CR_PG;
+
+	while (len) {
+		n = flash_program_access(address, data,
+			flash_program_width(address, len, program_size));
+		address += n;
+		data += n;
+		len -= n;
+		flash_wait_for_last_operation();
+		if (FLASH_SR & FLASH_SR_PROGRAM_ERRORS) {
+			break;
+		}
+	}
+
+	FLASH_CR &= ~FLASH_CR_PG;
+}
+
+static void flash_async_done(struct flash_async *f, bool ok)
+{
+	uint32_t sr = FLASH_SR;
+
+	FLASH_CR &= ~(FLASH_CR_PG | FLASH_CR_EOPIE | FLASH_CR_ERRIE);
+	if (!ok) {
+		FLASH_SR = sr & (FLASH_SR_EOP | FLASH_SR_PROGRAM_ERRORS);
+		f->error = sr & FLASH_SR_PROGRAM_ERRORS;
+		f->stats.errors++;
+	}
+	f->busy = false;
+	if (f->callback) {
+		f->callback(f, ok, f->callback_arg);
+	}
+}
+
+/* Start the next access of an interrupt driven programming, or end it if
+ * the access is refused: width, alignment and sequence errors are raised
+ * at once, without an interrupt. */
+static void flash_async_next(struct flash_async *f)
+{
+	uint32_t n = flash_program_access(f->address, f->data,
+		flash_program_width(f->address, f->left, f->program_size));
+
+	f->address += n;
+	f->data += n;
+	f->left -= n;
+	f->stats.bytes += n;
+
+	__asm__ volatile("dsb" ::: "memory");
+	if (FLASH_SR & FLASH_SR_PROGRAM_ERRORS) {
+		flash_async_done(f, false);
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set the function called when an interrupt driven programming has
+ended. */
+void flash_async_set_callback(struct flash_async *f,
+			      flash_async_callback_t callback, void *arg)
+{
+	f->callback = callback;
+	f->callback_arg = arg;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Start an Interrupt Driven Programming of a Data Block
+
+Programs like @ref flash_program_block, but returns once the first access is
+started. Each end of operation interrupt starts the next one, from
+@ref flash_async_isr which the flash interrupt handler must call with the
+flash interrupt enabled in the NVIC. The callback runs at the end.
+
+The CPU stalls on any read of the flash bank being programmed, so code and
+data used meanwhile must live in RAM or in the other bank.
+
+@param[in] f Programming state
+@param[in] address Starting address in Flash.
+@param[in] data Pointer to start of data block, any alignment, valid until
+the end.
+@param[in] len Length of data block.
+@param[in] program_size Widest programming width, one of
+@ref flash_cr_program_width
+@returns false if a programming is already running
+*/
+bool flash_program_async(struct flash_async *f, uint32_t address,
+			 const uint8_t *data, uint32_t len,
+			 uint32_t program_size)
+{
+	if (f->busy) {
+		return false;
+	}
+
+	f->address = address;
+	f->data = data;
+	f->left = len;
+	f->program_size = program_size;
+	f->error = 0;
+	if (!len) {
+		return true;
+	}
+
+	f->busy = true;
+	flash_wait_for_last_operation();
+	FLASH_SR = FLASH_SR_EOP | FLASH_SR_PROGRAM_ERRORS;
+	FLASH_CR |= FLASH_CR_PG | FLASH_CR_EOPIE | FLASH_CR_ERRIE;
+	flash_async_next(f);
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Flash Interrupt Handler of Interrupt Driven Programming
+
+@param[in] f Programming state
+*/
+void flash_async_isr(struct flash_async *f)
+{
+	uint32_t sr = FLASH_SR;
+
+	if (!f->busy) {
+		return;
+	}
+	if (sr & FLASH_SR_PROGRAM_ERRORS) {
+		flash_async_done(f, false);
+		return;
+	}
+	if (!(sr & FLASH_SR_EOP)) {
+		return;
+	}
+
+	FLASH_SR = FLASH_SR_EOP;
+	if (f->left) {
+		flash_async_next(f);
+	} else {
+		flash_async_done(f, true);
 	}
 }
 
@@ -0,0 +1,445 @@
+/** @addtogroup hash_file
+ *
+ * @brief Incremental, DMA capable hashing and HMAC
+ *
+ * A hash stream computes an MD5, SHA-1 (and on processors with SHA-2,
+ * SHA-224 or SHA-256) digest or HMAC over a message given in pieces of any
+ * length and alignment. Bytes that do not fill a word are kept until the
+ * next piece, and the last word of the message is marked with its number of
+ * valid bits.
+ *
+ * Several hashes may be in progress at the same time. The processor holds
+ * one of them; using another saves the context of the one loaded (IMR, STR,
+ * CR and the context swap registers) into its structure and restores the
+ * other, as described for context swapping in the reference manual.
+ *
+ * SHA-2 and DMA feeding need the HASH of the F42x/F43x, F469/F479 and F7,
+ * which the F4 driver tells from that of the F415/F417 by the device ID.
+ *
+ * Pieces are fed either by the CPU or, on processors with multiple DMA
+ * transfer support (MDMAT: F42x/F43x, F469/F479, F7), by a DMA channel
+ * allocated by the application with @ref dma_async_alloc for the HASH IN
+ * request, whose interrupt must call @ref dma_async_irq.
+ *
+ * LGPL License Terms @ref lgpl_license
+ */
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#include <string.h>
+#include <libopencm3/stm32/dbgmcu.h>
+#include <libopencm3/stm32/hash_stream.h>
+
+#if defined(HASH_ALGO_SHA256)
+#define HASH_STREAM_ALGO	(HASH_CR_ALGO1 | HASH_CR_ALGO)
+#else
+#define HASH_STREAM_ALGO	HASH_CR_ALGO
+#endif
+
+/* DBGMCU_IDCODE DEV_ID of the F42x/F43x and F469/F479. Their HASH has SHA-2,
+ * MDMAT and 38 or 54 context swap registers, that of the F415/F417 none of
+ * these and always 51. */
+#define DBGMCU_IDCODE_DEV_ID_STM32F42X_43X	0x419
+#define DBGMCU_IDCODE_DEV_ID_STM32F469_479	0x434
+
+/* Words handed to the DMA at once */
+#define HASH_STREAM_DMA_CHUNK	0xFFFFU
+
+/* The hash whose context is in the processor */
+static struct hash_stream *hash_stream_loaded;
+
+/* The HASH has SHA-2 and MDMAT */
+static bool hash_stream_sha2(void)
+{
+#if defined(STM32F4)
+	uint32_t dev_id = DBGMCU_IDCODE & DBGMCU_IDCODE_DEV_ID_MASK;
+
+	return (dev_id == DBGMCU_IDCODE_DEV_ID_STM32F42X_43X) ||
+	       (dev_id == DBGMCU_IDCODE_DEV_ID_STM32F469_479);
+#elif defined(HASH_ALGO_SHA256)
+	return true;
+#else
+	return false;
+#endif
+}
+
+static uint8_t hash_stream_csr_count(const struct hash_stream *s)
+{
+	if (!hash_stream_sha2()) {
+		return 51;
+	}
+	return (s->cr & HASH_CR_MODE) == HASH_MODE_HMAC ? 54 : 38;
+}
+
+static void hash_stream_save(struct hash_stream *s)
+{
+	uint8_t i;
+
+	while (HASH_SR & HASH_SR_BUSY);
+	s->imr = HASH_IMR;
+	s->str = HASH_STR;
+	s->cr = HASH_CR;
+	for (i = 0; i < hash_stream_csr_count(s); i++) {
+		s->csr[i] = HASH_CSR[i];
+	}
+}
+
+static void hash_stream_load(struct hash_stream *s)
+{
+	uint8_t i;
+
+	if (hash_stream_loaded == s) {
+		return;
+	}
+	if (hash_stream_loaded) {
+		hash_stream_save(hash_stream_loaded);
+	}
+
+	if (!s->started) {
+		HASH_IMR = 0;
+		HASH_STR = 0;
+		HASH_CR = s->cr;
+		HASH_CR = s->cr | HASH_CR_INIT;
+		s->started = true;
+	} else {
+		HASH_IMR = s->imr;
+		HASH_STR = s->str;
+		HASH_CR = s->cr;
+		HASH_CR = s->cr | HASH_CR_INIT;
+		for (i = 0; i < hash_stream_csr_count(s); i++) {
+			HASH_CSR[i] = s->csr[i];
+		}
+		s->stats.swaps++;
+	}
+	hash_stream_loaded = s;
+}
+
+static void hash_stream_word(const uint8_t *p)
+{
+	uint32_t w;
+
+	memcpy(&w, p, 4);
+	HASH_DIN = w;
+}
+
+static void hash_stream_feed(struct hash_stream *s, const uint8_t *p,
+			     size_t len)
+{
+	s->stats.bytes += len;
+	while (s->ntail && len) {
+		s->tail[s->ntail++] = *p++;
+		len--;
+		if (s->ntail == 4) {
+			hash_stream_word(s->tail);
+			s->ntail = 0;
+		}
+	}
+	for (; len >= 4; p += 4, len -= 4) {
+		hash_stream_word(p);
+	}
+	while (len--) {
+		s->tail[s->ntail++] = *p++;
+	}
+}
+
+/* Feed a whole message (an HMAC key) and start its digest */
+static void hash_stream_message(const uint8_t *p, size_t len)
+{
+	uint8_t last[4] = { 0 };
+
+	for (; len >= 4; p += 4, len -= 4) {
+		hash_stream_word(p);
+	}
+	if (len) {
+		memcpy(last, p, len);
+		hash_stream_word(last);
+	}
+	HASH_STR = len * 8;
+	HASH_STR = (len * 8) | HASH_STR_DCAL;
+}
+
+/* End the message in progress: the bytes of an incomplete word go in a
+ * last word with its number of valid bits. */
+static void hash_stream_end(struct hash_stream *s)
+{
+	uint32_t nblw = s->ntail * 8;
+
+	if (s->ntail) {
+		memset(&s->tail[s->ntail], 0, 4 - s->ntail);
+		hash_stream_word(s->tail);
+		s->ntail = 0;
+	}
+	HASH_STR = nblw;
+	HASH_STR = nblw | HASH_STR_DCAL;
+}
+
+#if defined(HASH_CR_MDMAT)
+static void hash_stream_dma_next(struct hash_stream *s);
+
+static void hash_stream_dma_event(struct dma_async_chan *ch, uint32_t events,
+				  void *arg)
+{
+	struct hash_stream *s = arg;
+
+	(void)ch;
+	if (events & DMA_ASYNC_ERROR) {
+		s->stats.dma_errors++;
+		HASH_CR &= ~(HASH_CR_DMAE | HASH_CR_MDMAT);
+		s->busy = false;
+		if (s->callback) {
+			s->callback(s, false, s->callback_arg);
+		}
+		return;
+	}
+	if (events & DMA_ASYNC_COMPLETE) {
+		hash_stream_dma_next(s);
+	}
+}
+
+/* Hand the next chunk of whole words to the DMA, or keep the last bytes for
+ * the next piece and finish the update. */
+static void hash_stream_dma_next(struct hash_stream *s)
+{
+	size_t n = s->dma_left / 4;
+	struct dma_async_xfer xfer = {
+		.dir = DMA_ASYNC_MEM_TO_PERIPH,
+		.periph = (uint32_t)&HASH_DIN,
+		.mem = (uint32_t)s->dma_next,
+		.width = DMA_ASYNC_WIDTH_32,
+		.priority = 1,
+	};
+
+	if (n > HASH_STREAM_DMA_CHUNK) {
+		n = HASH_STREAM_DMA_CHUNK;
+	}
+	if (!n) {
+		HASH_CR &= ~(HASH_CR_DMAE | HASH_CR_MDMAT);
+		hash_stream_feed(s, s->dma_next, s->dma_left);
+		s->dma_left = 0;
+		s->busy = false;
+		if (s->callback) {
+			s->callback(s, true, s->callback_arg);
+		}
+		return;
+	}
+
+	xfer.count = n;
+	s->dma_next += n * 4;
+	s->dma_left -= n * 4;
+	s->stats.bytes += n * 4;
+	dma_async_start(s->dma, &xfer);
+	/* MDMAT keeps the end of the transfer from starting the digest */
+	HASH_CR |= HASH_CR_DMAE | HASH_CR_MDMAT;
+}
+#endif
+
+/*---------------------------------------------------------------------------*/
+/** @brief Start a hash or HMAC.
+
+The processor is taken over at once, to initialise it and, for a HMAC, to
+process the key.
+
+@param[in] s Stream state
+@param[in] algorithm @ref hash_algorithm
+@param[in] key HMAC key, which must stay valid until @ref hash_stream_final,
+or NULL for a plain hash
+@param[in] key_len Key length in bytes
+@returns false if the algorithm is not valid or, for SHA-224 and SHA-256,
+not supported by the processor (F415/F417), or if a DMA update is running
+*/
+bool hash_stream_init(struct hash_stream *s, uint32_t algorithm,
+		      const uint8_t *key, size_t key_len)
+{
+	if ((algorithm & ~HASH_STREAM_ALGO) ||
+	    ((algorithm & ~HASH_CR_ALGO) && !hash_stream_sha2())) {
+		return false;
+	}
+	if (hash_stream_loaded && hash_stream_loaded->busy) {
+		return false;
+	}
+	if (hash_stream_loaded == s) {
+		while (HASH_SR & HASH_SR_BUSY);
+		hash_stream_loaded = NULL;
+	}
+
+	s->cr = algorithm | HASH_DATA_8BIT;
+	if (key) {
+		s->cr |= HASH_MODE_HMAC;
+		if (key_len > 64) {
+			s->cr |= HASH_KEY_LONG;
+		}
+	}
+	s->started = false;
+	s->ntail = 0;
+	s->key = key;
+	s->key_len = key_len;
+	s->dma = NULL;
+	s->dma_next = NULL;
+	s->dma_left = 0;
+	s->callback = NULL;
+	s->callback_arg = NULL;
+	s->busy = false;
+	s->stats.bytes = 0;
+	s->stats.swaps = 0;
+	s->stats.dma_errors = 0;
+
+	hash_stream_load(s);
+	if (key) {
+		hash_stream_message(key, key_len);
+	}
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set the DMA channel of @ref hash_stream_update_dma. */
+void hash_stream_set_dma(struct hash_stream *s, struct dma_async_chan *dma)
+{
+	s->dma = dma;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set the function called when a DMA update has ended. */
+void hash_stream_set_callback(struct hash_stream *s,
+			      hash_stream_callback_t callback, void *arg)
+{
+	s->callback = callback;
+	s->callback_arg = arg;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Feed the next piece of the message from the CPU.
+
+@param[in] s Stream state
+@param[in] data Data, any alignment
+@param[in] len Number of bytes
+@returns false if a DMA update is running
+*/
+bool hash_stream_update(struct hash_stream *s, const void *data, size_t len)
+{
+	if (hash_stream_loaded && hash_stream_loaded->busy) {
+		return false;
+	}
+	hash_stream_load(s);
+	hash_stream_feed(s, data, len);
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Start feeding the next piece of the message by DMA.
+
+Returns at once, the callback runs when the whole piece has been fed. Pieces
+longer than a DMA transfer are fed in several transfers, and bytes that do
+not make up a word at either end by the CPU. Until then no hash can use the
+processor.
+
+@param[in] s Stream state
+@param[in] data Data, any alignment
+@param[in] len Number of bytes
+@returns false if no DMA channel is set, a DMA update is running, or the
+processor has no multiple DMA transfer support (F2, F415/F417)
+*/
+bool hash_stream_update_dma(struct hash_stream *s, const void *data,
+			    size_t len)
+{
+#if defined(HASH_CR_MDMAT)
+	const uint8_t *p = data;
+
+	if (!hash_stream_sha2() || !s->dma ||
+	    (hash_stream_loaded && hash_stream_loaded->busy)) {
+		return false;
+	}
+
+	hash_stream_load(s);
+	/* The DMA moves aligned words, the CPU gets there first */
+	while (len && (s->ntail || ((uint32_t)p & 3))) {
+		hash_stream_feed(s, p++, 1);
+		len--;
+	}
+
+	s->dma_next = p;
+	s->dma_left = len;
+	s->busy = true;
+	dma_async_set_callback(s->dma, hash_stream_dma_event, s);
+	hash_stream_dma_next(s);
+	return true;
+#else
+	(void)s;
+	(void)data;
+	(void)len;
+	return false;
+#endif
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Finish the hash and read the digest.
+
+Blocks until the digest is computed. For a HMAC this includes the outer hash
+over the key.
+
+@param[in] s Stream state
+@param[out] digest Digest words as in the HASH_HR registers, 4 (MD5),
+5 (SHA-1), 7 (SHA-224) or 8 (SHA-256) words
+@returns Number of digest words, 0 if a DMA update is running
+*/
+uint8_t hash_stream_final(struct hash_stream *s, uint32_t *digest)
+{
+	uint8_t i, words;
+
+	if (hash_stream_loaded && hash_stream_loaded->busy) {
+		return 0;
+	}
+
+	hash_stream_load(s);
+	hash_stream_end(s);
+	if ((s->cr & HASH_CR_MODE) == HASH_MODE_HMAC) {
+		while (HASH_SR & HASH_SR_BUSY);
+		hash_stream_message(s->key, s->key_len);
+	}
+	while (!(HASH_SR & HASH_SR_DCIS));
+
+	switch (s->cr & HASH_STREAM_ALGO) {
+	case HASH_ALGO_MD5:
+		words = 4;
+		break;
+#if defined(HASH_ALGO_SHA256)
+	case HASH_ALGO_SHA224:
+		words = 7;
+		break;
+	case HASH_ALGO_SHA256:
+		words = 8;
+		break;
+#endif
+	default:
+		words = 5;
+		break;
+	}
+	for (i = 0; i < words; i++) {
+#if defined(HASH_ALGO_SHA256)
+		digest[i] = hash_stream_sha2() ? HASH_HR_EXT[i] : HASH_HR[i];
+#else
+		digest[i] = HASH_HR[i];
+#endif
+	}
+
+	hash_stream_loaded = NULL;
+	s->started = false;
+	return words;
+}
+
+/**@}*/
@@ -0,0 +1,504 @@
+/** @addtogroup i2c_file I2C peripheral API
+@ingroup peripheral_apis
+
+@brief Queued, interrupt driven I2C master
+
+Runs I2C master transactions from the I2C interrupt, so the caller never
+waits on the bus. Transactions are queued per bus and handed to the hardware
+one after the other; each ends with its callback, including on a NACK, a bus
+error or a timeout.
+
+A transaction writes, reads, or writes and then reads back after a repeated
+start, the usual register access. On the v2 peripheral a phase may be longer
+than the 255 bytes NBYTES can count: it is cut into chunks chained with
+RELOAD. The data of the v2 peripheral can also be moved by DMA, see
+@ref i2c_async_set_dma, leaving only a handful of interrupts per transaction.
+
+The peripheral clocks, pins and timing are set up by the application with the
+usual register level functions, with the peripheral enabled. The event and
+error interrupts (one interrupt on the F0, G0 and L0) must call
+@ref i2c_async_isr, and something periodic, such as the systick handler,
+@ref i2c_async_tick when timeouts are wanted.
+
+LGPL License Terms @ref lgpl_license
+*/
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/stm32/i2c_async.h>
+
+/* Peripheral flavours: the v2 IP with ISR/ICR and NBYTES, and the v1 IP with
+ * SR1/SR2 where every event of the transaction is driven by software. */
+#if defined(I2C_ICR)
+#define I2C_ASYNC_V2
+#endif
+
+#if defined(I2C_ASYNC_V2)
+
+#define I2C_ASYNC_NBYTES_MAX	255
+#define I2C_ASYNC_IRQS		(I2C_CR1_TXIE | I2C_CR1_RXIE | \
+				 I2C_CR1_NACKIE | I2C_CR1_STOPIE | \
+				 I2C_CR1_TCIE | I2C_CR1_ERRIE | \
+				 I2C_CR1_TXDMAEN | I2C_CR1_RXDMAEN)
+#define I2C_ASYNC_ERRORS	(I2C_ISR_BERR | I2C_ISR_ARLO | I2C_ISR_OVR)
+
+static void i2c_async_reset(struct i2c_async *bus)
+{
+	uint32_t i2c = bus->i2c;
+
+	I2C_CR1(i2c) &= ~I2C_ASYNC_IRQS;
+	if (bus->tx_dma) {
+		dma_async_stop(bus->tx_dma);
+	}
+	if (bus->rx_dma) {
+		dma_async_stop(bus->rx_dma);
+	}
+	/* PE low releases the bus and clears the state machine and flags */
+	I2C_CR1(i2c) &= ~I2C_CR1_PE;
+	while (I2C_CR1(i2c) & I2C_CR1_PE);
+	I2C_CR1(i2c) |= I2C_CR1_PE;
+}
+
+static bool i2c_async_dma_start(struct dma_async_chan *ch, bool read,
+				uint32_t i2c, void *buf, size_t n)
+{
+	const struct dma_async_xfer xfer = {
+		.dir = read ? DMA_ASYNC_PERIPH_TO_MEM : DMA_ASYNC_MEM_TO_PERIPH,
+		.periph = read ? (uint32_t)&I2C_RXDR(i2c) :
+				 (uint32_t)&I2C_TXDR(i2c),
+		.mem = (uint32_t)buf,
+		.count = n,
+		.width = DMA_ASYNC_WIDTH_8,
+		.priority = 1,
+	};
+
+	/* The DMA counts 16 bits, longer phases fall back to interrupts */
+	if (!ch || (n > 0xFFFF)) {
+		return false;
+	}
+	return dma_async_start(ch, &xfer);
+}
+
+/* Start the write or the read phase of the head transaction, with a START
+ * or a repeated START. */
+static void i2c_async_phase(struct i2c_async *bus, bool read)
+{
+	struct i2c_async_xfer *xfer = bus->head;
+	uint32_t i2c = bus->i2c;
+	size_t n = read ? xfer->rn : xfer->wn;
+	size_t chunk = n > I2C_ASYNC_NBYTES_MAX ? I2C_ASYNC_NBYTES_MAX : n;
+	uint32_t cr1;
+
+	bus->reading = read;
+	bus->pos = 0;
+	bus->left = n - chunk;
+
+	cr1 = I2C_CR1(i2c) & ~(I2C_CR1_TXIE | I2C_CR1_RXIE |
+			       I2C_CR1_TXDMAEN | I2C_CR1_RXDMAEN);
+	if (read) {
+		cr1 |= i2c_async_dma_start(bus->rx_dma, true, i2c, xfer->r, n) ?
+		       I2C_CR1_RXDMAEN : I2C_CR1_RXIE;
+	} else {
+		cr1 |= i2c_async_dma_start(bus->tx_dma, false, i2c,
+					   (void *)xfer->w, n) ?
+		       I2C_CR1_TXDMAEN : I2C_CR1_TXIE;
+	}
+	I2C_CR1(i2c) = cr1;
+
+	I2C_CR2(i2c) = (xfer->addr << I2C_CR2_SADD_7BIT_SHIFT) |
+		       (chunk << I2C_CR2_NBYTES_SHIFT) |
+		       (bus->left ? I2C_CR2_RELOAD : 0) |
+		       (read ? I2C_CR2_RD_WRN : 0) |
+		       I2C_CR2_START;
+}
+
+static void i2c_async_begin(struct i2c_async *bus)
+{
+	uint32_t i2c = bus->i2c;
+
+	bus->nack = false;
+	I2C_ICR(i2c) = I2C_ICR_STOPCF | I2C_ICR_NACKCF | I2C_ICR_BERRCF |
+		       I2C_ICR_ARLOCF | I2C_ICR_OVRCF;
+	I2C_CR1(i2c) |= I2C_CR1_NACKIE | I2C_CR1_STOPIE | I2C_CR1_TCIE |
+			I2C_CR1_ERRIE;
+	i2c_async_phase(bus, bus->head->wn == 0);
+}
+
+#else
+
+#define I2C_ASYNC_IRQS		(I2C_CR2_ITEVTEN | I2C_CR2_ITBUFEN | \
+				 I2C_CR2_ITERREN)
+#define I2C_ASYNC_ERRORS	(I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_OVR)
+
+static void i2c_async_reset(struct i2c_async *bus)
+{
+	uint32_t i2c = bus->i2c;
+
+	I2C_CR2(i2c) &= ~I2C_ASYNC_IRQS;
+	I2C_CR1(i2c) &= ~I2C_CR1_PE;
+	I2C_CR1(i2c) |= I2C_CR1_PE;
+}
+
+static void i2c_async_begin(struct i2c_async *bus)
+{
+	uint32_t i2c = bus->i2c;
+
+	bus->nack = false;
+	bus->reading = bus->head->wn == 0;
+	bus->pos = 0;
+
+	/* The STOP of the previous transaction is generated in a few bit
+	 * times, a START requested before it is out would be lost. */
+	while (I2C_CR1(i2c) & I2C_CR1_STOP);
+	I2C_CR1(i2c) = (I2C_CR1(i2c) & ~I2C_CR1_POS) | I2C_CR1_ACK;
+	I2C_CR2(i2c) |= I2C_ASYNC_IRQS;
+	I2C_CR1(i2c) |= I2C_CR1_START;
+}
+
+#endif
+
+/* End the head transaction and start the next one. The next one is on its
+ * way before the callback runs, so the callback may queue more. */
+static void i2c_async_finish(struct i2c_async *bus,
+			     enum i2c_async_status status)
+{
+	struct i2c_async_xfer *xfer = bus->head;
+
+	bus->head = xfer->next;
+	if (!bus->head) {
+		bus->tail = NULL;
+	}
+
+	switch (status) {
+	case I2C_ASYNC_DONE:
+		bus->stats.completed++;
+		break;
+	case I2C_ASYNC_NACK:
+		bus->stats.nacks++;
+		break;
+	case I2C_ASYNC_TIMEOUT:
+		bus->stats.timeouts++;
+		break;
+	default:
+		bus->stats.errors++;
+		break;
+	}
+
+	if (bus->head) {
+		bus->ticks = bus->timeout;
+		bus->head->status = I2C_ASYNC_RUNNING;
+		i2c_async_begin(bus);
+	} else {
+#if defined(I2C_ASYNC_V2)
+		I2C_CR1(bus->i2c) &= ~I2C_ASYNC_IRQS;
+#else
+		I2C_CR2(bus->i2c) &= ~I2C_ASYNC_IRQS;
+#endif
+	}
+
+	xfer->next = NULL;
+	xfer->status = status;
+	if (xfer->callback) {
+		xfer->callback(xfer, xfer->arg);
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Initialise an I2C bus for queued transactions.
+
+@param[in] bus Bus state
+@param[in] i2c I2C register base address @ref i2c_reg_base
+@param[in] timeout Number of @ref i2c_async_tick calls a transaction may
+take before it is aborted, 0 for no timeout
+*/
+void i2c_async_init(struct i2c_async *bus, uint32_t i2c, uint32_t timeout)
+{
+	bus->i2c = i2c;
+	bus->head = NULL;
+	bus->tail = NULL;
+	bus->reading = false;
+	bus->nack = false;
+	bus->pos = 0;
+	bus->left = 0;
+	bus->timeout = timeout;
+	bus->ticks = 0;
+	bus->tx_dma = NULL;
+	bus->rx_dma = NULL;
+	bus->stats.completed = 0;
+	bus->stats.nacks = 0;
+	bus->stats.errors = 0;
+	bus->stats.timeouts = 0;
+}
+
+#if defined(I2C_ASYNC_V2)
+/*---------------------------------------------------------------------------*/
+/** @brief Move the data of the transactions by DMA.
+
+The channels are allocated by the application with @ref dma_async_alloc for
+the TX and RX requests of the peripheral, and their interrupts must call
+@ref dma_async_irq. The end of each phase is still seen by the I2C interrupt.
+Only to be called while the bus is idle.
+
+@param[in] bus Bus state
+@param[in] tx Channel for the TX request, NULL to write from the interrupt
+@param[in] rx Channel for the RX request, NULL to read from the interrupt
+*/
+void i2c_async_set_dma(struct i2c_async *bus, struct dma_async_chan *tx,
+		       struct dma_async_chan *rx)
+{
+	bus->tx_dma = tx;
+	bus->rx_dma = rx;
+	if (tx) {
+		dma_async_set_callback(tx, NULL, NULL);
+	}
+	if (rx) {
+		dma_async_set_callback(rx, NULL, NULL);
+	}
+}
+#endif
+
+/*---------------------------------------------------------------------------*/
+/** @brief Queue a transaction.
+
+The transaction starts at once if the bus is idle, otherwise after the ones
+queued before it. @p xfer and its buffers must stay valid until its status is
+no longer @ref I2C_ASYNC_QUEUED or @ref I2C_ASYNC_RUNNING. May be called from
+the callback of a transaction.
+
+@param[in] bus Bus state
+@param[in] xfer Transaction
+@returns false if the transaction has no data
+*/
+bool i2c_async_submit(struct i2c_async *bus, struct i2c_async_xfer *xfer)
+{
+	uint32_t primask;
+
+	if (!xfer->wn && !xfer->rn) {
+		return false;
+	}
+
+	xfer->next = NULL;
+	xfer->status = I2C_ASYNC_QUEUED;
+
+	primask = cm_mask_interrupts(1);
+	if (bus->tail) {
+		bus->tail->next = xfer;
+		bus->tail = xfer;
+	} else {
+		bus->head = xfer;
+		bus->tail = xfer;
+		bus->ticks = bus->timeout;
+		xfer->status = I2C_ASYNC_RUNNING;
+		i2c_async_begin(bus);
+	}
+	cm_mask_interrupts(primask);
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief I2C event and error interrupt handler. */
+void i2c_async_isr(struct i2c_async *bus)
+{
+	uint32_t i2c = bus->i2c;
+	struct i2c_async_xfer *xfer = bus->head;
+
+#if defined(I2C_ASYNC_V2)
+	uint32_t isr = I2C_ISR(i2c);
+	uint32_t cr1 = I2C_CR1(i2c);
+	size_t chunk;
+
+	if (!xfer) {
+		I2C_CR1(i2c) &= ~I2C_ASYNC_IRQS;
+		return;
+	}
+
+	if (isr & I2C_ASYNC_ERRORS) {
+		i2c_async_reset(bus);
+		i2c_async_finish(bus, I2C_ASYNC_ERROR);
+		return;
+	}
+
+	/* A NACK makes the hardware send a STOP on its own, the transaction
+	 * ends with the STOPF that follows. */
+	if (isr & I2C_ISR_NACKF) {
+		I2C_ICR(i2c) = I2C_ICR_NACKCF;
+		bus->nack = true;
+	}
+
+	if ((cr1 & I2C_CR1_RXIE) && (isr & I2C_ISR_RXNE)) {
+		xfer->r[bus->pos++] = I2C_RXDR(i2c);
+	}
+	if ((cr1 & I2C_CR1_TXIE) && (isr & I2C_ISR_TXIS)) {
+		I2C_TXDR(i2c) = xfer->w[bus->pos++];
+	}
+
+	if (isr & I2C_ISR_TCR) {
+		chunk = bus->left > I2C_ASYNC_NBYTES_MAX ?
+			I2C_ASYNC_NBYTES_MAX : bus->left;
+		bus->left -= chunk;
+		I2C_CR2(i2c) = (I2C_CR2(i2c) & ~(I2C_CR2_NBYTES_MASK |
+						 I2C_CR2_RELOAD)) |
+			       (chunk << I2C_CR2_NBYTES_SHIFT) |
+			       (bus->left ? I2C_CR2_RELOAD : 0);
+	}
+
+	if (isr & I2C_ISR_TC) {
+		if (!bus->reading && xfer->rn) {
+			i2c_async_phase(bus, true);
+		} else {
+			I2C_CR2(i2c) |= I2C_CR2_STOP;
+		}
+	}
+
+	if (isr & I2C_ISR_STOPF) {
+		I2C_ICR(i2c) = I2C_ICR_STOPCF;
+		if (bus->tx_dma) {
+			dma_async_stop(bus->tx_dma);
+		}
+		if (bus->rx_dma) {
+			dma_async_stop(bus->rx_dma);
+		}
+		/* Drop a byte left in TXDR by a NACK */
+		I2C_ISR(i2c) = I2C_ISR_TXE;
+		i2c_async_finish(bus, bus->nack ? I2C_ASYNC_NACK :
+						  I2C_ASYNC_DONE);
+	}
+#else
+	uint32_t sr1 = I2C_SR1(i2c);
+	size_t left;
+
+	if (!xfer) {
+		I2C_CR2(i2c) &= ~I2C_ASYNC_IRQS;
+		return;
+	}
+
+	if (sr1 & I2C_ASYNC_ERRORS) {
+		I2C_SR1(i2c) = ~(sr1 & I2C_ASYNC_ERRORS);
+		i2c_async_reset(bus);
+		i2c_async_finish(bus, I2C_ASYNC_ERROR);
+		return;
+	}
+
+	if (sr1 & I2C_SR1_AF) {
+		I2C_SR1(i2c) = ~I2C_SR1_AF;
+		I2C_CR1(i2c) |= I2C_CR1_STOP;
+		i2c_async_finish(bus, I2C_ASYNC_NACK);
+		return;
+	}
+
+	if (sr1 & I2C_SR1_SB) {
+		I2C_DR(i2c) = (xfer->addr << 1) | (bus->reading ? 1 : 0);
+		return;
+	}
+
+	/* The end of a read is set up before ADDR is cleared, see the
+	 * reference manual: single byte reads NACK their byte and stop,
+	 * two byte reads NACK the second one with POS, and longer reads are
+	 * finished from BTF with the last three bytes. */
+	if (sr1 & I2C_SR1_ADDR) {
+		if (bus->reading && (xfer->rn == 1)) {
+			I2C_CR1(i2c) &= ~I2C_CR1_ACK;
+			(void)I2C_SR2(i2c);
+			I2C_CR1(i2c) |= I2C_CR1_STOP;
+		} else if (bus->reading && (xfer->rn == 2)) {
+			I2C_CR1(i2c) = (I2C_CR1(i2c) & ~I2C_CR1_ACK) |
+				       I2C_CR1_POS;
+			(void)I2C_SR2(i2c);
+			I2C_CR2(i2c) &= ~I2C_CR2_ITBUFEN;
+		} else {
+			if (bus->reading && (xfer->rn == 3)) {
+				I2C_CR2(i2c) &= ~I2C_CR2_ITBUFEN;
+			}
+			(void)I2C_SR2(i2c);
+		}
+		return;
+	}
+
+	if (!bus->reading) {
+		if ((I2C_CR2(i2c) & I2C_CR2_ITBUFEN) && (sr1 & I2C_SR1_TxE)) {
+			I2C_DR(i2c) = xfer->w[bus->pos++];
+			if (bus->pos == xfer->wn) {
+				I2C_CR2(i2c) &= ~I2C_CR2_ITBUFEN;
+			}
+		} else if (sr1 & I2C_SR1_BTF) {
+			if (xfer->rn) {
+				bus->reading = true;
+				bus->pos = 0;
+				I2C_CR2(i2c) |= I2C_CR2_ITBUFEN;
+				I2C_CR1(i2c) |= I2C_CR1_START;
+			} else {
+				I2C_CR1(i2c) |= I2C_CR1_STOP;
+				i2c_async_finish(bus, I2C_ASYNC_DONE);
+			}
+		}
+		return;
+	}
+
+	if ((I2C_CR2(i2c) & I2C_CR2_ITBUFEN) && (sr1 & I2C_SR1_RxNE)) {
+		xfer->r[bus->pos++] = I2C_DR(i2c);
+		if (xfer->rn == 1) {
+			i2c_async_finish(bus, I2C_ASYNC_DONE);
+		} else if (xfer->rn - bus->pos == 3) {
+			I2C_CR2(i2c) &= ~I2C_CR2_ITBUFEN;
+		}
+		return;
+	}
+
+	if (sr1 & I2C_SR1_BTF) {
+		left = xfer->rn - bus->pos;
+		if (left == 3) {
+			I2C_CR1(i2c) &= ~I2C_CR1_ACK;
+			xfer->r[bus->pos++] = I2C_DR(i2c);
+		} else if (left == 2) {
+			I2C_CR1(i2c) |= I2C_CR1_STOP;
+			xfer->r[bus->pos++] = I2C_DR(i2c);
+			xfer->r[bus->pos++] = I2C_DR(i2c);
+			I2C_CR1(i2c) &= ~I2C_CR1_POS;
+			i2c_async_finish(bus, I2C_ASYNC_DONE);
+		}
+	}
+#endif
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Count down the timeout of the running transaction.
+
+When it expires, the peripheral is reset, which also releases the bus, and
+the transaction ends with @ref I2C_ASYNC_TIMEOUT.
+*/
+void i2c_async_tick(struct i2c_async *bus)
+{
+	uint32_t primask = cm_mask_interrupts(1);
+
+	if (bus->head && bus->timeout && (--bus->ticks == 0)) {
+		i2c_async_reset(bus);
+		i2c_async_finish(bus, I2C_ASYNC_TIMEOUT);
+	}
+	cm_mask_interrupts(primask);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Check whether all queued transactions have ended. */
+bool i2c_async_idle(struct i2c_async *bus)
+{
+	return bus->head == NULL;
+}
+
+/**@}*/
@@ -1,5 +1,5 @@
-
 #include <libopencm3/stm32/quadspi.h>
+#include <libopencm3/stm32/dma_async.h>
 
 void quadspi_enable(uint32_t quadspi)
 {
@@ -10,3 +10,292 @@ void quadspi_disable(uint32_t quadspi)
 {
 	QUADSPI_CR(quadspi) &= ~QUADSPI_CR_EN;
 }
+
+void quadspi_set_prescaler(uint32_t quadspi, uint8_t prescaler)
+{
+	QUADSPI_CR(quadspi) = (QUADSPI_CR(quadspi) &
+		~(QUADSPI_CR_PRESCALE_MASK << QUADSPI_CR_PRESCALE_SHIFT)) |
+		((uint32_t)prescaler << QUADSPI_CR_PRESCALE_SHIFT);
+}
+
+void quadspi_set_flash_size(uint32_t quadspi, uint8_t fsize)
+{
+	QUADSPI_DCR(quadspi) = (QUADSPI_DCR(quadspi) &
+		~(QUADSPI_DCR_FSIZE_MASK << QUADSPI_DCR_FSIZE_SHIFT)) |
+		((fsize & QUADSPI_DCR_FSIZE_MASK) << QUADSPI_DCR_FSIZE_SHIFT);
+}
+
+void quadspi_set_cs_high_time(uint32_t quadspi, uint8_t cycles)
+{
+	QUADSPI_DCR(quadspi) = (QUADSPI_DCR(quadspi) &
+		~(QUADSPI_DCR_CSHT_MASK << QUADSPI_DCR_CSHT_SHIFT)) |
+		(((cycles - 1) & QUADSPI_DCR_CSHT_MASK) <<
+		 QUADSPI_DCR_CSHT_SHIFT);
+}
+
+void quadspi_set_clock_mode(uint32_t quadspi, uint8_t mode)
+{
+	if (mode == 3) {
+		QUADSPI_DCR(quadspi) |= QUADSPI_DCR_CKMODE;
+	} else {
+		QUADSPI_DCR(quadspi) &= ~QUADSPI_DCR_CKMODE;
+	}
+}
+
+void quadspi_set_fifo_threshold(uint32_t quadspi, uint8_t bytes)
+{
+	QUADSPI_CR(quadspi) = (QUADSPI_CR(quadspi) &
+		~(QUADSPI_CR_FTHRES_MASK << QUADSPI_CR_FTHRES_SHIFT)) |
+		(((bytes - 1) & QUADSPI_CR_FTHRES_MASK) <<
+		 QUADSPI_CR_FTHRES_SHIFT);
+}
+
+void quadspi_enable_sample_shift(uint32_t quadspi)
+{
+	QUADSPI_CR(quadspi) |= QUADSPI_CR_SSHIFT;
+}
+
+void quadspi_disable_sample_shift(uint32_t quadspi)
+{
+	QUADSPI_CR(quadspi) &= ~QUADSPI_CR_SSHIFT;
+}
+
+uint32_t quadspi_command_ccr(const struct quadspi_command *cmd,
+			     uint8_t fmode)
+{
+	uint32_t ccr = ((uint32_t)fmode << QUADSPI_CCR_FMODE_SHIFT) |
+		((uint32_t)cmd->data_mode << QUADSPI_CCR_DMODE_SHIFT) |
+		((uint32_t)(cmd->dummy_cycles & QUADSPI_CCR_DCYC_MASK) <<
+		 QUADSPI_CCR_DCYC_SHIFT) |
+		((uint32_t)cmd->alternate_mode << QUADSPI_CCR_ABMODE_SHIFT) |
+		((uint32_t)cmd->address_mode << QUADSPI_CCR_ADMODE_SHIFT) |
+		((uint32_t)cmd->instruction_mode << QUADSPI_CCR_IMODE_SHIFT) |
+		((uint32_t)cmd->instruction << QUADSPI_CCR_INST_SHIFT);
+
+	if (cmd->alternate_mode != QUADSPI_CCR_MODE_NONE) {
+		ccr |= ((uint32_t)(cmd->alternate_size - 1) &
+			QUADSPI_CCR_ABSIZE_MASK) << QUADSPI_CCR_ABSIZE_SHIFT;
+	}
+	if (cmd->address_mode != QUADSPI_CCR_MODE_NONE) {
+		ccr |= ((uint32_t)(cmd->address_size - 1) &
+			QUADSPI_CCR_ADSIZE_MASK) << QUADSPI_CCR_ADSIZE_SHIFT;
+	}
+	if (cmd->ddr) {
+		ccr |= QUADSPI_CCR_DDRM;
+	}
+	if (cmd->sioo) {
+		ccr |= QUADSPI_CCR_SIOO;
+	}
+	return ccr;
+}
+
+void quadspi_abort(uint32_t quadspi)
+{
+	QUADSPI_CR(quadspi) |= QUADSPI_CR_ABORT;
+	while (QUADSPI_CR(quadspi) & QUADSPI_CR_ABORT);
+	while (QUADSPI_SR(quadspi) & QUADSPI_SR_BUSY);
+}
+
+/* Start a command: the transfer begins with the write of the last register
+ * it needs, CCR or AR. */
+static void quadspi_start(uint32_t quadspi, const struct quadspi_command *cmd,
+			  uint8_t fmode, uint32_t len)
+{
+	while (QUADSPI_SR(quadspi) & QUADSPI_SR_BUSY);
+	QUADSPI_FCR(quadspi) = QUADSPI_FCR_CTOF | QUADSPI_FCR_CSMF |
+			       QUADSPI_FCR_CTCF | QUADSPI_FCR_CTEF;
+	if (len) {
+		QUADSPI_DLR(quadspi) = len - 1;
+	}
+	if (cmd->alternate_mode != QUADSPI_CCR_MODE_NONE) {
+		QUADSPI_ABR(quadspi) = cmd->alternate;
+	}
+	QUADSPI_CCR(quadspi) = quadspi_command_ccr(cmd, fmode);
+	if (cmd->address_mode != QUADSPI_CCR_MODE_NONE) {
+		QUADSPI_AR(quadspi) = cmd->address;
+	}
+}
+
+/* Wait for the end of the command in progress */
+static bool quadspi_complete(uint32_t quadspi)
+{
+	uint32_t sr;
+
+	do {
+		sr = QUADSPI_SR(quadspi);
+	} while (!(sr & (QUADSPI_SR_TCF | QUADSPI_SR_TEF)));
+	QUADSPI_FCR(quadspi) = QUADSPI_FCR_CTCF | QUADSPI_FCR_CTEF;
+	return !(sr & QUADSPI_SR_TEF);
+}
+
+/* Wait for the FIFO to hold at least one byte (read) or have room for one
+ * (write) */
+static bool quadspi_wait_fifo(uint32_t quadspi)
+{
+	uint32_t sr;
+
+	do {
+		sr = QUADSPI_SR(quadspi);
+	} while (!(sr & (QUADSPI_SR_FTF | QUADSPI_SR_TEF)));
+	return !(sr & QUADSPI_SR_TEF);
+}
+
+bool quadspi_command(uint32_t quadspi, const struct quadspi_command *cmd)
+{
+	quadspi_start(quadspi, cmd, QUADSPI_CCR_FMODE_IWRITE, 0);
+	return quadspi_complete(quadspi);
+}
+
+bool quadspi_read(uint32_t quadspi, const struct quadspi_command *cmd,
+		  uint8_t *data, uint32_t len)
+{
+	uint32_t i;
+
+	quadspi_start(quadspi, cmd, QUADSPI_CCR_FMODE_IREAD, len);
+	for (i = 0; i < len; i++) {
+		if (!quadspi_wait_fifo(quadspi)) {
+			quadspi_abort(quadspi);
+			QUADSPI_FCR(quadspi) = QUADSPI_FCR_CTCF |
+					       QUADSPI_FCR_CTEF;
+			return false;
+		}
+		data[i] = QUADSPI_BYTE_DR(quadspi);
+	}
+	return quadspi_complete(quadspi);
+}
+
+bool quadspi_write(uint32_t quadspi, const struct quadspi_command *cmd,
+		   const uint8_t *data, uint32_t len)
+{
+	uint32_t i;
+
+	quadspi_start(quadspi, cmd, QUADSPI_CCR_FMODE_IWRITE, len);
+	for (i = 0; i < len; i++) {
+		if (!quadspi_wait_fifo(quadspi)) {
+			quadspi_abort(quadspi);
+			QUADSPI_FCR(quadspi) = QUADSPI_FCR_CTCF |
+					       QUADSPI_FCR_CTEF;
+			return false;
+		}
+		QUADSPI_BYTE_DR(quadspi) = data[i];
+	}
+	return quadspi_complete(quadspi);
+}
+
+#if defined(QUADSPI_CR_DMAEN)
+static bool quadspi_dma(uint32_t quadspi, const struct quadspi_command *cmd,
+			struct dma_async_chan *dma, uint8_t fmode,
+			uint32_t mem, uint32_t len)
+{
+	struct dma_async_xfer xfer = {
+		.dir = fmode == QUADSPI_CCR_FMODE_IREAD ?
+		       DMA_ASYNC_PERIPH_TO_MEM : DMA_ASYNC_MEM_TO_PERIPH,
+		.periph = (uint32_t)&QUADSPI_BYTE_DR(quadspi),
+		.mem = mem,
+		.count = len,
+		.width = DMA_ASYNC_WIDTH_8,
+		.priority = 2,
+	};
+
+	if (!len || (len > 0xFFFF) || dma->busy) {
+		return false;
+	}
+
+	/* The transfer starts with the command, requests follow at once */
+	while (QUADSPI_SR(quadspi) & QUADSPI_SR_BUSY);
+	QUADSPI_CR(quadspi) |= QUADSPI_CR_DMAEN;
+	if (!dma_async_start(dma, &xfer)) {
+		QUADSPI_CR(quadspi) &= ~QUADSPI_CR_DMAEN;
+		return false;
+	}
+	quadspi_start(quadspi, cmd, fmode, len);
+	return true;
+}
+#endif
+
+bool quadspi_read_dma(uint32_t quadspi, const struct quadspi_command *cmd,
+		      struct dma_async_chan *dma, uint8_t *data, uint32_t len)
+{
+#if defined(QUADSPI_CR_DMAEN)
+	return quadspi_dma(quadspi, cmd, dma, QUADSPI_CCR_FMODE_IREAD,
+			   (uint32_t)data, len);
+#else
+	(void)quadspi;
+	(void)cmd;
+	(void)dma;
+	(void)data;
+	(void)len;
+	return false;
+#endif
+}
+
+bool quadspi_write_dma(uint32_t quadspi, const struct quadspi_command *cmd,
+		       struct dma_async_chan *dma, const uint8_t *data,
+		       uint32_t len)
+{
+#if defined(QUADSPI_CR_DMAEN)
+	return quadspi_dma(quadspi, cmd, dma, QUADSPI_CCR_FMODE_IWRITE,
+			   (uint32_t)data, len);
+#else
+	(void)quadspi;
+	(void)cmd;
+	(void)dma;
+	(void)data;
+	(void)len;
+	return false;
+#endif
+}
+
+bool quadspi_dma_finish(uint32_t quadspi)
+{
+	bool ok = quadspi_complete(quadspi);
+
+#if defined(QUADSPI_CR_DMAEN)
+	QUADSPI_CR(quadspi) &= ~QUADSPI_CR_DMAEN;
+#endif
+	return ok;
+}
+
+bool quadspi_poll_status(uint32_t quadspi, const struct quadspi_command *cmd,
+			 uint32_t mask, uint32_t match, uint8_t size,
+			 uint16_t interval)
+{
+	uint32_t sr;
+
+	while (QUADSPI_SR(quadspi) & QUADSPI_SR_BUSY);
+	QUADSPI_PSMKR(quadspi) = mask;
+	QUADSPI_PSMAR(quadspi) = match;
+	QUADSPI_PIR(quadspi) = interval;
+	/* Stop at the first match, with all the masked bits equal */
+	QUADSPI_CR(quadspi) = (QUADSPI_CR(quadspi) & ~QUADSPI_CR_PMM) |
+			      QUADSPI_CR_APMS;
+	quadspi_start(quadspi, cmd, QUADSPI_CCR_FMODE_APOLL, size);
+
+	do {
+		sr = QUADSPI_SR(quadspi);
+	} while (!(sr & (QUADSPI_SR_SMF | QUADSPI_SR_TEF)));
+	QUADSPI_FCR(quadspi) = QUADSPI_FCR_CSMF | QUADSPI_FCR_CTCF |
+			       QUADSPI_FCR_CTEF;
+	if (sr & QUADSPI_SR_TEF) {
+		quadspi_abort(quadspi);
+		return false;
+	}
+	return true;
+}
+
+void quadspi_memory_mapped(uint32_t quadspi, const struct quadspi_command *cmd,
+			   uint16_t timeout)
+{
+	while (QUADSPI_SR(quadspi) & QUADSPI_SR_BUSY);
+	if (timeout) {
+		QUADSPI_LPTR(quadspi) = timeout;
+		QUADSPI_CR(quadspi) |= QUADSPI_CR_TCEN;
+	} else {
+		QUADSPI_CR(quadspi) &= ~QUADSPI_CR_TCEN;
+	}
+	if (cmd->alternate_mode != QUADSPI_CCR_MODE_NONE) {
+		QUADSPI_ABR(quadspi) = cmd->alternate;
+	}
+	QUADSPI_CCR(quadspi) = quadspi_command_ccr(cmd,
+						   QUADSPI_CCR_FMODE_MEMMAP);
+}
@@ -0,0 +1,621 @@
+/** @addtogroup sdio_file SDIO peripheral API
+@ingroup peripheral_apis
+
+@brief SD and MMC memory cards over the SDIO peripheral
+
+Identifies and initialises SD (standard, high and extended capacity) and MMC
+or eMMC cards, switches them to the 4 bit bus and, when the card and the
+given dividers allow, to high speed. Blocks of 512 bytes are then read and
+written by DMA, several blocks with one multiple block command (CMD18,
+CMD25), and the end is reported from the SDIO interrupt.
+
+The application sets up the pins and clocks, allocates a DMA channel with
+@ref dma_async_alloc for the SDIO request, whose interrupt must call
+@ref dma_async_irq, and calls @ref sdio_card_isr from the SDIO interrupt,
+enabled in the NVIC.
+
+Card detection and supply switching are left to the board.
+
+LGPL License Terms @ref lgpl_license
+*/
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#include <stddef.h>
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/stm32/sdio_card.h>
+
+/* Response kinds */
+enum sdio_card_resp {
+	SDIO_CARD_R_NONE,
+	SDIO_CARD_R1,		/* Card status */
+	SDIO_CARD_R2,		/* CID or CSD, long */
+	SDIO_CARD_R3,		/* OCR, without a valid CRC */
+	SDIO_CARD_R6,		/* Published RCA */
+	SDIO_CARD_R7,		/* Interface condition */
+};
+
+/* Card status bits */
+#define SDIO_CARD_STATUS_ERRORS		0xFDFFE008U
+#define SDIO_CARD_STATUS_SWITCH_ERROR	(1U << 7)
+#define SDIO_CARD_STATUS_READY		(1U << 8)
+#define SDIO_CARD_STATUS_STATE(s)	(((s) >> 9) & 0xF)
+#define SDIO_CARD_STATE_TRAN		4
+
+/* OCR bits */
+#define SDIO_CARD_OCR_BUSY		(1U << 31)
+#define SDIO_CARD_OCR_CCS		(1U << 30)
+
+#define SDIO_CARD_ICR_ALL		0x00C007FFU
+#define SDIO_CARD_DATA_ERRORS		(SDIO_STA_DCRCFAIL | SDIO_STA_DTIMEOUT | \
+					 SDIO_STA_TXUNDERR | SDIO_STA_RXOVERR | \
+					 SDIO_STA_STBITERR)
+
+/* Data timeout, in card clock cycles: 0.5 s at 24 MHz */
+#define SDIO_CARD_DATA_TIMEOUT		12000000U
+/* Operating condition polls before giving up, about 1 s at 400 kHz */
+#define SDIO_CARD_INIT_TRIES		4000
+/* Status polls while the card is busy programming */
+#define SDIO_CARD_READY_TRIES		1000000
+
+static void sdio_card_set_clock(uint16_t div, bool wide)
+{
+	uint32_t clkcr = SDIO_CLKCR_CLKEN |
+			 (wide ? SDIO_CLKCR_WIDBUS_4 : SDIO_CLKCR_WIDBUS_1);
+
+	if (div == SDIO_CARD_CLKDIV_BYPASS) {
+		clkcr |= SDIO_CLKCR_BYPASS;
+	} else {
+		clkcr |= div & SDIO_CLKCR_CLKDIV_MASK;
+	}
+	SDIO_CLKCR = clkcr;
+}
+
+/* Send a command and wait for its response */
+static bool sdio_card_cmd(uint8_t index, uint32_t arg,
+			  enum sdio_card_resp resp, uint32_t *out)
+{
+	uint32_t cmd = index | SDIO_CMD_CPSMEN;
+	uint32_t done = SDIO_STA_CMDREND | SDIO_STA_CCRCFAIL |
+			SDIO_STA_CTIMEOUT;
+	uint32_t sta;
+
+	if (resp == SDIO_CARD_R_NONE) {
+		done = SDIO_STA_CMDSENT;
+	} else if (resp == SDIO_CARD_R2) {
+		cmd |= SDIO_CMD_WAITRESP_LONG;
+	} else {
+		cmd |= SDIO_CMD_WAITRESP_SHORT;
+	}
+
+	SDIO_ICR = SDIO_ICR_CMDSENTC | SDIO_ICR_CMDRENDC | SDIO_ICR_CCRCFAILC |
+		   SDIO_ICR_CTIMEOUTC;
+	SDIO_ARG = arg;
+	SDIO_CMD = cmd;
+	do {
+		sta = SDIO_STA;
+	} while (!(sta & done));
+	SDIO_ICR = SDIO_ICR_CMDSENTC | SDIO_ICR_CMDRENDC | SDIO_ICR_CCRCFAILC |
+		   SDIO_ICR_CTIMEOUTC;
+
+	if (sta & SDIO_STA_CTIMEOUT) {
+		return false;
+	}
+	/* The OCR comes with all ones in place of the CRC */
+	if ((sta & SDIO_STA_CCRCFAIL) && (resp != SDIO_CARD_R3)) {
+		return false;
+	}
+	if (!out) {
+		return (resp != SDIO_CARD_R1) ||
+		       !(SDIO_RESP1 & SDIO_CARD_STATUS_ERRORS);
+	}
+
+	out[0] = SDIO_RESP1;
+	if (resp == SDIO_CARD_R2) {
+		out[1] = SDIO_RESP2;
+		out[2] = SDIO_RESP3;
+		out[3] = SDIO_RESP4;
+	}
+	return (resp != SDIO_CARD_R1) ||
+	       !(out[0] & SDIO_CARD_STATUS_ERRORS);
+}
+
+/* Application specific command: CMD55 then the command */
+static bool sdio_card_acmd(const struct sdio_card *c, uint8_t index,
+			   uint32_t arg, enum sdio_card_resp resp,
+			   uint32_t *out)
+{
+	return sdio_card_cmd(55, (uint32_t)c->rca << 16, SDIO_CARD_R1, NULL) &&
+	       sdio_card_cmd(index, arg, resp, out);
+}
+
+/* Wait for the card to be back in the transfer state, ready for data */
+static bool sdio_card_wait_ready(const struct sdio_card *c, uint32_t *status)
+{
+	uint32_t s;
+	uint32_t i;
+
+	for (i = 0; i < SDIO_CARD_READY_TRIES; i++) {
+		if (!sdio_card_cmd(13, (uint32_t)c->rca << 16, SDIO_CARD_R1,
+				   &s)) {
+			return false;
+		}
+		if ((s & SDIO_CARD_STATUS_READY) &&
+		    (SDIO_CARD_STATUS_STATE(s) == SDIO_CARD_STATE_TRAN)) {
+			if (status) {
+				*status = s;
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Read a short data block by the CPU, during initialisation */
+static bool sdio_card_read_data(uint8_t index, uint32_t arg, uint32_t *buf,
+				uint32_t len, uint32_t blocksize)
+{
+	uint32_t sta;
+	uint32_t n = 0;
+
+	SDIO_ICR = SDIO_CARD_ICR_ALL;
+	SDIO_DTIMER = SDIO_CARD_DATA_TIMEOUT;
+	SDIO_DLEN = len;
+	SDIO_DCTRL = blocksize | SDIO_DCTRL_DTDIR | SDIO_DCTRL_DTEN;
+	if (!sdio_card_cmd(index, arg, SDIO_CARD_R1, NULL)) {
+		SDIO_DCTRL = 0;
+		return false;
+	}
+
+	do {
+		sta = SDIO_STA;
+		if ((sta & SDIO_STA_RXDAVL) && (n < len / 4)) {
+			buf[n++] = SDIO_FIFO;
+		}
+	} while (!(sta & (SDIO_STA_DATAEND | SDIO_CARD_DATA_ERRORS)));
+	while ((SDIO_STA & SDIO_STA_RXDAVL) && (n < len / 4)) {
+		buf[n++] = SDIO_FIFO;
+	}
+
+	SDIO_DCTRL = 0;
+	SDIO_ICR = SDIO_CARD_ICR_ALL;
+	return !(sta & SDIO_CARD_DATA_ERRORS);
+}
+
+/* Capacity from the CSD, or for high capacity MMC from the EXT_CSD */
+static bool sdio_card_capacity(struct sdio_card *c)
+{
+	uint32_t c_size, mult, bl_len;
+	uint32_t ext_csd[128];
+
+	if ((c->type == SDIO_CARD_MMC) && c->block_addressing) {
+		/* SEC_COUNT, bytes 212 to 215 */
+		if (!sdio_card_read_data(8, 0, ext_csd, sizeof(ext_csd),
+					 SDIO_DCTRL_DBLOCKSIZE_9)) {
+			return false;
+		}
+		c->blocks = ext_csd[212 / 4];
+	} else if ((c->csd[0] >> 30) == 1) {
+		/* CSD 2.0: C_SIZE [69:48], in 512 KiB units */
+		c_size = ((c->csd[1] & 0x3F) << 16) | (c->csd[2] >> 16);
+		c->blocks = (c_size + 1) << 10;
+	} else {
+		/* CSD 1.0: C_SIZE [73:62], C_SIZE_MULT [49:47],
+		 * READ_BL_LEN [83:80] */
+		c_size = ((c->csd[1] & 0x3FF) << 2) | (c->csd[2] >> 30);
+		mult = (c->csd[2] >> 15) & 7;
+		bl_len = (c->csd[1] >> 16) & 0xF;
+		c->blocks = (c_size + 1) << (mult + 2 + bl_len - 9);
+	}
+	return true;
+}
+
+/* SD: 4 bit bus with ACMD6, high speed with CMD6 switch function */
+static void sdio_card_sd_speed(struct sdio_card *c, uint16_t init_div,
+			       bool hs)
+{
+	uint32_t status[16];
+
+	/* The card drives all four lines from now on, so must the host
+	 * before reading the switch status */
+	if (sdio_card_acmd(c, 6, 2, SDIO_CARD_R1, NULL)) {
+		c->wide = true;
+		sdio_card_set_clock(init_div, true);
+	}
+	if (!hs) {
+		return;
+	}
+	/* Set function group 1 to high speed; the 64 byte status tells
+	 * whether it took, in byte 16 */
+	if (sdio_card_read_data(6, 0x80FFFFF1, status, sizeof(status),
+				SDIO_DCTRL_DBLOCKSIZE_6) &&
+	    ((((const uint8_t *)status)[16] & 0xF) == 1)) {
+		c->high_speed = true;
+	}
+}
+
+/* MMC: 4 bit bus and high speed timing through the EXT_CSD */
+static void sdio_card_mmc_speed(struct sdio_card *c, bool hs)
+{
+	uint32_t s;
+
+	/* BUS_WIDTH (183) = 1 */
+	if (sdio_card_cmd(6, 0x03B70100, SDIO_CARD_R1, NULL) &&
+	    sdio_card_wait_ready(c, &s) &&
+	    !(s & SDIO_CARD_STATUS_SWITCH_ERROR)) {
+		c->wide = true;
+	}
+	if (!hs) {
+		return;
+	}
+	/* HS_TIMING (185) = 1 */
+	if (sdio_card_cmd(6, 0x03B90100, SDIO_CARD_R1, NULL) &&
+	    sdio_card_wait_ready(c, &s) &&
+	    !(s & SDIO_CARD_STATUS_SWITCH_ERROR)) {
+		c->high_speed = true;
+	}
+}
+
+static bool sdio_card_identify(struct sdio_card *c)
+{
+	uint32_t r[4];
+	bool v2;
+	int i;
+
+	sdio_card_cmd(0, 0, SDIO_CARD_R_NONE, NULL);
+
+	/* Only SD 2.0 and later cards answer CMD8, echoing the pattern */
+	v2 = sdio_card_cmd(8, 0x1AA, SDIO_CARD_R7, r) &&
+	     ((r[0] & 0xFFF) == 0x1AA);
+
+	c->type = SDIO_CARD_SDSC;
+	for (i = 0; i < SDIO_CARD_INIT_TRIES; i++) {
+		if (!sdio_card_acmd(c, 41, 0x80100000 |
+				    (v2 ? SDIO_CARD_OCR_CCS : 0),
+				    SDIO_CARD_R3, r)) {
+			c->type = SDIO_CARD_MMC;
+			break;
+		}
+		if (r[0] & SDIO_CARD_OCR_BUSY) {
+			break;
+		}
+	}
+
+	if (c->type == SDIO_CARD_MMC) {
+		/* No answer to CMD55: an MMC, asked for sector mode */
+		sdio_card_cmd(0, 0, SDIO_CARD_R_NONE, NULL);
+		for (i = 0; i < SDIO_CARD_INIT_TRIES; i++) {
+			if (!sdio_card_cmd(1, 0x40FF8000, SDIO_CARD_R3, r)) {
+				return false;
+			}
+			if (r[0] & SDIO_CARD_OCR_BUSY) {
+				break;
+			}
+		}
+	}
+	if (i == SDIO_CARD_INIT_TRIES) {
+		return false;
+	}
+
+	c->block_addressing = (r[0] & SDIO_CARD_OCR_CCS) != 0;
+	if ((c->type == SDIO_CARD_SDSC) && c->block_addressing) {
+		c->type = SDIO_CARD_SDHC;
+	}
+
+	if (!sdio_card_cmd(2, 0, SDIO_CARD_R2, c->cid)) {
+		return false;
+	}
+	if (c->type == SDIO_CARD_MMC) {
+		/* The host gives an MMC its address */
+		c->rca = 1;
+		if (!sdio_card_cmd(3, (uint32_t)c->rca << 16, SDIO_CARD_R1,
+				   NULL)) {
+			return false;
+		}
+	} else {
+		if (!sdio_card_cmd(3, 0, SDIO_CARD_R6, r)) {
+			return false;
+		}
+		c->rca = r[0] >> 16;
+	}
+	return sdio_card_cmd(9, (uint32_t)c->rca << 16, SDIO_CARD_R2, c->csd);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Power up and initialise the card.
+
+The SDIO clock must be enabled. Dividers give the card clock as the SDIO
+clock divided by (div + 2), or the SDIO clock itself with
+@ref SDIO_CARD_CLKDIV_BYPASS.
+
+@param[in] c Card state
+@param[in] init_div Divider for identification, at most 400 kHz
+@param[in] div Divider for transfers, at most 25 MHz
+@param[in] hs_div Divider for transfers in high speed, at most 50 MHz, or
+the same as div to stay at default speed
+@returns false if no card answered or its initialisation failed
+*/
+bool sdio_card_init(struct sdio_card *c, uint16_t init_div, uint16_t div,
+		    uint16_t hs_div)
+{
+	volatile uint32_t i;
+
+	c->type = SDIO_CARD_NONE;
+	c->rca = 0;
+	c->block_addressing = false;
+	c->wide = false;
+	c->high_speed = false;
+	c->blocks = 0;
+	c->busy = false;
+	c->error = 0;
+	c->stats.blocks_read = 0;
+	c->stats.blocks_written = 0;
+	c->stats.errors = 0;
+
+	SDIO_MASK = 0;
+	SDIO_DCTRL = 0;
+	SDIO_POWER = SDIO_POWER_PWRCTRL_PWRON;
+	sdio_card_set_clock(init_div, false);
+	/* Let the card see its 74 power up clock cycles */
+	for (i = 0; i < 100000; i++);
+
+	if (!sdio_card_identify(c)) {
+		c->type = SDIO_CARD_NONE;
+		return false;
+	}
+
+	/* Select the card, and give standard capacity cards our block size */
+	if (!sdio_card_cmd(7, (uint32_t)c->rca << 16, SDIO_CARD_R1, NULL) ||
+	    !sdio_card_wait_ready(c, NULL) ||
+	    (!c->block_addressing &&
+	     !sdio_card_cmd(16, SDIO_CARD_BLOCK_SIZE, SDIO_CARD_R1, NULL)) ||
+	    !sdio_card_capacity(c)) {
+		c->type = SDIO_CARD_NONE;
+		return false;
+	}
+
+	if (c->type == SDIO_CARD_MMC) {
+		sdio_card_mmc_speed(c, hs_div != div);
+	} else {
+		sdio_card_sd_speed(c, init_div, hs_div != div);
+	}
+	sdio_card_set_clock(c->high_speed ? hs_div : div, c->wide);
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set the DMA channel of the transfers. */
+void sdio_card_set_dma(struct sdio_card *c, struct dma_async_chan *dma)
+{
+	c->dma = dma;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set the function called when a transfer has ended. */
+void sdio_card_set_callback(struct sdio_card *c,
+			    sdio_card_callback_t callback, void *arg)
+{
+	c->callback = callback;
+	c->callback_arg = arg;
+}
+
+/* true for the one caller that gets to end the transfer. The SDIO and DMA
+ * interrupts may preempt each other, each ends it once it has seen both
+ * halves complete, or on an error. */
+static bool sdio_card_claim(struct sdio_card *c, uint32_t error)
+{
+	uint32_t primask = cm_mask_interrupts(1);
+	bool ret = c->busy && !c->ending &&
+		   (error || (c->data_done && c->dma_done));
+
+	if (ret) {
+		c->ending = true;
+	}
+	cm_mask_interrupts(primask);
+	return ret;
+}
+
+static void sdio_card_done(struct sdio_card *c, uint32_t error)
+{
+	if (!sdio_card_claim(c, error)) {
+		return;
+	}
+	SDIO_MASK = 0;
+	SDIO_DCTRL = 0;
+	SDIO_ICR = SDIO_CARD_ICR_ALL;
+	if (error) {
+		dma_async_stop(c->dma);
+		c->stats.errors++;
+	} else if (c->writing) {
+		c->stats.blocks_written += c->count;
+	} else {
+		c->stats.blocks_read += c->count;
+	}
+	/* Multiple block commands run until stopped */
+	if (c->count > 1) {
+		sdio_card_cmd(12, 0, SDIO_CARD_R1, NULL);
+	}
+	c->error = error;
+	c->busy = false;
+	if (c->callback) {
+		c->callback(c, !error, c->callback_arg);
+	}
+}
+
+static void sdio_card_dma_event(struct dma_async_chan *ch, uint32_t events,
+				void *arg)
+{
+	struct sdio_card *c = arg;
+
+	(void)ch;
+	if (!c->busy) {
+		return;
+	}
+	if (events & DMA_ASYNC_ERROR) {
+		sdio_card_done(c, SDIO_CARD_ERROR_DMA);
+	} else if (events & DMA_ASYNC_COMPLETE) {
+		c->dma_done = true;
+		sdio_card_done(c, 0);
+	}
+}
+
+static bool sdio_card_start(struct sdio_card *c, uint32_t block, void *buf,
+			    uint16_t count, bool write)
+{
+	struct dma_async_xfer xfer = {
+		.dir = write ? DMA_ASYNC_MEM_TO_PERIPH :
+			       DMA_ASYNC_PERIPH_TO_MEM,
+		.periph = (uint32_t)&SDIO_FIFO,
+		.mem = (uint32_t)buf,
+		.count = count * (SDIO_CARD_BLOCK_SIZE / 4),
+		.width = DMA_ASYNC_WIDTH_32,
+		.priority = 3,
+	};
+	uint32_t dctrl = SDIO_DCTRL_DBLOCKSIZE_9 | SDIO_DCTRL_DMAEN |
+			 SDIO_DCTRL_DTEN;
+	uint32_t addr = c->block_addressing ? block :
+			block * SDIO_CARD_BLOCK_SIZE;
+	uint8_t cmd;
+
+	if (!c->dma || c->busy || (c->type == SDIO_CARD_NONE) || !count ||
+	    (count > SDIO_CARD_MAX_BLOCKS) || ((uint32_t)buf & 3)) {
+		return false;
+	}
+	/* A previous write may still be programming */
+	if (!sdio_card_wait_ready(c, NULL)) {
+		return false;
+	}
+
+	c->count = count;
+	c->writing = write;
+	c->data_done = false;
+	c->dma_done = false;
+	c->ending = false;
+	c->error = 0;
+	c->busy = true;
+
+	dma_async_set_callback(c->dma, sdio_card_dma_event, c);
+	if (!dma_async_start(c->dma, &xfer)) {
+		c->busy = false;
+		return false;
+	}
+
+	SDIO_ICR = SDIO_CARD_ICR_ALL;
+	SDIO_DTIMER = SDIO_CARD_DATA_TIMEOUT;
+	SDIO_DLEN = count * SDIO_CARD_BLOCK_SIZE;
+	SDIO_MASK = SDIO_MASK_DATAENDIE | SDIO_MASK_DCRCFAILIE |
+		    SDIO_MASK_DTIMEOUTIE | SDIO_MASK_TXUNDERRIE |
+		    SDIO_MASK_RXOVERRIE | SDIO_MASK_STBITERRIE;
+
+	if (write) {
+		/* The card takes data once it has answered the command */
+		cmd = count > 1 ? 25 : 24;
+		if (!sdio_card_cmd(cmd, addr, SDIO_CARD_R1, NULL)) {
+			goto fail;
+		}
+		SDIO_DCTRL = dctrl;
+	} else {
+		cmd = count > 1 ? 18 : 17;
+		SDIO_DCTRL = dctrl | SDIO_DCTRL_DTDIR;
+		if (!sdio_card_cmd(cmd, addr, SDIO_CARD_R1, NULL)) {
+			goto fail;
+		}
+	}
+	return true;
+
+fail:
+	SDIO_MASK = 0;
+	SDIO_DCTRL = 0;
+	dma_async_stop(c->dma);
+	c->busy = false;
+	return false;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Start reading blocks.
+
+Returns at once, the callback runs when the blocks are in memory.
+
+@param[in] c Card state
+@param[in] block First block
+@param[out] buf Buffer of count * @ref SDIO_CARD_BLOCK_SIZE bytes, word
+aligned
+@param[in] count 1 to @ref SDIO_CARD_MAX_BLOCKS blocks
+@returns false if the transfer could not be started
+*/
+bool sdio_card_read(struct sdio_card *c, uint32_t block, void *buf,
+		    uint16_t count)
+{
+	return sdio_card_start(c, block, buf, count, false);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Start writing blocks.
+
+Returns at once, the callback runs when the blocks have been sent. The card
+goes on programming them; the next transfer waits for it.
+
+@param[in] c Card state
+@param[in] block First block
+@param[in] buf Data of count * @ref SDIO_CARD_BLOCK_SIZE bytes, word aligned
+@param[in] count 1 to @ref SDIO_CARD_MAX_BLOCKS blocks
+@returns false if the transfer could not be started
+*/
+bool sdio_card_write(struct sdio_card *c, uint32_t block, const void *buf,
+		     uint16_t count)
+{
+	return sdio_card_start(c, block, (void *)buf, count, true);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Wait for the end of the transfer in progress.
+
+@returns false if it failed
+*/
+bool sdio_card_wait(struct sdio_card *c)
+{
+	while (c->busy);
+	return !c->error;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief SDIO interrupt handler.
+
+@param[in] c Card state
+*/
+void sdio_card_isr(struct sdio_card *c)
+{
+	uint32_t sta = SDIO_STA;
+
+	if (!c->busy) {
+		return;
+	}
+	if (sta & SDIO_CARD_DATA_ERRORS) {
+		sdio_card_done(c, sta & SDIO_CARD_DATA_ERRORS);
+		return;
+	}
+	if (sta & SDIO_STA_DATAEND) {
+		SDIO_ICR = SDIO_ICR_DATAENDC;
+		SDIO_MASK = 0;
+		c->data_done = true;
+		sdio_card_done(c, 0);
+	}
+}
+
+/**@}*/
@@ -29,6 +29,8 @@
 
 /* TODO - can't these be inside the impls, not globals from the core? */
 uint8_t st_usbfs_force_nak[8];
+uint8_t st_usbfs_tx_inflight[8];
+uint8_t st_usbfs_tx_pending[8];
 struct _usbd_device st_usbfs_dev;
 
 void st_usbfs_set_address(usbd_device *dev, uint8_t addr)
@@ -78,10 +80,66 @@ uint16_t st_usbfs_set_ep_rx_bufsize(usbd_device *dev, uint8_t ep, uint32_t size)
 	return realsize;
 }
 
-void st_usbfs_ep_setup(usbd_device *dev, uint8_t addr, uint8_t type,
-		uint16_t max_size,
-		void (*callback) (usbd_device *usbd_dev,
-		uint8_t ep))
+static bool st_usbfs_ep_is_double_buffered(uint16_t reg)
+{
+	/* Isochronous endpoints are always double-buffered */
+	return ((reg & USB_EP_TYPE) == USB_EP_TYPE_ISO) ||
+	       ((reg & (USB_EP_TYPE | USB_EP_KIND)) ==
+		(USB_EP_TYPE_BULK | USB_EP_KIND));
+}
+
+static void st_usbfs_ep_setup_double_buffered_pm(usbd_device *dev,
+		uint8_t addr, uint8_t dir, uint8_t type, uint16_t max_size,
+		usbd_endpoint_callback callback)
+{
+	/*
+	 * Both buffer descriptor entries are used for the one direction, so
+	 * the other direction is disabled. Bulk endpoints are flow controlled
+	 * by the DTOG / SW_BUF pair instead of the STAT bits, isochronous
+	 * ones just alternate on DTOG.
+	 */
+	if (dir) {
+		USB_SET_EP_TX_ADDR(addr, dev->pm_top);
+		USB_SET_EP_TX_COUNT(addr, 0);
+		USB_SET_EP_RX_ADDR(addr, dev->pm_top + max_size);
+		USB_SET_EP_RX_COUNT(addr, 0);
+		if (callback) {
+			dev->user_callback_ctr[addr][USB_TRANSACTION_IN] = callback;
+		}
+		/* DTOG == SW_BUF, the hardware NAKs until a buffer is filled */
+		USB_CLR_EP_TX_DTOG(addr);
+		USB_CLR_EP_RX_DTOG(addr);
+		st_usbfs_tx_inflight[addr] = 0;
+		st_usbfs_tx_pending[addr] = 0;
+		USB_SET_EP_RX_STAT(addr, USB_EP_RX_STAT_DISABLED);
+		USB_SET_EP_TX_STAT(addr, type == USB_ENDPOINT_ATTR_ISOCHRONOUS ?
+				   USB_EP_TX_STAT_NAK : USB_EP_TX_STAT_VALID);
+		dev->pm_top += 2 * max_size;
+	} else {
+		uint16_t realsize;
+		realsize = st_usbfs_set_ep_rx_bufsize(dev, addr, max_size);
+		/* Buffer 0 lives in the TX half of the descriptor */
+		USB_SET_EP_TX_COUNT(addr, USB_GET_EP_RX_COUNT(addr));
+		USB_SET_EP_TX_ADDR(addr, dev->pm_top);
+		USB_SET_EP_RX_ADDR(addr, dev->pm_top + realsize);
+		if (callback) {
+			dev->user_callback_ctr[addr][USB_TRANSACTION_OUT] = callback;
+		}
+		/* DTOG != SW_BUF, the hardware owns buffer 0 */
+		USB_CLR_EP_RX_DTOG(addr);
+		USB_CLR_EP_TX_DTOG(addr);
+		if (type != USB_ENDPOINT_ATTR_ISOCHRONOUS) {
+			USB_TOG_EP_TX_DTOG(addr);
+		}
+		USB_SET_EP_TX_STAT(addr, USB_EP_TX_STAT_DISABLED);
+		USB_SET_EP_RX_STAT(addr, USB_EP_RX_STAT_VALID);
+		dev->pm_top += 2 * realsize;
+	}
+}
+
+static void st_usbfs_ep_setup_pm(usbd_device *dev, uint8_t addr,
+		uint8_t type, uint16_t max_size,
+		usbd_endpoint_callback callback, bool double_buffered)
 {
 	/* Translate USB standard type codes to STM32. */
 	const uint16_t typelookup[] = {
@@ -97,6 +155,21 @@ void st_usbfs_ep_setup(usbd_device *dev, uint8_t addr, uint8_t type,
 	USB_SET_EP_ADDR(addr, addr);
 	USB_SET_EP_TYPE(addr, typelookup[type]);
 
+	/* Only bulk endpoints have a choice, isochronous ones always alternate */
+	double_buffered = (double_buffered && type == USB_ENDPOINT_ATTR_BULK) ||
+			  type == USB_ENDPOINT_ATTR_ISOCHRONOUS;
+	if (double_buffered && type == USB_ENDPOINT_ATTR_BULK) {
+		USB_SET_EP_KIND(addr);
+	} else {
+		USB_CLR_EP_KIND(addr);
+	}
+
+	if (double_buffered && addr != 0) {
+		st_usbfs_ep_setup_double_buffered_pm(dev, addr, dir, type,
+						     max_size, callback);
+		return;
+	}
+
 	if (dir || (addr == 0)) {
 		USB_SET_EP_TX_ADDR(addr, dev->pm_top);
 		if (callback) {
@@ -120,6 +193,30 @@ void st_usbfs_ep_setup(usbd_device *dev, uint8_t addr, uint8_t type,
 	}
 }
 
+void st_usbfs_ep_setup(usbd_device *dev, uint8_t addr, uint8_t type,
+		uint16_t max_size,
+		void (*callback) (usbd_device *usbd_dev,
+		uint8_t ep))
+{
+	st_usbfs_ep_setup_pm(dev, addr, type, max_size, callback, false);
+}
+
+/**
+ * Set up an endpoint using both packet memory buffers.
+ *
+ * Bulk endpoints become double-buffered, so the host can move the next
+ * packet while the application is copying the previous one in or out.
+ * Other types fall back to @ref st_usbfs_ep_setup, isochronous endpoints
+ * are always double-buffered.
+ */
+void st_usbfs_ep_setup_double_buffered(usbd_device *dev, uint8_t addr,
+		uint8_t type, uint16_t max_size,
+		void (*callback) (usbd_device *usbd_dev,
+		uint8_t ep))
+{
+	st_usbfs_ep_setup_pm(dev, addr, type, max_size, callback, true);
+}
+
 void st_usbfs_endpoints_reset(usbd_device *dev)
 {
 	int i;
@@ -141,20 +238,35 @@ void st_usbfs_ep_stall_set(usbd_device *dev, uint8_t addr,
 				   USB_EP_TX_STAT_NAK);
 	}
 
+	bool dbl = (GET_REG(USB_EP_REG(addr & 0x7F)) & (USB_EP_TYPE | USB_EP_KIND)) ==
+		   (USB_EP_TYPE_BULK | USB_EP_KIND);
+
 	if (addr & 0x80) {
 		addr &= 0x7F;
 
-		USB_SET_EP_TX_STAT(addr, stall ? USB_EP_TX_STAT_STALL :
-				   USB_EP_TX_STAT_NAK);
-
-		/* Reset to DATA0 if clearing stall condition. */
-		if (!stall) {
+		if (stall) {
+			USB_SET_EP_TX_STAT(addr, USB_EP_TX_STAT_STALL);
+		} else if (dbl) {
+			/* Reset to DATA0 and empty both buffers. */
+			USB_CLR_EP_TX_DTOG(addr);
+			USB_CLR_EP_RX_DTOG(addr);
+			st_usbfs_tx_inflight[addr] = 0;
+			st_usbfs_tx_pending[addr] = 0;
+			USB_SET_EP_TX_STAT(addr, USB_EP_TX_STAT_VALID);
+		} else {
+			USB_SET_EP_TX_STAT(addr, USB_EP_TX_STAT_NAK);
+			/* Reset to DATA0 if clearing stall condition. */
 			USB_CLR_EP_TX_DTOG(addr);
 		}
 	} else {
 		/* Reset to DATA0 if clearing stall condition. */
 		if (!stall) {
 			USB_CLR_EP_RX_DTOG(addr);
+			if (dbl) {
+				/* Hand buffer 0 back to the hardware. */
+				USB_CLR_EP_TX_DTOG(addr);
+				USB_TOG_EP_TX_DTOG(addr);
+			}
 		}
 
 		USB_SET_EP_RX_STAT(addr, stall ? USB_EP_RX_STAT_STALL :
@@ -196,13 +308,55 @@ void st_usbfs_ep_nak_set(usbd_device *dev, uint8_t addr, uint8_t nak)
 	}
 }
 
+static uint16_t st_usbfs_ep_write_packet_dbuf(uint8_t addr, uint16_t reg,
+					      const void *buf, uint16_t len)
+{
+	uint8_t sw_buf;
+
+	if ((reg & USB_EP_TYPE) == USB_EP_TYPE_ISO) {
+		/* The hardware sends from DTOG, so fill the other buffer */
+		sw_buf = !(reg & USB_EP_TX_DTOG);
+		st_usbfs_copy_to_pm(USB_GET_EP_DBUF_BUFF(addr, sw_buf), buf, len);
+		USB_SET_EP_DBUF_COUNT(addr, sw_buf, len);
+		if ((reg & USB_EP_TX_STAT) != USB_EP_TX_STAT_VALID) {
+			USB_SET_EP_TX_STAT(addr, USB_EP_TX_STAT_VALID);
+		}
+		return len;
+	}
+
+	/* Both buffers full, one sending and one waiting for its turn */
+	if (st_usbfs_tx_inflight[addr] >= 2) {
+		return 0;
+	}
+
+	sw_buf = !!(reg & USB_EP_TX_SW_BUF);
+	st_usbfs_copy_to_pm(USB_GET_EP_DBUF_BUFF(addr, sw_buf), buf, len);
+	USB_SET_EP_DBUF_COUNT(addr, sw_buf, len);
+	st_usbfs_tx_inflight[addr]++;
+
+	if (!!(reg & USB_EP_TX_DTOG) == sw_buf) {
+		/* The hardware sends this buffer next, hand it over now */
+		USB_TOG_EP_RX_DTOG(addr);
+	} else {
+		/* Still sending the other buffer, released on its CTR */
+		st_usbfs_tx_pending[addr] = 1;
+	}
+
+	return len;
+}
+
 uint16_t st_usbfs_ep_write_packet(usbd_device *dev, uint8_t addr,
 				     const void *buf, uint16_t len)
 {
 	(void)dev;
 	addr &= 0x7F;
+	uint16_t reg = GET_REG(USB_EP_REG(addr));
+
+	if (st_usbfs_ep_is_double_buffered(reg)) {
+		return st_usbfs_ep_write_packet_dbuf(addr, reg, buf, len);
+	}
 
-	if ((*USB_EP_REG(addr) & USB_EP_TX_STAT) == USB_EP_TX_STAT_VALID) {
+	if ((reg & USB_EP_TX_STAT) == USB_EP_TX_STAT_VALID) {
 		return 0;
 	}
 
@@ -213,11 +367,41 @@ uint16_t st_usbfs_ep_write_packet(usbd_device *dev, uint8_t addr,
 	return len;
 }
 
+static uint16_t st_usbfs_ep_read_packet_dbuf(uint8_t addr, uint16_t reg,
+					     void *buf, uint16_t len)
+{
+	if (!(reg & USB_EP_RX_CTR)) {
+		return 0;
+	}
+
+	/* The hardware has already moved DTOG on to the other buffer */
+	const uint8_t sw_buf = !(reg & USB_EP_RX_DTOG);
+	len = MIN(USB_GET_EP_DBUF_COUNT(addr, sw_buf) & 0x3ff, len);
+	USB_CLR_EP_RX_CTR(addr);
+
+	/*
+	 * Let the hardware have the other buffer before copying this one out,
+	 * so the next packet can arrive in the meantime.
+	 */
+	if ((reg & USB_EP_TYPE) != USB_EP_TYPE_ISO) {
+		USB_TOG_EP_TX_DTOG(addr);
+	}
+	st_usbfs_copy_from_pm(buf, USB_GET_EP_DBUF_BUFF(addr, sw_buf), len);
+
+	return len;
+}
+
 uint16_t st_usbfs_ep_read_packet(usbd_device *dev, uint8_t addr,
 					 void *buf, uint16_t len)
 {
 	(void)dev;
-	if ((*USB_EP_REG(addr) & USB_EP_RX_STAT) == USB_EP_RX_STAT_VALID) {
+	uint16_t reg = GET_REG(USB_EP_REG(addr));
+
+	if (st_usbfs_ep_is_double_buffered(reg)) {
+		return st_usbfs_ep_read_packet_dbuf(addr, reg, buf, len);
+	}
+
+	if ((reg & USB_EP_RX_STAT) == USB_EP_RX_STAT_VALID) {
 		return 0;
 	}
 
@@ -243,7 +427,12 @@ void st_usbfs_poll(usbd_device *dev)
 		return;
 	}
 
-	if (istr & USB_ISTR_CTR) {
+	/*
+	 * Drain every pending correct transfer in one go, EP_ID always names the
+	 * highest priority one left. The bound stops a callback that leaves its
+	 * packet unread from keeping us here forever.
+	 */
+	for (size_t i = 0; (istr & USB_ISTR_CTR) && i < 16U; ++i) {
 		uint8_t ep = istr & USB_ISTR_EP_ID;
 		uint8_t type;
 
@@ -258,34 +447,39 @@ void st_usbfs_poll(usbd_device *dev)
 		} else {
 			type = USB_TRANSACTION_IN;
 			USB_CLR_EP_TX_CTR(ep);
+			/* A double-buffered packet has gone, freeing its buffer,
+			 * and the one queued behind it can go out. */
+			if (st_usbfs_tx_inflight[ep]) {
+				st_usbfs_tx_inflight[ep]--;
+			}
+			if (st_usbfs_tx_pending[ep]) {
+				st_usbfs_tx_pending[ep] = 0;
+				USB_TOG_EP_RX_DTOG(ep);
+			}
 		}
 
 		if (dev->user_callback_ctr[ep][type]) {
-			dev->user_callback_ctr[ep][type] (dev, ep);
+			_usbd_ep_event(dev, ep, type);
 		} else {
 			USB_CLR_EP_RX_CTR(ep);
 		}
+
+		istr = *USB_ISTR_REG;
 	}
 
 	if (istr & USB_ISTR_SUSP) {
 		USB_CLR_ISTR_SUSP();
-		if (dev->user_callback_suspend) {
-			dev->user_callback_suspend();
-		}
+		_usbd_bus_event(dev, USBD_EVENT_SUSPEND);
 	}
 
 	if (istr & USB_ISTR_WKUP) {
 		USB_CLR_ISTR_WKUP();
-		if (dev->user_callback_resume) {
-			dev->user_callback_resume();
-		}
+		_usbd_bus_event(dev, USBD_EVENT_RESUME);
 	}
 
 	if (istr & USB_ISTR_SOF) {
 		USB_CLR_ISTR_SOF();
-		if (dev->user_callback_sof) {
-			dev->user_callback_sof();
-		}
+		_usbd_bus_event(dev, USBD_EVENT_SOF);
 	}
 
 	if (dev->user_callback_sof) {
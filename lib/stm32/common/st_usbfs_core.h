@@ -40,6 +40,11 @@ void st_usbfs_ep_setup(usbd_device *usbd_dev, uint8_t addr,
 		void (*callback) (usbd_device *usbd_dev,
 		uint8_t ep));
 
+void st_usbfs_ep_setup_double_buffered(usbd_device *usbd_dev, uint8_t addr,
+		uint8_t type, uint16_t max_size,
+		void (*callback) (usbd_device *usbd_dev,
+		uint8_t ep));
+
 void st_usbfs_endpoints_reset(usbd_device *usbd_dev);
 void st_usbfs_ep_stall_set(usbd_device *usbd_dev, uint8_t addr, uint8_t stall);
 uint8_t st_usbfs_ep_stall_get(usbd_device *usbd_dev, uint8_t addr);
@@ -71,6 +76,8 @@ void st_usbfs_copy_from_pm(void *buf, const volatile void *vPM, uint16_t len);
 void st_usbfs_copy_to_pm(volatile void *vPM, const void *buf, uint16_t len);
 
 extern uint8_t st_usbfs_force_nak[8];
+extern uint8_t st_usbfs_tx_inflight[8];
+extern uint8_t st_usbfs_tx_pending[8];
 extern struct _usbd_device st_usbfs_dev;
 
 #endif
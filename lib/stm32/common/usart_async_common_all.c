@@ -0,0 +1,446 @@
+/** @addtogroup usart_file USART peripheral API
+@ingroup peripheral_apis
+
+@brief Buffered USART driver
+
+Decouples the application from the USART through two lock-free rings. Receive
+is done either byte-wise from the RX interrupt (draining the hardware FIFO on
+parts that have one) or by a circular DMA channel, whose progress is published
+on idle line and receiver timeout interrupts. Transmit is done from the TX
+interrupt, or in contiguous chunks by a DMA channel started through a user
+hook.
+
+The DMA channels themselves are programmed by the user, which keeps this
+layer independent of the DMA flavour of the part.
+
+LGPL License Terms @ref lgpl_license
+*/
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#include <stddef.h>
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/stm32/usart_async.h>
+
+/* Register level differences between the SR/DR and ISR/ICR/RDR/TDR IPs */
+#ifdef USART_ICR
+#define USART_ASYNC_STATUS(usart)	USART_ISR(usart)
+#define USART_ASYNC_RDR(usart)		USART_RDR(usart)
+#define USART_ASYNC_TDR(usart)		USART_TDR(usart)
+#else
+#define USART_ASYNC_STATUS(usart)	USART_SR(usart)
+#define USART_ASYNC_RDR(usart)		USART_DR(usart)
+#define USART_ASYNC_TDR(usart)		USART_DR(usart)
+#endif
+
+#define USART_ASYNC_ERRORS	(USART_FLAG_FE | USART_FLAG_NF | USART_FLAG_PE)
+
+/* Bytes moved between the data register and a ring per batch */
+#define USART_ASYNC_BURST	16
+
+/*---------------------------------------------------------------------------*/
+/** @brief Acknowledge status flags.
+
+On the SR/DR IP, the error and idle flags are cleared by the SR read done by
+the caller followed by a read of DR.
+*/
+static void usart_async_clear(uint32_t usart, uint32_t flags)
+{
+#ifdef USART_ICR
+	uint32_t reg32 = 0;
+
+	if (flags & USART_FLAG_ORE) {
+		reg32 |= USART_ICR_ORECF;
+	}
+	if (flags & USART_FLAG_IDLE) {
+		reg32 |= USART_ICR_IDLECF;
+	}
+	if (flags & USART_ISR_RTOF) {
+		reg32 |= USART_ICR_RTOCF;
+	}
+	if (flags & USART_ASYNC_ERRORS) {
+		reg32 |= USART_ICR_FECF | USART_ICR_NCF | USART_ICR_PECF;
+	}
+	USART_ICR(usart) = reg32;
+#else
+	(void)flags;
+	(void)USART_DR(usart);
+#endif
+}
+
+static bool usart_async_fifo_mode(uint32_t usart)
+{
+#ifdef USART_CR1_FIFOEN
+	return (USART_CR1(usart) & USART_CR1_FIFOEN) != 0;
+#else
+	(void)usart;
+	return false;
+#endif
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Hand the next contiguous part of the TX ring to the DMA.
+
+Must be called with interrupts masked or from the interrupt handler.
+*/
+static void usart_async_tx_dma_kick(struct usart_async *ua)
+{
+	uint32_t tail = ua->tx.tail;
+	uint32_t idx = tail & (ua->tx.count - 1);
+	uint32_t len = ua->tx.head - tail;
+
+	if ((ua->tx_dma_len != 0) || (len == 0)) {
+		return;
+	}
+
+	if (len > ua->tx.count - idx) {
+		len = ua->tx.count - idx;
+	}
+	if (len > 0xffff) {
+		len = 0xffff;
+	}
+
+	ua->tx_dma_len = len;
+	ua->tx_dma_start(&ua->tx.buf[idx], len);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Start transmitting the TX ring if it is idle. */
+static void usart_async_tx_kick(struct usart_async *ua)
+{
+	uint32_t primask;
+
+	if (ua->tx_dma_start) {
+		primask = cm_mask_interrupts(1);
+		usart_async_tx_dma_kick(ua);
+		cm_mask_interrupts(primask);
+		return;
+	}
+
+#ifdef USART_CR1_FIFOEN
+	if (usart_async_fifo_mode(ua->usart)) {
+		usart_enable_tx_fifo_threshold_interrupt(ua->usart);
+		return;
+	}
+#endif
+	usart_enable_tx_interrupt(ua->usart);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Initialise a buffered USART.
+
+The USART itself must have been configured (baudrate, format, mode) and, on
+parts with a hardware FIFO, optionally put into FIFO mode with its thresholds
+set. In FIFO mode the driver interrupts on the RX and TX FIFO thresholds
+instead of per byte.
+
+@param[in] ua Driver state
+@param[in] usart USART block register address base @ref usart_reg_base
+@param[in] rx_buf Receive ring
+@param[in] rx_size Receive ring size in bytes, a power of two
+@param[in] tx_buf Transmit ring
+@param[in] tx_size Transmit ring size in bytes, a power of two
+*/
+void usart_async_init(struct usart_async *ua, uint32_t usart,
+		      uint8_t *rx_buf, uint32_t rx_size,
+		      uint8_t *tx_buf, uint32_t tx_size)
+{
+	ua->usart = usart;
+	spsc_init(&ua->rx, rx_buf, rx_size, 1);
+	spsc_init(&ua->tx, tx_buf, tx_size, 1);
+	ua->rx_dma_count = NULL;
+	ua->tx_dma_start = NULL;
+	ua->tx_dma_len = 0;
+	ua->rx_callback = NULL;
+
+	ua->stats.rx_bytes = 0;
+	ua->stats.tx_bytes = 0;
+	ua->stats.overruns = 0;
+	ua->stats.rx_dropped = 0;
+	ua->stats.errors = 0;
+	ua->stats.idle = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Receive through a circular DMA channel.
+
+The channel must be set up by the caller to transfer from the USART data
+register into the whole RX ring in circular mode, and be enabled before
+@ref usart_async_start. Calling @ref usart_async_rx_dma_sync from its half and
+full transfer interrupts publishes the data in time when the line never goes
+idle.
+
+The DMA does not know how far the reader has got: when more than the ring size
+arrives before it is read, the oldest bytes are overwritten. The sync then
+moves the read position past them and counts them in rx_dropped. A read
+running while this happens may return some of the newer bytes in their place.
+
+@param[in] ua Driver state
+@param[in] dma_count Transfer count register of the channel (CNDTR, SxNDTR)
+*/
+void usart_async_set_rx_dma(struct usart_async *ua,
+			    volatile uint32_t *dma_count)
+{
+	ua->rx_dma_count = dma_count;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Transmit through a DMA channel.
+
+@p start must program and enable a memory to USART data register transfer of
+@p len bytes from @p buf. Its transfer complete interrupt must call
+@ref usart_async_tx_dma_done.
+
+@param[in] ua Driver state
+@param[in] start Hook starting a transfer
+*/
+void usart_async_set_tx_dma(struct usart_async *ua,
+			    void (*start)(const uint8_t *buf, uint16_t len))
+{
+	ua->tx_dma_start = start;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Enable the interrupts and DMA requests the driver needs.
+
+The USART interrupt must be enabled in the NVIC and call
+@ref usart_async_isr.
+*/
+void usart_async_start(struct usart_async *ua)
+{
+	uint32_t usart = ua->usart;
+
+	if (ua->rx_dma_count) {
+		usart_enable_rx_dma(usart);
+	} else {
+#ifdef USART_CR1_FIFOEN
+		if (usart_async_fifo_mode(usart)) {
+			usart_enable_rx_fifo_threshold_interrupt(usart);
+		} else {
+			usart_enable_rx_interrupt(usart);
+		}
+#else
+		usart_enable_rx_interrupt(usart);
+#endif
+	}
+
+	if (ua->tx_dma_start) {
+		usart_enable_tx_dma(usart);
+	}
+
+	usart_enable_idle_interrupt(usart);
+	usart_enable_error_interrupt(usart);
+#ifdef USART_ICR
+	/* Flushes the tail of a burst once the timeout set with
+	 * usart_set_rx_timeout_value() expires. */
+	if (USART_CR2(usart) & USART_CR2_RTOEN) {
+		usart_enable_rx_timeout_interrupt(usart);
+	}
+#endif
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Disable all interrupts and DMA requests used by the driver. */
+void usart_async_stop(struct usart_async *ua)
+{
+	uint32_t usart = ua->usart;
+
+	usart_disable_rx_interrupt(usart);
+	usart_disable_tx_interrupt(usart);
+	usart_disable_idle_interrupt(usart);
+	usart_disable_error_interrupt(usart);
+	usart_disable_rx_dma(usart);
+	usart_disable_tx_dma(usart);
+#ifdef USART_ICR
+	usart_disable_rx_timeout_interrupt(usart);
+#endif
+#ifdef USART_CR1_FIFOEN
+	usart_disable_rx_fifo_threshold_interrupt(usart);
+	usart_disable_tx_fifo_threshold_interrupt(usart);
+#endif
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Publish what the RX DMA has written so far to the reader.
+
+Called by the driver on idle line and receiver timeout, and by
+@ref usart_async_read. May also be called from the DMA half and full transfer
+interrupts.
+*/
+void usart_async_rx_dma_sync(struct usart_async *ua)
+{
+	uint32_t mask = ua->rx.count - 1;
+	uint32_t pos, n, used, primask;
+
+	if (!ua->rx_dma_count) {
+		return;
+	}
+
+	/* Both thread code and interrupts publish, serialise them */
+	primask = cm_mask_interrupts(1);
+
+	/* The count register runs down from the ring size */
+	pos = (ua->rx.count - (*ua->rx_dma_count & 0xffff)) & mask;
+	n = (pos - ua->rx.head) & mask;
+
+	if (n) {
+		ua->stats.rx_bytes += n;
+		/* The DMA wrote over the oldest bytes before they were read:
+		 * drop them, head always follows the DMA position. */
+		used = ua->rx.head - ua->rx.tail + n;
+		if (used > ua->rx.count) {
+			ua->stats.rx_dropped += used - ua->rx.count;
+			ua->rx.tail = ua->rx.head + n - ua->rx.count;
+		}
+		__dmb();
+		ua->rx.head += n;
+	}
+
+	cm_mask_interrupts(primask);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Account for a finished TX DMA transfer and start the next one.
+
+Call from the transfer complete interrupt of the TX DMA channel.
+*/
+void usart_async_tx_dma_done(struct usart_async *ua)
+{
+	ua->stats.tx_bytes += ua->tx_dma_len;
+	/* The DMA is the consumer of the TX ring */
+	ua->tx.tail += ua->tx_dma_len;
+	ua->tx_dma_len = 0;
+
+	usart_async_tx_dma_kick(ua);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief USART interrupt handler.
+
+Call from the interrupt service routine of the USART.
+*/
+void usart_async_isr(struct usart_async *ua)
+{
+	uint32_t usart = ua->usart;
+	uint32_t sr = USART_ASYNC_STATUS(usart);
+	uint32_t cr1 = USART_CR1(usart);
+	uint8_t burst[USART_ASYNC_BURST];
+	uint32_t n, events = 0;
+
+	if (sr & USART_FLAG_ORE) {
+		ua->stats.overruns++;
+		events |= USART_FLAG_ORE;
+	}
+	if (sr & USART_ASYNC_ERRORS) {
+		ua->stats.errors++;
+		events |= sr & USART_ASYNC_ERRORS;
+	}
+
+	/* Interrupt receive, drains the whole FIFO in FIFO mode */
+	if (!ua->rx_dma_count) {
+		while (USART_ASYNC_STATUS(usart) & USART_FLAG_RXNE) {
+			n = 0;
+			while ((n < USART_ASYNC_BURST) &&
+			       (USART_ASYNC_STATUS(usart) & USART_FLAG_RXNE)) {
+				burst[n++] = USART_ASYNC_RDR(usart);
+			}
+			ua->stats.rx_bytes += n;
+			ua->stats.rx_dropped += n - spsc_write(&ua->rx, burst, n);
+		}
+	}
+
+	if (sr & USART_FLAG_IDLE) {
+		events |= USART_FLAG_IDLE;
+	}
+#ifdef USART_ICR
+	if (sr & USART_ISR_RTOF) {
+		events |= USART_ISR_RTOF;
+	}
+#endif
+	if (events) {
+		usart_async_clear(usart, events);
+	}
+
+	if (events & ~(USART_FLAG_ORE | USART_ASYNC_ERRORS)) {
+		ua->stats.idle++;
+		usart_async_rx_dma_sync(ua);
+		if (ua->rx_callback) {
+			ua->rx_callback(ua);
+		}
+	}
+
+	/* Interrupt transmit, fills the whole FIFO in FIFO mode */
+	if (!ua->tx_dma_start &&
+	    ((cr1 & USART_CR1_TXEIE) || usart_async_fifo_mode(usart))) {
+		while (USART_ASYNC_STATUS(usart) & USART_FLAG_TXE) {
+			if (!spsc_pop(&ua->tx, burst)) {
+				usart_disable_tx_interrupt(usart);
+#ifdef USART_CR1_FIFOEN
+				usart_disable_tx_fifo_threshold_interrupt(usart);
+#endif
+				break;
+			}
+			USART_ASYNC_TDR(usart) = burst[0];
+			ua->stats.tx_bytes++;
+		}
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Queue data for transmission.
+
+@returns Number of bytes queued, less than @p len if the TX ring is full
+*/
+uint32_t usart_async_write(struct usart_async *ua, const void *data,
+			   uint32_t len)
+{
+	len = spsc_write(&ua->tx, data, len);
+	if (len) {
+		usart_async_tx_kick(ua);
+	}
+	return len;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Take received data from the RX ring.
+
+@returns Number of bytes read, at most @p len
+*/
+uint32_t usart_async_read(struct usart_async *ua, void *data, uint32_t len)
+{
+	usart_async_rx_dma_sync(ua);
+	return spsc_read(&ua->rx, data, len);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Number of received bytes waiting to be read. */
+uint32_t usart_async_rx_available(struct usart_async *ua)
+{
+	usart_async_rx_dma_sync(ua);
+	return spsc_used(&ua->rx);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Number of queued bytes not yet handed to the hardware. */
+uint32_t usart_async_tx_pending(struct usart_async *ua)
+{
+	return spsc_used(&ua->tx);
+}
+
+/**@}*/
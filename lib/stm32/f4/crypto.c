@@ -29,38 +29,3 @@
  */
 
 #include <libopencm3/stm32/crypto.h>
-
-/**@{*/
-
-/*---------------------------------------------------------------------------*/
-
-/** @brief Set the MAC algorithm
- */
-void crypto_set_mac_algorithm(enum crypto_mode_mac mode)
-{
-	crypto_set_algorithm((enum crypto_mode) mode);
-}
-
-/**
- * @brief Swap context
- *
- *@param[in] buf uint32_t Memory space for swap (16 items length)
- */
-void crypto_context_swap(uint32_t *buf)
-{
-	int i;
-	/* Apply exact order of ? */
-	for (i = 0; i < 8; i++) {
-		uint32_t save = *buf;
-		*buf++ = CRYP_CSGCMCCMR(i);
-		CRYP_CSGCMCCMR(i) = save;
-	};
-
-	for (i = 0; i < 8; i++) {
-		uint32_t save = *buf;
-		*buf++ = CRYP_CSGCMR(i);
-		CRYP_CSGCMCCMR(i) = save;
-	};
-}
-
-/**@}*/
@@ -81,6 +81,34 @@ unsigned fdcan_get_txbuf_element_size(uint32_t canport)
 	return sizeof(struct fdcan_tx_buffer_element);
 }
 
+/** Returns amount of elements in receive FIFO for given CAN port and FIFO.
+ *
+ * For G4 it returns constant value as G4 has FIFO size hardcoded.
+ *
+ * @param [in] canport FDCAN block base address. See @ref fdcan_block. Unused.
+ * @param [in] fifo_id ID of FIFO whose size is queried. Unused.
+ * @returns Amount of elements in receive FIFO.
+ */
+unsigned fdcan_get_fifo_size(uint32_t canport, unsigned fifo_id)
+{
+	(void) (canport);
+	(void) (fifo_id);
+	return 3;
+}
+
+/** Returns amount of transmit buffers for given CAN port.
+ *
+ * For G4 it returns constant value as G4 has three transmit buffers.
+ *
+ * @param [in] canport FDCAN block base address. See @ref fdcan_block. Unused.
+ * @returns Amount of transmit buffer elements.
+ */
+unsigned fdcan_get_txbuf_count(uint32_t canport)
+{
+	(void) (canport);
+	return 3;
+}
+
 /** Configure amount of filters and initialize filtering block.
  *
  * This function allows to configure global amount of filters present.
@@ -42,8 +42,14 @@
 
 /**@{*/
 
+#include <string.h>
 #include <libopencm3/stm32/flash.h>
 
+/* Error flags of a programming operation */
+#define FLASH_SR_PROGRAM_ERRORS	(FLASH_SR_PGSERR | FLASH_SR_SIZERR | \
+				 FLASH_SR_PGAERR | FLASH_SR_WRPERR | \
+				 FLASH_SR_PROGERR)
+
 /** @brief Wait until Last Operation has Ended
  * This loops indefinitely until an operation (write or erase) has completed
  * by testing the busy flag.
@@ -142,15 +148,34 @@ void flash_program_double_word(uint32_t address, uint64_t data)
  * This programs an arbitrary length data block to FLASH memory.
  * The program error flag should be checked separately for the event that
  * memory was not properly erased.
- * @param[in] address Starting address in Flash.
- * @param[in] data Pointer to start of data block.
- * @param[in] len Length of data block in bytes (multiple of 8).
+ * Double words are programmed back to back, an incomplete last one padded
+ * with the erased value. Programming stops at the first error, whose flag is
+ * left set.
+ * @param[in] address Starting address in Flash, double word aligned.
+ * @param[in] data Pointer to start of data block, any alignment.
+ * @param[in] len Length of data block in bytes.
  */
 void flash_program(uint32_t address, uint8_t *data, uint32_t len)
 {
+	uint32_t w[2];
+	uint32_t n;
+
+	flash_wait_for_last_operation();
+	FLASH_CR |= FLASH_CR_PG;
+
 	for (uint32_t i = 0; i < len; i += 8) {
-		flash_program_double_word(address+i, *(uint64_t*)(data + i));
+		n = len - i < 8 ? len - i : 8;
+		memset(w, 0xff, sizeof(w));
+		memcpy(w, data + i, n);
+		MMIO32(address + i) = w[0];
+		MMIO32(address + i + 4) = w[1];
+		flash_wait_for_last_operation();
+		if (FLASH_SR & FLASH_SR_PROGRAM_ERRORS) {
+			break;
+		}
 	}
+
+	FLASH_CR &= ~FLASH_CR_PG;
 }
 
 /** @brief Erase a page of FLASH
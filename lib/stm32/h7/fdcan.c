@@ -98,6 +98,31 @@ unsigned fdcan_get_txbuf_element_size(uint32_t canport)
 	return 8 + fdcan_dlc_to_length((element_size & FDCAN_TXESC_TBDS_MASK) | 0x8);
 }
 
+/** Returns amount of elements in receive FIFO for given CAN port and FIFO.
+ *
+ * Obtains FIFO size configured using @ref fdcan_init_fifo_ram.
+ *
+ * @param [in] canport FDCAN block base address. See @ref fdcan_block.
+ * @param [in] fifo_id ID of FIFO whose size is queried.
+ * @returns Amount of elements in receive FIFO.
+ */
+unsigned fdcan_get_fifo_size(uint32_t canport, unsigned fifo_id)
+{
+	return (FDCAN_RXFIC(canport, fifo_id) >> FDCAN_RXFIC_FIS_SHIFT) & FDCAN_RXFIC_FIS_MASK;
+}
+
+/** Returns amount of transmit buffers for given CAN port.
+ *
+ * Obtains transmit queue size configured using @ref fdcan_init_tx_buffer_ram.
+ *
+ * @param [in] canport FDCAN block base address. See @ref fdcan_block.
+ * @returns Amount of transmit buffer elements.
+ */
+unsigned fdcan_get_txbuf_count(uint32_t canport)
+{
+	return (FDCAN_TXBC(canport) >> FDCAN_TXBC_TFQS_SHIFT) & FDCAN_TXBC_TFQS_MASK;
+}
+
 /** Initialize allocation of standard filter block in CAN message RAM.
  *
  * Allows specifying size of standard filtering block (in term of available filtering
@@ -275,10 +275,10 @@ bool flash_program(const uintptr_t address, const uint8_t *const data, const siz
 		/* Having completed the forced write, reset the FW bit */
 		switch (variant) {
 		case STM32H7Bx:
-			REBASE(FLASH_CR) &= FLASH_CR_H7Bx_FW;
+			REBASE(FLASH_CR) &= ~FLASH_CR_H7Bx_FW;
 			break;
 		default:
-			REBASE(FLASH_CR) &= FLASH_CR_FW;
+			REBASE(FLASH_CR) &= ~FLASH_CR_FW;
 			break;
 		}
 	}
@@ -298,10 +298,10 @@ bool flash_program(const uintptr_t address, const uint8_t *const data, const siz
 		/* Having completed the forced write, reset the FW bit */
 		switch (variant) {
 		case STM32H7Bx:
-			REBASE(FLASH_CR) &= FLASH_CR_H7Bx_FW;
+			REBASE(FLASH_CR) &= ~FLASH_CR_H7Bx_FW;
 			break;
 		default:
-			REBASE(FLASH_CR) &= FLASH_CR_FW;
+			REBASE(FLASH_CR) &= ~FLASH_CR_FW;
 			break;
 		}
 	}
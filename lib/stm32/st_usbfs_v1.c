@@ -32,6 +32,7 @@ const struct _usbd_driver st_usbfs_v1_usb_driver = {
 	.init = st_usbfs_v1_usbd_init,
 	.set_address = st_usbfs_set_address,
 	.ep_setup = st_usbfs_ep_setup,
+	.ep_setup_double_buffered = st_usbfs_ep_setup_double_buffered,
 	.ep_reset = st_usbfs_endpoints_reset,
 	.ep_stall_set = st_usbfs_ep_stall_set,
 	.ep_stall_get = st_usbfs_ep_stall_get,
@@ -54,34 +55,103 @@ static usbd_device *st_usbfs_v1_usbd_init(void)
 	return &st_usbfs_dev;
 }
 
+/**
+ * Copy a data buffer to packet memory.
+ *
+ * The packet memory is organised as 16-bit halfwords on a 32-bit stride, so
+ * each halfword takes a full word write. A word aligned source is read a
+ * word at a time, feeding two packet memory halfwords per load, a halfword
+ * aligned one a halfword at a time.
+ *
+ * @param vPM Destination pointer into packet memory.
+ * @param buf Source pointer to data buffer.
+ * @param len Number of bytes to copy.
+ */
 void st_usbfs_copy_to_pm(volatile void *const vPM, const void *const buf, const uint16_t len)
 {
-	const uint16_t *const src = buf;
 	volatile uint32_t *const packet_memory = vPM;
-	const size_t blocks = (len + 1U) >> 1U;
-	for (size_t idx = 0U; idx < blocks; ++idx) {
-		packet_memory[idx] = src[idx];
+	size_t idx = 0U;
+
+	if (!(((uintptr_t)buf) & 0x03U)) {
+		const uint32_t *const src = buf;
+		const size_t words = len >> 2U;
+		size_t word = 0U;
+
+		/* Two words (four packet memory halfwords) per iteration */
+		for (; word + 2U <= words; word += 2U) {
+			const uint32_t value0 = src[word];
+			const uint32_t value1 = src[word + 1U];
+			packet_memory[(word << 1U) + 0U] = value0 & 0xffffU;
+			packet_memory[(word << 1U) + 1U] = value0 >> 16U;
+			packet_memory[(word << 1U) + 2U] = value1 & 0xffffU;
+			packet_memory[(word << 1U) + 3U] = value1 >> 16U;
+		}
+		if (word < words) {
+			const uint32_t value = src[word];
+			packet_memory[(word << 1U) + 0U] = value & 0xffffU;
+			packet_memory[(word << 1U) + 1U] = value >> 16U;
+		}
+		idx = words << 2U;
+	}
+
+	/* The tail, or the whole buffer if it is not word aligned */
+	if (!(((uintptr_t)buf) & 0x01U)) {
+		const uint16_t *const src = buf;
+		for (; idx + 1U < len; idx += 2U) {
+			packet_memory[idx >> 1U] = src[idx >> 1U];
+		}
+	}
+	const uint8_t *const src = buf;
+	for (; idx + 1U < len; idx += 2U) {
+		packet_memory[idx >> 1U] = ((uint16_t)src[idx + 1U] << 8U) | src[idx];
+	}
+	if (idx < len) {
+		packet_memory[idx >> 1U] = src[idx];
 	}
 }
 
 /**
  * Copy a data buffer from packet memory.
  *
- * @param buf Source pointer to data buffer.
- * @param vPM Destination pointer into packet memory.
+ * A word aligned destination is written a word at a time, assembled from two
+ * packet memory halfwords, a halfword aligned one a halfword at a time.
+ *
+ * @param buf Destination pointer for data buffer.
+ * @param vPM Source pointer into packet memory.
  * @param len Number of bytes to copy.
  */
 void st_usbfs_copy_from_pm(void *const buf, const volatile void *const vPM, const uint16_t len)
 {
-	uint16_t *const dest = buf;
 	const volatile uint16_t *const packet_memory = vPM;
 	const size_t blocks = len >> 1U;
+	size_t idx = 0U;
+
+	if (!(((uintptr_t)buf) & 0x03U)) {
+		uint32_t *const dest = buf;
+		const size_t words = len >> 2U;
+
+		for (size_t word = 0U; word < words; ++word) {
+			dest[word] = packet_memory[(word << 2U) + 0U] |
+				((uint32_t)packet_memory[(word << 2U) + 2U] << 16U);
+		}
+		idx = words << 1U;
+	}
+
+	if (!(((uintptr_t)buf) & 0x01U)) {
+		uint16_t *const dest = buf;
+		for (; idx < blocks; ++idx) {
+			dest[idx] = packet_memory[idx << 1U];
+		}
+	}
 
-	for (size_t idx = 0; idx < blocks; ++idx) {
-		dest[idx] = packet_memory[idx << 1U];
+	uint8_t *const dest = buf;
+	for (; idx < blocks; ++idx) {
+		const uint16_t value = packet_memory[idx << 1U];
+		dest[(idx << 1U) + 0U] = value;
+		dest[(idx << 1U) + 1U] = value >> 8U;
 	}
 
 	if (len & 1U) {
-		*(uint8_t *)(dest + blocks) = packet_memory[blocks << 1U];
+		dest[blocks << 1U] = packet_memory[blocks << 1U];
 	}
 }
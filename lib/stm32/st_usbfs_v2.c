@@ -41,17 +41,55 @@ static usbd_device *st_usbfs_v2_usbd_init(void)
 	return &st_usbfs_dev;
 }
 
+/**
+ * Copy a data buffer to packet memory.
+ *
+ * Packet memory is only guaranteed to take halfword accesses, so the bus
+ * writes stay 16 bits wide. A word aligned source is read a word at a time
+ * though, halving the loads from SRAM; anything else falls back to a
+ * bytewise copy, so it always works, even on CM0(+) that don't support
+ * unaligned accesses.
+ *
+ * @param vPM Destination pointer into packet memory.
+ * @param buf Source pointer to data buffer.
+ * @param len Number of bytes to copy.
+ */
 void st_usbfs_copy_to_pm(volatile void *const vPM, const void *const buf, const uint16_t len)
 {
-	/*
-	 * This is a bytewise copy, so it always works, even on CM0(+)
-	 * that don't support unaligned accesses.
-	 */
-	const uint8_t *const src = buf;
 	volatile uint16_t *const packet_memory = vPM;
-	for (size_t idx = 0; idx < len; idx += 2) {
+	size_t idx = 0U;
+
+	if (!(((uintptr_t)buf) & 0x03U)) {
+		const uint32_t *const src = buf;
+		const size_t words = len >> 2U;
+		size_t word = 0U;
+
+		/* Two words (four packet memory halfwords) per iteration */
+		for (; word + 2U <= words; word += 2U) {
+			const uint32_t value0 = src[word];
+			const uint32_t value1 = src[word + 1U];
+			packet_memory[(word << 1U) + 0U] = value0;
+			packet_memory[(word << 1U) + 1U] = value0 >> 16U;
+			packet_memory[(word << 1U) + 2U] = value1;
+			packet_memory[(word << 1U) + 3U] = value1 >> 16U;
+		}
+		if (word < words) {
+			const uint32_t value = src[word];
+			packet_memory[(word << 1U) + 0U] = value;
+			packet_memory[(word << 1U) + 1U] = value >> 16U;
+		}
+		idx = words << 2U;
+	}
+
+	/* The tail, or the whole buffer if it is not word aligned */
+	const uint8_t *const src = buf;
+	for (; idx + 1U < len; idx += 2U) {
 		packet_memory[idx >> 1U] = ((uint16_t)src[idx + 1U] << 8U) | src[idx];
 	}
+	/* Don't read past the end of the source for an odd length */
+	if (idx < len) {
+		packet_memory[idx >> 1U] = src[idx];
+	}
 }
 
 /**
@@ -65,11 +103,12 @@ void st_usbfs_copy_from_pm(void *const buf, const volatile void *const vPM, cons
 {
 	const volatile uint16_t *const packet_memory = vPM;
 	const size_t blocks = len >> 1U;
+	size_t idx = 0U;
 
 	/* If the buffer to write into is at an unaligned address for uint16_t access */
 	if (((uintptr_t)buf) & 0x01U) {
 		uint8_t *const dest = (uint8_t *)buf;
-		for (size_t idx = 0U; idx < blocks; ++idx) {
+		for (; idx < blocks; ++idx) {
 			/* Extract the next data block from packet memory */
 			const uint16_t value = packet_memory[idx];
 			/* Copy it into the output buffer byte at a time to handle the misalignment */
@@ -77,9 +116,19 @@ void st_usbfs_copy_from_pm(void *const buf, const volatile void *const vPM, cons
 			dest[(idx << 1U) + 1U] = value >> 8;
 		}
 	} else {
+		if (!(((uintptr_t)buf) & 0x02U)) {
+			/* Word aligned, pair up packet memory blocks into word stores */
+			uint32_t *const dest = (uint32_t *)buf;
+			const size_t words = len >> 2U;
+			for (size_t word = 0U; word < words; ++word) {
+				dest[word] = packet_memory[(word << 1U) + 0U] |
+					((uint32_t)packet_memory[(word << 1U) + 1U] << 16U);
+			}
+			idx = words << 1U;
+		}
 		/* The buffer to write into is aligned, so do things the easy way */
 		uint16_t *const dest = (uint16_t *)buf;
-		for (size_t idx = 0U; idx < blocks; ++idx) {
+		for (; idx < blocks; ++idx) {
 			/* Extract the next data block from packet memory and stuff it into the output buffer */
 			dest[idx] = packet_memory[idx];
 		}
@@ -107,6 +156,7 @@ const struct _usbd_driver st_usbfs_v2_usb_driver = {
 	.init = st_usbfs_v2_usbd_init,
 	.set_address = st_usbfs_set_address,
 	.ep_setup = st_usbfs_ep_setup,
+	.ep_setup_double_buffered = st_usbfs_ep_setup_double_buffered,
 	.ep_reset = st_usbfs_endpoints_reset,
 	.ep_stall_set = st_usbfs_ep_stall_set,
 	.ep_stall_get = st_usbfs_ep_stall_get,
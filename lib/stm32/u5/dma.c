@@ -49,6 +49,7 @@
 
 /**@{*/
 
+#include <stddef.h>
 #include <libopencm3/stm32/dma.h>
 
 void dma_channel_reset(const uintptr_t dma, const uint8_t channel)
@@ -312,3 +313,242 @@ void dma_set_number_of_data(const uintptr_t dma, const uint8_t channel, const ui
 {
 	DMA_CBR1(dma, channel) = number;
 }
+
+/*
+ * Linked-list transfer engine
+ *
+ * A list is a chain of items in memory, each holding the register values for one block. When a
+ * block completes the channel follows the link word of the item it came from, reloads the flagged
+ * registers from the next item and carries on without any CPU involvement. Only the low 16 bits of
+ * an item address are stored in a link word, the upper 16 come from CxLBAR, so every item of a list
+ * has to live in the same 64KiB region. The pool allocator checks this once for all its items.
+ *
+ * Items take their CxTR1, CxTR2 and (on 2D channels) CxTR3 values from the channel registers at the
+ * time they are appended, so configure the channel (widths, increment, bursts, request, strides via
+ * dma_set_source_stride() and dma_set_destination_stride()) first and then build the list.
+ */
+
+#define DMA_LL_IRQS (DMA_TCIF | DMA_DTEIF | DMA_ULEIF | DMA_USEIF)
+
+bool dma_ll_pool_init(dma_ll_pool_s *const pool, dma_ll_node_s *const nodes, const uint16_t count)
+{
+	const uintptr_t first = (uintptr_t)nodes;
+	const uintptr_t last = (uintptr_t)(nodes + count) - 1U;
+	if (count == 0U || (first & 3U) != 0U || (first & 0xffff0000U) != (last & 0xffff0000U))
+		return false;
+
+	pool->nodes = nodes;
+	pool->count = count;
+	/* Thread the free list through the link words, storing index + 1 so 0 can terminate it */
+	for (uint16_t idx = 0U; idx < count; ++idx)
+		nodes[idx].cllr = idx + 2U < count + 1U ? idx + 2U : 0U;
+	pool->free_head = 1U;
+	pool->free_count = count;
+	return true;
+}
+
+dma_ll_node_s *dma_ll_node_alloc(dma_ll_pool_s *const pool)
+{
+	if (pool->free_head == 0U)
+		return NULL;
+	dma_ll_node_s *const node = &pool->nodes[pool->free_head - 1U];
+	pool->free_head = (uint16_t)node->cllr;
+	--pool->free_count;
+	return node;
+}
+
+void dma_ll_node_free(dma_ll_pool_s *const pool, dma_ll_node_s *const node)
+{
+	node->cllr = pool->free_head;
+	pool->free_head = (uint16_t)(node - pool->nodes) + 1U;
+	++pool->free_count;
+}
+
+/* The link word follows the last register a channel reloads, which depends on its addressing mode */
+static uint32_t *dma_ll_link_word(const dma_ll_list_s *const list, dma_ll_node_s *const node)
+{
+	return list->two_d ? &node->cllr : &node->ctr3;
+}
+
+static uint32_t dma_ll_link_to(const dma_ll_list_s *const list, const dma_ll_node_s *const node)
+{
+	const uint32_t update = list->two_d ? DMA_CxLLR_UPDATE_2D : DMA_CxLLR_UPDATE_LINEAR;
+	return update | ((uintptr_t)node & DMA_CxLLR_LA_MASK);
+}
+
+static dma_ll_node_s *dma_ll_next(const dma_ll_list_s *const list, dma_ll_node_s *const node)
+{
+	if (node == list->tail && !list->circular)
+		return NULL;
+	const uint32_t link = *dma_ll_link_word(list, node);
+	return (dma_ll_node_s *)(((uintptr_t)node & 0xffff0000U) | (link & DMA_CxLLR_LA_MASK));
+}
+
+void dma_ll_init(dma_ll_list_s *const list, const uintptr_t dma, const uint8_t channel, dma_ll_pool_s *const pool)
+{
+	list->dma = dma;
+	list->channel = channel;
+	list->two_d = dma == GPDMA1 && channel >= DMA_CHANNEL12;
+	list->circular = false;
+	list->per_node = false;
+	list->pool = pool;
+	list->head = NULL;
+	list->tail = NULL;
+	list->current = NULL;
+	list->count = 0U;
+	list->completed = 0U;
+	list->callback = NULL;
+	list->callback_arg = NULL;
+}
+
+static dma_ll_node_s *dma_ll_append_node(dma_ll_list_s *const list, const uintptr_t source,
+	const uintptr_t destination, const uint32_t cbr1, const uint32_t cbr2)
+{
+	/* A circular list has no end to append to */
+	if (list->circular)
+		return NULL;
+	dma_ll_node_s *const node = dma_ll_node_alloc(list->pool);
+	if (!node)
+		return NULL;
+
+	node->ctr1 = DMA_CTR1(list->dma, list->channel);
+	node->ctr2 = DMA_CTR2(list->dma, list->channel);
+	node->cbr1 = cbr1;
+	node->csar = source;
+	node->cdar = destination;
+	node->ctr3 = list->two_d ? DMA_CTR3(list->dma, list->channel) : 0U;
+	node->cbr2 = cbr2;
+	node->cllr = 0U;
+	/* A link word of 0 ends the list after this item */
+	*dma_ll_link_word(list, node) = 0U;
+
+	if (list->tail)
+		*dma_ll_link_word(list, list->tail) = dma_ll_link_to(list, node);
+	else
+		list->head = node;
+	list->tail = node;
+	++list->count;
+	return node;
+}
+
+dma_ll_node_s *dma_ll_append(
+	dma_ll_list_s *const list, const uintptr_t source, const uintptr_t destination, const uint16_t bytes)
+{
+	return dma_ll_append_node(list, source, destination, bytes, 0U);
+}
+
+dma_ll_node_s *dma_ll_append_2d(dma_ll_list_s *const list, const uintptr_t source, const uintptr_t destination,
+	const uint16_t bytes, const uint16_t repeat, const uint16_t source_block_offset,
+	const uint16_t destination_block_offset)
+{
+	/* Block repeats only exist on the 2D channels, and the counter holds repeat - 1 in 11 bits */
+	if (!list->two_d || repeat == 0U || repeat > 2048U)
+		return NULL;
+	const uint32_t cbr1 = bytes | ((uint32_t)(repeat - 1U) << DMA_CxBR1_BRC_SHIFT);
+	const uint32_t cbr2 = ((uint32_t)source_block_offset << DMA_CxBR2_BRSAO_SHIFT) |
+		((uint32_t)destination_block_offset << DMA_CxBR2_BRDAO_SHIFT);
+	return dma_ll_append_node(list, source, destination, cbr1, cbr2);
+}
+
+bool dma_ll_set_circular(dma_ll_list_s *const list, dma_ll_node_s *loop_start)
+{
+	if (!list->tail)
+		return false;
+	if (!loop_start)
+		loop_start = list->head;
+	*dma_ll_link_word(list, list->tail) = dma_ll_link_to(list, loop_start);
+	list->circular = true;
+	return true;
+}
+
+void dma_ll_clear(dma_ll_list_s *const list)
+{
+	dma_ll_node_s *node = list->head;
+	while (node) {
+		dma_ll_node_s *const next = node == list->tail ? NULL : dma_ll_next(list, node);
+		dma_ll_node_free(list->pool, node);
+		node = next;
+	}
+	list->head = NULL;
+	list->tail = NULL;
+	list->current = NULL;
+	list->count = 0U;
+	list->circular = false;
+}
+
+void dma_ll_set_callback(dma_ll_list_s *const list, const dma_ll_callback_t callback, void *const arg)
+{
+	list->callback = callback;
+	list->callback_arg = arg;
+}
+
+bool dma_ll_start(dma_ll_list_s *const list, const bool per_node)
+{
+	const uintptr_t dma = list->dma;
+	const uint8_t channel = list->channel;
+	dma_ll_node_s *const head = list->head;
+	if (!head || (DMA_CCR(dma, channel) & DMA_CxCR_EN))
+		return false;
+
+	/*
+	 * A circular list never reaches its end, so it can only report per item. Every item reloads
+	 * CxTR2, so the completion mode has to be written into all of them.
+	 */
+	list->per_node = per_node || list->circular;
+	const dma_transfer_complete_mode_e mode =
+		list->per_node ? DMA_TRANSFER_COMPLETE_MODE_LLI : DMA_TRANSFER_COMPLETE_MODE_CHANNEL;
+	for (dma_ll_node_s *node = head; node; node = node == list->tail ? NULL : dma_ll_next(list, node))
+		node->ctr2 = (node->ctr2 & ~DMA_CxTR2_TCEM_MASK) | ((uint32_t)mode << DMA_CxTR2_TCEM_SHIFT);
+
+	/* Load the first item straight into the channel, the link word chains in the rest */
+	DMA_CTR1(dma, channel) = head->ctr1;
+	DMA_CTR2(dma, channel) = head->ctr2;
+	DMA_CBR1(dma, channel) = head->cbr1;
+	DMA_CSAR(dma, channel) = head->csar;
+	DMA_CDAR(dma, channel) = head->cdar;
+	if (list->two_d) {
+		DMA_CTR3(dma, channel) = head->ctr3;
+		DMA_CBR2(dma, channel) = head->cbr2;
+	}
+	DMA_CLBAR(dma, channel) = (uintptr_t)head & 0xffff0000U;
+	DMA_CLLR(dma, channel) = *dma_ll_link_word(list, head);
+
+	list->current = head;
+	list->completed = 0U;
+	dma_enable_interrupts(dma, channel, DMA_LL_IRQS);
+	dma_enable_channel(dma, channel);
+	return true;
+}
+
+void dma_ll_stop(dma_ll_list_s *const list)
+{
+	dma_disable_interrupts(list->dma, list->channel, DMA_LL_IRQS);
+	dma_disable_channel(list->dma, list->channel);
+	dma_clear_interrupt_flags(list->dma, list->channel, DMA_ISR_FLAGS);
+	list->current = NULL;
+}
+
+void dma_ll_isr(dma_ll_list_s *const list)
+{
+	const uint32_t flags = DMA_CSR(list->dma, list->channel) & DMA_LL_IRQS;
+	if (!flags)
+		return;
+	dma_clear_interrupt_flags(list->dma, list->channel, flags);
+
+	dma_ll_node_s *node = NULL;
+	/* Any of the error flags means the hardware has already disabled the channel */
+	if (flags == DMA_TCIF) {
+		if (list->per_node) {
+			node = list->current;
+			list->current = node ? dma_ll_next(list, node) : NULL;
+		} else {
+			node = list->tail;
+			list->current = NULL;
+		}
+		++list->completed;
+	} else
+		list->current = NULL;
+
+	if (list->callback)
+		list->callback(list, node, flags);
+}
@@ -27,6 +27,7 @@
 #include <libopencm3/stm32/flash.h>
 
 #define ARRAY_LENGTH(arr) (sizeof(arr) / sizeof((arr)[0]))
+#define MIN(x, y)         ((x) < (y) ? (x) : (y))
 
 #define FLASH_WRITE_BLOCK_SIZE 16U
 
@@ -119,7 +120,7 @@ bool flash_program(const uintptr_t address, const uint8_t *const data, const siz
 		uint32_t block[4];
 		memset(block, 0xffU, sizeof(block));
 		/* Compute how many bytes we get to consume this iteration and copy those in */
-		const size_t amount = FLASH_WRITE_BLOCK_SIZE - alignment;
+		const size_t amount = MIN(FLASH_WRITE_BLOCK_SIZE - alignment, len - offset);
 		memcpy(((uint8_t *)block) + alignment, data + offset, amount);
 		/* Copy the 4 u32's to their destination in Flash and wait for programming to complete */
 		for (size_t i = 0; i < ARRAY_LENGTH(block); ++i) {
@@ -128,8 +129,10 @@ bool flash_program(const uintptr_t address, const uint8_t *const data, const siz
 		while (FLASH_NSSR & FLASH_NSSR_BSY)
 			continue;
 		/* Check for errors and bomb out if there are any */
-		if (FLASH_NSSR & FLASH_NSSR_ERROR_MASK)
+		if (FLASH_NSSR & FLASH_NSSR_ERROR_MASK) {
+			flash_program_disable();
 			return false;
+		}
 		/* Update where we are in the input buffer and with what alignment */
 		offset += amount;
 		alignment = 0U;
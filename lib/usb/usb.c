@@ -117,8 +117,83 @@ void usbd_register_bos_descriptor(usbd_device *const usbd_dev, const usb_bos_des
 	usbd_dev->bos = bos;
 }
 
+void usbd_register_timestamp(usbd_device *usbd_dev, uint32_t (*timestamp)(void))
+{
+	usbd_dev->timestamp = timestamp;
+}
+
+const struct usbd_stats *usbd_get_stats(usbd_device *usbd_dev)
+{
+	return &usbd_dev->stats;
+}
+
+void usbd_clear_stats(usbd_device *usbd_dev)
+{
+	memset(&usbd_dev->stats, 0, sizeof(usbd_dev->stats));
+}
+
+static uint32_t usbd_timestamp(usbd_device *usbd_dev)
+{
+	return usbd_dev->timestamp ? usbd_dev->timestamp() : 0;
+}
+
+static void usbd_account(usbd_device *usbd_dev, enum usbd_event event,
+			 uint32_t start)
+{
+	struct usbd_event_stats *stats = &usbd_dev->stats.event[event];
+	const uint32_t latency = start - usbd_dev->poll_start;
+	const uint32_t ticks = usbd_timestamp(usbd_dev) - start;
+
+	usbd_dev->stats.events++;
+	stats->count++;
+	stats->ticks_total += ticks;
+	if (ticks > stats->ticks_max) {
+		stats->ticks_max = ticks;
+	}
+	if (latency > stats->latency_max) {
+		stats->latency_max = latency;
+	}
+}
+
+/* Hand an endpoint event to its callback, which must be set */
+void _usbd_ep_event(usbd_device *usbd_dev, uint8_t ep, enum _usbd_transaction type)
+{
+	const uint32_t start = usbd_timestamp(usbd_dev);
+
+	usbd_dev->user_callback_ctr[ep][type](usbd_dev, ep);
+	usbd_account(usbd_dev, (enum usbd_event)type, start);
+}
+
+/* Hand a suspend, resume or SOF event to its callback, if any */
+void _usbd_bus_event(usbd_device *usbd_dev, enum usbd_event event)
+{
+	const uint32_t start = usbd_timestamp(usbd_dev);
+	void (*callback)(void) = NULL;
+
+	switch (event) {
+	case USBD_EVENT_SUSPEND:
+		callback = usbd_dev->user_callback_suspend;
+		break;
+	case USBD_EVENT_RESUME:
+		callback = usbd_dev->user_callback_resume;
+		break;
+	case USBD_EVENT_SOF:
+		callback = usbd_dev->user_callback_sof;
+		break;
+	default:
+		break;
+	}
+
+	if (callback) {
+		callback();
+	}
+	usbd_account(usbd_dev, event, start);
+}
+
 void _usbd_reset(usbd_device *usbd_dev)
 {
+	const uint32_t start = usbd_timestamp(usbd_dev);
+
 	usbd_dev->current_address = 0;
 	usbd_dev->current_config = 0;
 	usbd_ep_setup(usbd_dev, 0, USB_ENDPOINT_ATTR_CONTROL, usbd_dev->desc->bMaxPacketSize0, NULL);
@@ -127,12 +202,21 @@ void _usbd_reset(usbd_device *usbd_dev)
 	if (usbd_dev->user_callback_reset) {
 		usbd_dev->user_callback_reset();
 	}
+	usbd_account(usbd_dev, USBD_EVENT_RESET, start);
 }
 
 /* Functions to wrap the low-level driver */
 void usbd_poll(usbd_device *usbd_dev)
 {
+	const uint32_t events = usbd_dev->stats.events;
+
+	usbd_dev->poll_start = usbd_timestamp(usbd_dev);
 	usbd_dev->driver->poll(usbd_dev);
+
+	usbd_dev->stats.polls++;
+	if (usbd_dev->stats.events == events) {
+		usbd_dev->stats.idle_polls++;
+	}
 }
 
 __attribute__((weak)) void usbd_disconnect(usbd_device *usbd_dev,
@@ -144,12 +228,176 @@ __attribute__((weak)) void usbd_disconnect(usbd_device *usbd_dev,
 	}
 }
 
+static struct usbd_transfer *usbd_transfer_slot(usbd_device *usbd_dev,
+						 uint8_t addr)
+{
+	return &usbd_dev->transfer[addr & 0x7f][(addr & 0x80) ?
+		USB_TRANSACTION_IN : USB_TRANSACTION_OUT];
+}
+
+/* Forget any transfer on a (re)configured endpoint, and note its packet size */
+static void usbd_transfer_reset(usbd_device *usbd_dev, uint8_t addr,
+				uint16_t max_size)
+{
+	struct usbd_transfer *transfer = usbd_transfer_slot(usbd_dev, addr);
+
+	/* Drivers only replace the endpoint callback when given one, don't
+	 * leave the stand-in of a software transfer behind */
+	if (transfer->software) {
+		usbd_dev->user_callback_ctr[addr & 0x7f][(addr & 0x80) ?
+			USB_TRANSACTION_IN : USB_TRANSACTION_OUT] =
+			transfer->ep_callback;
+	}
+	memset(transfer, 0, sizeof(*transfer));
+	transfer->max_size = max_size;
+}
+
 void usbd_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
 		   uint16_t max_size, usbd_endpoint_callback callback)
 {
+	usbd_transfer_reset(usbd_dev, addr, max_size);
 	usbd_dev->driver->ep_setup(usbd_dev, addr, type, max_size, callback);
 }
 
+void usbd_ep_setup_double_buffered(usbd_device *usbd_dev, uint8_t addr,
+				   uint8_t type, uint16_t max_size,
+				   usbd_endpoint_callback callback)
+{
+	usbd_transfer_reset(usbd_dev, addr, max_size);
+	/* FIFO based cores already queue packets, they just get a normal EP */
+	if (usbd_dev->driver->ep_setup_double_buffered) {
+		usbd_dev->driver->ep_setup_double_buffered(usbd_dev, addr, type,
+							   max_size, callback);
+	} else {
+		usbd_dev->driver->ep_setup(usbd_dev, addr, type, max_size, callback);
+	}
+}
+
+static void usbd_transfer_finish(usbd_device *usbd_dev, uint8_t addr)
+{
+	struct usbd_transfer *transfer = usbd_transfer_slot(usbd_dev, addr);
+	const usbd_transfer_callback callback = transfer->callback;
+
+	/* Give the endpoint back before the callback, it may queue the next one */
+	usbd_dev->user_callback_ctr[addr & 0x7f][(addr & 0x80) ?
+		USB_TRANSACTION_IN : USB_TRANSACTION_OUT] = transfer->ep_callback;
+	transfer->callback = NULL;
+	transfer->software = false;
+	callback(usbd_dev, addr, transfer->done);
+}
+
+/* Send the next packet of a software IN transfer, or finish it */
+static void usbd_transfer_in_next(usbd_device *usbd_dev, uint8_t addr)
+{
+	struct usbd_transfer *transfer = usbd_transfer_slot(usbd_dev, addr);
+	const uint32_t left = transfer->len - transfer->done;
+
+	/* We only get here after a full packet, so that's followed by a ZLP if asked for */
+	if (!left && !(transfer->flags & USBD_TRANSFER_ZLP)) {
+		usbd_transfer_finish(usbd_dev, addr);
+		return;
+	}
+
+	transfer->in_flight = MIN(left, transfer->max_size);
+	if (usbd_dev->driver->ep_write_packet(usbd_dev, addr,
+			transfer->buf + transfer->done, transfer->in_flight) !=
+	    transfer->in_flight) {
+		/* Refused while the endpoint is busy, keep the offset and try
+		 * again when its packet has gone */
+		transfer->retry = true;
+	}
+}
+
+static void usbd_transfer_in(usbd_device *usbd_dev, uint8_t ep)
+{
+	struct usbd_transfer *transfer = usbd_transfer_slot(usbd_dev, ep | 0x80);
+
+	if (transfer->retry) {
+		transfer->retry = false;
+		usbd_transfer_in_next(usbd_dev, ep | 0x80);
+		return;
+	}
+
+	/* The last packet has gone */
+	transfer->done += transfer->in_flight;
+	if (transfer->in_flight < transfer->max_size) {
+		/* A short packet, including a ZLP, always ends the transfer */
+		usbd_transfer_finish(usbd_dev, ep | 0x80);
+		return;
+	}
+	usbd_transfer_in_next(usbd_dev, ep | 0x80);
+}
+
+static void usbd_transfer_out(usbd_device *usbd_dev, uint8_t ep)
+{
+	struct usbd_transfer *transfer = usbd_transfer_slot(usbd_dev, ep);
+	const uint16_t len = MIN(transfer->len - transfer->done,
+				 transfer->max_size);
+	const uint16_t got = usbd_dev->driver->ep_read_packet(usbd_dev, ep,
+		transfer->buf + transfer->done, len);
+
+	transfer->done += got;
+	if (got < transfer->max_size || transfer->done == transfer->len) {
+		usbd_transfer_finish(usbd_dev, ep);
+	}
+}
+
+bool usbd_ep_transfer(usbd_device *usbd_dev, uint8_t addr, void *buf,
+		      uint32_t len, uint8_t flags,
+		      usbd_transfer_callback callback)
+{
+	struct usbd_transfer *transfer = usbd_transfer_slot(usbd_dev, addr);
+	const uint8_t ep = addr & 0x7f;
+
+	/* EP0 belongs to the control logic, and one transfer at a time */
+	if (!ep || ep >= 8 || !callback || transfer->callback ||
+	    !transfer->max_size) {
+		return false;
+	}
+
+	/* Let the hardware move the whole thing if it can */
+	if (usbd_dev->driver->ep_transfer &&
+	    usbd_dev->driver->ep_transfer(usbd_dev, addr, buf, len, flags,
+					  callback)) {
+		return true;
+	}
+
+	/*
+	 * Otherwise split it into packets ourselves, by standing in for the
+	 * endpoint callback until the transfer is done.
+	 */
+	transfer->buf = buf;
+	transfer->len = len;
+	transfer->done = 0;
+	transfer->flags = flags;
+	transfer->callback = callback;
+	transfer->software = true;
+	transfer->retry = false;
+	if (addr & 0x80) {
+		transfer->ep_callback =
+			usbd_dev->user_callback_ctr[ep][USB_TRANSACTION_IN];
+		usbd_dev->user_callback_ctr[ep][USB_TRANSACTION_IN] =
+			usbd_transfer_in;
+		/* The first packet always goes, even when it is a ZLP */
+		transfer->in_flight = MIN(len, transfer->max_size);
+		if (usbd_dev->driver->ep_write_packet(usbd_dev, addr, buf,
+				transfer->in_flight) != transfer->in_flight) {
+			/* Still busy with a packet of its own */
+			usbd_dev->user_callback_ctr[ep][USB_TRANSACTION_IN] =
+				transfer->ep_callback;
+			transfer->callback = NULL;
+			transfer->software = false;
+			return false;
+		}
+	} else {
+		transfer->ep_callback =
+			usbd_dev->user_callback_ctr[ep][USB_TRANSACTION_OUT];
+		usbd_dev->user_callback_ctr[ep][USB_TRANSACTION_OUT] =
+			usbd_transfer_out;
+	}
+	return true;
+}
+
 uint16_t usbd_ep_write_packet(usbd_device *usbd_dev, uint8_t addr,
 			 const void *buf, uint16_t len)
 {
@@ -26,14 +26,56 @@
 #include "usb_private.h"
 #include "usb_dwc_common.h"
 
+#if defined(STM32F7) || defined(STM32H7)
+#define DWC_DCACHE
+#include <libopencm3/cm3/scb.h>
+#endif
+
 /* The FS core and the HS core have the same register layout.
  * As the code can be used on both cores, the registers offset is modified
  * according to the selected cores base address. */
 #define dev_base_address (usbd_dev->driver->base_address)
 #define REBASE(x)        MMIO32((x) + (dev_base_address))
 
+/* DMA mode packet buffer for OUT endpoint ep, ENDPOINT_COUNT is the shared IN buffer */
+#define DMA_BUFFER(ep) (usbd_dev->dma_buf + ((ep) * USBD_DWC_DMA_PACKET_SIZE))
+
 static void dwc_flush_txfifo(usbd_device *usbd_dev, uint8_t ep);
 
+/*
+ * With the data cache on, what the CPU wrote has to reach memory before the core fetches it, and lines of
+ * memory the core writes must not be held in the cache while it does, nor read from it afterwards
+ */
+static void dwc_dma_prepare_tx(const void *const buffer, const size_t length)
+{
+#ifdef DWC_DCACHE
+	scb_dma_prepare_tx(buffer, length);
+#else
+	(void)buffer;
+	(void)length;
+#endif
+}
+
+static void dwc_dma_prepare_rx(void *const buffer, const size_t length)
+{
+#ifdef DWC_DCACHE
+	scb_dma_prepare_rx(buffer, length);
+#else
+	(void)buffer;
+	(void)length;
+#endif
+}
+
+static void dwc_dma_complete_rx(void *const buffer, const size_t length)
+{
+#ifdef DWC_DCACHE
+	scb_dma_complete_rx(buffer, length);
+#else
+	(void)buffer;
+	(void)length;
+#endif
+}
+
 void dwc_set_address(usbd_device *const usbd_dev, const uint8_t address)
 {
 	REBASE(OTG_DCFG) = (REBASE(OTG_DCFG) & ~OTG_DCFG_DAD) | ((address << 4U) & OTG_DCFG_DAD);
@@ -74,6 +116,12 @@ void dwc_ep_setup(usbd_device *const usbd_dev, const uint8_t endpoint_address, c
 		/* Now configure EP0 OUT to allow us to receive SETUP packets */
 		usbd_dev->doeptsiz[0U] =
 			OTG_DOEPSIZ0_STUPCNT_1 | OTG_DOEPSIZ0_PKTCNT | (max_packet_length & OTG_DOEPSIZ0_XFRSIZ_MASK);
+		if (usbd_dev->driver->dma) {
+			/* Make room for back-to-back SETUP packets, which the core stores one after the other */
+			usbd_dev->doeptsiz[0U] = (usbd_dev->doeptsiz[0U] & ~OTG_DOEPSIZ0_STUPCNT_MASK) | OTG_DOEPSIZ0_STUPCNT_3;
+			dwc_dma_prepare_rx(DMA_BUFFER(0U), USBD_DWC_DMA_PACKET_SIZE);
+			REBASE(OTG_DOEPDMA(0U)) = (uintptr_t)DMA_BUFFER(0U);
+		}
 		REBASE(OTG_DOEPTSIZ0) = usbd_dev->doeptsiz[0U];
 		/* However, *do* arm the OUT endpoint so we can receive the first SETUP packet */
 #ifdef STM32H7
@@ -96,6 +144,10 @@ void dwc_ep_setup(usbd_device *const usbd_dev, const uint8_t endpoint_address, c
 			/* Set up this OUT endpoint, arming it so we can get data from it */
 			usbd_dev->doeptsiz[ep] = OTG_DOEPSIZX_PKTCNT(1U) | (max_packet_length & OTG_DOEPSIZX_XFRSIZ_MASK);
 			REBASE(OTG_DOEPTSIZ(ep)) = usbd_dev->doeptsiz[ep];
+			if (usbd_dev->driver->dma) {
+				dwc_dma_prepare_rx(DMA_BUFFER(ep), USBD_DWC_DMA_PACKET_SIZE);
+				REBASE(OTG_DOEPDMA(ep)) = (uintptr_t)DMA_BUFFER(ep);
+			}
 			REBASE(OTG_DOEPCTL(ep)) = OTG_DOEPCTL0_EPENA | OTG_DOEPCTL0_CNAK | OTG_DOEPCTL0_USBAEP |
 				OTG_DOEPCTLX_SD0PID | (type << OTG_DOEPCTLX_EPTYP_SHIFT) |
 				(max_packet_length & OTG_DOEPCTLX_MPSIZ_MASK);
@@ -120,8 +172,9 @@ void dwc_ep_setup(usbd_device *const usbd_dev, const uint8_t endpoint_address, c
 
 void dwc_endpoints_reset(usbd_device *const usbd_dev)
 {
-	/* Start by resetting our FIFO setup state */
+	/* Start by resetting our FIFO setup state and dropping any queued transfers */
 	usbd_dev->fifo_mem_top = usbd_dev->fifo_mem_top_ep0;
+	memset(usbd_dev->transfer, 0, sizeof(usbd_dev->transfer));
 
 	/*
 	 * Now loop through all endpoints and make sure we're NAK'ing and they're properly disabled
@@ -247,6 +300,24 @@ uint16_t dwc_ep_write_packet(
 		REBASE(OTG_DIEPTSIZ0) = OTG_DIEPSIZ0_PKTCNT | (length & OTG_DIEPSIZ0_XFRSIZ_MASK);
 	else
 		REBASE(OTG_DIEPTSIZ(ep)) = OTG_DIEPSIZX_MCNT_1 | OTG_DIEPSIZX_PKTCNT(1) | (length & OTG_DIEPSIZX_XFRSIZ_MASK);
+
+	if (usbd_dev->driver->dma) {
+		/* The core can only fetch from word aligned addresses, so bounce anything else */
+		const void *source = buffer;
+		if (((uintptr_t)buffer & 0x3U) != 0U) {
+			memcpy(DMA_BUFFER(ENDPOINT_COUNT), buffer, length);
+			source = DMA_BUFFER(ENDPOINT_COUNT);
+		}
+		dwc_dma_prepare_tx(source, length);
+		REBASE(OTG_DIEPDMA(ep)) = (uintptr_t)source;
+		REBASE(OTG_DIEPCTL(ep)) |= OTG_DIEPCTL0_EPENA | OTG_DIEPCTL0_CNAK;
+		/* Wait for the core to pull the packet into the FIFO so the caller gets its buffer back */
+		while ((REBASE(OTG_DIEPTSIZ(ep)) & OTG_DIEPSIZX_XFRSIZ_MASK) != 0U &&
+			(REBASE(OTG_DIEPCTL(ep)) & OTG_DIEPCTL0_EPENA) != 0U)
+			continue;
+		return length;
+	}
+
 	/* Arm the endpoint for send */
 	REBASE(OTG_DIEPCTL(ep)) |= OTG_DIEPCTL0_EPENA | OTG_DIEPCTL0_CNAK;
 
@@ -289,6 +360,15 @@ uint16_t dwc_ep_read_packet(
 	(void)endpoint_address;
 	/* Figure out how many bytes to read, and how many can be read as u32 chunks */
 	const size_t count = MIN(length, usbd_dev->rxbcnt);
+
+	/* In DMA mode the core has already put the packet in memory for us */
+	if (usbd_dev->driver->dma) {
+		memcpy(buffer, usbd_dev->dma_rx_data, count);
+		usbd_dev->dma_rx_data += count;
+		usbd_dev->rxbcnt -= count;
+		return count;
+	}
+
 	const size_t aligned_count = count & ~3U;
 
 	/* ARMv7-M and newer supports non-word-aligned accesses, ARMv6-M does not. */
@@ -326,6 +406,141 @@ uint16_t dwc_ep_read_packet(
 	return count;
 }
 
+bool dwc_ep_transfer(usbd_device *const usbd_dev, const uint8_t endpoint_address, void *const buffer,
+	const uint32_t length, const uint8_t flags, const usbd_transfer_callback callback)
+{
+	const uint8_t ep = endpoint_address & 0x7fU;
+	/*
+	 * Only the DMA capable core can move a whole transfer without us, the buffer has to be word aligned
+	 * for it, and EP0 belongs to the control request handling
+	 */
+	if (!usbd_dev->driver->dma || ep == 0U || ep >= ENDPOINT_COUNT || ((uintptr_t)buffer & 0x3U) != 0U ||
+		length > OTG_DIEPSIZX_XFRSIZ_MASK) {
+		return false;
+	}
+	const uint32_t max_packets = OTG_DIEPSIZX_PKTCNT_MASK >> OTG_DIEPSIZX_PKTCNT_SHIFT;
+
+	if (endpoint_address & 0x80U) {
+		struct usbd_transfer *const transfer = &usbd_dev->transfer[ep][USB_TRANSACTION_IN];
+		/* Refuse if there's already something in flight on this endpoint */
+		if (transfer->active || (REBASE(OTG_DIEPCTL(ep)) & OTG_DIEPCTL0_EPENA) != 0U) {
+			return false;
+		}
+		const uint32_t max_packet_length = REBASE(OTG_DIEPCTL(ep)) & OTG_DIEPCTLX_MPSIZ_MASK;
+		/* A zero length transfer is still one (empty) packet, as is a requested ZLP after full ones */
+		uint32_t packets = length ? (length + max_packet_length - 1U) / max_packet_length : 1U;
+		if ((flags & USBD_TRANSFER_ZLP) && length && length % max_packet_length == 0U) {
+			++packets;
+		}
+		if (packets > max_packets) {
+			return false;
+		}
+
+		transfer->buf = buffer;
+		transfer->len = length;
+		transfer->callback = callback;
+		transfer->active = true;
+		/* Hand the whole transfer to the core and let it split it into packets */
+		dwc_dma_prepare_tx(buffer, length);
+		REBASE(OTG_DIEPDMA(ep)) = (uintptr_t)buffer;
+		REBASE(OTG_DIEPTSIZ(ep)) = OTG_DIEPSIZX_MCNT_1 | OTG_DIEPSIZX_PKTCNT(packets) | length;
+		REBASE(OTG_DIEPCTL(ep)) |= OTG_DIEPCTL0_EPENA | OTG_DIEPCTL0_CNAK;
+		return true;
+	}
+
+	struct usbd_transfer *const transfer = &usbd_dev->transfer[ep][USB_TRANSACTION_OUT];
+	/* Refuse if there's already a transfer queued or in flight */
+	if (transfer->callback) {
+		return false;
+	}
+	(void)flags;
+	/* The core always writes whole packets, so the buffer must be a multiple of the packet size */
+	const uint32_t max_packet_length = REBASE(OTG_DOEPCTL(ep)) & OTG_DOEPCTLX_MPSIZ_MASK;
+	if (length == 0U || length % max_packet_length || length / max_packet_length > max_packets) {
+		return false;
+	}
+
+	/* The endpoint is already armed for a single packet, so this takes over when it is next armed */
+	transfer->buf = buffer;
+	transfer->len = length;
+	transfer->callback = callback;
+	transfer->active = false;
+	return true;
+}
+
+static void dwc_transfer_complete(usbd_device *const usbd_dev, const uint8_t endpoint_address, const uint32_t length)
+{
+	const uint8_t ep = endpoint_address & 0x7fU;
+	struct usbd_transfer *const transfer =
+		&usbd_dev->transfer[ep][(endpoint_address & 0x80U) ? USB_TRANSACTION_IN : USB_TRANSACTION_OUT];
+	const usbd_transfer_callback callback = transfer->callback;
+	/* Release the slot first so the callback can queue the next transfer */
+	transfer->callback = NULL;
+	transfer->active = false;
+	if (callback) {
+		callback(usbd_dev, endpoint_address, length);
+	}
+}
+
+/* (Re-)arm an OUT endpoint in DMA mode, with the next queued transfer if there is one */
+static void dwc_dma_arm_out(usbd_device *const usbd_dev, const uint8_t ep)
+{
+	struct usbd_transfer *const transfer = &usbd_dev->transfer[ep][USB_TRANSACTION_OUT];
+	if (transfer->callback && !transfer->active && !transfer->software) {
+		const uint32_t max_packet_length = REBASE(OTG_DOEPCTL(ep)) & OTG_DOEPCTLX_MPSIZ_MASK;
+		dwc_dma_prepare_rx(transfer->buf, transfer->len);
+		REBASE(OTG_DOEPDMA(ep)) = (uintptr_t)transfer->buf;
+		REBASE(OTG_DOEPTSIZ(ep)) = OTG_DOEPSIZX_PKTCNT(transfer->len / max_packet_length) | transfer->len;
+		transfer->active = true;
+	} else {
+		dwc_dma_prepare_rx(DMA_BUFFER(ep), USBD_DWC_DMA_PACKET_SIZE);
+		REBASE(OTG_DOEPDMA(ep)) = (uintptr_t)DMA_BUFFER(ep);
+		REBASE(OTG_DOEPTSIZ(ep)) = usbd_dev->doeptsiz[ep];
+	}
+	REBASE(OTG_DOEPCTL(ep)) |=
+		OTG_DOEPCTL0_EPENA | (usbd_dev->force_nak[ep] ? OTG_DOEPCTL0_SNAK : OTG_DOEPCTL0_CNAK);
+}
+
+/* DMA mode replacement for the RX FIFO handling, driven by the OUT endpoint interrupts */
+static void dwc_dma_out(usbd_device *const usbd_dev, const uint8_t ep, const uint32_t interrupts)
+{
+	if (interrupts & OTG_DOEPINTX_STUP) {
+		/* The core stores SETUP packets one after the other, the last one is the one to act on */
+		const uint8_t *const setup = (const uint8_t *)(uintptr_t)REBASE(OTG_DOEPDMA(ep)) - 8U;
+		dwc_dma_complete_rx(DMA_BUFFER(ep), USBD_DWC_DMA_PACKET_SIZE);
+		/* Check if there's anything stuck in the TX FIFO to flush */
+		if ((REBASE(OTG_DIEPTSIZ(ep)) & OTG_DIEPSIZ0_PKTCNT) != 0U) {
+			dwc_flush_txfifo(usbd_dev, ep);
+		}
+		memcpy(&usbd_dev->control_state.req, setup, sizeof(usbd_dev->control_state.req));
+		_usbd_ep_event(usbd_dev, ep, USB_TRANSACTION_SETUP);
+		/* A completion seen alongside this is just for the SETUP phase */
+		dwc_dma_arm_out(usbd_dev, ep);
+		return;
+	}
+	if ((interrupts & OTG_DOEPINTX_XFRC) == 0U) {
+		return;
+	}
+
+	/* Work out how much arrived from what's left of the programmed transfer size */
+	const uint32_t remaining = REBASE(OTG_DOEPTSIZ(ep)) & OTG_DOEPSIZX_XFRSIZ_MASK;
+	struct usbd_transfer *const transfer = &usbd_dev->transfer[ep][USB_TRANSACTION_OUT];
+	if (transfer->active) {
+		dwc_dma_complete_rx(transfer->buf, transfer->len - remaining);
+		dwc_transfer_complete(usbd_dev, ep, transfer->len - remaining);
+	} else {
+		/* Single packet, hand it to the user's handler to read out like it came from the FIFO */
+		usbd_dev->rxbcnt = (usbd_dev->doeptsiz[ep] & OTG_DOEPSIZX_XFRSIZ_MASK) - remaining;
+		dwc_dma_complete_rx(DMA_BUFFER(ep), usbd_dev->rxbcnt);
+		usbd_dev->dma_rx_data = DMA_BUFFER(ep);
+		if (usbd_dev->user_callback_ctr[ep][USB_TRANSACTION_OUT]) {
+			_usbd_ep_event(usbd_dev, ep, USB_TRANSACTION_OUT);
+		}
+		usbd_dev->rxbcnt = 0U;
+	}
+	dwc_dma_arm_out(usbd_dev, ep);
+}
+
 static void dwc_flush_txfifo(usbd_device *const usbd_dev, const uint8_t ep)
 {
 	/* Mark the endpoint to NAK and wait for it to become active */
@@ -370,17 +585,23 @@ void dwc_poll(usbd_device *const usbd_dev)
 	 * There is not always a global interrupt flag for transmit complete.
 	 * The XFRC bit must be checked in each OTG_DIEPINT(x).
 	 *
-	 * Iterate over the IN endpoints, triggering any post-transmit actions.
+	 * Iterate over just the IN endpoints DAINT says have something pending, triggering any
+	 * post-transmit actions.
 	 */
 	if (status & OTG_GINTSTS_IEPINT) {
-		for (size_t ep = 0U; ep < ENDPOINT_COUNT; ++ep) {
+		uint32_t endpoints_pending = REBASE(OTG_DAINT) & REBASE(OTG_DAINTMSK) & ((1U << ENDPOINT_COUNT) - 1U);
+		while (endpoints_pending != 0U) {
+			const uint8_t ep = (uint8_t)__builtin_ctz(endpoints_pending);
+			endpoints_pending &= endpoints_pending - 1U;
 			/* If this endpoint has a completion, process it */
 			if (REBASE(OTG_DIEPINT(ep)) & OTG_DIEPINTX_XFRC) {
 				/* Mark the endpoint for NAK so we don't cause a protocol error */
 				REBASE(OTG_DIEPCTL(ep)) |= OTG_DIEPCTL0_SNAK;
-				/* Call any callback that might be available */
-				if (usbd_dev->user_callback_ctr[ep][USB_TRANSACTION_IN]) {
-					usbd_dev->user_callback_ctr[ep][USB_TRANSACTION_IN](usbd_dev, ep);
+				/* Complete any whole transfer, otherwise call any callback that might be available */
+				if (usbd_dev->transfer[ep][USB_TRANSACTION_IN].active) {
+					dwc_transfer_complete(usbd_dev, ep | 0x80U, usbd_dev->transfer[ep][USB_TRANSACTION_IN].len);
+				} else if (usbd_dev->user_callback_ctr[ep][USB_TRANSACTION_IN]) {
+					_usbd_ep_event(usbd_dev, ep, USB_TRANSACTION_IN);
 				}
 			}
 			/* Clear any and all interrupt notifications on this endpoint */
@@ -388,8 +609,8 @@ void dwc_poll(usbd_device *const usbd_dev)
 		}
 	}
 
-	/* Handle OUT packet reception */
-	while (REBASE(OTG_GINTSTS) & OTG_GINTSTS_RXFLVL) {
+	/* Handle OUT packet reception, which in DMA mode is done from the OUT endpoint interrupts instead */
+	while (!usbd_dev->driver->dma && (REBASE(OTG_GINTSTS) & OTG_GINTSTS_RXFLVL)) {
 		/* Pop the RX packet status from the stack and decode */
 		const uint32_t rx_status = REBASE(OTG_GRXSTSP);
 		const uint32_t phase = rx_status & OTG_GRXSTSP_PKTSTS_MASK;
@@ -399,7 +620,7 @@ void dwc_poll(usbd_device *const usbd_dev)
 		switch (phase) {
 		case OTG_GRXSTSP_PKTSTS_SETUP_COMP:
 			/* Packet is for completion of a SETUP transaction, call the callback for this */
-			usbd_dev->user_callback_ctr[ep][USB_TRANSACTION_SETUP](usbd_dev, ep);
+			_usbd_ep_event(usbd_dev, ep, USB_TRANSACTION_SETUP);
 			break;
 		case OTG_GRXSTSP_PKTSTS_SETUP:
 			/* Packet is a SETUP packet, check if there's anything stuck in the TX FIFO to flush */
@@ -412,7 +633,7 @@ void dwc_poll(usbd_device *const usbd_dev)
 		case OTG_GRXSTSP_PKTSTS_OUT:
 			/* Call the user's handler if present */
 			if (usbd_dev->user_callback_ctr[ep][USB_TRANSACTION_OUT]) {
-				usbd_dev->user_callback_ctr[ep][USB_TRANSACTION_OUT](usbd_dev, ep);
+				_usbd_ep_event(usbd_dev, ep, USB_TRANSACTION_OUT);
 			}
 			break;
 		default:
@@ -444,7 +665,12 @@ void dwc_poll(usbd_device *const usbd_dev)
 			/* If there's an interrupt set on this endpoint */
 			if (endpoints_mask & 1U) {
 				/* Clear it */
-				REBASE(OTG_DOEPINT(ep)) = REBASE(OTG_DOEPINT(ep));
+				const uint32_t interrupts = REBASE(OTG_DOEPINT(ep));
+				REBASE(OTG_DOEPINT(ep)) = interrupts;
+				/* And in DMA mode, deal with whatever arrived */
+				if (usbd_dev->driver->dma) {
+					dwc_dma_out(usbd_dev, ep, interrupts);
+				}
 			}
 
 			/* Advance to the next endpoint */
@@ -455,23 +681,17 @@ void dwc_poll(usbd_device *const usbd_dev)
 
 	/* Process suspend and wakeup interrupts */
 	if (status & OTG_GINTSTS_USBSUSP) {
-		if (usbd_dev->user_callback_suspend) {
-			usbd_dev->user_callback_suspend();
-		}
+		_usbd_bus_event(usbd_dev, USBD_EVENT_SUSPEND);
 		REBASE(OTG_GINTSTS) = OTG_GINTSTS_USBSUSP;
 	}
 	if (status & OTG_GINTSTS_WKUPINT) {
-		if (usbd_dev->user_callback_resume) {
-			usbd_dev->user_callback_resume();
-		}
+		_usbd_bus_event(usbd_dev, USBD_EVENT_RESUME);
 		REBASE(OTG_GINTSTS) = OTG_GINTSTS_WKUPINT;
 	}
 
 	/* Handle SOF notifications */
 	if (status & OTG_GINTSTS_SOF) {
-		if (usbd_dev->user_callback_sof) {
-			usbd_dev->user_callback_sof();
-		}
+		_usbd_bus_event(usbd_dev, USBD_EVENT_SOF);
 		REBASE(OTG_GINTSTS) = OTG_GINTSTS_SOF;
 	}
 
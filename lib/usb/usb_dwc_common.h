@@ -22,6 +22,18 @@
 
 #include <libopencm3/cm3/common.h>
 
+/*
+ * Size of each DMA mode packet buffer, which has to hold the largest max
+ * packet size in use. DMA capable drivers provide USBD_DWC_DMA_BUFFER_SIZE
+ * bytes of these, one per OUT endpoint plus one for unaligned IN packets.
+ * It must stay a multiple of the 32 byte cache line, as the buffers are
+ * invalidated from the data cache on their own.
+ */
+#ifndef USBD_DWC_DMA_PACKET_SIZE
+#define USBD_DWC_DMA_PACKET_SIZE 512U
+#endif
+#define USBD_DWC_DMA_BUFFER_SIZE ((ENDPOINT_COUNT + 1U) * USBD_DWC_DMA_PACKET_SIZE)
+
 BEGIN_DECLS
 
 void dwc_set_address(usbd_device *usbd_dev, uint8_t addr);
@@ -33,6 +45,8 @@ uint8_t dwc_ep_stall_get(usbd_device *usbd_dev, uint8_t addr);
 void dwc_ep_nak_set(usbd_device *usbd_dev, uint8_t addr, uint8_t nak);
 uint16_t dwc_ep_write_packet(usbd_device *usbd_dev, uint8_t addr, const void *buf, uint16_t len);
 uint16_t dwc_ep_read_packet(usbd_device *usbd_dev, uint8_t addr, void *buf, uint16_t len);
+bool dwc_ep_transfer(
+	usbd_device *usbd_dev, uint8_t addr, void *buf, uint32_t len, uint8_t flags, usbd_transfer_callback callback);
 void dwc_poll(usbd_device *usbd_dev);
 void dwc_disconnect(usbd_device *usbd_dev, bool disconnected);
 void dwc_enable_sof(usbd_device *usbd_dev);
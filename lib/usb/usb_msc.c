@@ -27,6 +27,14 @@
 #include <libopencm3/usb/msc.h>
 #include "usb_private.h"
 
+/* Number of 512 byte sector buffers in the ring between USB and storage.
+ * Two are enough to overlap the USB transfer of one sector with the
+ * storage I/O of the next, more let the backend batch multi-block accesses.
+ */
+#ifndef USB_MSC_SECTOR_BUFFERS
+#define USB_MSC_SECTOR_BUFFERS			2
+#endif
+
 /* Definitions of Mass Storage Class from:
  *
  * (A) "Universal Serial Bus Mass Storage Class Bulk-Only Transport
@@ -159,9 +167,21 @@ struct usb_msc_trans {
 					   to bytes_to_write. */
 	uint32_t lba_start;
 	uint32_t block_count;
-	uint32_t current_block;
-
-	uint8_t msd_buf[512];
+	uint32_t current_block;		/* Blocks moved over USB */
+
+	/* Sector ring. For reads the backend produces and USB consumes, for
+	 * writes it is the other way round. Only one backend request is in
+	 * flight at a time, it always starts at the producer (read) or
+	 * consumer (write) slot. */
+	uint32_t io_block;		/* Blocks completed by the backend */
+	uint8_t io_count;		/* Blocks in flight, 0 if idle */
+	uint8_t ring_prod;
+	uint8_t ring_cons;
+	uint8_t ring_used;
+	bool usb_waiting;		/* IN data phase stalled on the ring */
+	bool nak;			/* OUT endpoint held off, ring is full */
+
+	uint8_t msd_buf[USB_MSC_SECTOR_BUFFERS * 512];
 
 	bool csw_valid;
 	uint8_t csw_sent;		/* Write until 13 bytes */
@@ -185,6 +205,9 @@ struct _usbd_mass_storage {
 
 	int (*read_block)(uint32_t lba, uint8_t *copy_to);
 	int (*write_block)(uint32_t lba, const uint8_t *copy_from);
+	int (*read_blocks)(uint32_t lba, uint8_t *copy_to, uint32_t count);
+	int (*write_blocks)(uint32_t lba, const uint8_t *copy_from,
+			    uint32_t count);
 
 	void (*lock)(void);
 	void (*unlock)(void);
@@ -368,6 +391,15 @@ static void scsi_format_unit(usbd_mass_storage *ms,
 	if (EVENT_CBW_VALID == event) {
 		uint32_t i;
 
+		if (NULL == ms->write_block) {
+			/* Multi-block backends can't be driven from here. */
+			set_sbc_status(ms, SBC_SENSE_KEY_ILLEGAL_REQUEST,
+				       SBC_ASC_INVALID_COMMAND_OPERATION_CODE,
+				       SBC_ASCQ_NA);
+			trans->csw.csw.bCSWStatus = CSW_STATUS_FAILED;
+			return;
+		}
+
 		memset(trans->msd_buf, 0, 512);
 
 		for (i = 0; i < ms->block_count; i++) {
@@ -539,8 +571,258 @@ static void scsi_command(usbd_mass_storage *ms,
 	}
 }
 
+/*-- Sector Pipeline ---------------------------------------------------------*/
+
+/* Legacy single block backends are run as synchronous multi-block ones. */
+static int msc_read_blocks(usbd_mass_storage *ms, uint32_t lba,
+			   uint8_t *copy_to, uint32_t count)
+{
+	int ret = 0;
+
+	if (NULL != ms->read_blocks) {
+		return (*ms->read_blocks)(lba, copy_to, count);
+	}
+
+	while (count--) {
+		if (0 != (*ms->read_block)(lba++, copy_to)) {
+			ret = -1;
+		}
+		copy_to += 512;
+	}
+
+	return ret;
+}
+
+static int msc_write_blocks(usbd_mass_storage *ms, uint32_t lba,
+			    const uint8_t *copy_from, uint32_t count)
+{
+	int ret = 0;
+
+	if (NULL != ms->write_blocks) {
+		return (*ms->write_blocks)(lba, copy_from, count);
+	}
+
+	while (count--) {
+		if (0 != (*ms->write_block)(lba++, copy_from)) {
+			ret = -1;
+		}
+		copy_from += 512;
+	}
+
+	return ret;
+}
+
+static bool msc_is_write(struct usb_msc_trans *trans)
+{
+	return 0 < trans->bytes_to_read;
+}
+
+static void msc_reset_trans(struct usb_msc_trans *trans)
+{
+	trans->lba_start = 0xffffffff;
+	trans->block_count = 0;
+	trans->current_block = 0;
+	trans->cbw_cnt = 0;
+	trans->bytes_to_read = 0;
+	trans->bytes_to_write = 0;
+	trans->byte_count = 0;
+	trans->csw_sent = 0;
+	trans->csw_valid = false;
+
+	trans->io_block = 0;
+	trans->io_count = 0;
+	trans->ring_prod = 0;
+	trans->ring_cons = 0;
+	trans->ring_used = 0;
+	trans->usb_waiting = false;
+	trans->nak = false;
+}
+
+/** @brief Account for a finished backend request. */
+static void msc_io_done(usbd_mass_storage *ms, int result)
+{
+	struct usb_msc_trans *trans = &ms->trans;
+
+	if (0 != result) {
+		trans->csw.csw.bCSWStatus = CSW_STATUS_FAILED;
+		if (msc_is_write(trans)) {
+			set_sbc_status(ms, SBC_SENSE_KEY_MEDIUM_ERROR,
+				       SBC_ASC_PERIPHERAL_DEVICE_WRITE_FAULT,
+				       SBC_ASCQ_NA);
+		} else {
+			set_sbc_status(ms, SBC_SENSE_KEY_MEDIUM_ERROR,
+				       SBC_ASC_UNRECOVERED_READ_ERROR,
+				       SBC_ASCQ_NA);
+		}
+	}
+
+	trans->io_block += trans->io_count;
+	if (msc_is_write(trans)) {
+		trans->ring_cons = (trans->ring_cons + trans->io_count) %
+				   USB_MSC_SECTOR_BUFFERS;
+		trans->ring_used -= trans->io_count;
+	} else {
+		trans->ring_prod = (trans->ring_prod + trans->io_count) %
+				   USB_MSC_SECTOR_BUFFERS;
+		trans->ring_used += trans->io_count;
+	}
+	trans->io_count = 0;
+}
+
+/** @brief Hand the next contiguous run of sectors to the backend.
+ *
+ * Loops for as long as the backend completes synchronously, returns as soon
+ * as a request is pending or the ring has nothing more to offer.
+ */
+static void msc_io_kick(usbd_mass_storage *ms)
+{
+	struct usb_msc_trans *trans = &ms->trans;
+
+	while ((0 == trans->io_count) &&
+	       (trans->io_block < trans->block_count)) {
+		uint32_t lba, count;
+		uint8_t *p;
+		uint8_t slot;
+		int ret;
+
+		if (msc_is_write(trans)) {
+			slot = trans->ring_cons;
+			count = trans->ring_used;
+		} else {
+			slot = trans->ring_prod;
+			count = USB_MSC_SECTOR_BUFFERS - trans->ring_used;
+		}
+		count = MIN(count, (uint32_t)(USB_MSC_SECTOR_BUFFERS - slot));
+		count = MIN(count, trans->block_count - trans->io_block);
+		if (0 == count) {
+			return;
+		}
+
+		lba = trans->lba_start + trans->io_block;
+		p = &trans->msd_buf[slot << 9];
+		trans->io_count = count;
+		if (msc_is_write(trans)) {
+			ret = msc_write_blocks(ms, lba, p, count);
+		} else {
+			ret = msc_read_blocks(ms, lba, p, count);
+		}
+
+		if (USB_MSC_IO_PENDING == ret) {
+			return;
+		}
+		msc_io_done(ms, ret);
+	}
+}
+
 /*-- USB Mass Storage Layer --------------------------------------------------*/
 
+static void msc_send_csw(usbd_mass_storage *ms)
+{
+	struct usb_msc_trans *trans = &ms->trans;
+	int len, max_len, left;
+
+	if (false == trans->csw_valid) {
+		scsi_command(ms, trans, EVENT_NEED_STATUS);
+		trans->csw_valid = true;
+	}
+
+	left = sizeof(struct usb_msc_csw) - trans->csw_sent;
+	if (0 < left) {
+		max_len = MIN(ms->ep_in_size, left);
+		len = usbd_ep_write_packet(ms->usbd_dev, ms->ep_in,
+					   &trans->csw.buf[trans->csw_sent],
+					   max_len);
+		trans->csw_sent += len;
+	}
+}
+
+/** @brief Queue the next packet of an IN data phase. */
+static void msc_send_data(usbd_mass_storage *ms)
+{
+	struct usb_msc_trans *trans = &ms->trans;
+	uint32_t offset;
+	int len, max_len;
+
+	offset = 0x1ff & trans->byte_count;
+	if (0 < trans->block_count) {
+		if (0 == trans->ring_used) {
+			/* Resumed by usb_msc_io_complete() */
+			trans->usb_waiting = true;
+			return;
+		}
+		offset |= trans->ring_cons << 9;
+	}
+	trans->usb_waiting = false;
+
+	max_len = MIN(ms->ep_in_size,
+		      trans->bytes_to_write - trans->byte_count);
+	len = usbd_ep_write_packet(ms->usbd_dev, ms->ep_in,
+				   &trans->msd_buf[offset], max_len);
+	trans->byte_count += len;
+
+	if ((0 < trans->block_count) && (0 < len) &&
+	    (0 == (0x1ff & trans->byte_count))) {
+		/* The sector is in the endpoint buffer, recycle its slot. */
+		trans->ring_cons = (trans->ring_cons + 1) %
+				   USB_MSC_SECTOR_BUFFERS;
+		trans->ring_used--;
+		trans->current_block++;
+		msc_io_kick(ms);
+	}
+}
+
+/** @brief Release the OUT endpoint and finish the command once the
+ *	   backend has caught up with the host.
+ */
+static void msc_write_progress(usbd_mass_storage *ms)
+{
+	struct usb_msc_trans *trans = &ms->trans;
+
+	if (trans->nak && (USB_MSC_SECTOR_BUFFERS > trans->ring_used)) {
+		trans->nak = false;
+		usbd_ep_nak_set(ms->usbd_dev, ms->ep_out, 0);
+	}
+
+	if (trans->io_block == trans->block_count) {
+		msc_send_csw(ms);
+	}
+}
+
+/** @brief Receive the next packet of an OUT data phase. */
+static void msc_recv_data(usbd_mass_storage *ms, uint8_t ep)
+{
+	struct usb_msc_trans *trans = &ms->trans;
+	uint32_t offset, left;
+	int len, max_len;
+
+	offset = 0x1ff & trans->byte_count;
+	left = trans->bytes_to_read - trans->byte_count;
+	max_len = MIN(ms->ep_out_size, left);
+
+	/* If this packet may complete the last free slot, NAK the host
+	 * before re-arming the endpoint, there would be nowhere to put the
+	 * next one. */
+	if ((USB_MSC_SECTOR_BUFFERS - 1 == trans->ring_used) &&
+	    (512 <= offset + max_len) && ((uint32_t)max_len < left)) {
+		trans->nak = true;
+		usbd_ep_nak_set(ms->usbd_dev, ep, 1);
+	}
+
+	offset |= trans->ring_prod << 9;
+	len = usbd_ep_read_packet(ms->usbd_dev, ep, &trans->msd_buf[offset],
+				  max_len);
+	trans->byte_count += len;
+
+	if ((0 < len) && (0 == (0x1ff & trans->byte_count))) {
+		trans->ring_prod = (trans->ring_prod + 1) %
+				   USB_MSC_SECTOR_BUFFERS;
+		trans->ring_used++;
+		trans->current_block++;
+		msc_io_kick(ms);
+		msc_write_progress(ms);
+	}
+}
+
 /** @brief Handle the USB 'OUT' requests. */
 static void msc_data_rx_cb(usbd_device *usbd_dev, uint8_t ep)
 {
@@ -560,109 +842,33 @@ static void msc_data_rx_cb(usbd_device *usbd_dev, uint8_t ep)
 		len = usbd_ep_read_packet(usbd_dev, ep, p, max_len);
 		trans->cbw_cnt += len;
 
-		if (sizeof(struct usb_msc_cbw) == trans->cbw_cnt) {
-			scsi_command(ms, trans, EVENT_CBW_VALID);
-			if (trans->byte_count < trans->bytes_to_read) {
-				/* We must wait until there is something to
-				 * read again. */
-				return;
-			}
+		if (sizeof(struct usb_msc_cbw) != trans->cbw_cnt) {
+			return;
 		}
-	}
 
-	if (trans->byte_count < trans->bytes_to_read) {
-		if (0 < trans->block_count) {
-			if ((0 == trans->byte_count) && (NULL != ms->lock)) {
-				(*ms->lock)();
-			}
+		scsi_command(ms, trans, EVENT_CBW_VALID);
+		if ((0 < trans->block_count) && (NULL != ms->lock)) {
+			(*ms->lock)();
 		}
 
-		left = trans->bytes_to_read - trans->byte_count;
-		max_len = MIN(ms->ep_out_size, left);
-		p = &trans->msd_buf[0x1ff & trans->byte_count];
-		len = usbd_ep_read_packet(usbd_dev, ep, p, max_len);
-		trans->byte_count += len;
-
-		if (0 < trans->block_count) {
-			if (0 == (0x1ff & trans->byte_count)) {
-				uint32_t lba;
-
-				lba = trans->lba_start + trans->current_block;
-				if (0 != (*ms->write_block)(lba,
-							    trans->msd_buf)) {
-					/* Error */
-				}
-				trans->current_block++;
-			}
+		if (trans->byte_count < trans->bytes_to_read) {
+			/* We must wait until there is something to
+			 * read again. */
+			return;
 		}
 
-		/* Fix "writes aren't acknowledged" bug on Linux (PR #409) */
-		if (false == trans->csw_valid) {
-			scsi_command(ms, trans, EVENT_NEED_STATUS);
-			trans->csw_valid = true;
-		}
-		left = sizeof(struct usb_msc_csw) - trans->csw_sent;
-		if (0 < left) {
-			max_len = MIN(ms->ep_out_size, left);
-			p = &trans->csw.buf[trans->csw_sent];
-			len = usbd_ep_write_packet(usbd_dev, ms->ep_in, p,
-						   max_len);
-			trans->csw_sent += len;
-		}
-
-	} else if (trans->byte_count < trans->bytes_to_write) {
-		if (0 < trans->block_count) {
-			if ((0 == trans->byte_count) && (NULL != ms->lock)) {
-				(*ms->lock)();
-			}
-
-			if (0 == (0x1ff & trans->byte_count)) {
-				uint32_t lba;
-
-				lba = trans->lba_start + trans->current_block;
-				if (0 != (*ms->read_block)(lba,
-							   trans->msd_buf)) {
-					/* Error */
-				}
-				trans->current_block++;
-			}
-		}
-
-		left = trans->bytes_to_write - trans->byte_count;
-		max_len = MIN(ms->ep_out_size, left);
-		p = &trans->msd_buf[0x1ff & trans->byte_count];
-		len = usbd_ep_write_packet(usbd_dev, ms->ep_in, p, max_len);
-		trans->byte_count += len;
-	} else {
-		if (0 < trans->block_count) {
-			if (trans->current_block == trans->block_count) {
-				uint32_t lba;
-
-				lba = trans->lba_start + trans->current_block;
-				if (0 != (*ms->write_block)(lba,
-							    trans->msd_buf)) {
-					/* Error */
-				}
-
-				trans->current_block = 0;
-				if (NULL != ms->unlock) {
-					(*ms->unlock)();
-				}
-			}
-		}
-		if (false == trans->csw_valid) {
-			scsi_command(ms, trans, EVENT_NEED_STATUS);
-			trans->csw_valid = true;
+		if (trans->byte_count < trans->bytes_to_write) {
+			/* Prefetch, then start the IN data phase. */
+			msc_io_kick(ms);
+			msc_send_data(ms);
+		} else {
+			msc_send_csw(ms);
 		}
+		return;
+	}
 
-		left = sizeof(struct usb_msc_csw) - trans->csw_sent;
-		if (0 < left) {
-			max_len = MIN(ms->ep_out_size, left);
-			p = &trans->csw.buf[trans->csw_sent];
-			len = usbd_ep_write_packet(usbd_dev, ms->ep_in, p,
-						   max_len);
-			trans->csw_sent += len;
-		}
+	if (trans->byte_count < trans->bytes_to_read) {
+		msc_recv_data(ms, ep);
 	}
 }
 
@@ -671,63 +877,23 @@ static void msc_data_tx_cb(usbd_device *usbd_dev, uint8_t ep)
 {
 	usbd_mass_storage *ms;
 	struct usb_msc_trans *trans;
-	int len, max_len, left;
-	void *p;
+
+	(void)usbd_dev;
+	(void)ep;
 
 	ms = &_mass_storage;
 	trans = &ms->trans;
 
 	if (trans->byte_count < trans->bytes_to_write) {
-		if (0 < trans->block_count) {
-			if (0 == (0x1ff & trans->byte_count)) {
-				uint32_t lba;
-
-				lba = trans->lba_start + trans->current_block;
-				if (0 != (*ms->read_block)(lba,
-							   trans->msd_buf)) {
-					/* Error */
-				}
-				trans->current_block++;
-			}
-		}
-
-		left = trans->bytes_to_write - trans->byte_count;
-		max_len = MIN(ms->ep_out_size, left);
-		p = &trans->msd_buf[0x1ff & trans->byte_count];
-		len = usbd_ep_write_packet(usbd_dev, ep, p, max_len);
-		trans->byte_count += len;
+		msc_send_data(ms);
+	} else if (sizeof(struct usb_msc_csw) > trans->csw_sent) {
+		msc_send_csw(ms);
 	} else {
-		if (0 < trans->block_count) {
-			if (trans->current_block == trans->block_count) {
-				trans->current_block = 0;
-				if (NULL != ms->unlock) {
-					(*ms->unlock)();
-				}
-			}
-		}
-		if (false == trans->csw_valid) {
-			scsi_command(ms, trans, EVENT_NEED_STATUS);
-			trans->csw_valid = true;
-		}
-
-		left = sizeof(struct usb_msc_csw) - trans->csw_sent;
-		if (0 < left) {
-			max_len = MIN(ms->ep_out_size, left);
-			p = &trans->csw.buf[trans->csw_sent];
-			len = usbd_ep_write_packet(usbd_dev, ep, p, max_len);
-			trans->csw_sent += len;
-		} else if (sizeof(struct usb_msc_csw) == trans->csw_sent) {
-			/* End of transaction */
-			trans->lba_start = 0xffffffff;
-			trans->block_count = 0;
-			trans->current_block = 0;
-			trans->cbw_cnt = 0;
-			trans->bytes_to_read = 0;
-			trans->bytes_to_write = 0;
-			trans->byte_count = 0;
-			trans->csw_sent = 0;
-			trans->csw_valid = false;
+		/* End of transaction */
+		if ((0 < trans->block_count) && (NULL != ms->unlock)) {
+			(*ms->unlock)();
 		}
+		msc_reset_trans(trans);
 	}
 }
 
@@ -822,18 +988,12 @@ usbd_mass_storage *usb_msc_init(usbd_device *usbd_dev,
 	_mass_storage.block_count = block_count - 1;
 	_mass_storage.read_block = read_block;
 	_mass_storage.write_block = write_block;
+	_mass_storage.read_blocks = NULL;
+	_mass_storage.write_blocks = NULL;
 	_mass_storage.lock = NULL;
 	_mass_storage.unlock = NULL;
 
-	_mass_storage.trans.lba_start = 0xffffffff;
-	_mass_storage.trans.block_count = 0;
-	_mass_storage.trans.current_block = 0;
-	_mass_storage.trans.cbw_cnt = 0;
-	_mass_storage.trans.bytes_to_read = 0;
-	_mass_storage.trans.bytes_to_write = 0;
-	_mass_storage.trans.byte_count = 0;
-	_mass_storage.trans.csw_valid = false;
-	_mass_storage.trans.csw_sent = 0;
+	msc_reset_trans(&_mass_storage.trans);
 
 	set_sbc_status_good(&_mass_storage);
 
@@ -842,4 +1002,88 @@ usbd_mass_storage *usb_msc_init(usbd_device *usbd_dev,
 	return &_mass_storage;
 }
 
+/** @brief Initializes the USB Mass Storage subsystem with a multi-block
+	   backend.
+
+Like @ref usb_msc_init, but the storage is accessed in runs of up to
+USB_MSC_SECTOR_BUFFERS contiguous 512-byte blocks, and each access may
+complete asynchronously. While the backend works on one run, the host keeps
+transferring the sectors already in the ring.
+
+A backend function returns 0 on success, @ref USB_MSC_IO_PENDING if the
+request has been started and will be finished by a call to
+@ref usb_msc_io_complete, or any other value on failure. Only one request is
+ever outstanding.
+
+@note SCSI FORMAT UNIT is not supported with this backend.
+
+@param[in] usbd_dev The USB device to associate the Mass Storage with.
+@param[in] ep_in The USB 'IN' endpoint.
+@param[in] ep_in_size The maximum endpoint size.  Valid values: 8, 16, 32 or 64
+@param[in] ep_out The USB 'OUT' endpoint.
+@param[in] ep_out_size The maximum endpoint size.  Valid values: 8, 16, 32 or 64
+@param[in] vendor_id The SCSI vendor ID to return.  Maximum used length is 8.
+@param[in] product_id The SCSI product ID to return.  Maximum used length is 16.
+@param[in] product_revision_level The SCSI product revision level to return.
+		Maximum used length is 4.
+@param[in] block_count The number of 512-byte blocks available.
+@param[in] read_blocks The function called to read @p count blocks starting at
+		@p lba.  Must _NOT_ be NULL.
+@param[in] write_blocks The function called to write @p count blocks starting
+		at @p lba.  Must _NOT_ be NULL.
+
+@return Pointer to the usbd_mass_storage struct.
+*/
+usbd_mass_storage *usb_msc_init_async(usbd_device *usbd_dev,
+				       uint8_t ep_in, uint8_t ep_in_size,
+				       uint8_t ep_out, uint8_t ep_out_size,
+				       const char *vendor_id,
+				       const char *product_id,
+				       const char *product_revision_level,
+				       const uint32_t block_count,
+				       int (*read_blocks)(uint32_t lba,
+							  uint8_t *copy_to,
+							  uint32_t count),
+				       int (*write_blocks)(uint32_t lba,
+						const uint8_t *copy_from,
+						uint32_t count))
+{
+	usb_msc_init(usbd_dev, ep_in, ep_in_size, ep_out, ep_out_size,
+		     vendor_id, product_id, product_revision_level,
+		     block_count, NULL, NULL);
+	_mass_storage.read_blocks = read_blocks;
+	_mass_storage.write_blocks = write_blocks;
+
+	return &_mass_storage;
+}
+
+/** @brief Complete an asynchronous block request.
+
+Called by the backend once a request for which it returned
+@ref USB_MSC_IO_PENDING has finished. This continues the USB side of the
+transfer and issues the next request, so it must not preempt usbd_poll():
+call it from the main loop or from an interrupt of the same priority as the
+USB interrupt.
+
+@param[in] ms The mass storage instance returned by @ref usb_msc_init_async.
+@param[in] result 0 on success, non-zero on failure.
+*/
+void usb_msc_io_complete(usbd_mass_storage *ms, int result)
+{
+	struct usb_msc_trans *trans = &ms->trans;
+
+	if (0 == trans->io_count) {
+		return;
+	}
+
+	msc_io_done(ms, result);
+	msc_io_kick(ms);
+
+	if (msc_is_write(trans)) {
+		msc_write_progress(ms);
+	} else if (trans->usb_waiting) {
+		msc_send_data(ms);
+	}
+}
+
 /** @} */
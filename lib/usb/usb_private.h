@@ -55,6 +55,21 @@ LGPL License Terms @ref lgpl_license
 #define ENDPOINT_COUNT 4U
 #endif
 
+/** A multi-packet transfer queued with usbd_ep_transfer() */
+struct usbd_transfer {
+	uint8_t *buf;
+	uint32_t len;
+	uint32_t done; /**< Bytes moved so far, when done in software */
+	usbd_transfer_callback callback;
+	usbd_endpoint_callback ep_callback; /**< Endpoint callback to put back after */
+	uint16_t max_size;
+	uint16_t in_flight; /**< Size of the IN packet being sent */
+	bool retry; /**< IN packet refused, written again on the next completion */
+	uint8_t flags;
+	bool active; /**< Handed to the hardware, rather than waiting to be */
+	bool software; /**< Being split into packets by usb.c */
+};
+
 /** Internal collection of device information. */
 struct _usbd_device {
 	const struct usb_device_descriptor *desc;
@@ -77,6 +92,11 @@ struct _usbd_device {
 	void (*user_callback_resume)(void);
 	void (*user_callback_sof)(void);
 
+	/* Event statistics, see usbd_get_stats() */
+	uint32_t (*timestamp)(void);
+	uint32_t poll_start;
+	struct usbd_stats stats;
+
 	struct usb_control_state {
 		enum {
 			IDLE,
@@ -106,6 +126,8 @@ struct _usbd_device {
 	} user_control_callback[MAX_USER_CONTROL_CALLBACK];
 
 	usbd_endpoint_callback user_callback_ctr[8][3];
+	/* Transfers in progress, indexed by USB_TRANSACTION_IN / _OUT */
+	struct usbd_transfer transfer[8][2];
 
 	/* User callback function for some standard USB function hooks */
 	usbd_set_config_callback user_callback_set_config[MAX_USER_SET_CONFIG_CALLBACK];
@@ -134,6 +156,12 @@ struct _usbd_device {
 	 * for use in stm32f107_ep_read_packet().
 	 */
 	uint16_t rxbcnt;
+	/*
+	 * DMA mode packet buffers, one per OUT endpoint and one shared by the IN
+	 * endpoints, and where the packet being read sits in them.
+	 */
+	uint8_t *dma_buf;
+	const uint8_t *dma_rx_data;
 };
 
 enum _usbd_transaction {
@@ -159,12 +187,15 @@ enum usbd_request_return_codes _usbd_standard_request(
 	usbd_device *usbd_dev, struct usb_setup_data *req, uint8_t **buf, uint16_t *len);
 
 void _usbd_reset(usbd_device *usbd_dev);
+void _usbd_ep_event(usbd_device *usbd_dev, uint8_t ep, enum _usbd_transaction type);
+void _usbd_bus_event(usbd_device *usbd_dev, enum usbd_event event);
 
 /* Functions provided by the hardware abstraction. */
 struct _usbd_driver {
 	usbd_device *(*init)(void);
 	void (*set_address)(usbd_device *usbd_dev, uint8_t addr);
 	void (*ep_setup)(usbd_device *usbd_dev, uint8_t addr, uint8_t type, uint16_t max_size, usbd_endpoint_callback cb);
+	void (*ep_setup_double_buffered)(usbd_device *usbd_dev, uint8_t addr, uint8_t type, uint16_t max_size, usbd_endpoint_callback cb);
 	void (*ep_reset)(usbd_device *usbd_dev);
 	void (*ep_stall_set)(usbd_device *usbd_dev, uint8_t addr, uint8_t stall);
 	void (*ep_nak_set)(usbd_device *usbd_dev, uint8_t addr, uint8_t nak);
@@ -174,8 +205,11 @@ struct _usbd_driver {
 	void (*poll)(usbd_device *usbd_dev);
 	void (*disconnect)(usbd_device *usbd_dev, bool disconnected);
 	void (*enable_sof)(usbd_device *usbd_dev);
+	bool (*ep_transfer)(usbd_device *usbd_dev, uint8_t addr, void *buf, uint32_t len, uint8_t flags,
+		usbd_transfer_callback cb);
 	uint32_t base_address;
 	bool set_address_before_status;
+	bool dma;
 	uint16_t rx_fifo_size;
 };
 
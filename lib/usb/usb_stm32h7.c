@@ -31,6 +31,7 @@
 #define RX_FIFO_SIZE 512U
 
 static usbd_device *stm32h7_usbd_init(void);
+static usbd_device *stm32h7_usbd_init_dma(void);
 
 static struct _usbd_device usbd_dev;
 
@@ -51,8 +52,31 @@ const struct _usbd_driver stm32h7_usb_driver = {
 	.rx_fifo_size = RX_FIFO_SIZE,
 };
 
-/** Initialize the USB device controller hardware of the STM32. */
-static usbd_device *stm32h7_usbd_init(void)
+/*
+ * The same core with its internal DMA enabled, so the core moves packets
+ * between the FIFOs and memory, and whole transfers can be queued.
+ * Buffers must not be in DTCM, and must be kept coherent with the D-cache.
+ */
+const struct _usbd_driver stm32h7_usb_dma_driver = {
+	.init = stm32h7_usbd_init_dma,
+	.set_address = dwc_set_address,
+	.ep_setup = dwc_ep_setup,
+	.ep_reset = dwc_endpoints_reset,
+	.ep_stall_set = dwc_ep_stall_set,
+	.ep_stall_get = dwc_ep_stall_get,
+	.ep_nak_set = dwc_ep_nak_set,
+	.ep_write_packet = dwc_ep_write_packet,
+	.ep_read_packet = dwc_ep_read_packet,
+	.ep_transfer = dwc_ep_transfer,
+	.poll = dwc_poll,
+	.disconnect = dwc_disconnect,
+	.base_address = USB_OTG_HS_BASE,
+	.set_address_before_status = true,
+	.rx_fifo_size = RX_FIFO_SIZE,
+	.dma = true,
+};
+
+static void stm32h7_usbd_setup(void)
 {
 	rcc_periph_clock_enable(RCC_OTGHS);
 	OTG_HS_GINTSTS = OTG_GINTSTS_MMIS;
@@ -85,13 +109,41 @@ static usbd_device *stm32h7_usbd_init(void)
 	OTG_HS_GRXFSIZ = stm32h7_usb_driver.rx_fifo_size;
 	usbd_dev.fifo_mem_top = stm32h7_usb_driver.rx_fifo_size;
 
+	OTG_HS_DAINTMSK = 0x00ff00ffU;
+	OTG_HS_DIEPMSK = OTG_DIEPMSK_XFRCM;
+	OTG_HS_DOEPMSK = OTG_DOEPMSK_STUPM | OTG_DOEPMSK_XFRCM;
+}
+
+/** Initialize the USB device controller hardware of the STM32. */
+static usbd_device *stm32h7_usbd_init(void)
+{
+	stm32h7_usbd_setup();
+
 	/* Unmask interrupts for TX and RX. */
 	OTG_HS_GAHBCFG |= OTG_GAHBCFG_GINT;
 	OTG_HS_GINTMSK = OTG_GINTMSK_ENUMDNEM | OTG_GINTMSK_RXFLVLM | OTG_GINTMSK_IEPINT | OTG_GINTMSK_USBSUSPM |
 		OTG_GINTMSK_WUIM | OTG_GINTMSK_SOFM;
-	OTG_HS_DAINTMSK = 0x00ff00ffU;
-	OTG_HS_DIEPMSK = OTG_DIEPMSK_XFRCM;
-	OTG_HS_DOEPMSK = OTG_DOEPMSK_STUPM | OTG_DOEPMSK_XFRCM;
+
+	return &usbd_dev;
+}
+
+/**
+ * Initialize the USB device controller hardware of the STM32, with the core's DMA in use.
+ *
+ * The packet buffers are kept coherent with the data cache by the driver, and are aligned to cache lines so
+ * that this never touches neighbouring data.
+ */
+static usbd_device *stm32h7_usbd_init_dma(void)
+{
+	static uint32_t dma_buf[USBD_DWC_DMA_BUFFER_SIZE / 4U] __attribute__((aligned(32)));
+
+	stm32h7_usbd_setup();
+	usbd_dev.dma_buf = (uint8_t *)dma_buf;
+
+	/* Enable DMA, reception then shows up as OUT endpoint interrupts rather than RXFLVL */
+	OTG_HS_GAHBCFG |= OTG_GAHBCFG_GINT | OTG_GAHBCFG_DMAEN | OTG_GAHBCFG_HBSTLEN_INCR4;
+	OTG_HS_GINTMSK = OTG_GINTMSK_ENUMDNEM | OTG_GINTMSK_OEPINT | OTG_GINTMSK_IEPINT | OTG_GINTMSK_USBSUSPM |
+		OTG_GINTMSK_WUIM | OTG_GINTMSK_SOFM;
 
 	return &usbd_dev;
 }
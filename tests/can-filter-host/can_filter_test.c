@@ -0,0 +1,333 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host tests for can_filter_plan() and can_filter_apply() in
+ * lib/stm32/can_filter.c. The banks can_filter_apply() programs are recorded
+ * and matched against identifiers the way the bxCAN filters would, so every
+ * plan is checked to accept all identifiers asked for, and no more than the
+ * report owns up to.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "../../lib/stm32/can_filter.c"
+#include "check.h"
+
+#define MAX_BANKS	28
+
+/* --- Recorded filter banks ----------------------------------------------- */
+
+static struct {
+	bool scale_32bit;
+	bool id_list_mode;
+	uint32_t fr1, fr2;
+} bank[MAX_BANKS];
+static uint32_t banks_written;
+
+void can_filter_init(uint32_t nr, bool scale_32bit, bool id_list_mode,
+		     uint32_t fr1, uint32_t fr2, uint32_t fifo, bool enable)
+{
+	(void)fifo;
+	(void)enable;
+	if (nr >= MAX_BANKS) {
+		CHECK(nr < MAX_BANKS);
+		return;
+	}
+	bank[nr].scale_32bit = scale_32bit;
+	bank[nr].id_list_mode = id_list_mode;
+	bank[nr].fr1 = fr1;
+	bank[nr].fr2 = fr2;
+	banks_written++;
+}
+
+void can_filter_id_list_16bit_init(uint32_t nr, uint16_t id1, uint16_t id2,
+				   uint16_t id3, uint16_t id4, uint32_t fifo,
+				   bool enable)
+{
+	can_filter_init(nr, false, true, ((uint32_t)id2 << 16) | id1,
+			((uint32_t)id4 << 16) | id3, fifo, enable);
+}
+
+static bool match16(uint16_t v, uint32_t fr, bool list)
+{
+	uint16_t lo = fr & 0xFFFF, hi = fr >> 16;
+
+	if (list) {
+		return (v == lo) || (v == hi);
+	}
+	return (v & hi) == (lo & hi);
+}
+
+/* true if a data frame with this identifier passes one of the banks */
+static bool accepted(uint32_t id, bool ext)
+{
+	/* Register images of the frame identifier at both scales */
+	uint32_t v32 = ext ? (id << 3) | CAN_FILTER32_IDE : id << 21;
+	uint16_t v16 = ext ? (((id >> 18) << 5) | CAN_FILTER16_IDE |
+			      ((id >> 15) & 7)) : id << 5;
+
+	for (uint32_t nr = 0; nr < banks_written; nr++) {
+		bool list = bank[nr].id_list_mode;
+
+		if (bank[nr].scale_32bit) {
+			if (list ? ((v32 == bank[nr].fr1) ||
+				    (v32 == bank[nr].fr2)) :
+			    ((v32 & bank[nr].fr2) ==
+			     (bank[nr].fr1 & bank[nr].fr2))) {
+				return true;
+			}
+		} else if (match16(v16, bank[nr].fr1, list) ||
+			   match16(v16, bank[nr].fr2, list)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool requested(const struct can_filter_id *ids, uint32_t count,
+		      uint32_t id, bool ext)
+{
+	for (uint32_t i = 0; i < count; i++) {
+		if ((ids[i].ext == ext) && (ids[i].first <= id) &&
+		    (id <= ids[i].last)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* --- Plan, program and verify -------------------------------------------- */
+
+#define MAX_BLOCKS	64
+
+static struct can_filter_mask blocks[MAX_BLOCKS];
+static struct can_filter_report report;
+
+/*
+ * Plans ids into at most banks filter banks and programs them. All standard
+ * identifiers and the extended ones from ext_lo to ext_hi are then checked
+ * against the programmed banks, returns the number accepted in excess.
+ */
+static uint32_t plan(const struct can_filter_id *ids, uint32_t count,
+		     uint32_t max_blocks, uint32_t banks,
+		     uint32_t ext_lo, uint32_t ext_hi, int *n)
+{
+	uint32_t extra = 0;
+
+	memset(bank, 0, sizeof(bank));
+	banks_written = 0;
+
+	*n = can_filter_plan(ids, count, blocks, max_blocks, banks, &report);
+	if (*n < 0) {
+		return 0;
+	}
+
+	CHECK(can_filter_apply(0, blocks, *n, 0) == report.rules);
+	CHECK(banks_written == report.rules);
+	CHECK(report.rules <= banks);
+
+	for (uint32_t id = 0; id <= CAN_FILTER_STD_ID_MAX; id++) {
+		bool want = requested(ids, count, id, false);
+
+		CHECK(!want || accepted(id, false));
+		extra += !want && accepted(id, false);
+	}
+	for (uint32_t id = ext_lo; id <= ext_hi; id++) {
+		bool want = requested(ids, count, id, true);
+
+		CHECK(!want || accepted(id, true));
+		extra += !want && accepted(id, true);
+	}
+
+	CHECK(extra <= report.extra_ids);
+	CHECK((report.widened != 0) == (report.extra_ids != 0));
+	return extra;
+}
+
+static bool has_block(int n, uint32_t id, uint32_t mask, bool ext)
+{
+	for (int i = 0; i < n; i++) {
+		if ((blocks[i].id == id) && (blocks[i].mask == mask) &&
+		    (blocks[i].ext == ext)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* --- Tests --------------------------------------------------------------- */
+
+static void test_range_split(void)
+{
+	const struct can_filter_id odd[] = { { 0x101, 0x10E, false } };
+	const struct can_filter_id all[] = {
+		{ 0, CAN_FILTER_STD_ID_MAX, false },
+		{ 0, CAN_FILTER_EXT_ID_MAX, true },
+	};
+	int n;
+
+	/* 0x101, 0x102-3, 0x104-7, 0x108-B, 0x10C-D, 0x10E */
+	CHECK(plan(odd, 1, MAX_BLOCKS, MAX_BANKS, 0, 0, &n) == 0);
+	CHECK(n == 6);
+	CHECK(has_block(n, 0x101, 0x7FF, false));
+	CHECK(has_block(n, 0x102, 0x7FE, false));
+	CHECK(has_block(n, 0x104, 0x7FC, false));
+	CHECK(has_block(n, 0x108, 0x7FC, false));
+	CHECK(has_block(n, 0x10C, 0x7FE, false));
+	CHECK(has_block(n, 0x10E, 0x7FF, false));
+	CHECK(report.widened == 0);
+	/* Two singles share a list bank, four blocks two mask banks, or one
+	 * single takes the spare slot of a third mask bank: 3 either way */
+	CHECK(report.rules == 3);
+
+	CHECK(plan(all, 2, MAX_BLOCKS, MAX_BANKS, 0, 0x1000, &n) == 0);
+	CHECK(n == 2);
+	CHECK(has_block(n, 0, 0, false));
+	CHECK(has_block(n, 0, 0, true));
+	CHECK(report.rules == 2);
+}
+
+static void test_bank_packing(void)
+{
+	const struct can_filter_id four[] = {
+		{ 0x001, 0x001, false }, { 0x100, 0x100, false },
+		{ 0x3FF, 0x3FF, false }, { 0x7FF, 0x7FF, false },
+	};
+	const struct can_filter_id spare[] = {
+		{ 0x200, 0x20F, false }, { 0x555, 0x555, false },
+	};
+	const struct can_filter_id ext[] = {
+		{ 0x1234567, 0x1234567, true }, { 0x1234569, 0x1234569, true },
+		{ 0x1234600, 0x12346FF, true },
+	};
+	int n;
+
+	/* Four standard identifiers fill one 16 bit list bank */
+	CHECK(plan(four, 4, MAX_BLOCKS, MAX_BANKS, 0, 0, &n) == 0);
+	CHECK(n == 4 && report.rules == 1 && report.widened == 0);
+	CHECK(!bank[0].scale_32bit && bank[0].id_list_mode);
+
+	/* A single identifier takes the spare slot of a mask bank */
+	CHECK(plan(spare, 2, MAX_BLOCKS, MAX_BANKS, 0, 0, &n) == 0);
+	CHECK(n == 2 && report.rules == 1);
+	CHECK(!bank[0].scale_32bit && !bank[0].id_list_mode);
+
+	/* Extended: two identifiers to a list bank, a block to a mask bank */
+	CHECK(plan(ext, 3, MAX_BLOCKS, MAX_BANKS, 0x1234000, 0x1235000,
+		   &n) == 0);
+	CHECK(n == 3 && report.rules == 2);
+	CHECK(bank[0].scale_32bit && bank[0].id_list_mode);
+	CHECK(bank[1].scale_32bit && !bank[1].id_list_mode);
+}
+
+static void test_merge(void)
+{
+	const struct can_filter_id pairs[] = {
+		{ 0x10, 0x10, false }, { 0x11, 0x11, false },
+		{ 0x12, 0x12, false }, { 0x13, 0x13, false },
+		{ 0x40, 0x40, false },
+	};
+	const struct can_filter_id spread[] = {
+		{ 0x100, 0x100, false }, { 0x101, 0x101, false },
+		{ 0x200, 0x200, false }, { 0x201, 0x201, false },
+		{ 0x300, 0x300, false }, { 0x301, 0x301, false },
+		{ 0x400, 0x400, false }, { 0x401, 0x401, false },
+	};
+	int n;
+
+	/* Singles merge into an exact block, which shares its mask bank with
+	 * the last single */
+	CHECK(plan(pairs, 5, MAX_BLOCKS, 1, 0, 0, &n) == 0);
+	CHECK(n == 2 && report.rules == 1 && report.widened == 0);
+	CHECK(has_block(n, 0x10, 0x7FC, false));
+	CHECK(has_block(n, 0x40, 0x7FF, false));
+
+	/* Two list banks hold them as they are, one bank has to widen */
+	CHECK(plan(spread, 8, MAX_BLOCKS, 2, 0, 0, &n) == 0);
+	CHECK(n == 8 && report.rules == 2 && report.widened == 0);
+	CHECK(plan(spread, 8, MAX_BLOCKS, 1, 0, 0, &n) > 0);
+	CHECK(n > 0 && report.rules == 1 && report.widened > 0);
+}
+
+static void test_widening_report(void)
+{
+	const struct can_filter_id ext[] = {
+		{ 0x1000, 0x1000, true }, { 0x1002, 0x1002, true },
+		{ 0x1004, 0x1004, true },
+	};
+	int n;
+
+	/* 0x1000 and 0x1002 merge exactly, adding 0x1004 lets 0x1006 in */
+	CHECK(plan(ext, 3, MAX_BLOCKS, 1, 0x0F00, 0x1100, &n) == 1);
+	CHECK(n == 1);
+	CHECK(has_block(n, 0x1000, CAN_FILTER_EXT_ID_MAX & ~6, true));
+	CHECK(report.rules == 1);
+	CHECK(report.widened == 1 && report.extra_ids == 1);
+}
+
+/* A work area smaller than the split ranges forces merging early */
+static void test_small_work_area(void)
+{
+	const struct can_filter_id odd[] = { { 0x101, 0x10E, false } };
+	int n;
+
+	CHECK(plan(odd, 1, 2, MAX_BANKS, 0, 0, &n) > 0);
+	CHECK(n > 0 && n <= 2);
+	CHECK(report.widened > 0);
+}
+
+static void test_exhausted(void)
+{
+	const struct can_filter_id both[] = {
+		{ 0x100, 0x100, false }, { 0x100, 0x100, true },
+	};
+	const struct can_filter_id bad_range[] = { { 0x20, 0x10, false } };
+	const struct can_filter_id bad_std[] = { { 0x700, 0x800, false } };
+	const struct can_filter_id bad_ext[] = {
+		{ 0, CAN_FILTER_EXT_ID_MAX + 1, true },
+	};
+	int n;
+
+	/* Standard and extended identifiers never share a bank */
+	plan(both, 2, MAX_BLOCKS, 1, 0, 0, &n);
+	CHECK(n == -1);
+	plan(both, 2, MAX_BLOCKS, 2, 0x0F0, 0x110, &n);
+	CHECK(n == 2 && report.rules == 2);
+
+	plan(bad_range, 1, MAX_BLOCKS, MAX_BANKS, 0, 0, &n);
+	CHECK(n == -1);
+	plan(bad_std, 1, MAX_BLOCKS, MAX_BANKS, 0, 0, &n);
+	CHECK(n == -1);
+	plan(bad_ext, 1, MAX_BLOCKS, MAX_BANKS, 0, 0, &n);
+	CHECK(n == -1);
+	plan(bad_range, 1, 1, MAX_BANKS, 0, 0, &n);
+	CHECK(n == -1);
+}
+
+int main(void)
+{
+	test_range_split();
+	test_bank_packing();
+	test_merge();
+	test_widening_report();
+	test_small_work_area();
+	test_exhausted();
+
+	return check_result("can_filter");
+}
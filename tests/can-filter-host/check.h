@@ -0,0 +1,45 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int failures;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			printf("%s:%d: %s: check failed: %s\n", \
+			       __FILE__, __LINE__, __func__, #cond); \
+			failures++; \
+		} \
+	} while (0)
+
+static inline int check_result(const char *name)
+{
+	if (failures) {
+		printf("%s: %d checks failed\n", name, failures);
+		return EXIT_FAILURE;
+	}
+	printf("%s: all checks passed\n", name);
+	return EXIT_SUCCESS;
+}
+
+#endif
@@ -0,0 +1,248 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host tests for fdcan_filter_plan() in lib/stm32/common/fdcan_common.c.
+ * Only the planner runs here, everything touching the peripheral is linked
+ * against stubs that fail the test if called.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "../../lib/stm32/common/fdcan_common.c"
+#include "check.h"
+
+/* --- Stubs for the family specific part of the driver -------------------- */
+
+static void unexpected(const char *func)
+{
+	printf("unexpected call to %s\n", func);
+	abort();
+}
+
+void fdcan_init_filter(uint32_t canport, uint8_t std_filt, uint8_t ext_filt)
+{
+	(void)canport; (void)std_filt; (void)ext_filt;
+	unexpected(__func__);
+}
+
+unsigned fdcan_get_fifo_element_size(uint32_t canport, unsigned fifo_id)
+{
+	(void)canport; (void)fifo_id;
+	unexpected(__func__);
+	return 0;
+}
+
+unsigned fdcan_get_fifo_size(uint32_t canport, unsigned fifo_id)
+{
+	(void)canport; (void)fifo_id;
+	unexpected(__func__);
+	return 0;
+}
+
+unsigned fdcan_get_txbuf_element_size(uint32_t canport)
+{
+	(void)canport;
+	unexpected(__func__);
+	return 0;
+}
+
+unsigned fdcan_get_txbuf_count(uint32_t canport)
+{
+	(void)canport;
+	unexpected(__func__);
+	return 0;
+}
+
+void fdcan_set_fifo_locked_mode(uint32_t canport, bool locked)
+{
+	(void)canport; (void)locked;
+	unexpected(__func__);
+}
+
+/* --- Plan and verify ----------------------------------------------------- */
+
+#define MAX_IDS		16
+
+static struct can_filter_id plan_ids[MAX_IDS];
+static struct can_filter_report report;
+
+static bool in_list(const struct can_filter_id *ids, uint32_t count,
+		    uint32_t id, bool ext)
+{
+	for (uint32_t i = 0; i < count; i++) {
+		if ((ids[i].ext == ext) && (ids[i].first <= id) &&
+		    (id <= ids[i].last)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Plans a copy of ids. Identifiers of both types from 0 to window are then
+ * checked against the plan, returns the number accepted in excess.
+ */
+static uint32_t plan(const struct can_filter_id *ids, uint32_t count,
+		     uint32_t std_max, uint32_t ext_max, uint32_t window,
+		     int *n)
+{
+	uint32_t extra = 0;
+
+	memcpy(plan_ids, ids, count * sizeof(ids[0]));
+	*n = fdcan_filter_plan(plan_ids, count, std_max, ext_max, &report);
+	if (*n < 0) {
+		return 0;
+	}
+
+	CHECK(report.rules <= std_max + ext_max);
+	CHECK(report.rules == fdcan_filter_elements(plan_ids, *n, false) +
+			      fdcan_filter_elements(plan_ids, *n, true));
+
+	/* Sorted, standard identifiers first, and without overlaps */
+	for (int i = 1; i < *n; i++) {
+		const struct can_filter_id *a = &plan_ids[i - 1];
+		const struct can_filter_id *b = &plan_ids[i];
+
+		CHECK((a->ext < b->ext) ||
+		      ((a->ext == b->ext) && (a->last + 1 < b->first)));
+	}
+
+	for (uint32_t id = 0; id <= window; id++) {
+		for (int ext = 0; ext < 2; ext++) {
+			bool want = in_list(ids, count, id, ext);
+			bool got = in_list(plan_ids, *n, id, ext);
+
+			CHECK(!want || got);
+			extra += !want && got;
+		}
+	}
+
+	CHECK(extra <= report.extra_ids);
+	CHECK((report.widened != 0) == (report.extra_ids != 0));
+	return extra;
+}
+
+/* --- Tests --------------------------------------------------------------- */
+
+static void test_sort_join(void)
+{
+	const struct can_filter_id ids[] = {
+		{ 0x20, 0x2F, false }, { 0x05, 0x05, true },
+		{ 0x10, 0x10, false }, { 0x11, 0x1F, false },
+		{ 0x28, 0x30, false }, { 0x30, 0x30, false },
+	};
+	int n;
+
+	/* Adjacent and overlapping entries join without widening */
+	CHECK(plan(ids, 6, 8, 8, 0x100, &n) == 0);
+	CHECK(n == 2);
+	CHECK(!plan_ids[0].ext && plan_ids[0].first == 0x10 &&
+	      plan_ids[0].last == 0x30);
+	CHECK(plan_ids[1].ext && plan_ids[1].first == 0x05 &&
+	      plan_ids[1].last == 0x05);
+	CHECK(report.rules == 2 && report.widened == 0);
+}
+
+static void test_elements(void)
+{
+	const struct can_filter_id ids[] = {
+		{ 0x100, 0x100, false }, { 0x200, 0x200, false },
+		{ 0x300, 0x300, false }, { 0x400, 0x4FF, false },
+		{ 0x100, 0x100, true }, { 0x200, 0x200, true },
+	};
+	int n;
+
+	/* Singles pair up in dual ID filters, ranges take one each */
+	CHECK(plan(ids, 6, 3, 1, 0x500, &n) == 0);
+	CHECK(n == 6 && report.rules == 4 && report.widened == 0);
+}
+
+static void test_merge_widening(void)
+{
+	const struct can_filter_id ids[] = {
+		{ 0x10, 0x10, false }, { 0x20, 0x20, false },
+		{ 0x22, 0x22, false }, { 0x40, 0x40, false },
+	};
+	int n;
+
+	/* Two dual filters are enough */
+	CHECK(plan(ids, 4, 2, 0, 0x100, &n) == 0);
+	CHECK(n == 4 && report.rules == 2 && report.widened == 0);
+
+	/* One element: smallest gaps close first, 0x21, then 0x11-0x1F, then
+	 * 0x23-0x3F */
+	CHECK(plan(ids, 4, 1, 0, 0x100, &n) == 45);
+	CHECK(n == 1 && plan_ids[0].first == 0x10 && plan_ids[0].last == 0x40);
+	CHECK(report.rules == 1);
+	CHECK(report.widened == 3 && report.extra_ids == 45);
+}
+
+/* A merge that saves an element wins over one closing a smaller gap */
+static void test_merge_saves(void)
+{
+	const struct can_filter_id ids[] = {
+		{ 0x10, 0x1F, false }, { 0x21, 0x2F, false },
+		{ 0x40, 0x40, false }, { 0x42, 0x42, false },
+	};
+	int n;
+
+	CHECK(plan(ids, 4, 2, 0, 0x100, &n) == 1);
+	CHECK(n == 3 && report.rules == 2);
+	CHECK(plan_ids[0].first == 0x10 && plan_ids[0].last == 0x2F);
+	CHECK(report.widened == 1 && report.extra_ids == 1);
+}
+
+static void test_exhausted(void)
+{
+	const struct can_filter_id ext[] = {
+		{ 0x10, 0x10, false }, { 0x1000, 0x1000, true },
+	};
+	const struct can_filter_id bad_range[] = { { 0x20, 0x10, false } };
+	const struct can_filter_id bad_std[] = { { 0x700, 0x800, false } };
+	const struct can_filter_id bad_ext[] = {
+		{ 0, CAN_FILTER_EXT_ID_MAX + 1, true },
+	};
+	int n;
+
+	/* No element for extended identifiers */
+	plan(ext, 2, 4, 0, 0, &n);
+	CHECK(n == FDCAN_E_INVALID);
+	plan(ext, 2, 0, 4, 0, &n);
+	CHECK(n == FDCAN_E_INVALID);
+	plan(ext, 2, 1, 1, 0x1000, &n);
+	CHECK(n == 2 && report.rules == 2);
+
+	plan(bad_range, 1, 4, 4, 0, &n);
+	CHECK(n == FDCAN_E_INVALID);
+	plan(bad_std, 1, 4, 4, 0, &n);
+	CHECK(n == FDCAN_E_INVALID);
+	plan(bad_ext, 1, 4, 4, 0, &n);
+	CHECK(n == FDCAN_E_INVALID);
+}
+
+int main(void)
+{
+	test_sort_join();
+	test_elements();
+	test_merge_widening();
+	test_merge_saves();
+	test_exhausted();
+
+	return check_result("fdcan_filter");
+}
@@ -0,0 +1,43 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host stand-in for libopencm3/cm3/cortex.h, just enough for lib/cm3/sync.c.
+ * PRIMASK is a plain variable, and the test can hook every change of it to
+ * run code where an interrupt handler could have preempted the caller.
+ */
+
+#ifndef LIBOPENCM3_CORTEX_H
+#define LIBOPENCM3_CORTEX_H
+
+#include <stdint.h>
+
+extern uint32_t host_primask;
+extern void (*host_primask_hook)(uint32_t mask);
+
+static inline uint32_t cm_mask_interrupts(uint32_t mask)
+{
+	uint32_t old = host_primask;
+
+	if (host_primask_hook) {
+		host_primask_hook(mask);
+	}
+	host_primask = mask;
+	return old;
+}
+
+#endif
@@ -0,0 +1,322 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host tests for the lock-free queues in lib/cm3/sync.c.
+ *
+ * sync.c is built in here as it is, on the ARMv6-M code path: PRIMASK comes
+ * from the stand-in cortex.h under host/, and the DMB instruction is turned
+ * into a host fence by an assembler macro.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+__asm__(".macro dmb\n\tmfence\n.endm\n");
+
+#include "../../lib/cm3/sync.c"
+
+uint32_t host_primask;
+void (*host_primask_hook)(uint32_t mask);
+
+static int failures;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			printf("%s:%d: %s: check failed: %s\n", \
+			       __FILE__, __LINE__, __func__, #cond); \
+			failures++; \
+		} \
+	} while (0)
+
+/* --- Single producer, single consumer queue ------------------------------ */
+
+static void test_spsc_empty_full(void)
+{
+	uint32_t buf[8], rec;
+	spsc_queue_t q;
+
+	spsc_init(&q, buf, 8, sizeof(rec));
+	CHECK(spsc_used(&q) == 0);
+	CHECK(!spsc_pop(&q, &rec));
+	CHECK(spsc_read(&q, &rec, 1) == 0);
+
+	for (rec = 0; rec < 8; rec++) {
+		CHECK(spsc_push(&q, &rec));
+	}
+	CHECK(spsc_used(&q) == 8);
+	rec = 8;
+	CHECK(!spsc_push(&q, &rec));
+	CHECK(spsc_write(&q, &rec, 1) == 0);
+
+	for (uint32_t i = 0; i < 8; i++) {
+		CHECK(spsc_pop(&q, &rec));
+		CHECK(rec == i);
+	}
+	CHECK(spsc_used(&q) == 0);
+	CHECK(!spsc_pop(&q, &rec));
+}
+
+/* Bulk transfers split at the end of the buffer, and only take what fits. */
+static void test_spsc_bulk_wrap(void)
+{
+	uint8_t buf[16], in[32], out[32];
+	spsc_queue_t q;
+	uint8_t next_in = 0, next_out = 0;
+
+	for (unsigned i = 0; i < sizeof(in); i++) {
+		in[i] = (uint8_t)i;
+	}
+
+	spsc_init(&q, buf, sizeof(buf), 1);
+
+	/* Every write and read length against every buffer position */
+	for (uint32_t w = 1; w <= 20; w++) {
+		for (uint32_t r = 1; r <= 20; r++) {
+			uint32_t used = spsc_used(&q);
+			uint32_t want = w > 16 - used ? 16 - used : w;
+			uint32_t n;
+
+			for (uint32_t i = 0; i < w; i++) {
+				in[i] = next_in + i;
+			}
+			n = spsc_write(&q, in, w);
+			CHECK(n == want);
+			next_in += n;
+
+			want = r > used + n ? used + n : r;
+			n = spsc_read(&q, out, r);
+			CHECK(n == want);
+			for (uint32_t i = 0; i < n; i++) {
+				CHECK(out[i] == (uint8_t)(next_out + i));
+			}
+			next_out += n;
+		}
+	}
+	CHECK((uint8_t)(next_in - next_out) == spsc_used(&q));
+}
+
+/* The free running indices may overflow, records must not notice. */
+static void test_spsc_index_overflow(void)
+{
+	uint16_t buf[4], rec;
+	spsc_queue_t q;
+
+	spsc_init(&q, buf, 4, sizeof(rec));
+	q.head = q.tail = UINT32_MAX - 5;
+
+	for (uint16_t i = 0; i < 64; i++) {
+		rec = i;
+		CHECK(spsc_push(&q, &rec));
+		rec = i + 1000;
+		CHECK(spsc_push(&q, &rec));
+		CHECK(spsc_used(&q) == 2);
+		CHECK(spsc_pop(&q, &rec) && rec == i);
+		CHECK(spsc_pop(&q, &rec) && rec == i + 1000);
+		CHECK(spsc_used(&q) == 0);
+	}
+	CHECK(q.head < 64 * 2);
+}
+
+/* --- Multiple producer, single consumer queue ---------------------------- */
+
+/* Records of 6 bytes, to exercise the slot padding */
+typedef struct {
+	uint16_t a, b, c;
+} rec6_t;
+
+#define MPSC_COUNT	4
+
+static uint8_t mpsc_buf[MPSC_COUNT * MPSC_QUEUE_SLOT_SIZE(sizeof(rec6_t))]
+	__attribute__((aligned(4)));
+static mpsc_queue_t mq;
+
+static rec6_t rec6(uint16_t v)
+{
+	rec6_t r = { v, (uint16_t)~v, (uint16_t)(v * 3) };
+	return r;
+}
+
+static int rec6_is(const rec6_t *r, uint16_t v)
+{
+	rec6_t e = rec6(v);
+	return memcmp(r, &e, sizeof(e)) == 0;
+}
+
+/* As mpsc_init(), but with the indices starting at pos */
+static void mpsc_init_at(mpsc_queue_t *q, uint32_t pos)
+{
+	mpsc_init(q, mpsc_buf, MPSC_COUNT, sizeof(rec6_t));
+	q->head = q->tail = pos;
+	for (uint32_t i = 0; i < MPSC_COUNT; i++) {
+		*mpsc_slot(q, pos + i) = pos + i;
+	}
+}
+
+static void test_mpsc_empty_full(void)
+{
+	rec6_t r;
+
+	mpsc_init(&mq, mpsc_buf, MPSC_COUNT, sizeof(r));
+	CHECK(!mpsc_pop(&mq, &r));
+
+	for (uint16_t i = 0; i < MPSC_COUNT; i++) {
+		r = rec6(i);
+		CHECK(mpsc_push(&mq, &r));
+	}
+	r = rec6(99);
+	CHECK(!mpsc_push(&mq, &r));
+
+	/* Freeing one slot makes room for exactly one more */
+	CHECK(mpsc_pop(&mq, &r) && rec6_is(&r, 0));
+	r = rec6(4);
+	CHECK(mpsc_push(&mq, &r));
+	CHECK(!mpsc_push(&mq, &r));
+
+	for (uint16_t i = 1; i <= MPSC_COUNT; i++) {
+		CHECK(mpsc_pop(&mq, &r) && rec6_is(&r, i));
+	}
+	CHECK(!mpsc_pop(&mq, &r));
+}
+
+static void test_mpsc_wrap(void)
+{
+	static const uint32_t starts[] = { 0, UINT32_MAX - 6 };
+	uint16_t next_in, next_out;
+	rec6_t r;
+
+	for (unsigned s = 0; s < 2; s++) {
+		mpsc_init_at(&mq, starts[s]);
+		next_in = next_out = 0;
+
+		/* Fill levels from 1 to full, for many laps of the buffer */
+		for (uint16_t lap = 0; lap < 40; lap++) {
+			uint16_t n = lap % MPSC_COUNT + 1;
+
+			for (uint16_t i = 0; i < n; i++) {
+				r = rec6(next_in++);
+				CHECK(mpsc_push(&mq, &r));
+			}
+			for (uint16_t i = 0; i < n; i++) {
+				CHECK(mpsc_pop(&mq, &r));
+				CHECK(rec6_is(&r, next_out++));
+			}
+			CHECK(!mpsc_pop(&mq, &r));
+		}
+	}
+}
+
+/*
+ * Multi-producer reservation. The PRIMASK hook runs a second producer where
+ * an interrupt handler could preempt the first one: before it claims a slot,
+ * and between claiming the slot and publishing the record.
+ */
+
+static int hook_calls;
+static int hook_at;
+static bool hook_pushed;
+static bool hook_popped;
+static rec6_t hook_rec;
+
+static void preempting_producer(uint32_t mask)
+{
+	rec6_t r = rec6(200);
+
+	(void)mask;
+	if (++hook_calls != hook_at) {
+		return;
+	}
+	host_primask_hook = NULL;
+	hook_pushed = mpsc_push(&mq, &r);
+	hook_popped = mpsc_pop(&mq, &hook_rec);
+}
+
+static void test_mpsc_preempted(void)
+{
+	rec6_t r;
+
+	/* Before the claim: the first producer loses the compare and swap,
+	 * retries and lands behind the second one. */
+	mpsc_init(&mq, mpsc_buf, MPSC_COUNT, sizeof(r));
+	hook_calls = 0;
+	hook_at = 1;
+	host_primask_hook = preempting_producer;
+	r = rec6(100);
+	CHECK(mpsc_push(&mq, &r));
+	CHECK(host_primask_hook == NULL);
+	CHECK(hook_pushed);
+	CHECK(hook_popped && rec6_is(&hook_rec, 200));
+	CHECK(mpsc_pop(&mq, &r) && rec6_is(&r, 100));
+	CHECK(!mpsc_pop(&mq, &r));
+	CHECK(mq.head == 2 && mq.tail == 2);
+
+	/* After the claim: the slot is reserved, so the second producer takes
+	 * the next one, and its record waits until the first one publishes. */
+	mpsc_init(&mq, mpsc_buf, MPSC_COUNT, sizeof(r));
+	hook_calls = 0;
+	hook_at = 2;
+	host_primask_hook = preempting_producer;
+	r = rec6(100);
+	CHECK(mpsc_push(&mq, &r));
+	CHECK(host_primask_hook == NULL);
+	CHECK(hook_pushed);
+	/* The consumer sees nothing past a claimed but unpublished slot */
+	CHECK(!hook_popped);
+	CHECK(mpsc_pop(&mq, &r) && rec6_is(&r, 100));
+	CHECK(mpsc_pop(&mq, &r) && rec6_is(&r, 200));
+	CHECK(!mpsc_pop(&mq, &r));
+
+	/* A reservation counts against the space: with one slot left, the
+	 * second producer finds the queue full. */
+	mpsc_init(&mq, mpsc_buf, MPSC_COUNT, sizeof(r));
+	for (uint16_t i = 0; i < MPSC_COUNT - 1; i++) {
+		r = rec6(i);
+		CHECK(mpsc_push(&mq, &r));
+	}
+	hook_calls = 0;
+	hook_at = 2;
+	host_primask_hook = preempting_producer;
+	r = rec6(100);
+	CHECK(mpsc_push(&mq, &r));
+	CHECK(!hook_pushed);
+	CHECK(hook_popped && rec6_is(&hook_rec, 0));
+	for (uint16_t i = 1; i < MPSC_COUNT - 1; i++) {
+		CHECK(mpsc_pop(&mq, &r) && rec6_is(&r, i));
+	}
+	CHECK(mpsc_pop(&mq, &r) && rec6_is(&r, 100));
+	CHECK(!mpsc_pop(&mq, &r));
+}
+
+int main(void)
+{
+	test_spsc_empty_full();
+	test_spsc_bulk_wrap();
+	test_spsc_index_overflow();
+	test_mpsc_empty_full();
+	test_mpsc_wrap();
+	test_mpsc_preempted();
+
+	if (failures) {
+		printf("%d checks failed\n", failures);
+		return EXIT_FAILURE;
+	}
+	printf("all checks passed\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,107 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Cycles per packet for st_usbfs_copy_to_pm() and st_usbfs_copy_from_pm(),
+ * measured with the DWT cycle counter for every packet size of interest and
+ * every source/destination alignment. Results go out on ITM stimulus port 0.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/stm32/memorymap.h>
+
+#include "st_usbfs_core.h"
+#include "bench.h"
+
+/* On the v1 core every halfword of packet memory takes a 32 bit slot. */
+#if defined(STM32F1) || defined(STM32F3) || defined(STM32L1)
+#define BENCH_PM_SCALE		2
+#else
+#define BENCH_PM_SCALE		1
+#endif
+
+/* Packet memory offset used for the copies, clear of the buffer table. */
+#define BENCH_PM_OFFSET		0x100
+#define BENCH_PM_BUF \
+	((volatile void *)(USB_PMA_BASE + BENCH_PM_OFFSET * BENCH_PM_SCALE))
+
+#define BENCH_MAX_LEN		64
+#define BENCH_ROUNDS		64
+
+static const uint16_t bench_lens[] = { 8, 16, 32, 63, 64 };
+
+static uint8_t bench_buf[BENCH_MAX_LEN + 4] __attribute__((aligned(4)));
+static uint8_t bench_check[BENCH_MAX_LEN + 4] __attribute__((aligned(4)));
+
+static uint32_t bench_to_pm(uint8_t *buf, uint16_t len)
+{
+	uint32_t start = dwt_read_cycle_counter();
+	for (int i = 0; i < BENCH_ROUNDS; i++) {
+		st_usbfs_copy_to_pm(BENCH_PM_BUF, buf, len);
+	}
+	return (dwt_read_cycle_counter() - start) / BENCH_ROUNDS;
+}
+
+static uint32_t bench_from_pm(uint8_t *buf, uint16_t len)
+{
+	uint32_t start = dwt_read_cycle_counter();
+	for (int i = 0; i < BENCH_ROUNDS; i++) {
+		st_usbfs_copy_from_pm(buf, BENCH_PM_BUF, len);
+	}
+	return (dwt_read_cycle_counter() - start) / BENCH_ROUNDS;
+}
+
+/* Round trip through packet memory, so a fast but wrong copy shows up. */
+static int bench_verify(unsigned align, uint16_t len)
+{
+	for (unsigned i = 0; i < len; i++) {
+		bench_buf[align + i] = (uint8_t)(i * 7 + align + len);
+	}
+	memset(bench_check, 0, sizeof(bench_check));
+	st_usbfs_copy_to_pm(BENCH_PM_BUF, &bench_buf[align], len);
+	st_usbfs_copy_from_pm(&bench_check[align], BENCH_PM_BUF, len);
+	return memcmp(&bench_buf[align], &bench_check[align], len) == 0;
+}
+
+void bench_run(const char *board)
+{
+	if (!dwt_enable_cycle_counter()) {
+		printf("%s: no DWT cycle counter\n", board);
+		while (1);
+	}
+
+	printf("%s: st_usbfs copy, cycles per packet\n", board);
+	printf("len align to_pm from_pm ok\n");
+	for (unsigned l = 0; l < sizeof(bench_lens) / sizeof(bench_lens[0]); l++) {
+		uint16_t len = bench_lens[l];
+		for (unsigned align = 0; align < 4; align++) {
+			int ok = bench_verify(align, len);
+			uint32_t to = bench_to_pm(&bench_buf[align], len);
+			uint32_t from = bench_from_pm(&bench_buf[align], len);
+			printf("%3u %5u %5lu %7lu %s\n", len, align,
+			       (unsigned long)to, (unsigned long)from,
+			       ok ? "yes" : "NO");
+		}
+	}
+	printf("done\n");
+
+	while (1);
+}